@@ -30,6 +30,8 @@ SOFTWARE.
 ==============================================================================*/
 
 #include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
 
 /*==============================================================================
         Public Definitions
@@ -46,6 +48,502 @@ SOFTWARE.
 /*! opaque pointer to the IOT Client */
 typedef struct IotClient *IOTCLIENT_HANDLE;
 
+/*! current version of the IOTCLIENT_OPTIONS object */
+#define IOTCLIENT_OPTIONS_VERSION   2
+
+/*! option flag: fail with EAGAIN instead of blocking on a full queue */
+#define IOTCLIENT_OPT_NONBLOCK      ( 1U << 0 )
+
+/*! option flag: send headers using the binary header encoding, and
+    decode binary headers on received messages.
+    Only set this if the IOTHub service supports binary headers */
+#define IOTCLIENT_OPT_BINARY_HEADERS ( 1U << 1 )
+
+/*! option flag: announce the message body length in the header message
+    when it is known, so the IOTHub service can preallocate for it.
+    Only set this if the IOTHub service supports known length messages */
+#define IOTCLIENT_OPT_BODY_LENGTH ( 1U << 2 )
+
+/*! option flag: accept length-framed headers on received messages.
+    Only set this if the IOTHub service sends length-framed messages */
+#define IOTCLIENT_OPT_FRAMED_HEADERS ( 1U << 3 )
+
+/*! option flag: allow IOTCLIENT_StreamWithTrailers to send trailers
+    after a streamed message body.
+    Only set this if the IOTHub service supports trailer messages */
+#define IOTCLIENT_OPT_TRAILERS ( 1U << 4 )
+
+/*! message body length passed to IOTCLIENT_StreamWithLength when
+    the length of the stream is not known */
+#define IOTCLIENT_LENGTH_UNKNOWN ( (size_t)-1 )
+
+/*! receiver flag: hand messages with the same correlation-id to the
+    same worker so related messages are handled in order */
+#define IOTCLIENT_RECEIVE_ORDERED ( 1U << 0 )
+
+/*! number of message priority levels */
+#define IOTCLIENT_PRIORITY_LEVELS 8
+
+/*! IOT Client transport engines */
+typedef enum _iotclient_transport
+{
+    /*! message queue for headers, blocking FIFO for message bodies */
+    IOTCLIENT_TRANSPORT_FIFO = 0,
+
+    /*! as per IOTCLIENT_TRANSPORT_FIFO, but message bodies are
+        transferred using io_uring.  Falls back to the FIFO transport
+        if io_uring is not available */
+    IOTCLIENT_TRANSPORT_IOURING = 1
+
+} IOTCLIENT_TRANSPORT;
+
+/*! well-known property ids.  These are part of the binary header
+    encoding, so new ids are only ever added before IOTCLIENT_PROP_COUNT */
+typedef enum _iotclient_property_id
+{
+    IOTCLIENT_PROP_UNKNOWN = 0,
+    IOTCLIENT_PROP_CONTENT_TYPE,
+    IOTCLIENT_PROP_CONTENT_ENCODING,
+    IOTCLIENT_PROP_MESSAGE_ID,
+    IOTCLIENT_PROP_CORRELATION_ID,
+    IOTCLIENT_PROP_USER_ID,
+    IOTCLIENT_PROP_TO,
+    IOTCLIENT_PROP_EXPIRY_TIME_UTC,
+    IOTCLIENT_PROP_CREATION_TIME_UTC,
+    IOTCLIENT_PROP_CONNECTION_DEVICE_ID,
+    IOTCLIENT_PROP_CONNECTION_MODULE_ID,
+    IOTCLIENT_PROP_CONNECTION_AUTH_METHOD,
+    IOTCLIENT_PROP_CONNECTION_AUTH_GENERATION_ID,
+    IOTCLIENT_PROP_ENQUEUED_TIME,
+    IOTCLIENT_PROP_IOTHUB_CREATION_TIME_UTC,
+    IOTCLIENT_PROP_MESSAGE_SOURCE,
+    IOTCLIENT_PROP_MESSAGE_SCHEMA,
+    IOTCLIENT_PROP_INTERFACE_ID,
+    IOTCLIENT_PROP_ACK,
+    IOTCLIENT_PROP_DT_DATASCHEMA,
+    IOTCLIENT_PROP_DT_SUBJECT,
+    IOTCLIENT_PROP_LOCK_TOKEN,
+    IOTCLIENT_PROP_SEQUENCE_NUMBER,
+    IOTCLIENT_PROP_COUNT
+
+} IOTCLIENT_PROPERTY_ID;
+
+/*! maximum number of headers recorded in a header index */
+#define IOTCLIENT_MAX_INDEXED_HEADERS 32
+
+/*! location of a property in the message headers */
+typedef struct _iotclient_header_entry
+{
+    /*! well-known property id, or IOTCLIENT_PROP_UNKNOWN */
+    IOTCLIENT_PROPERTY_ID id;
+
+    /*! pointer to the property name (not NUL terminated) */
+    const char *name;
+
+    /*! length of the property name */
+    size_t nameLength;
+
+    /*! pointer to the property value (not NUL terminated) */
+    const char *value;
+
+    /*! length of the property value */
+    size_t valueLength;
+
+} IOTCLIENT_HEADER_ENTRY;
+
+/*! index of the properties in a set of message headers */
+typedef struct _iotclient_header_index
+{
+    /*! number of indexed properties */
+    size_t count;
+
+    /*! indexed properties, in header order */
+    IOTCLIENT_HEADER_ENTRY entries[IOTCLIENT_MAX_INDEXED_HEADERS];
+
+    /*! entry number (index + 1) of the first occurrence of each
+        well-known property, or 0 if it is not present */
+    uint8_t byId[IOTCLIENT_PROP_COUNT];
+
+} IOTCLIENT_HEADER_INDEX;
+
+/*! opaque pointer to a message router */
+typedef struct _iotclient_router *IOTCLIENT_ROUTER;
+
+/*! message router property value predicates */
+typedef enum _iotclient_match
+{
+    /*! the property value equals the route value */
+    IOTCLIENT_MATCH_EXACT = 0,
+
+    /*! the property value starts with the route value */
+    IOTCLIENT_MATCH_PREFIX
+
+} IOTCLIENT_MATCH;
+
+/*! opaque pointer to a telemetry record aggregator */
+typedef struct _iotclient_aggregator *IOTCLIENT_AGGREGATOR;
+
+/*! aggregated message body formats */
+typedef enum _iotclient_agg_format
+{
+    /*! records are JSON values sent as a JSON array */
+    IOTCLIENT_AGG_JSON_ARRAY = 0,
+
+    /*! records are CSV rows separated by newlines */
+    IOTCLIENT_AGG_CSV,
+
+    /*! records are preceded by their 32-bit big-endian length */
+    IOTCLIENT_AGG_LENGTH_DELIMITED
+
+} IOTCLIENT_AGG_FORMAT;
+
+/*! aggregator error callback, invoked when a stream's aggregated
+    message cannot be sent.  The records are kept and retried later
+    unless the error cannot be recovered from, in which case they are
+    discarded */
+typedef void (*IOTCLIENT_AGGREGATOR_CALLBACK)( void *ctx,
+                                               const char *key,
+                                               size_t records,
+                                               int result,
+                                               bool discarded );
+
+/*! telemetry record aggregator options.
+    Initialize with IOTCLIENT_InitAggregatorOptions before use */
+typedef struct _iotclient_aggregator_options
+{
+    /*! aggregated message body format */
+    IOTCLIENT_AGG_FORMAT format;
+
+    /*! send a stream's message once it holds this many records,
+        0 for no limit */
+    size_t maxRecords;
+
+    /*! maximum size of a stream's message body, 0 for no limit */
+    size_t maxBytes;
+
+    /*! maximum time a record waits before it is sent (ms),
+        0 for no limit */
+    unsigned int maxDelay;
+
+    /*! headers to send with every aggregated message, or NULL */
+    const char *headers;
+
+    /*! name of a property to carry the stream key, or NULL */
+    const char *keyProperty;
+
+    /*! error callback, or NULL */
+    IOTCLIENT_AGGREGATOR_CALLBACK errorCb;
+
+    /*! error callback context */
+    void *errorCtx;
+
+} IOTCLIENT_AGGREGATOR_OPTIONS;
+
+/*! pre-send filter types */
+typedef enum _iotclient_filter_type
+{
+    /*! allow a sustained rate and burst of messages per stream */
+    IOTCLIENT_FILTER_RATE_LIMIT = 0,
+
+    /*! keep the first of every n messages per stream */
+    IOTCLIENT_FILTER_EVERY_NTH,
+
+    /*! drop messages whose value changed by less than epsilon */
+    IOTCLIENT_FILTER_DEADBAND,
+
+    /*! drop messages whose body repeats the last one sent */
+    IOTCLIENT_FILTER_DUPLICATE,
+
+    /*! drop messages rejected by a callback */
+    IOTCLIENT_FILTER_CUSTOM
+
+} IOTCLIENT_FILTER_TYPE;
+
+/*! custom pre-send filter callback.  Returns true to keep the message.
+    body is NULL for streamed messages */
+typedef bool (*IOTCLIENT_FILTER_CALLBACK)( void *ctx,
+                                           const char *headers,
+                                           const unsigned char *body,
+                                           size_t bodyLength );
+
+/*! pre-send filter definition */
+typedef struct _iotclient_filter
+{
+    /*! filter type */
+    IOTCLIENT_FILTER_TYPE type;
+
+    /*! name of the property which identifies the stream of a message,
+        or NULL to treat all messages as one stream */
+    const char *keyProperty;
+
+    /*! IOTCLIENT_FILTER_RATE_LIMIT: sustained messages per second */
+    double rate;
+
+    /*! IOTCLIENT_FILTER_RATE_LIMIT: maximum burst, 0 for 1 */
+    unsigned int burst;
+
+    /*! IOTCLIENT_FILTER_EVERY_NTH: keep one message in n */
+    unsigned int n;
+
+    /*! IOTCLIENT_FILTER_DEADBAND: name of the property holding the
+        numeric value, or NULL if the body is the value */
+    const char *valueProperty;
+
+    /*! IOTCLIENT_FILTER_DEADBAND: minimum change in value to send */
+    double epsilon;
+
+    /*! IOTCLIENT_FILTER_CUSTOM: filter callback */
+    IOTCLIENT_FILTER_CALLBACK cb;
+
+    /*! IOTCLIENT_FILTER_CUSTOM: filter callback context */
+    void *ctx;
+
+} IOTCLIENT_FILTER;
+
+/*! send rate limits.  A rate of 0 is unlimited */
+typedef struct _iotclient_rate_limit
+{
+    /*! messages per second */
+    double messageRate;
+
+    /*! maximum burst of messages, 0 for a single message */
+    double messageBurst;
+
+    /*! body bytes per second */
+    double byteRate;
+
+    /*! maximum burst of body bytes, 0 for one second of bytes */
+    double byteBurst;
+
+} IOTCLIENT_RATE_LIMIT;
+
+/*! maximum length of a message digest */
+#define IOTCLIENT_DIGEST_MAX_LENGTH 32
+
+/*! message digest algorithms */
+typedef enum _iotclient_digest_type
+{
+    /*! no digest */
+    IOTCLIENT_DIGEST_NONE = 0,
+
+    /*! 32-bit CRC32C (Castagnoli), stored big-endian */
+    IOTCLIENT_DIGEST_CRC32C,
+
+    /*! 256-bit SHA-256 */
+    IOTCLIENT_DIGEST_SHA256
+
+} IOTCLIENT_DIGEST_TYPE;
+
+/*! streamed message body digest callback */
+typedef void (*IOTCLIENT_DIGEST_CALLBACK)( void *ctx,
+                                           IOTCLIENT_DIGEST_TYPE type,
+                                           const unsigned char *digest,
+                                           size_t length,
+                                           uint64_t bodyLength );
+
+/*! trailer flag: append the body length as a content-length trailer */
+#define IOTCLIENT_TRAILER_LENGTH ( 1U << 0 )
+
+/*! streamed message trailer callback, invoked once the body has been
+    sent.  Writes NUL terminated name:value trailer lines into buf */
+typedef int (*IOTCLIENT_TRAILER_CALLBACK)( void *ctx,
+                                           uint64_t bodyLength,
+                                           char *buf,
+                                           size_t size );
+
+/*! trailers sent after a streamed message body */
+typedef struct _iotclient_trailers
+{
+    /*! IOTCLIENT_TRAILER_xxx flags */
+    uint32_t flags;
+
+    /*! digest to compute over the body and append as a content-digest
+        trailer, or IOTCLIENT_DIGEST_NONE */
+    IOTCLIENT_DIGEST_TYPE digest;
+
+    /*! comma separated names of the trailers written by the callback,
+        or NULL */
+    const char *names;
+
+    /*! trailer callback, or NULL */
+    IOTCLIENT_TRAILER_CALLBACK cb;
+
+    /*! trailer callback context */
+    void *ctx;
+
+} IOTCLIENT_TRAILERS;
+
+/*! message streamed by IOTCLIENT_StreamMany */
+typedef struct _iotclient_stream_item
+{
+    /*! NUL terminated message headers */
+    const char *headers;
+
+    /*! path of the file to stream, or NULL to stream from fd */
+    const char *path;
+
+    /*! file descriptor to stream from when path is NULL */
+    int fd;
+
+    /*! result of streaming the message, set by IOTCLIENT_StreamMany */
+    int result;
+
+    /*! number of body bytes streamed, set by IOTCLIENT_StreamMany */
+    size_t length;
+
+} IOTCLIENT_STREAM_ITEM;
+
+/*! aggregate IOTCLIENT_StreamMany progress */
+typedef struct _iotclient_stream_stats
+{
+    /*! number of messages which were streamed successfully */
+    size_t completed;
+
+    /*! number of messages which failed */
+    size_t failed;
+
+    /*! total number of body bytes streamed */
+    uint64_t bytes;
+
+    /*! time since the transfer started (ms) */
+    uint64_t elapsed;
+
+    /*! aggregate throughput (bytes per second) */
+    double throughput;
+
+} IOTCLIENT_STREAM_STATS;
+
+/*! IOTCLIENT_StreamMany progress callback, invoked as each message
+    completes.  Callbacks are serialized across the transfer channels */
+typedef void (*IOTCLIENT_STREAM_CALLBACK)( void *ctx,
+                                           size_t index,
+                                           const IOTCLIENT_STREAM_ITEM *pItem,
+                                           const IOTCLIENT_STREAM_STATS *pStats );
+
+/*! stream input types, as classified for copy loop chunk sizing */
+typedef enum _iotclient_input_type
+{
+    /*! no stream has been copied yet */
+    IOTCLIENT_INPUT_NONE = 0,
+
+    /*! regular file */
+    IOTCLIENT_INPUT_FILE,
+
+    /*! pipe or FIFO */
+    IOTCLIENT_INPUT_PIPE,
+
+    /*! socket */
+    IOTCLIENT_INPUT_SOCKET,
+
+    /*! character device or other input */
+    IOTCLIENT_INPUT_OTHER,
+
+    /*! number of input types */
+    IOTCLIENT_INPUT_TYPES
+
+} IOTCLIENT_INPUT_TYPE;
+
+/*! chunk sizing of the last message body copied by the stream engine */
+typedef struct _iotclient_chunk_stats
+{
+    /*! type of the input the body was read from */
+    IOTCLIENT_INPUT_TYPE inputType;
+
+    /*! chunk size the copy started with (bytes) */
+    size_t initialChunk;
+
+    /*! chunk size the copy finished with (bytes) */
+    size_t finalChunk;
+
+    /*! largest chunk size allowed for the input (bytes) */
+    size_t chunkLimit;
+
+    /*! size of the client's page-aligned copy buffer (bytes) */
+    size_t bufferSize;
+
+    /*! number of reads from the input */
+    uint64_t reads;
+
+    /*! number of body bytes copied */
+    uint64_t bytes;
+
+    /*! copy throughput (bytes per second) */
+    double throughput;
+
+} IOTCLIENT_CHUNK_STATS;
+
+/*! received cloud-to-device message descriptor */
+typedef struct _iotclient_message
+{
+    /*! NUL terminated message headers, or NULL if there are none */
+    char *headers;
+
+    /*! length of the message headers */
+    size_t headerLength;
+
+    /*! message body */
+    char *body;
+
+    /*! length of the message body */
+    size_t bodyLength;
+
+} IOTCLIENT_MESSAGE;
+
+/*! asynchronous send completion callback */
+typedef void (*IOTCLIENT_SEND_CALLBACK)( void *ctx, int result );
+
+/*! cloud-to-device message receive callback */
+typedef void (*IOTCLIENT_RECEIVE_CALLBACK)( void *ctx,
+                                            char *headers,
+                                            size_t headerLength,
+                                            char *body,
+                                            size_t bodyLength );
+
+/*! IOT Client options used by IOTCLIENT_CreateEx.
+    Initialize with IOTCLIENT_InitOptions before use */
+typedef struct _iotclient_options
+{
+    /*! options object version, set to IOTCLIENT_OPTIONS_VERSION */
+    uint32_t version;
+
+    /*! IOTCLIENT_OPT_xxx option flags */
+    uint32_t flags;
+
+    /*! name of the IOTHub message queue, NULL for "/iothub" */
+    const char *queueName;
+
+    /*! directory to create the message body FIFO in, NULL for "/tmp" */
+    const char *fifoDir;
+
+    /*! transmit buffer size, 0 for the message queue's maximum */
+    size_t txBufSize;
+
+    /*! message body FIFO pipe capacity, 0 for automatic sizing */
+    size_t pipeSize;
+
+    /*! transport engine used to send messages */
+    IOTCLIENT_TRANSPORT transport;
+
+    /*! number of library managed receive worker threads, 0 to handle
+        received messages on the receiver thread */
+    unsigned int workers;
+
+    /*! CPU affinity mask for library managed threads, 0 for any CPU */
+    uint64_t cpuAffinity;
+
+    /* version 2 options */
+
+    /*! maximum number of unacknowledged messages, 0 to send messages
+        without sequence numbers or acknowledgements.  The window is
+        rounded up to the next power of two */
+    unsigned int window;
+
+    /*! time to wait for an acknowledgement when the in-flight window
+        is full (ms), 0 to wait indefinitely */
+    unsigned int ackTimeout;
+
+} IOTCLIENT_OPTIONS;
+
 /*==============================================================================
         Public Function Declarations
 ==============================================================================*/
@@ -53,6 +551,12 @@ typedef struct IotClient *IOTCLIENT_HANDLE;
 /*! create a new IOT Client */
 IOTCLIENT_HANDLE IOTCLIENT_Create();
 
+/*! initialize an IOT Client options object with the default options */
+int IOTCLIENT_InitOptions( IOTCLIENT_OPTIONS *pOptions );
+
+/*! create a new IOT Client with the specified options */
+IOTCLIENT_HANDLE IOTCLIENT_CreateEx( const IOTCLIENT_OPTIONS *pOptions );
+
 /*! send a message to the IOTHub service */
 int IOTCLIENT_Send( IOTCLIENT_HANDLE hIoTClient,
                     const char *headers,
@@ -64,6 +568,58 @@ int IOTCLIENT_Stream( IOTCLIENT_HANDLE hIoTClient,
                       const char *headers,
                       int fd );
 
+/*! stream a message with a body of known length */
+int IOTCLIENT_StreamWithLength( IOTCLIENT_HANDLE hIoTClient,
+                                const char *headers,
+                                int fd,
+                                size_t length );
+
+/*! stream a message followed by late-bound trailer properties */
+int IOTCLIENT_StreamWithTrailers( IOTCLIENT_HANDLE hIoTClient,
+                                  const char *headers,
+                                  int fd,
+                                  const IOTCLIENT_TRAILERS *pTrailers );
+
+/*! compute a digest of streamed message bodies as they are sent */
+int IOTCLIENT_SetStreamDigest( IOTCLIENT_HANDLE hIoTClient,
+                               IOTCLIENT_DIGEST_TYPE type,
+                               IOTCLIENT_DIGEST_CALLBACK cb,
+                               void *ctx );
+
+/*! stream many messages concurrently over multiple channels */
+int IOTCLIENT_StreamMany( IOTCLIENT_HANDLE hIoTClient,
+                          IOTCLIENT_STREAM_ITEM *pItems,
+                          size_t count,
+                          unsigned int concurrency,
+                          IOTCLIENT_STREAM_CALLBACK cb,
+                          void *ctx,
+                          IOTCLIENT_STREAM_STATS *pStats );
+
+/*! stream a file as a resumable, checkpointed upload */
+int IOTCLIENT_StreamResumable( IOTCLIENT_HANDLE hIoTClient,
+                               const char *headers,
+                               int fd,
+                               const char *stateFile,
+                               size_t segmentSize,
+                               uint64_t *pResumeOffset );
+
+/*! send the content of a regular file to the IOTHUB service */
+int IOTCLIENT_SendFile( IOTCLIENT_HANDLE hIoTClient,
+                        const char *headers,
+                        const char *path );
+
+/*! allocate a page-aligned message body transfer buffer */
+void *IOTCLIENT_AllocBuffer( IOTCLIENT_HANDLE hIoTClient, size_t size );
+
+/*! release an unsent message body transfer buffer */
+int IOTCLIENT_FreeBuffer( IOTCLIENT_HANDLE hIoTClient, void *buf );
+
+/*! send a message, handing ownership of the body buffer to the client */
+int IOTCLIENT_SendBuffer( IOTCLIENT_HANDLE hIoTClient,
+                          const char *headers,
+                          void *buf,
+                          size_t bodylen );
+
 /*! Get a message property from the message headers */
 int IOTCLIENT_GetProperty( const char *headers,
                            char *property,
@@ -83,10 +639,202 @@ int IOTCLIENT_Receive( IOTCLIENT_HANDLE hIoTClient,
                        size_t *pHeaderLength,
                        size_t *pBodyLength );
 
+/*! receive a batch of queued cloud-to-device messages */
+int IOTCLIENT_ReceiveMany( IOTCLIENT_HANDLE hIoTClient,
+                           IOTCLIENT_MESSAGE *pMessages,
+                           size_t maxMessages,
+                           size_t *pCount );
+
 /*! close the IOT Client */
 int IOTCLIENT_Close( IOTCLIENT_HANDLE hIoTClient );
 
 /*! enable/disable verbose output */
 int IOTCLIENT_SetVerbose( IOTCLIENT_HANDLE hIoTClient, bool verbose );
 
+/*! set the message body FIFO pipe capacity (0 for automatic) */
+int IOTCLIENT_SetPipeSize( IOTCLIENT_HANDLE hIoTClient, size_t size );
+
+/*! get the effective message body FIFO pipe capacity */
+int IOTCLIENT_GetPipeSize( IOTCLIENT_HANDLE hIoTClient, size_t *pSize );
+
+/*! get the chunk sizing of the last message body copied by the client */
+int IOTCLIENT_GetChunkStats( IOTCLIENT_HANDLE hIoTClient,
+                             IOTCLIENT_CHUNK_STATS *pStats );
+
+/*! get the transport engine in use */
+int IOTCLIENT_GetTransport( IOTCLIENT_HANDLE hIoTClient,
+                            IOTCLIENT_TRANSPORT *pTransport );
+
+/*! send a message and get a callback when it is acknowledged */
+int IOTCLIENT_SendWithAck( IOTCLIENT_HANDLE hIoTClient,
+                           const char *headers,
+                           const unsigned char *body,
+                           size_t bodylen,
+                           IOTCLIENT_SEND_CALLBACK cb,
+                           void *ctx );
+
+/*! wait for all in-flight messages to be acknowledged */
+int IOTCLIENT_Flush( IOTCLIENT_HANDLE hIoTClient );
+
+/*! retransmit the unacknowledged messages */
+int IOTCLIENT_Retransmit( IOTCLIENT_HANDLE hIoTClient, size_t *pLost );
+
+/*! get the number of unacknowledged messages */
+int IOTCLIENT_GetInFlight( IOTCLIENT_HANDLE hIoTClient, size_t *pCount );
+
+/*! encode text message headers using the binary header encoding */
+int IOTCLIENT_EncodeHeaders( const char *headers,
+                             void *buf,
+                             size_t size,
+                             size_t *pLength );
+
+/*! decode a binary header block into text message headers */
+int IOTCLIENT_DecodeHeaders( const void *buf,
+                             size_t len,
+                             char *headers,
+                             size_t size,
+                             size_t *pHeaderLength,
+                             size_t *pEncodedLength );
+
+/*! get the id of a well-known property name */
+IOTCLIENT_PROPERTY_ID IOTCLIENT_GetPropertyId( const char *name, size_t len );
+
+/*! get the name of a well-known property */
+const char *IOTCLIENT_GetPropertyName( IOTCLIENT_PROPERTY_ID id );
+
+/*! append a well-known property to text message headers */
+int IOTCLIENT_AppendProperty( char *buf,
+                              size_t size,
+                              size_t *pLength,
+                              IOTCLIENT_PROPERTY_ID id,
+                              const char *value );
+
+/*! build an index of the properties in text message headers */
+int IOTCLIENT_IndexHeaders( const char *headers,
+                            size_t len,
+                            IOTCLIENT_HEADER_INDEX *pIndex );
+
+/*! get a well-known property value from a header index */
+int IOTCLIENT_GetPropertyById( const IOTCLIENT_HEADER_INDEX *pIndex,
+                               IOTCLIENT_PROPERTY_ID id,
+                               const char **ppValue,
+                               size_t *pLength );
+
+/*! get a file descriptor for event loop integration */
+int IOTCLIENT_GetEventFd( IOTCLIENT_HANDLE hIoTClient, int *pFd );
+
+/*! process IOT Client events without blocking */
+int IOTCLIENT_ProcessEvents( IOTCLIENT_HANDLE hIoTClient );
+
+/*! queue a message to send to the IOTHub service */
+int IOTCLIENT_SendAsync( IOTCLIENT_HANDLE hIoTClient,
+                         const char *headers,
+                         const unsigned char *body,
+                         size_t bodylen,
+                         IOTCLIENT_SEND_CALLBACK cb,
+                         void *ctx );
+
+/*! queue a message to stream to the IOTHub service */
+int IOTCLIENT_StreamAsync( IOTCLIENT_HANDLE hIoTClient,
+                           const char *headers,
+                           int fd,
+                           IOTCLIENT_SEND_CALLBACK cb,
+                           void *ctx );
+
+/*! attach a pre-send filter to the IOT Client */
+int IOTCLIENT_AddFilter( IOTCLIENT_HANDLE hIoTClient,
+                         const IOTCLIENT_FILTER *pFilter );
+
+/*! remove all pre-send filters from the IOT Client */
+int IOTCLIENT_ClearFilters( IOTCLIENT_HANDLE hIoTClient );
+
+/*! set the send rate limits of the IOT Client */
+int IOTCLIENT_SetRateLimit( IOTCLIENT_HANDLE hIoTClient,
+                            const IOTCLIENT_RATE_LIMIT *pLimit );
+
+/*! set the process wide send rate limits of a priority level */
+int IOTCLIENT_SetPriorityRateLimit( unsigned int priority,
+                                    const IOTCLIENT_RATE_LIMIT *pLimit );
+
+/*! set the message priority level of the IOT Client */
+int IOTCLIENT_SetPriority( IOTCLIENT_HANDLE hIoTClient,
+                           unsigned int priority );
+
+/*! get the time until a message may be sent without exceeding the limits */
+int IOTCLIENT_GetNextSendTime( IOTCLIENT_HANDLE hIoTClient,
+                               size_t length,
+                               unsigned int *pDelay );
+
+/*! set the cloud-to-device message receive callback */
+int IOTCLIENT_SetReceiveHandler( IOTCLIENT_HANDLE hIoTClient,
+                                 IOTCLIENT_RECEIVE_CALLBACK cb,
+                                 void *ctx );
+
+/*! start a library managed receiver thread and worker pool */
+int IOTCLIENT_StartReceiver( IOTCLIENT_HANDLE hIoTClient,
+                             IOTCLIENT_RECEIVE_CALLBACK cb,
+                             void *ctx,
+                             size_t queueDepth,
+                             uint32_t flags );
+
+/*! stop the library managed receiver thread and worker pool */
+int IOTCLIENT_StopReceiver( IOTCLIENT_HANDLE hIoTClient );
+
+/*! create a property based message router */
+IOTCLIENT_ROUTER IOTCLIENT_CreateRouter( void );
+
+/*! add a route on a property value to a message router */
+int IOTCLIENT_AddRoute( IOTCLIENT_ROUTER hRouter,
+                        const char *property,
+                        IOTCLIENT_MATCH match,
+                        const char *value,
+                        IOTCLIENT_RECEIVE_CALLBACK cb,
+                        void *ctx );
+
+/*! set the handler for messages which do not match any route */
+int IOTCLIENT_SetDefaultRoute( IOTCLIENT_ROUTER hRouter,
+                               IOTCLIENT_RECEIVE_CALLBACK cb,
+                               void *ctx );
+
+/*! dispatch a received message to its route handler */
+int IOTCLIENT_Route( IOTCLIENT_ROUTER hRouter,
+                     char *headers,
+                     size_t headerLength,
+                     char *body,
+                     size_t bodyLength );
+
+/*! receive callback which dispatches via the message router in ctx */
+void IOTCLIENT_RouteMessage( void *ctx,
+                             char *headers,
+                             size_t headerLength,
+                             char *body,
+                             size_t bodyLength );
+
+/*! destroy a message router */
+int IOTCLIENT_DestroyRouter( IOTCLIENT_ROUTER hRouter );
+
+/*! initialize a telemetry record aggregator options object */
+int IOTCLIENT_InitAggregatorOptions( IOTCLIENT_AGGREGATOR_OPTIONS *pOptions );
+
+/*! create a telemetry record aggregator */
+IOTCLIENT_AGGREGATOR IOTCLIENT_CreateAggregator(
+                            IOTCLIENT_HANDLE hIoTClient,
+                            const IOTCLIENT_AGGREGATOR_OPTIONS *pOptions );
+
+/*! submit a telemetry record for aggregation */
+int IOTCLIENT_Aggregate( IOTCLIENT_AGGREGATOR hAggregator,
+                         const char *key,
+                         const void *record,
+                         size_t len );
+
+/*! send the aggregated messages whose delay has expired */
+int IOTCLIENT_PollAggregator( IOTCLIENT_AGGREGATOR hAggregator,
+                              int *pTimeout );
+
+/*! send all of the aggregated messages */
+int IOTCLIENT_FlushAggregator( IOTCLIENT_AGGREGATOR hAggregator );
+
+/*! destroy a telemetry record aggregator */
+int IOTCLIENT_DestroyAggregator( IOTCLIENT_AGGREGATOR hAggregator );
+
 #endif
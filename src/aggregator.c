@@ -0,0 +1,937 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup aggregator aggregator
+ * @brief telemetry record aggregation
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file aggregator.c
+
+    Telemetry record aggregation
+
+    An aggregator coalesces small telemetry records into larger IOT
+    messages.  Each record is submitted with a stream key, and the
+    records of each stream are appended to a body for that stream in
+    one of the following formats:
+
+    - IOTCLIENT_AGG_JSON_ARRAY: records are JSON values, and the body
+      is a JSON array of them
+    - IOTCLIENT_AGG_CSV: records are CSV rows, and the body is the rows
+      separated by newlines
+    - IOTCLIENT_AGG_LENGTH_DELIMITED: records are arbitrary octets, and
+      each one is preceded by its 32-bit big-endian length
+
+    A stream's body is sent when it holds the maximum number of records,
+    when the next record would take it over the maximum body size, or
+    when its oldest record has waited for the maximum delay.  Delays are
+    enforced by IOTCLIENT_PollAggregator, which returns the time until
+    the next deadline so it can be used as a poll/epoll timeout.
+
+    A message which cannot be sent for a transient reason, such as a
+    full queue, keeps its records so it is retried later.  Any other
+    failure, such as the message being dropped by a pre-send filter,
+    discards the records so the stream is not wedged.  Either way the
+    failure is reported to the error callback.
+
+    An aggregator is not thread safe, and should be used by the same
+    thread as its IOT Client.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <iotclient/iotclient.h>
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! number of stream hash table buckets */
+#define AGGREGATOR_BUCKETS 64
+
+/*! length of the record length prefix of the length-delimited format */
+#define LENGTH_PREFIX_SIZE 4
+
+/*! FNV-1a offset basis used to hash stream keys */
+#define KEY_HASH_BASIS 2166136261U
+
+/*! FNV-1a prime used to hash stream keys */
+#define KEY_HASH_PRIME 16777619U
+
+/*==============================================================================
+        Private type definitions
+==============================================================================*/
+
+/*! records waiting to be sent for one stream key */
+typedef struct _aggregator_stream
+{
+    /*! stream key */
+    char *key;
+
+    /*! headers sent with the stream's messages */
+    char *headers;
+
+    /*! aggregated message body */
+    unsigned char *body;
+
+    /*! length of the aggregated message body */
+    size_t length;
+
+    /*! allocated size of the message body buffer */
+    size_t size;
+
+    /*! number of records in the message body */
+    size_t count;
+
+    /*! time the oldest record must be sent by (ms) */
+    uint64_t deadline;
+
+    /*! pointer to the next stream in the hash bucket */
+    struct _aggregator_stream *pNext;
+} AggregatorStream;
+
+/*! telemetry record aggregator */
+struct _iotclient_aggregator
+{
+    /*! IOT Client used to send the aggregated messages */
+    IOTCLIENT_HANDLE hIoTClient;
+
+    /*! aggregation options */
+    IOTCLIENT_AGGREGATOR_OPTIONS options;
+
+    /*! stream hash table */
+    AggregatorStream *buckets[AGGREGATOR_BUCKETS];
+};
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static AggregatorStream *aggregator_GetStream( IOTCLIENT_AGGREGATOR hAggregator,
+                                               const char *key );
+static char *aggregator_BuildHeaders( IOTCLIENT_AGGREGATOR hAggregator,
+                                      const char *key );
+static int aggregator_Append( IOTCLIENT_AGGREGATOR hAggregator,
+                              AggregatorStream *pStream,
+                              const void *record,
+                              size_t len );
+static size_t aggregator_RecordSize( IOTCLIENT_AGGREGATOR hAggregator,
+                                     AggregatorStream *pStream,
+                                     size_t len );
+static int aggregator_Flush( IOTCLIENT_AGGREGATOR hAggregator,
+                             AggregatorStream *pStream );
+static bool aggregator_Retryable( int result );
+static uint64_t aggregator_Now( void );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  IOTCLIENT_InitAggregatorOptions                                           */
+/*!
+    Initialize an aggregator options object
+
+    The IOTCLIENT_InitAggregatorOptions function populates an aggregator
+    options object with the defaults: JSON array format, no record or
+    size limit, a one second delay, and no additional headers.
+
+    @param[out]
+        pOptions
+            pointer to the aggregator options object to initialize
+
+    @retval EOK the options object was initialized
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_InitAggregatorOptions( IOTCLIENT_AGGREGATOR_OPTIONS *pOptions )
+{
+    int result = EINVAL;
+
+    if ( pOptions != NULL )
+    {
+        memset( pOptions, 0, sizeof( IOTCLIENT_AGGREGATOR_OPTIONS ) );
+        pOptions->format = IOTCLIENT_AGG_JSON_ARRAY;
+        pOptions->maxDelay = 1000;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_CreateAggregator                                                */
+/*!
+    Create a telemetry record aggregator
+
+    The IOTCLIENT_CreateAggregator function creates an aggregator which
+    coalesces records into messages sent via the specified IOT Client.
+    The option strings are copied.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client used to send the aggregated messages
+
+    @param[in]
+        pOptions
+            pointer to the aggregation options, or NULL for the defaults
+
+    @retval handle to the aggregator
+    @retval NULL if the aggregator could not be created
+
+==============================================================================*/
+IOTCLIENT_AGGREGATOR IOTCLIENT_CreateAggregator(
+                            IOTCLIENT_HANDLE hIoTClient,
+                            const IOTCLIENT_AGGREGATOR_OPTIONS *pOptions )
+{
+    IOTCLIENT_AGGREGATOR hAggregator = NULL;
+    bool ok;
+
+    if ( hIoTClient != NULL )
+    {
+        hAggregator = calloc( 1, sizeof( struct _iotclient_aggregator ) );
+        if ( hAggregator != NULL )
+        {
+            hAggregator->hIoTClient = hIoTClient;
+
+            if ( pOptions != NULL )
+            {
+                hAggregator->options = *pOptions;
+            }
+            else
+            {
+                IOTCLIENT_InitAggregatorOptions( &hAggregator->options );
+            }
+
+            ok = ( hAggregator->options.format <=
+                        IOTCLIENT_AGG_LENGTH_DELIMITED );
+
+            /* take copies of the option strings */
+            if ( hAggregator->options.headers != NULL )
+            {
+                hAggregator->options.headers =
+                    strdup( hAggregator->options.headers );
+                ok = ok && ( hAggregator->options.headers != NULL );
+            }
+
+            if ( hAggregator->options.keyProperty != NULL )
+            {
+                hAggregator->options.keyProperty =
+                    strdup( hAggregator->options.keyProperty );
+                ok = ok && ( hAggregator->options.keyProperty != NULL );
+            }
+
+            if ( ok == false )
+            {
+                IOTCLIENT_DestroyAggregator( hAggregator );
+                hAggregator = NULL;
+            }
+        }
+    }
+
+    return hAggregator;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Aggregate                                                       */
+/*!
+    Submit a telemetry record for aggregation
+
+    The IOTCLIENT_Aggregate function appends a record to the message body
+    of its stream.  The stream's message is sent first if the record
+    would take it over the maximum body size, if its delay has expired,
+    or if it already holds the maximum number of records, and afterwards
+    if it holds the maximum number of records.
+
+    If the message sent first cannot be sent and its records are kept
+    for a retry, the record is not appended and the error is returned.
+    Once the record has been appended EOK is returned, and a failure to
+    send the message afterwards is reported to the error callback.
+
+    @param[in]
+        hAggregator
+            handle to the aggregator
+
+    @param[in]
+        key
+            NUL terminated stream key
+
+    @param[in]
+        record
+            pointer to the record
+
+    @param[in]
+        len
+            length of the record
+
+    @retval EOK the record was aggregated
+    @retval EINVAL invalid arguments
+    @retval ENOMEM memory could not be allocated
+    @retval other error as reported by IOTCLIENT_Send for a message
+            whose records were kept, before the record was appended
+
+==============================================================================*/
+int IOTCLIENT_Aggregate( IOTCLIENT_AGGREGATOR hAggregator,
+                         const char *key,
+                         const void *record,
+                         size_t len )
+{
+    int result = EINVAL;
+    AggregatorStream *pStream;
+    size_t maxBytes;
+
+    if ( ( hAggregator != NULL ) &&
+         ( key != NULL ) &&
+         ( ( record != NULL ) || ( len == 0 ) ) &&
+         ( len <= UINT32_MAX ) )
+    {
+        pStream = aggregator_GetStream( hAggregator, key );
+        if ( pStream != NULL )
+        {
+            result = EOK;
+            maxBytes = hAggregator->options.maxBytes;
+
+            if ( ( pStream->count > 0 ) &&
+                 ( ( ( maxBytes > 0 ) &&
+                     ( pStream->length +
+                       aggregator_RecordSize( hAggregator, pStream, len ) >
+                       maxBytes ) ) ||
+                   ( ( hAggregator->options.maxRecords > 0 ) &&
+                     ( pStream->count >= hAggregator->options.maxRecords ) ) ||
+                   ( ( hAggregator->options.maxDelay > 0 ) &&
+                     ( aggregator_Now() >= pStream->deadline ) ) ) )
+            {
+                /* make room for the record.  Discarded records leave
+                   room as well as sent ones */
+                result = aggregator_Flush( hAggregator, pStream );
+                if ( pStream->count == 0 )
+                {
+                    result = EOK;
+                }
+            }
+
+            if ( result == EOK )
+            {
+                result = aggregator_Append( hAggregator, pStream, record, len );
+            }
+
+            if ( ( result == EOK ) &&
+                 ( hAggregator->options.maxRecords > 0 ) &&
+                 ( pStream->count >= hAggregator->options.maxRecords ) )
+            {
+                /* the record is stored, so a failure is only reported
+                   to the error callback */
+                (void)aggregator_Flush( hAggregator, pStream );
+            }
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_PollAggregator                                                  */
+/*!
+    Send the aggregated messages whose delay has expired
+
+    The IOTCLIENT_PollAggregator function sends the message of every
+    stream whose oldest record has waited for the maximum delay, and
+    gets the time until the next stream's delay expires.
+
+    @param[in]
+        hAggregator
+            handle to the aggregator
+
+    @param[out]
+        pTimeout
+            pointer to the location to store the number of milliseconds
+            until IOTCLIENT_PollAggregator should be called again, or -1
+            if no records are waiting.  May be NULL.
+
+    @retval EOK the expired messages were sent
+    @retval EINVAL invalid arguments
+    @retval other error as reported by IOTCLIENT_Send
+
+==============================================================================*/
+int IOTCLIENT_PollAggregator( IOTCLIENT_AGGREGATOR hAggregator,
+                              int *pTimeout )
+{
+    int result = EINVAL;
+    AggregatorStream *pStream;
+    uint64_t now;
+    uint64_t next = UINT64_MAX;
+    int rc;
+    size_t i;
+
+    if ( hAggregator != NULL )
+    {
+        result = EOK;
+        now = aggregator_Now();
+
+        for ( i = 0; i < AGGREGATOR_BUCKETS; i++ )
+        {
+            for ( pStream = hAggregator->buckets[i];
+                  pStream != NULL;
+                  pStream = pStream->pNext )
+            {
+                if ( ( pStream->count > 0 ) &&
+                     ( hAggregator->options.maxDelay > 0 ) &&
+                     ( now >= pStream->deadline ) )
+                {
+                    rc = aggregator_Flush( hAggregator, pStream );
+                    if ( rc != EOK )
+                    {
+                        result = rc;
+                    }
+                }
+
+                if ( ( pStream->count > 0 ) &&
+                     ( hAggregator->options.maxDelay > 0 ) &&
+                     ( pStream->deadline < next ) )
+                {
+                    next = pStream->deadline;
+                }
+            }
+        }
+
+        if ( pTimeout != NULL )
+        {
+            if ( next == UINT64_MAX )
+            {
+                *pTimeout = -1;
+            }
+            else
+            {
+                /* a failed send is retried straight away */
+                *pTimeout = ( next > now ) ? (int)( next - now ) : 0;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_FlushAggregator                                                 */
+/*!
+    Send all of the aggregated messages
+
+    The IOTCLIENT_FlushAggregator function sends the message of every
+    stream which has records waiting, regardless of its delay.
+
+    @param[in]
+        hAggregator
+            handle to the aggregator
+
+    @retval EOK the messages were sent
+    @retval EINVAL invalid arguments
+    @retval other error as reported by IOTCLIENT_Send
+
+==============================================================================*/
+int IOTCLIENT_FlushAggregator( IOTCLIENT_AGGREGATOR hAggregator )
+{
+    int result = EINVAL;
+    AggregatorStream *pStream;
+    int rc;
+    size_t i;
+
+    if ( hAggregator != NULL )
+    {
+        result = EOK;
+
+        for ( i = 0; i < AGGREGATOR_BUCKETS; i++ )
+        {
+            for ( pStream = hAggregator->buckets[i];
+                  pStream != NULL;
+                  pStream = pStream->pNext )
+            {
+                if ( pStream->count > 0 )
+                {
+                    rc = aggregator_Flush( hAggregator, pStream );
+                    if ( rc != EOK )
+                    {
+                        result = rc;
+                    }
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_DestroyAggregator                                               */
+/*!
+    Destroy a telemetry record aggregator
+
+    The IOTCLIENT_DestroyAggregator function sends any records which are
+    waiting, and frees the aggregator.  Records which cannot be sent are
+    discarded.
+
+    @param[in]
+        hAggregator
+            handle to the aggregator
+
+    @retval EOK the aggregator was destroyed
+    @retval EINVAL invalid arguments
+    @retval other error as reported by IOTCLIENT_Send
+
+==============================================================================*/
+int IOTCLIENT_DestroyAggregator( IOTCLIENT_AGGREGATOR hAggregator )
+{
+    int result = EINVAL;
+    AggregatorStream *pStream;
+    size_t i;
+
+    if ( hAggregator != NULL )
+    {
+        result = IOTCLIENT_FlushAggregator( hAggregator );
+
+        for ( i = 0; i < AGGREGATOR_BUCKETS; i++ )
+        {
+            while ( hAggregator->buckets[i] != NULL )
+            {
+                pStream = hAggregator->buckets[i];
+                hAggregator->buckets[i] = pStream->pNext;
+                free( pStream->key );
+                free( pStream->headers );
+                free( pStream->body );
+                free( pStream );
+            }
+        }
+
+        free( (char *)hAggregator->options.headers );
+        free( (char *)hAggregator->options.keyProperty );
+        free( hAggregator );
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  aggregator_GetStream                                                      */
+/*!
+    Get the stream for a stream key
+
+    The aggregator_GetStream function looks up the stream for a key in
+    the stream hash table, creating it if this is the first record with
+    the key.
+
+    @param[in]
+        hAggregator
+            handle to the aggregator
+
+    @param[in]
+        key
+            NUL terminated stream key
+
+    @retval pointer to the stream
+    @retval NULL if the stream could not be allocated
+
+==============================================================================*/
+static AggregatorStream *aggregator_GetStream( IOTCLIENT_AGGREGATOR hAggregator,
+                                               const char *key )
+{
+    AggregatorStream *pStream;
+    uint32_t hash = KEY_HASH_BASIS;
+    const char *p;
+    size_t bucket;
+
+    for ( p = key; *p != '\0'; p++ )
+    {
+        hash ^= (uint8_t)*p;
+        hash *= KEY_HASH_PRIME;
+    }
+
+    bucket = hash % AGGREGATOR_BUCKETS;
+
+    pStream = hAggregator->buckets[bucket];
+    while ( ( pStream != NULL ) && ( strcmp( pStream->key, key ) != 0 ) )
+    {
+        pStream = pStream->pNext;
+    }
+
+    if ( pStream == NULL )
+    {
+        pStream = calloc( 1, sizeof( AggregatorStream ) );
+        if ( pStream != NULL )
+        {
+            pStream->key = strdup( key );
+            pStream->headers = aggregator_BuildHeaders( hAggregator, key );
+            if ( ( pStream->key != NULL ) &&
+                 ( pStream->headers != NULL ) )
+            {
+                pStream->pNext = hAggregator->buckets[bucket];
+                hAggregator->buckets[bucket] = pStream;
+            }
+            else
+            {
+                free( pStream->key );
+                free( pStream->headers );
+                free( pStream );
+                pStream = NULL;
+            }
+        }
+    }
+
+    return pStream;
+}
+
+/*============================================================================*/
+/*  aggregator_BuildHeaders                                                   */
+/*!
+    Build the headers sent with a stream's messages
+
+    The aggregator_BuildHeaders function builds the headers for a stream
+    from the headers specified in the options, the content type of the
+    aggregation format, and the stream key property if one is specified.
+
+    @param[in]
+        hAggregator
+            handle to the aggregator
+
+    @param[in]
+        key
+            NUL terminated stream key
+
+    @retval pointer to the allocated headers
+    @retval NULL if the headers could not be allocated
+
+==============================================================================*/
+static char *aggregator_BuildHeaders( IOTCLIENT_AGGREGATOR hAggregator,
+                                      const char *key )
+{
+    static const char *contentTypes[] =
+    {
+        "application/json",
+        "text/csv",
+        "application/octet-stream"
+    };
+
+    char *headers = NULL;
+    const char *extra = hAggregator->options.headers;
+    const char *keyProperty = hAggregator->options.keyProperty;
+    int n;
+
+    n = asprintf( &headers,
+                  "%s%s%s:%s\n%s%s%s%s",
+                  ( extra != NULL ) ? extra : "",
+                  ( ( extra != NULL ) &&
+                    ( *extra != '\0' ) &&
+                    ( extra[strlen( extra ) - 1] != '\n' ) ) ? "\n" : "",
+                  IOTCLIENT_GetPropertyName( IOTCLIENT_PROP_CONTENT_TYPE ),
+                  contentTypes[hAggregator->options.format],
+                  ( keyProperty != NULL ) ? keyProperty : "",
+                  ( keyProperty != NULL ) ? ":" : "",
+                  ( keyProperty != NULL ) ? key : "",
+                  ( keyProperty != NULL ) ? "\n" : "" );
+
+    return ( n >= 0 ) ? headers : NULL;
+}
+
+/*============================================================================*/
+/*  aggregator_RecordSize                                                     */
+/*!
+    Calculate the number of body octets a record will occupy
+
+    @param[in]
+        hAggregator
+            handle to the aggregator
+
+    @param[in]
+        pStream
+            pointer to the stream the record is appended to
+
+    @param[in]
+        len
+            length of the record
+
+    @retval number of body octets used by the record and its delimiters
+
+==============================================================================*/
+static size_t aggregator_RecordSize( IOTCLIENT_AGGREGATOR hAggregator,
+                                     AggregatorStream *pStream,
+                                     size_t len )
+{
+    size_t size = len;
+
+    switch ( hAggregator->options.format )
+    {
+        case IOTCLIENT_AGG_JSON_ARRAY:
+            /* the opening bracket or a comma, and the closing bracket */
+            size += ( pStream->count == 0 ) ? 2 : 1;
+            break;
+
+        case IOTCLIENT_AGG_CSV:
+            /* a separating newline */
+            size += ( pStream->count == 0 ) ? 0 : 1;
+            break;
+
+        case IOTCLIENT_AGG_LENGTH_DELIMITED:
+        default:
+            size += LENGTH_PREFIX_SIZE;
+            break;
+    }
+
+    return size;
+}
+
+/*============================================================================*/
+/*  aggregator_Append                                                         */
+/*!
+    Append a record to a stream's message body
+
+    The aggregator_Append function appends a record and its delimiters
+    to a stream's message body, growing the body buffer as required.
+    The delay of the stream starts with its first record.
+
+    @param[in]
+        hAggregator
+            handle to the aggregator
+
+    @param[in]
+        pStream
+            pointer to the stream
+
+    @param[in]
+        record
+            pointer to the record
+
+    @param[in]
+        len
+            length of the record
+
+    @retval EOK the record was appended
+    @retval ENOMEM the body buffer could not be grown
+
+==============================================================================*/
+static int aggregator_Append( IOTCLIENT_AGGREGATOR hAggregator,
+                              AggregatorStream *pStream,
+                              const void *record,
+                              size_t len )
+{
+    int result = EOK;
+    size_t required;
+    size_t size;
+    unsigned char *p;
+
+    required = pStream->length +
+               aggregator_RecordSize( hAggregator, pStream, len );
+    if ( ( required > pStream->size ) || ( pStream->body == NULL ) )
+    {
+        size = ( pStream->size > 0 ) ? pStream->size : 256;
+        while ( size < required )
+        {
+            size *= 2;
+        }
+
+        p = realloc( pStream->body, size );
+        if ( p != NULL )
+        {
+            pStream->body = p;
+            pStream->size = size;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    if ( result == EOK )
+    {
+        p = &pStream->body[pStream->length];
+
+        switch ( hAggregator->options.format )
+        {
+            case IOTCLIENT_AGG_JSON_ARRAY:
+                if ( pStream->count == 0 )
+                {
+                    *p++ = '[';
+                }
+                else
+                {
+                    /* replace the closing bracket with a separator */
+                    p[-1] = ',';
+                }
+
+                memcpy( p, record, len );
+                p += len;
+                *p++ = ']';
+                break;
+
+            case IOTCLIENT_AGG_CSV:
+                if ( pStream->count > 0 )
+                {
+                    *p++ = '\n';
+                }
+
+                memcpy( p, record, len );
+                p += len;
+                break;
+
+            case IOTCLIENT_AGG_LENGTH_DELIMITED:
+            default:
+                *p++ = (unsigned char)( len >> 24 );
+                *p++ = (unsigned char)( len >> 16 );
+                *p++ = (unsigned char)( len >> 8 );
+                *p++ = (unsigned char)len;
+                memcpy( p, record, len );
+                p += len;
+                break;
+        }
+
+        if ( pStream->count == 0 )
+        {
+            pStream->deadline = aggregator_Now() +
+                                hAggregator->options.maxDelay;
+        }
+
+        pStream->length = p - pStream->body;
+        pStream->count++;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  aggregator_Flush                                                          */
+/*!
+    Send a stream's aggregated message
+
+    The aggregator_Flush function sends the aggregated message body of
+    a stream, and empties the stream if it was sent.  If it could not
+    be sent, the records are kept for a retry if the error is transient
+    and discarded otherwise, and the error callback is invoked.
+
+    @param[in]
+        hAggregator
+            handle to the aggregator
+
+    @param[in]
+        pStream
+            pointer to the stream
+
+    @retval EOK the message was sent
+    @retval other error as reported by IOTCLIENT_Send
+
+==============================================================================*/
+static int aggregator_Flush( IOTCLIENT_AGGREGATOR hAggregator,
+                             AggregatorStream *pStream )
+{
+    int result;
+    size_t count = pStream->count;
+    bool discard;
+
+    result = IOTCLIENT_Send( hAggregator->hIoTClient,
+                             pStream->headers,
+                             pStream->body,
+                             pStream->length );
+
+    discard = ( result != EOK ) && !aggregator_Retryable( result );
+    if ( ( result == EOK ) || ( discard == true ) )
+    {
+        pStream->length = 0;
+        pStream->count = 0;
+    }
+
+    if ( ( result != EOK ) && ( hAggregator->options.errorCb != NULL ) )
+    {
+        hAggregator->options.errorCb( hAggregator->options.errorCtx,
+                                      pStream->key,
+                                      count,
+                                      result,
+                                      discard );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  aggregator_Retryable                                                      */
+/*!
+    Check if an aggregated message can be sent again after a failure
+
+    @param[in]
+        result
+            error reported by IOTCLIENT_Send
+
+    @retval true the error is transient and the message can be retried
+    @retval false the message would fail again, eg. it was dropped by
+            a pre-send filter or is invalid or too big
+
+==============================================================================*/
+static bool aggregator_Retryable( int result )
+{
+    return ( result == EAGAIN ) ||
+           ( result == EWOULDBLOCK ) ||
+           ( result == EBUSY ) ||
+           ( result == EINTR ) ||
+           ( result == ETIMEDOUT ) ||
+           ( result == ENOMEM ) ||
+           ( result == ENOBUFS );
+}
+
+/*============================================================================*/
+/*  aggregator_Now                                                            */
+/*!
+    Get the current monotonic time
+
+    @retval current monotonic time in milliseconds
+
+==============================================================================*/
+static uint64_t aggregator_Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (uint64_t)ts.tv_sec * 1000 ) + ( ts.tv_nsec / 1000000 );
+}
+
+/*! @}
+ * end of the aggregator group */
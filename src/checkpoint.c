@@ -0,0 +1,298 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup checkpoint checkpoint
+ * @brief resumable upload checkpoints
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file checkpoint.c
+
+    Resumable upload checkpoints
+
+    A resumable upload records its progress in a small state file, so
+    an upload which fails part way through can be resumed from the last
+    delivered offset instead of being resent from the start.
+
+    The state file holds a single line containing the upload identifier,
+    the identity of the file being uploaded (device, inode, size and
+    modification time) and the delivered offset.  A checkpoint is only
+    resumed if the file is unchanged.  The state file is replaced
+    atomically, so a crash while saving leaves the previous checkpoint.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <iotclient/iotclient.h>
+#include "checkpoint.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! state file format, the upload identifier is read with a width */
+#define CHECKPOINT_FORMAT "%s %" PRIu64 " %" PRIu64 " %" PRIu64 \
+                          " %" PRIu64 " %" PRIu64 "\n"
+
+/*! state file scan format */
+#define CHECKPOINT_SCAN_FORMAT "%63s %" SCNu64 " %" SCNu64 " %" SCNu64 \
+                               " %" SCNu64 " %" SCNu64
+
+/*! suffix of the temporary file used to replace the state file */
+#define CHECKPOINT_TMP_SUFFIX ".tmp"
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static void checkpoint_Identify( const struct stat *pStat,
+                                 Checkpoint *pCheckpoint );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  checkpoint_Load                                                           */
+/*!
+    Load the checkpoint of an upload
+
+    The checkpoint_Load function reads the checkpoint of an upload from
+    its state file.  If there is no state file, it cannot be read, or
+    it belongs to a different or modified file, a new checkpoint is
+    started at offset 0 with a new upload identifier.
+
+    @param[in]
+        path
+            path of the state file
+
+    @param[in]
+        pStat
+            pointer to the status of the file being uploaded
+
+    @param[out]
+        pCheckpoint
+            pointer to the checkpoint to populate
+
+    @retval true the upload is resumed from the saved checkpoint
+    @retval false a new upload was started
+
+==============================================================================*/
+bool checkpoint_Load( const char *path,
+                      const struct stat *pStat,
+                      Checkpoint *pCheckpoint )
+{
+    Checkpoint saved;
+    struct timespec ts;
+    bool resumed = false;
+    FILE *fp;
+
+    checkpoint_Identify( pStat, pCheckpoint );
+
+    fp = fopen( path, "r" );
+    if ( fp != NULL )
+    {
+        if ( ( fscanf( fp,
+                       CHECKPOINT_SCAN_FORMAT,
+                       saved.id,
+                       &saved.dev,
+                       &saved.ino,
+                       &saved.size,
+                       &saved.mtime,
+                       &saved.offset ) == 6 ) &&
+             ( saved.dev == pCheckpoint->dev ) &&
+             ( saved.ino == pCheckpoint->ino ) &&
+             ( saved.size == pCheckpoint->size ) &&
+             ( saved.mtime == pCheckpoint->mtime ) &&
+             ( saved.offset <= saved.size ) )
+        {
+            *pCheckpoint = saved;
+            resumed = true;
+        }
+
+        fclose( fp );
+    }
+
+    if ( resumed == false )
+    {
+        /* identify the new upload by its process, file and start time */
+        clock_gettime( CLOCK_REALTIME, &ts );
+        snprintf( pCheckpoint->id,
+                  sizeof( pCheckpoint->id ),
+                  "%x-%" PRIx64 "-%lx%09lx",
+                  (unsigned int)getpid(),
+                  pCheckpoint->ino,
+                  (unsigned long)ts.tv_sec,
+                  (unsigned long)ts.tv_nsec );
+        pCheckpoint->offset = 0;
+    }
+
+    return resumed;
+}
+
+/*============================================================================*/
+/*  checkpoint_Save                                                           */
+/*!
+    Save the checkpoint of an upload
+
+    The checkpoint_Save function writes the checkpoint to a temporary
+    file, flushes it to storage, and renames it over the state file.
+
+    @param[in]
+        path
+            path of the state file
+
+    @param[in]
+        pCheckpoint
+            pointer to the checkpoint to save
+
+    @retval EOK the checkpoint was saved
+    @retval ENAMETOOLONG the state file path is too long
+    @retval other error as returned by fopen(), fsync() or rename()
+
+==============================================================================*/
+int checkpoint_Save( const char *path, const Checkpoint *pCheckpoint )
+{
+    int result = EOK;
+    char tmp[PATH_MAX];
+    FILE *fp;
+
+    if ( snprintf( tmp,
+                   sizeof( tmp ),
+                   "%s" CHECKPOINT_TMP_SUFFIX,
+                   path ) >= (int)sizeof( tmp ) )
+    {
+        result = ENAMETOOLONG;
+    }
+    else if ( ( fp = fopen( tmp, "w" ) ) == NULL )
+    {
+        result = errno;
+    }
+    else
+    {
+        if ( ( fprintf( fp,
+                        CHECKPOINT_FORMAT,
+                        pCheckpoint->id,
+                        pCheckpoint->dev,
+                        pCheckpoint->ino,
+                        pCheckpoint->size,
+                        pCheckpoint->mtime,
+                        pCheckpoint->offset ) < 0 ) ||
+             ( fflush( fp ) != 0 ) ||
+             ( fsync( fileno( fp ) ) != 0 ) )
+        {
+            result = errno;
+        }
+
+        if ( ( fclose( fp ) != 0 ) && ( result == EOK ) )
+        {
+            result = errno;
+        }
+
+        if ( ( result == EOK ) && ( rename( tmp, path ) != 0 ) )
+        {
+            result = errno;
+        }
+
+        if ( result != EOK )
+        {
+            (void)unlink( tmp );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  checkpoint_Remove                                                         */
+/*!
+    Remove the checkpoint of a completed upload
+
+    @param[in]
+        path
+            path of the state file
+
+    @retval EOK the state file was removed, or did not exist
+    @retval other error as returned by unlink()
+
+==============================================================================*/
+int checkpoint_Remove( const char *path )
+{
+    int result = EOK;
+
+    if ( ( unlink( path ) != 0 ) && ( errno != ENOENT ) )
+    {
+        result = errno;
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  checkpoint_Identify                                                       */
+/*!
+    Record the identity of the file being uploaded in a checkpoint
+
+    @param[in]
+        pStat
+            pointer to the status of the file being uploaded
+
+    @param[out]
+        pCheckpoint
+            pointer to the checkpoint to update
+
+==============================================================================*/
+static void checkpoint_Identify( const struct stat *pStat,
+                                 Checkpoint *pCheckpoint )
+{
+    pCheckpoint->dev = (uint64_t)pStat->st_dev;
+    pCheckpoint->ino = (uint64_t)pStat->st_ino;
+    pCheckpoint->size = (uint64_t)pStat->st_size;
+    pCheckpoint->mtime = ( (uint64_t)pStat->st_mtim.tv_sec * 1000000000ULL ) +
+                         (uint64_t)pStat->st_mtim.tv_nsec;
+}
+
+/*! @}
+ * end of the checkpoint group */
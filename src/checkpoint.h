@@ -0,0 +1,80 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+/*==============================================================================
+        Public Definitions
+==============================================================================*/
+
+/*! maximum length of an upload identifier, including the NUL */
+#define CHECKPOINT_ID_LENGTH 64
+
+/*! resumable upload checkpoint */
+typedef struct _checkpoint
+{
+    /*! identifier shared by every segment of the upload */
+    char id[CHECKPOINT_ID_LENGTH];
+
+    /*! device of the file being uploaded */
+    uint64_t dev;
+
+    /*! inode of the file being uploaded */
+    uint64_t ino;
+
+    /*! size of the file being uploaded */
+    uint64_t size;
+
+    /*! modification time of the file being uploaded (ns) */
+    uint64_t mtime;
+
+    /*! number of bytes delivered to the IOT Hub service */
+    uint64_t offset;
+} Checkpoint;
+
+/*==============================================================================
+        Public Function Declarations
+==============================================================================*/
+
+/*! load the checkpoint of an upload, or start a new one */
+bool checkpoint_Load( const char *path,
+                      const struct stat *pStat,
+                      Checkpoint *pCheckpoint );
+
+/*! save the checkpoint of an upload */
+int checkpoint_Save( const char *path, const Checkpoint *pCheckpoint );
+
+/*! remove the checkpoint of a completed upload */
+int checkpoint_Remove( const char *path );
+
+#endif
@@ -0,0 +1,727 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup digest digest
+ * @brief inline message digests
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file digest.c
+
+    Inline message digests
+
+    Message digests are computed incrementally over the octets of a
+    streamed message body as they are forwarded, so the body is only
+    read once.  CRC32C uses the SSE4.2 CRC32 instruction, and SHA-256
+    uses the SHA extensions, when the processor supports them.
+    Otherwise table driven and portable implementations are used.
+    The implementations are selected once, when the library is loaded.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <iotclient/iotclient.h>
+#include "digest.h"
+
+#if defined( __x86_64__ )
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! reflected CRC32C (Castagnoli) polynomial */
+#define CRC32C_POLY 0x82F63B78U
+
+/*! SSE4.2 feature bit of CPUID leaf 1 ECX */
+#define CPUID_SSE42 ( 1U << 20 )
+
+/*! SHA extensions feature bit of CPUID leaf 7 EBX */
+#define CPUID_SHA ( 1U << 29 )
+
+/*! SHA-256 right rotation */
+#define ROTR( x, n ) ( ( (x) >> (n) ) | ( (x) << ( 32 - (n) ) ) )
+
+/*==============================================================================
+        Private type definitions
+==============================================================================*/
+
+/*! CRC32C block function */
+typedef uint32_t (*Crc32cFn)( uint32_t crc, const unsigned char *p, size_t len );
+
+/*! SHA-256 block function, processes whole 64 octet blocks */
+typedef void (*Sha256Fn)( uint32_t *state, const unsigned char *p, size_t len );
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static void digest_Setup( void ) __attribute__ ((constructor));
+static uint32_t digest_Crc32cTable( uint32_t crc,
+                                    const unsigned char *p,
+                                    size_t len );
+static void digest_Sha256Blocks( uint32_t *state,
+                                 const unsigned char *p,
+                                 size_t len );
+#if defined( __x86_64__ )
+static uint32_t digest_Crc32cHw( uint32_t crc,
+                                 const unsigned char *p,
+                                 size_t len );
+static void digest_Sha256BlocksHw( uint32_t *state,
+                                   const unsigned char *p,
+                                   size_t len );
+#endif
+static void digest_Sha256Update( Digest *pDigest,
+                                 const unsigned char *p,
+                                 size_t len );
+static size_t digest_Sha256Final( Digest *pDigest, unsigned char *out );
+
+/*==============================================================================
+        File scoped variables
+==============================================================================*/
+
+/*! slice-by-8 CRC32C lookup tables */
+static uint32_t crc32cTable[8][256];
+
+/*! selected CRC32C implementation */
+static Crc32cFn crc32c = digest_Crc32cTable;
+
+/*! selected SHA-256 implementation */
+static Sha256Fn sha256Blocks = digest_Sha256Blocks;
+
+/*! SHA-256 initial hash value */
+static const uint32_t sha256Init[8] =
+{
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+    0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/*! SHA-256 round constants */
+static const uint32_t sha256K[64] =
+{
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+    0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+    0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+    0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+    0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+    0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/*==============================================================================
+        Function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  digest_Setup                                                              */
+/*!
+    Build the CRC32C tables and select the digest implementations
+
+    The digest_Setup function is called when the library is loaded.
+
+==============================================================================*/
+static void digest_Setup( void )
+{
+    uint32_t crc;
+    unsigned int i;
+    unsigned int j;
+#if defined( __x86_64__ )
+    unsigned int eax;
+    unsigned int ebx;
+    unsigned int ecx;
+    unsigned int edx;
+#endif
+
+    for ( i = 0; i < 256; i++ )
+    {
+        crc = i;
+        for ( j = 0; j < 8; j++ )
+        {
+            crc = ( crc >> 1 ) ^ ( ( crc & 1 ) ? CRC32C_POLY : 0 );
+        }
+
+        crc32cTable[0][i] = crc;
+    }
+
+    for ( i = 0; i < 256; i++ )
+    {
+        crc = crc32cTable[0][i];
+        for ( j = 1; j < 8; j++ )
+        {
+            crc = crc32cTable[0][crc & 0xFF] ^ ( crc >> 8 );
+            crc32cTable[j][i] = crc;
+        }
+    }
+
+#if defined( __x86_64__ )
+    if ( ( __get_cpuid( 1, &eax, &ebx, &ecx, &edx ) != 0 ) &&
+         ( ecx & CPUID_SSE42 ) )
+    {
+        crc32c = digest_Crc32cHw;
+
+        /* the SHA extensions implementation also uses SSE4.1 */
+        if ( ( __get_cpuid_count( 7, 0, &eax, &ebx, &ecx, &edx ) != 0 ) &&
+             ( ebx & CPUID_SHA ) )
+        {
+            sha256Blocks = digest_Sha256BlocksHw;
+        }
+    }
+#endif
+}
+
+/*============================================================================*/
+/*  digest_Init                                                               */
+/*!
+    Start a message digest
+
+    @param[in]
+        pDigest
+            pointer to the digest to initialize
+
+    @param[in]
+        type
+            digest algorithm
+
+==============================================================================*/
+void digest_Init( Digest *pDigest, IOTCLIENT_DIGEST_TYPE type )
+{
+    memset( pDigest, 0, sizeof( Digest ) );
+    pDigest->type = type;
+    pDigest->crc = 0xFFFFFFFFU;
+    memcpy( pDigest->state, sha256Init, sizeof( sha256Init ) );
+}
+
+/*============================================================================*/
+/*  digest_Update                                                             */
+/*!
+    Add data to a message digest
+
+    @param[in]
+        pDigest
+            pointer to the digest
+
+    @param[in]
+        data
+            pointer to the data
+
+    @param[in]
+        len
+            length of the data
+
+==============================================================================*/
+void digest_Update( Digest *pDigest, const void *data, size_t len )
+{
+    switch ( pDigest->type )
+    {
+        case IOTCLIENT_DIGEST_CRC32C:
+            pDigest->crc = crc32c( pDigest->crc, data, len );
+            pDigest->length += len;
+            break;
+
+        case IOTCLIENT_DIGEST_SHA256:
+            digest_Sha256Update( pDigest, data, len );
+            break;
+
+        default:
+            pDigest->length += len;
+            break;
+    }
+}
+
+/*============================================================================*/
+/*  digest_Final                                                              */
+/*!
+    Complete a message digest
+
+    @param[in]
+        pDigest
+            pointer to the digest
+
+    @param[out]
+        out
+            pointer to a buffer of at least IOTCLIENT_DIGEST_MAX_LENGTH
+            octets to store the digest in
+
+    @retval length of the digest
+
+==============================================================================*/
+size_t digest_Final( Digest *pDigest, unsigned char *out )
+{
+    size_t len = 0;
+    uint32_t crc;
+
+    switch ( pDigest->type )
+    {
+        case IOTCLIENT_DIGEST_CRC32C:
+            crc = ~pDigest->crc;
+            out[0] = crc >> 24;
+            out[1] = crc >> 16;
+            out[2] = crc >> 8;
+            out[3] = crc;
+            len = sizeof( uint32_t );
+            break;
+
+        case IOTCLIENT_DIGEST_SHA256:
+            len = digest_Sha256Final( pDigest, out );
+            break;
+
+        default:
+            break;
+    }
+
+    return len;
+}
+
+/*============================================================================*/
+/*  digest_Crc32cTable                                                        */
+/*!
+    Update a CRC32C using the slice-by-8 lookup tables
+
+    @param[in]
+        crc
+            CRC32C register
+
+    @param[in]
+        p
+            pointer to the data
+
+    @param[in]
+        len
+            length of the data
+
+    @retval updated CRC32C register
+
+==============================================================================*/
+static uint32_t digest_Crc32cTable( uint32_t crc,
+                                    const unsigned char *p,
+                                    size_t len )
+{
+    uint32_t lo;
+    uint32_t hi;
+
+    while ( len >= 8 )
+    {
+        lo = crc ^ ( (uint32_t)p[0] |
+                     ( (uint32_t)p[1] << 8 ) |
+                     ( (uint32_t)p[2] << 16 ) |
+                     ( (uint32_t)p[3] << 24 ) );
+        hi = (uint32_t)p[4] |
+             ( (uint32_t)p[5] << 8 ) |
+             ( (uint32_t)p[6] << 16 ) |
+             ( (uint32_t)p[7] << 24 );
+
+        crc = crc32cTable[7][lo & 0xFF] ^
+              crc32cTable[6][( lo >> 8 ) & 0xFF] ^
+              crc32cTable[5][( lo >> 16 ) & 0xFF] ^
+              crc32cTable[4][lo >> 24] ^
+              crc32cTable[3][hi & 0xFF] ^
+              crc32cTable[2][( hi >> 8 ) & 0xFF] ^
+              crc32cTable[1][( hi >> 16 ) & 0xFF] ^
+              crc32cTable[0][hi >> 24];
+
+        p += 8;
+        len -= 8;
+    }
+
+    while ( len > 0 )
+    {
+        crc = crc32cTable[0][( crc ^ *p++ ) & 0xFF] ^ ( crc >> 8 );
+        len--;
+    }
+
+    return crc;
+}
+
+#if defined( __x86_64__ )
+/*============================================================================*/
+/*  digest_Crc32cHw                                                           */
+/*!
+    Update a CRC32C using the SSE4.2 CRC32 instruction
+
+    @param[in]
+        crc
+            CRC32C register
+
+    @param[in]
+        p
+            pointer to the data
+
+    @param[in]
+        len
+            length of the data
+
+    @retval updated CRC32C register
+
+==============================================================================*/
+__attribute__ ((target("sse4.2")))
+static uint32_t digest_Crc32cHw( uint32_t crc,
+                                 const unsigned char *p,
+                                 size_t len )
+{
+    uint64_t crc64;
+    uint64_t v;
+
+    while ( ( len > 0 ) && ( ( (uintptr_t)p & 7 ) != 0 ) )
+    {
+        crc = _mm_crc32_u8( crc, *p++ );
+        len--;
+    }
+
+    crc64 = crc;
+    while ( len >= 8 )
+    {
+        memcpy( &v, p, sizeof( v ) );
+        crc64 = _mm_crc32_u64( crc64, v );
+        p += 8;
+        len -= 8;
+    }
+
+    crc = (uint32_t)crc64;
+    while ( len > 0 )
+    {
+        crc = _mm_crc32_u8( crc, *p++ );
+        len--;
+    }
+
+    return crc;
+}
+
+/*============================================================================*/
+/*  digest_Sha256BlocksHw                                                     */
+/*!
+    Process SHA-256 blocks using the SHA extensions
+
+    The hash state is held as the ABEF and CDGH register pairs used by
+    the SHA256RNDS2 instruction, and the message schedule is computed
+    four words at a time with SHA256MSG1 and SHA256MSG2.
+
+    @param[in,out]
+        state
+            SHA-256 hash state
+
+    @param[in]
+        p
+            pointer to the blocks
+
+    @param[in]
+        len
+            length of the blocks, a multiple of the block size
+
+==============================================================================*/
+__attribute__ ((target("sha,sse4.1")))
+static void digest_Sha256BlocksHw( uint32_t *state,
+                                   const unsigned char *p,
+                                   size_t len )
+{
+    const __m128i mask = _mm_set_epi64x( 0x0c0d0e0f08090a0bULL,
+                                         0x0405060700010203ULL );
+    __m128i state0;
+    __m128i state1;
+    __m128i abef;
+    __m128i cdgh;
+    __m128i msg;
+    __m128i tmp;
+    __m128i w[4];
+    unsigned int i;
+
+    /* load the state as ABEF and CDGH */
+    tmp = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i *)&state[0] ),
+                             0xB1 );
+    state1 = _mm_shuffle_epi32( _mm_loadu_si128( (const __m128i *)&state[4] ),
+                                0x1B );
+    state0 = _mm_alignr_epi8( tmp, state1, 8 );
+    state1 = _mm_blend_epi16( state1, tmp, 0xF0 );
+
+    while ( len >= DIGEST_SHA256_BLOCK_SIZE )
+    {
+        abef = state0;
+        cdgh = state1;
+
+        for ( i = 0; i < 16; i++ )
+        {
+            if ( i < 4 )
+            {
+                w[i] = _mm_shuffle_epi8(
+                        _mm_loadu_si128( (const __m128i *)&p[16 * i] ),
+                        mask );
+            }
+            else
+            {
+                /* w[i & 3] holds the words from four groups ago */
+                w[i & 3] = _mm_sha256msg2_epu32(
+                            _mm_add_epi32(
+                                _mm_sha256msg1_epu32( w[i & 3],
+                                                      w[( i + 1 ) & 3] ),
+                                _mm_alignr_epi8( w[( i + 3 ) & 3],
+                                                 w[( i + 2 ) & 3],
+                                                 4 ) ),
+                            w[( i + 3 ) & 3] );
+            }
+
+            msg = _mm_add_epi32( w[i & 3],
+                                 _mm_loadu_si128(
+                                    (const __m128i *)&sha256K[4 * i] ) );
+            state1 = _mm_sha256rnds2_epu32( state1, state0, msg );
+            msg = _mm_shuffle_epi32( msg, 0x0E );
+            state0 = _mm_sha256rnds2_epu32( state0, state1, msg );
+        }
+
+        state0 = _mm_add_epi32( state0, abef );
+        state1 = _mm_add_epi32( state1, cdgh );
+
+        p += DIGEST_SHA256_BLOCK_SIZE;
+        len -= DIGEST_SHA256_BLOCK_SIZE;
+    }
+
+    /* store the state as ABCD and EFGH */
+    tmp = _mm_shuffle_epi32( state0, 0x1B );
+    state1 = _mm_shuffle_epi32( state1, 0xB1 );
+    state0 = _mm_blend_epi16( tmp, state1, 0xF0 );
+    state1 = _mm_alignr_epi8( state1, tmp, 8 );
+
+    _mm_storeu_si128( (__m128i *)&state[0], state0 );
+    _mm_storeu_si128( (__m128i *)&state[4], state1 );
+}
+#endif
+
+/*============================================================================*/
+/*  digest_Sha256Blocks                                                       */
+/*!
+    Process SHA-256 blocks
+
+    @param[in,out]
+        state
+            SHA-256 hash state
+
+    @param[in]
+        p
+            pointer to the blocks
+
+    @param[in]
+        len
+            length of the blocks, a multiple of the block size
+
+==============================================================================*/
+static void digest_Sha256Blocks( uint32_t *state,
+                                 const unsigned char *p,
+                                 size_t len )
+{
+    uint32_t w[64];
+    uint32_t v[8];
+    uint32_t s0;
+    uint32_t s1;
+    uint32_t t1;
+    uint32_t t2;
+    unsigned int i;
+
+    while ( len >= DIGEST_SHA256_BLOCK_SIZE )
+    {
+        for ( i = 0; i < 16; i++ )
+        {
+            w[i] = ( (uint32_t)p[4 * i] << 24 ) |
+                   ( (uint32_t)p[4 * i + 1] << 16 ) |
+                   ( (uint32_t)p[4 * i + 2] << 8 ) |
+                   (uint32_t)p[4 * i + 3];
+        }
+
+        for ( i = 16; i < 64; i++ )
+        {
+            s0 = ROTR( w[i - 15], 7 ) ^ ROTR( w[i - 15], 18 ) ^
+                 ( w[i - 15] >> 3 );
+            s1 = ROTR( w[i - 2], 17 ) ^ ROTR( w[i - 2], 19 ) ^
+                 ( w[i - 2] >> 10 );
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        memcpy( v, state, sizeof( v ) );
+
+        for ( i = 0; i < 64; i++ )
+        {
+            s1 = ROTR( v[4], 6 ) ^ ROTR( v[4], 11 ) ^ ROTR( v[4], 25 );
+            t1 = v[7] + s1 + ( ( v[4] & v[5] ) ^ ( ~v[4] & v[6] ) ) +
+                 sha256K[i] + w[i];
+            s0 = ROTR( v[0], 2 ) ^ ROTR( v[0], 13 ) ^ ROTR( v[0], 22 );
+            t2 = s0 + ( ( v[0] & v[1] ) ^ ( v[0] & v[2] ) ^ ( v[1] & v[2] ) );
+
+            v[7] = v[6];
+            v[6] = v[5];
+            v[5] = v[4];
+            v[4] = v[3] + t1;
+            v[3] = v[2];
+            v[2] = v[1];
+            v[1] = v[0];
+            v[0] = t1 + t2;
+        }
+
+        for ( i = 0; i < 8; i++ )
+        {
+            state[i] += v[i];
+        }
+
+        p += DIGEST_SHA256_BLOCK_SIZE;
+        len -= DIGEST_SHA256_BLOCK_SIZE;
+    }
+}
+
+/*============================================================================*/
+/*  digest_Sha256Update                                                       */
+/*!
+    Add data to a SHA-256 digest
+
+    Whole blocks are processed directly from the data, and any remainder
+    is kept in the partial block.
+
+    @param[in]
+        pDigest
+            pointer to the digest
+
+    @param[in]
+        p
+            pointer to the data
+
+    @param[in]
+        len
+            length of the data
+
+==============================================================================*/
+static void digest_Sha256Update( Digest *pDigest,
+                                 const unsigned char *p,
+                                 size_t len )
+{
+    size_t n;
+
+    pDigest->length += len;
+
+    if ( pDigest->blockLength > 0 )
+    {
+        n = DIGEST_SHA256_BLOCK_SIZE - pDigest->blockLength;
+        n = ( len < n ) ? len : n;
+        memcpy( &pDigest->block[pDigest->blockLength], p, n );
+        pDigest->blockLength += n;
+        p += n;
+        len -= n;
+
+        if ( pDigest->blockLength == DIGEST_SHA256_BLOCK_SIZE )
+        {
+            sha256Blocks( pDigest->state,
+                          pDigest->block,
+                          DIGEST_SHA256_BLOCK_SIZE );
+            pDigest->blockLength = 0;
+        }
+    }
+
+    n = len - ( len % DIGEST_SHA256_BLOCK_SIZE );
+    if ( n > 0 )
+    {
+        sha256Blocks( pDigest->state, p, n );
+        p += n;
+        len -= n;
+    }
+
+    if ( len > 0 )
+    {
+        memcpy( pDigest->block, p, len );
+        pDigest->blockLength = len;
+    }
+}
+
+/*============================================================================*/
+/*  digest_Sha256Final                                                        */
+/*!
+    Complete a SHA-256 digest
+
+    @param[in]
+        pDigest
+            pointer to the digest
+
+    @param[out]
+        out
+            pointer to a buffer of at least 32 octets to store the digest
+
+    @retval length of the digest
+
+==============================================================================*/
+static size_t digest_Sha256Final( Digest *pDigest, unsigned char *out )
+{
+    uint64_t bits = pDigest->length * 8;
+    size_t n = pDigest->blockLength;
+    unsigned int i;
+
+    /* pad with a 1 bit, zeros and the 64-bit message length in bits */
+    pDigest->block[n++] = 0x80;
+    if ( n > DIGEST_SHA256_BLOCK_SIZE - sizeof( uint64_t ) )
+    {
+        memset( &pDigest->block[n], 0, DIGEST_SHA256_BLOCK_SIZE - n );
+        sha256Blocks( pDigest->state,
+                      pDigest->block,
+                      DIGEST_SHA256_BLOCK_SIZE );
+        n = 0;
+    }
+
+    memset( &pDigest->block[n],
+            0,
+            DIGEST_SHA256_BLOCK_SIZE - sizeof( uint64_t ) - n );
+    for ( i = 0; i < sizeof( uint64_t ); i++ )
+    {
+        pDigest->block[DIGEST_SHA256_BLOCK_SIZE - 1 - i] = bits >> ( 8 * i );
+    }
+
+    sha256Blocks( pDigest->state, pDigest->block, DIGEST_SHA256_BLOCK_SIZE );
+
+    for ( i = 0; i < 8; i++ )
+    {
+        out[4 * i] = pDigest->state[i] >> 24;
+        out[4 * i + 1] = pDigest->state[i] >> 16;
+        out[4 * i + 2] = pDigest->state[i] >> 8;
+        out[4 * i + 3] = pDigest->state[i];
+    }
+
+    pDigest->blockLength = 0;
+
+    return 32;
+}
+
+/*! @}
+ * end of the digest group */
@@ -0,0 +1,78 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef DIGEST_H
+#define DIGEST_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <iotclient/iotclient.h>
+
+/*==============================================================================
+        Public Definitions
+==============================================================================*/
+
+/*! SHA-256 block size */
+#define DIGEST_SHA256_BLOCK_SIZE 64
+
+/*! running message digest */
+typedef struct _digest
+{
+    /*! digest algorithm */
+    IOTCLIENT_DIGEST_TYPE type;
+
+    /*! CRC32C register */
+    uint32_t crc;
+
+    /*! SHA-256 hash state */
+    uint32_t state[8];
+
+    /*! number of octets digested */
+    uint64_t length;
+
+    /*! partial SHA-256 block */
+    unsigned char block[DIGEST_SHA256_BLOCK_SIZE];
+
+    /*! number of octets in the partial block */
+    size_t blockLength;
+} Digest;
+
+/*==============================================================================
+        Public Function Declarations
+==============================================================================*/
+
+/*! start a message digest */
+void digest_Init( Digest *pDigest, IOTCLIENT_DIGEST_TYPE type );
+
+/*! add data to a message digest */
+void digest_Update( Digest *pDigest, const void *data, size_t len );
+
+/*! complete a message digest */
+size_t digest_Final( Digest *pDigest, unsigned char *out );
+
+#endif
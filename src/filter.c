@@ -0,0 +1,860 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup filter filter
+ * @brief pre-send message filters
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file filter.c
+
+    Pre-send message filters
+
+    Pre-send filters let a producer run at full rate while only the
+    messages which matter are sent.  Filters are attached to an IOT
+    Client and are evaluated in the order they were added, before the
+    message is copied or any of it is sent.  A message which is dropped
+    by a filter is not evaluated by the filters which follow it.
+
+    Evaluating a message does not change the filter state, apart from
+    counting the messages an every nth filter drops.  The state is only
+    updated when the message is committed once it has been sent, so a
+    message which could not be sent, or which a later filter dropped,
+    is evaluated afresh when it is offered again.
+
+    Each filter keeps separate state for each stream, where the stream
+    of a message is the value of the filter's key property, or a single
+    stream if the filter has no key property.  The filter types are:
+
+    - IOTCLIENT_FILTER_RATE_LIMIT: a token bucket per stream which
+      allows a sustained rate and a burst of messages
+    - IOTCLIENT_FILTER_EVERY_NTH: keep the first of every N messages
+    - IOTCLIENT_FILTER_DEADBAND: drop messages whose numeric value
+      differs from the last value sent by less than epsilon
+    - IOTCLIENT_FILTER_DUPLICATE: drop messages whose body is identical
+      to the last body sent, compared by hash
+    - IOTCLIENT_FILTER_CUSTOM: drop messages rejected by a callback
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <time.h>
+#include <iotclient/iotclient.h>
+#include "filter.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! number of stream hash table buckets per filter */
+#define FILTER_BUCKETS 64
+
+/*! maximum number of characters parsed as a deadband value */
+#define MAX_VALUE_LENGTH 63
+
+/*! FNV-1a 64-bit offset basis */
+#define HASH_BASIS 14695981039346656037ULL
+
+/*! FNV-1a 64-bit prime */
+#define HASH_PRIME 1099511628211ULL
+
+/*==============================================================================
+        Private type definitions
+==============================================================================*/
+
+/*! per-stream filter state */
+typedef struct _filter_stream
+{
+    /*! stream key */
+    char *key;
+
+    /*! length of the stream key */
+    size_t keyLength;
+
+    /*! rate limit: tokens available */
+    double tokens;
+
+    /*! rate limit: time the tokens were last replenished (s) */
+    double last;
+
+    /*! every nth: number of messages seen */
+    uint64_t count;
+
+    /*! deadband: last value sent */
+    double value;
+
+    /*! duplicate: hash of the last body sent */
+    uint64_t hash;
+
+    /*! indicates a message has been sent on the stream */
+    bool sent;
+
+    /*! pointer to the next stream in the hash bucket */
+    struct _filter_stream *pNext;
+} FilterStream;
+
+/*! pre-send filter */
+struct _filter
+{
+    /*! filter definition, with copies of its strings */
+    IOTCLIENT_FILTER def;
+
+    /*! id of the key property, or IOTCLIENT_PROP_UNKNOWN */
+    IOTCLIENT_PROPERTY_ID keyId;
+
+    /*! id of the value property, or IOTCLIENT_PROP_UNKNOWN */
+    IOTCLIENT_PROPERTY_ID valueId;
+
+    /*! stream hash table */
+    FilterStream *buckets[FILTER_BUCKETS];
+
+    /*! pointer to the next filter in the chain */
+    struct _filter *pNext;
+};
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static bool filter_Run( Filter *pFilters,
+                        const char *headers,
+                        const unsigned char *body,
+                        size_t len,
+                        bool commit );
+static bool filter_Evaluate( Filter *pFilter,
+                             const IOTCLIENT_HEADER_INDEX *pIndex,
+                             const char *headers,
+                             const unsigned char *body,
+                             size_t len,
+                             bool commit );
+static FilterStream *filter_GetStream( Filter *pFilter,
+                                       const char *key,
+                                       size_t len );
+static bool filter_GetValue( const IOTCLIENT_HEADER_INDEX *pIndex,
+                             IOTCLIENT_PROPERTY_ID id,
+                             const char *name,
+                             const char **ppValue,
+                             size_t *pLength );
+static bool filter_ParseNumber( const void *p, size_t len, double *pValue );
+static uint64_t filter_Hash( const void *p, size_t len );
+static double filter_Now( void );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  filter_Add                                                                */
+/*!
+    Append a pre-send filter to a filter chain
+
+    The filter_Add function validates a filter definition and appends a
+    filter built from it to the end of a filter chain.  The strings in
+    the definition are copied.
+
+    @param[in,out]
+        ppFilters
+            pointer to the first filter in the chain
+
+    @param[in]
+        pFilter
+            pointer to the filter definition
+
+    @retval EOK the filter was added
+    @retval EINVAL invalid filter definition
+    @retval ENOMEM the filter could not be allocated
+
+==============================================================================*/
+int filter_Add( Filter **ppFilters, const IOTCLIENT_FILTER *pFilter )
+{
+    int result = EINVAL;
+    Filter *pNew;
+    bool valid;
+
+    if ( ( ppFilters != NULL ) && ( pFilter != NULL ) )
+    {
+        switch ( pFilter->type )
+        {
+            case IOTCLIENT_FILTER_RATE_LIMIT:
+                valid = ( pFilter->rate > 0.0 );
+                break;
+
+            case IOTCLIENT_FILTER_EVERY_NTH:
+                valid = ( pFilter->n > 0 );
+                break;
+
+            case IOTCLIENT_FILTER_DEADBAND:
+                valid = ( pFilter->epsilon >= 0.0 );
+                break;
+
+            case IOTCLIENT_FILTER_DUPLICATE:
+                valid = true;
+                break;
+
+            case IOTCLIENT_FILTER_CUSTOM:
+                valid = ( pFilter->cb != NULL );
+                break;
+
+            default:
+                valid = false;
+                break;
+        }
+
+        pNew = valid ? calloc( 1, sizeof( Filter ) ) : NULL;
+        if ( pNew != NULL )
+        {
+            pNew->def = *pFilter;
+            pNew->def.keyProperty = NULL;
+            pNew->def.valueProperty = NULL;
+            result = EOK;
+
+            if ( pFilter->keyProperty != NULL )
+            {
+                pNew->def.keyProperty = strdup( pFilter->keyProperty );
+                pNew->keyId = IOTCLIENT_GetPropertyId(
+                                        pFilter->keyProperty,
+                                        strlen( pFilter->keyProperty ) );
+                result = ( pNew->def.keyProperty != NULL ) ? result : ENOMEM;
+            }
+
+            if ( pFilter->valueProperty != NULL )
+            {
+                pNew->def.valueProperty = strdup( pFilter->valueProperty );
+                pNew->valueId = IOTCLIENT_GetPropertyId(
+                                        pFilter->valueProperty,
+                                        strlen( pFilter->valueProperty ) );
+                result = ( pNew->def.valueProperty != NULL ) ? result : ENOMEM;
+            }
+
+            if ( result == EOK )
+            {
+                /* append the filter to the chain */
+                while ( *ppFilters != NULL )
+                {
+                    ppFilters = &(*ppFilters)->pNext;
+                }
+
+                *ppFilters = pNew;
+            }
+            else
+            {
+                filter_Destroy( pNew );
+            }
+        }
+        else if ( valid )
+        {
+            result = ENOMEM;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  filter_Accept                                                             */
+/*!
+    Check if a message passes every filter in a filter chain
+
+    The filter_Accept function evaluates the filters in a chain in order,
+    and stops at the first one which drops the message.  The message
+    headers are indexed once, and only if a filter needs a property.
+    The filter state is not updated for an accepted message until it
+    is committed with filter_Commit.
+
+    @param[in]
+        pFilters
+            pointer to the first filter in the chain, or NULL
+
+    @param[in]
+        headers
+            pointer to the NUL terminated message headers
+
+    @param[in]
+        body
+            pointer to the message body, or NULL if it is streamed
+
+    @param[in]
+        len
+            length of the message body
+
+    @retval true the message should be sent
+    @retval false the message was dropped by a filter
+
+==============================================================================*/
+bool filter_Accept( Filter *pFilters,
+                    const char *headers,
+                    const unsigned char *body,
+                    size_t len )
+{
+    return filter_Run( pFilters, headers, body, len, false );
+}
+
+/*============================================================================*/
+/*  filter_Commit                                                             */
+/*!
+    Update a filter chain's state for a message which was sent
+
+    The filter_Commit function updates the state of every filter in a
+    chain for a message which filter_Accept accepted and which has been
+    sent: it takes a rate limit token, advances the every nth count, and
+    records the deadband value and the duplicate hash.  Custom filter
+    callbacks are not invoked again.
+
+    @param[in]
+        pFilters
+            pointer to the first filter in the chain, or NULL
+
+    @param[in]
+        headers
+            pointer to the NUL terminated message headers
+
+    @param[in]
+        body
+            pointer to the message body, or NULL if it is streamed
+
+    @param[in]
+        len
+            length of the message body
+
+==============================================================================*/
+void filter_Commit( Filter *pFilters,
+                    const char *headers,
+                    const unsigned char *body,
+                    size_t len )
+{
+    (void)filter_Run( pFilters, headers, body, len, true );
+}
+
+/*============================================================================*/
+/*  filter_Destroy                                                            */
+/*!
+    Destroy a filter chain
+
+    @param[in]
+        pFilters
+            pointer to the first filter in the chain, or NULL
+
+==============================================================================*/
+void filter_Destroy( Filter *pFilters )
+{
+    Filter *pFilter;
+    FilterStream *pStream;
+    size_t i;
+
+    while ( pFilters != NULL )
+    {
+        pFilter = pFilters;
+        pFilters = pFilter->pNext;
+
+        for ( i = 0; i < FILTER_BUCKETS; i++ )
+        {
+            while ( pFilter->buckets[i] != NULL )
+            {
+                pStream = pFilter->buckets[i];
+                pFilter->buckets[i] = pStream->pNext;
+                free( pStream->key );
+                free( pStream );
+            }
+        }
+
+        free( (char *)pFilter->def.keyProperty );
+        free( (char *)pFilter->def.valueProperty );
+        free( pFilter );
+    }
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  filter_Run                                                                */
+/*!
+    Evaluate or commit a message against a filter chain
+
+    The filter_Run function evaluates the filters in a chain in order,
+    indexing the message headers once if a filter needs a property.
+    When evaluating, it stops at the first filter which drops the
+    message.  When committing, every filter's state is updated.
+
+    @param[in]
+        pFilters
+            pointer to the first filter in the chain, or NULL
+
+    @param[in]
+        headers
+            pointer to the NUL terminated message headers
+
+    @param[in]
+        body
+            pointer to the message body, or NULL if it is streamed
+
+    @param[in]
+        len
+            length of the message body
+
+    @param[in]
+        commit
+            true to update the filter state for a sent message,
+            false to evaluate the message
+
+    @retval true the message passes every filter
+    @retval false the message was dropped by a filter
+
+==============================================================================*/
+static bool filter_Run( Filter *pFilters,
+                        const char *headers,
+                        const unsigned char *body,
+                        size_t len,
+                        bool commit )
+{
+    IOTCLIENT_HEADER_INDEX index;
+    bool indexed = false;
+    bool accept = true;
+    Filter *pFilter;
+
+    for ( pFilter = pFilters;
+          ( pFilter != NULL ) && ( ( accept == true ) || ( commit == true ) );
+          pFilter = pFilter->pNext )
+    {
+        if ( ( indexed == false ) &&
+             ( headers != NULL ) &&
+             ( ( pFilter->def.keyProperty != NULL ) ||
+               ( pFilter->def.valueProperty != NULL ) ) )
+        {
+            /* too many headers to index is not an error here */
+            (void)IOTCLIENT_IndexHeaders( headers, strlen( headers ), &index );
+            indexed = true;
+        }
+
+        accept = filter_Evaluate( pFilter,
+                                  indexed ? &index : NULL,
+                                  headers,
+                                  body,
+                                  len,
+                                  commit );
+    }
+
+    return accept;
+}
+
+/*============================================================================*/
+/*  filter_Evaluate                                                           */
+/*!
+    Evaluate a single filter
+
+    The filter_Evaluate function finds the message's stream and decides
+    whether the filter keeps the message.  The stream state is only
+    updated when a sent message is committed, except that an every nth
+    filter counts the messages it drops as it drops them.  Messages the
+    filter cannot evaluate, for example a deadband message without a
+    numeric value, are kept.
+
+    @param[in]
+        pFilter
+            pointer to the filter
+
+    @param[in]
+        pIndex
+            pointer to the message header index, or NULL if the filter
+            does not use properties
+
+    @param[in]
+        headers
+            pointer to the NUL terminated message headers
+
+    @param[in]
+        body
+            pointer to the message body, or NULL if it is streamed
+
+    @param[in]
+        len
+            length of the message body
+
+    @param[in]
+        commit
+            true to update the stream state for a sent message
+
+    @retval true the filter keeps the message
+    @retval false the filter drops the message
+
+==============================================================================*/
+static bool filter_Evaluate( Filter *pFilter,
+                             const IOTCLIENT_HEADER_INDEX *pIndex,
+                             const char *headers,
+                             const unsigned char *body,
+                             size_t len,
+                             bool commit )
+{
+    bool accept = true;
+    bool numeric;
+    FilterStream *pStream;
+    const char *key = "";
+    size_t keyLength = 0;
+    const char *p;
+    size_t n;
+    double now;
+    double tokens;
+    double value;
+    uint64_t hash;
+
+    if ( pFilter->def.type == IOTCLIENT_FILTER_CUSTOM )
+    {
+        /* the callback has no state to commit */
+        return ( commit == true ) ||
+               pFilter->def.cb( pFilter->def.ctx, headers, body, len );
+    }
+
+    if ( ( pFilter->def.keyProperty != NULL ) &&
+         ( filter_GetValue( pIndex,
+                            pFilter->keyId,
+                            pFilter->def.keyProperty,
+                            &key,
+                            &keyLength ) == false ) )
+    {
+        /* messages without the key property share a stream */
+        key = "";
+        keyLength = 0;
+    }
+
+    pStream = filter_GetStream( pFilter, key, keyLength );
+    if ( pStream == NULL )
+    {
+        /* without state the message cannot be filtered */
+        return true;
+    }
+
+    switch ( pFilter->def.type )
+    {
+        case IOTCLIENT_FILTER_RATE_LIMIT:
+            now = filter_Now();
+            n = ( pFilter->def.burst > 0 ) ? pFilter->def.burst : 1;
+            tokens = ( pStream->sent == false )
+                     ? n
+                     : pStream->tokens +
+                       ( now - pStream->last ) * pFilter->def.rate;
+            if ( tokens > n )
+            {
+                tokens = n;
+            }
+
+            accept = ( tokens >= 1.0 );
+            if ( commit == true )
+            {
+                pStream->tokens = tokens - 1.0;
+                pStream->last = now;
+                pStream->sent = true;
+            }
+            break;
+
+        case IOTCLIENT_FILTER_EVERY_NTH:
+            accept = ( pStream->count % pFilter->def.n ) == 0;
+            if ( ( commit == true ) || ( accept == false ) )
+            {
+                /* a dropped message counts as soon as it is dropped */
+                pStream->count++;
+            }
+            break;
+
+        case IOTCLIENT_FILTER_DEADBAND:
+            if ( pFilter->def.valueProperty != NULL )
+            {
+                numeric = filter_GetValue( pIndex,
+                                           pFilter->valueId,
+                                           pFilter->def.valueProperty,
+                                           &p,
+                                           &n ) &&
+                          filter_ParseNumber( p, n, &value );
+            }
+            else
+            {
+                numeric = ( body != NULL ) &&
+                          filter_ParseNumber( body, len, &value );
+            }
+
+            if ( numeric )
+            {
+                accept = ( pStream->sent == false ) ||
+                         ( fabs( value - pStream->value ) >=
+                           pFilter->def.epsilon );
+                if ( commit == true )
+                {
+                    pStream->value = value;
+                    pStream->sent = true;
+                }
+            }
+            break;
+
+        case IOTCLIENT_FILTER_DUPLICATE:
+            if ( body != NULL )
+            {
+                hash = filter_Hash( body, len );
+                accept = ( pStream->sent == false ) ||
+                         ( hash != pStream->hash );
+                if ( commit == true )
+                {
+                    pStream->hash = hash;
+                    pStream->sent = true;
+                }
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return accept;
+}
+
+/*============================================================================*/
+/*  filter_GetStream                                                          */
+/*!
+    Get a filter's state for a stream
+
+    The filter_GetStream function looks up the filter state for a stream
+    key, creating it if this is the first message on the stream.
+
+    @param[in]
+        pFilter
+            pointer to the filter
+
+    @param[in]
+        key
+            pointer to the stream key (not NUL terminated)
+
+    @param[in]
+        len
+            length of the stream key
+
+    @retval pointer to the stream state
+    @retval NULL if the stream state could not be allocated
+
+==============================================================================*/
+static FilterStream *filter_GetStream( Filter *pFilter,
+                                       const char *key,
+                                       size_t len )
+{
+    size_t bucket = filter_Hash( key, len ) % FILTER_BUCKETS;
+    FilterStream *pStream = pFilter->buckets[bucket];
+
+    while ( ( pStream != NULL ) &&
+            ( ( pStream->keyLength != len ) ||
+              ( memcmp( pStream->key, key, len ) != 0 ) ) )
+    {
+        pStream = pStream->pNext;
+    }
+
+    if ( pStream == NULL )
+    {
+        pStream = calloc( 1, sizeof( FilterStream ) );
+        if ( pStream != NULL )
+        {
+            pStream->key = strndup( key, len );
+            if ( pStream->key != NULL )
+            {
+                pStream->keyLength = len;
+                pStream->pNext = pFilter->buckets[bucket];
+                pFilter->buckets[bucket] = pStream;
+            }
+            else
+            {
+                free( pStream );
+                pStream = NULL;
+            }
+        }
+    }
+
+    return pStream;
+}
+
+/*============================================================================*/
+/*  filter_GetValue                                                           */
+/*!
+    Get a property value from a header index
+
+    @param[in]
+        pIndex
+            pointer to the header index, or NULL if there are no headers
+
+    @param[in]
+        id
+            id of the property, or IOTCLIENT_PROP_UNKNOWN
+
+    @param[in]
+        name
+            name of the property
+
+    @param[out]
+        ppValue
+            pointer to the location to store a pointer to the value
+
+    @param[out]
+        pLength
+            pointer to the location to store the value length
+
+    @retval true the property was found
+    @retval false the property was not found
+
+==============================================================================*/
+static bool filter_GetValue( const IOTCLIENT_HEADER_INDEX *pIndex,
+                             IOTCLIENT_PROPERTY_ID id,
+                             const char *name,
+                             const char **ppValue,
+                             size_t *pLength )
+{
+    bool found = false;
+    size_t nameLength = strlen( name );
+    size_t i;
+
+    if ( pIndex == NULL )
+    {
+        /* the message has no headers */
+    }
+    else if ( id != IOTCLIENT_PROP_UNKNOWN )
+    {
+        found = ( IOTCLIENT_GetPropertyById( pIndex,
+                                             id,
+                                             ppValue,
+                                             pLength ) == EOK );
+    }
+    else
+    {
+        for ( i = 0; ( found == false ) && ( i < pIndex->count ); i++ )
+        {
+            if ( ( pIndex->entries[i].nameLength == nameLength ) &&
+                 ( memcmp( pIndex->entries[i].name, name, nameLength ) == 0 ) )
+            {
+                *ppValue = pIndex->entries[i].value;
+                *pLength = pIndex->entries[i].valueLength;
+                found = true;
+            }
+        }
+    }
+
+    return found;
+}
+
+/*============================================================================*/
+/*  filter_ParseNumber                                                        */
+/*!
+    Parse a numeric value which is not NUL terminated
+
+    @param[in]
+        p
+            pointer to the value text
+
+    @param[in]
+        len
+            length of the value text
+
+    @param[out]
+        pValue
+            pointer to the location to store the value
+
+    @retval true the text starts with a number
+    @retval false the text is not numeric
+
+==============================================================================*/
+static bool filter_ParseNumber( const void *p, size_t len, double *pValue )
+{
+    char buf[MAX_VALUE_LENGTH + 1];
+    char *end;
+
+    if ( len > MAX_VALUE_LENGTH )
+    {
+        len = MAX_VALUE_LENGTH;
+    }
+
+    memcpy( buf, p, len );
+    buf[len] = '\0';
+
+    *pValue = strtod( buf, &end );
+
+    return ( end != buf ) && isfinite( *pValue );
+}
+
+/*============================================================================*/
+/*  filter_Hash                                                               */
+/*!
+    Calculate the 64-bit FNV-1a hash of a buffer
+
+    @param[in]
+        p
+            pointer to the buffer
+
+    @param[in]
+        len
+            length of the buffer
+
+    @retval hash of the buffer
+
+==============================================================================*/
+static uint64_t filter_Hash( const void *p, size_t len )
+{
+    const uint8_t *q = p;
+    uint64_t hash = HASH_BASIS;
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+    {
+        hash ^= q[i];
+        hash *= HASH_PRIME;
+    }
+
+    return hash;
+}
+
+/*============================================================================*/
+/*  filter_Now                                                                */
+/*!
+    Get the current monotonic time
+
+    @retval current monotonic time in seconds
+
+==============================================================================*/
+static double filter_Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return (double)ts.tv_sec + ( (double)ts.tv_nsec / 1e9 );
+}
+
+/*! @}
+ * end of the filter group */
@@ -0,0 +1,65 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef FILTER_H
+#define FILTER_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <iotclient/iotclient.h>
+
+/*==============================================================================
+        Public Definitions
+==============================================================================*/
+
+/*! opaque pointer to a pre-send filter */
+typedef struct _filter Filter;
+
+/*==============================================================================
+        Public Function Declarations
+==============================================================================*/
+
+/*! append a pre-send filter to a filter chain */
+int filter_Add( Filter **ppFilters, const IOTCLIENT_FILTER *pFilter );
+
+/*! check if a message passes every filter in a filter chain */
+bool filter_Accept( Filter *pFilters,
+                    const char *headers,
+                    const unsigned char *body,
+                    size_t len );
+
+/*! update a filter chain's state for a message which was sent */
+void filter_Commit( Filter *pFilters,
+                    const char *headers,
+                    const unsigned char *body,
+                    size_t len );
+
+/*! destroy a filter chain */
+void filter_Destroy( Filter *pFilters );
+
+#endif
@@ -0,0 +1,1353 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup headers headers
+ * @brief binary message header encoding
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file headers.c
+
+    Binary message header encoding
+
+    The binary header encoding is a compact alternative to the text
+    "name:value\n" message headers.  A binary header block consists of:
+
+    - the marker octet HEADERS_BINARY_MARKER
+    - the version octet HEADERS_BINARY_VERSION
+    - the varint length of the header entries which follow
+    - the header entries
+
+    Each header entry consists of a varint key, followed by a varint
+    value length and the value octets.  A non-zero key is the id of a
+    well-known property name.  A zero key is followed by the varint
+    length and octets of a property name which is not well-known.
+
+    Varints are unsigned LEB128: seven bits per octet, least significant
+    group first, with the top bit set on all but the last octet.
+
+    Since the header block carries its own length, the start of the
+    message body is found without scanning the headers, and each header
+    can be skipped without scanning its value.
+
+    Well-known property names are identified by IOTCLIENT_PROPERTY_ID
+    values, which are looked up with a perfect hash of the name.  Text
+    headers can be indexed in a single pass so that well-known properties
+    are retrieved by id in constant time.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+#include <iotclient/iotclient.h>
+#include "headers.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! maximum length of an encoded varint */
+#define MAX_VARINT_LENGTH 10
+
+/*! size of the binary header block marker and version */
+#define HEADERS_PREFIX_LENGTH 2
+
+/*! seed of the property name hash, chosen so that every well-known
+    property name hashes to a different slot of the hash table */
+#define PROPERTY_HASH_SEED 0x811C9DCEU
+
+/*! property name hash multiplier (the 32-bit FNV prime) */
+#define PROPERTY_HASH_PRIME 16777619U
+
+/*! number of bits in a property name hash table index */
+#define PROPERTY_HASH_BITS 6
+
+/*==============================================================================
+        Private type definitions
+==============================================================================*/
+
+/*! header index scan state */
+typedef struct _header_scan
+{
+    /*! headers being scanned */
+    const char *headers;
+
+    /*! header index being populated */
+    IOTCLIENT_HEADER_INDEX *pIndex;
+
+    /*! offset of the start of the current line */
+    size_t lineStart;
+
+    /*! offset of the first colon in the current line */
+    size_t sep;
+
+    /*! indicates a colon has been found in the current line */
+    bool sepFound;
+
+    /*! indicates the end of the headers has been reached */
+    bool done;
+
+    /*! scan result */
+    int result;
+} HeaderScan;
+
+/*! header delimiter scanner.  Calls headers_OnDelimiter for every
+    newline, colon and NUL in the headers from offset start, in order,
+    until it returns false or the offset len is reached */
+typedef void (*HeaderScanner)( HeaderScan *pScan, size_t start, size_t len );
+
+/*==============================================================================
+        Private file scoped variables
+==============================================================================*/
+
+/*! well-known property names, indexed by their IOTCLIENT_PROPERTY_ID.
+    The ids are part of the wire format, so new names must only be added
+    to the end, and the property name hash table must be regenerated */
+static const char *headerNames[IOTCLIENT_PROP_COUNT] =
+{
+    NULL,
+    "content-type",
+    "content-encoding",
+    "message-id",
+    "correlation-id",
+    "user-id",
+    "to",
+    "expiry-time-utc",
+    "creation-time-utc",
+    "iothub-connection-device-id",
+    "iothub-connection-module-id",
+    "iothub-connection-auth-method",
+    "iothub-connection-auth-generation-id",
+    "iothub-enqueuedtime",
+    "iothub-creation-time-utc",
+    "iothub-message-source",
+    "iothub-message-schema",
+    "iothub-interface-id",
+    "iothub-ack",
+    "dt-dataschema",
+    "dt-subject",
+    "lock-token",
+    "sequence-number"
+};
+
+/*! perfect hash table mapping the property name hash to the id of the
+    well-known property name with that hash, or 0 if there is none.
+    Generated offline by searching for a PROPERTY_HASH_SEED which gives
+    every name in headerNames a distinct slot */
+static const uint8_t propertyHashTable[1 << PROPERTY_HASH_BITS] =
+{
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 20,  0, 13,  1,
+     6,  0,  0,  0,  0,  0,  5, 12,  9,  0,  0,  0,  0,  0,  0,  0,
+    10,  0,  8,  0,  0,  0,  0,  7, 19,  0,  0, 18, 21,  0,  0, 22,
+     0,  0,  0,  4, 15,  0,  0, 17,  2, 11,  0, 16,  3,  0,  0, 14
+};
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static size_t headers_PutVarint( uint8_t *buf, uint64_t value );
+static size_t headers_VarintLength( uint64_t value );
+static size_t headers_GetVarint( const uint8_t *buf,
+                                 size_t len,
+                                 uint64_t *pValue );
+static uint32_t headers_Hash( const char *name, size_t len );
+static bool headers_OnDelimiter( HeaderScan *pScan, size_t pos );
+static void headers_AddEntry( HeaderScan *pScan, size_t end );
+static void headers_ScanScalar( HeaderScan *pScan,
+                                size_t start,
+                                size_t len );
+#if defined(__x86_64__) || defined(__i386__)
+static void headers_ScanSSE2( HeaderScan *pScan,
+                              size_t start,
+                              size_t len );
+static void headers_ScanAVX2( HeaderScan *pScan,
+                              size_t start,
+                              size_t len );
+#endif
+static int headers_PutEntry( uint8_t *buf,
+                             size_t size,
+                             size_t *pOffset,
+                             const char *name,
+                             size_t nameLength,
+                             const char *value,
+                             size_t valueLength );
+
+/*! header delimiter scanner selected for the CPU */
+static HeaderScanner headerScanner = headers_ScanScalar;
+
+/*==============================================================================
+        Function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  headers_SelectScanner                                                     */
+/*!
+    Select the header delimiter scanner for the CPU
+
+    The headers_SelectScanner function is called when the library is
+    loaded, and selects the widest vector implementation of the header
+    delimiter scanner which the CPU supports.
+
+==============================================================================*/
+static void __attribute__ ((constructor)) headers_SelectScanner( void )
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if ( __builtin_cpu_supports( "avx2" ) )
+    {
+        headerScanner = headers_ScanAVX2;
+    }
+    else if ( __builtin_cpu_supports( "sse2" ) )
+    {
+        headerScanner = headers_ScanSSE2;
+    }
+#endif
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_EncodeHeaders                                                   */
+/*!
+    Encode text message headers using the binary header encoding
+
+    The IOTCLIENT_EncodeHeaders function converts message headers in the
+    text "name:value\n" format into a binary header block.  Encoding stops
+    at the end of the string or at the first empty line.
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[out]
+        buf
+            pointer to the buffer to store the binary header block in
+
+    @param[in]
+        size
+            size of the buffer
+
+    @param[out]
+        pLength
+            pointer to the location to store the length of the header block
+
+    @retval EOK the headers were encoded
+    @retval EINVAL invalid arguments, or a header line has no ':' separator
+    @retval EMSGSIZE the header block does not fit in the buffer
+
+==============================================================================*/
+int IOTCLIENT_EncodeHeaders( const char *headers,
+                             void *buf,
+                             size_t size,
+                             size_t *pLength )
+{
+    int result = EINVAL;
+    uint8_t *p = buf;
+    const char *line;
+    const char *end;
+    const char *sep;
+    size_t offset = HEADERS_PREFIX_LENGTH + MAX_VARINT_LENGTH;
+    size_t n;
+
+    if ( ( headers != NULL ) &&
+         ( buf != NULL ) &&
+         ( pLength != NULL ) )
+    {
+        /* leave room for the prefix and the longest block length */
+        result = ( size >= offset ) ? EOK : EMSGSIZE;
+
+        line = headers;
+        while ( ( result == EOK ) &&
+                ( *line != '\0' ) &&
+                ( *line != '\n' ) )
+        {
+            end = strchr( line, '\n' );
+            if ( end == NULL )
+            {
+                end = line + strlen( line );
+            }
+
+            sep = memchr( line, ':', end - line );
+            if ( sep != NULL )
+            {
+                result = headers_PutEntry( p,
+                                           size,
+                                           &offset,
+                                           line,
+                                           sep - line,
+                                           sep + 1,
+                                           end - sep - 1 );
+            }
+            else
+            {
+                result = EINVAL;
+            }
+
+            line = ( *end == '\n' ) ? end + 1 : end;
+        }
+
+        if ( result == EOK )
+        {
+            /* move the entries down behind the actual block length */
+            p[0] = HEADERS_BINARY_MARKER;
+            p[1] = HEADERS_BINARY_VERSION;
+            n = headers_PutVarint( &p[HEADERS_PREFIX_LENGTH],
+                                   offset - HEADERS_PREFIX_LENGTH
+                                          - MAX_VARINT_LENGTH );
+            memmove( &p[HEADERS_PREFIX_LENGTH + n],
+                     &p[HEADERS_PREFIX_LENGTH + MAX_VARINT_LENGTH],
+                     offset - HEADERS_PREFIX_LENGTH - MAX_VARINT_LENGTH );
+
+            *pLength = offset - MAX_VARINT_LENGTH + n;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_DecodeHeaders                                                   */
+/*!
+    Decode a binary header block into text message headers
+
+    The IOTCLIENT_DecodeHeaders function converts a binary header block
+    into the text format returned by IOTCLIENT_Receive: "name:value"
+    lines separated by newlines, and terminated with a NUL character.
+
+    The text length is always reported, so the function can be called
+    with a NULL text buffer to find the buffer size required.
+
+    @param[in]
+        buf
+            pointer to the binary header block
+
+    @param[in]
+        len
+            number of octets available in the buffer.  This may include
+            data following the header block, eg. the message body
+
+    @param[out]
+        headers
+            pointer to the buffer to store the text headers in, or NULL
+
+    @param[in]
+        size
+            size of the text headers buffer
+
+    @param[out]
+        pHeaderLength
+            pointer to the location to store the length of the text headers
+            excluding the NUL terminator, or NULL if not required
+
+    @param[out]
+        pEncodedLength
+            pointer to the location to store the length of the binary
+            header block, or NULL if not required
+
+    @retval EOK the headers were decoded
+    @retval EINVAL invalid arguments
+    @retval EBADMSG the buffer does not contain a valid header block
+    @retval ENOMEM the text headers do not fit in the buffer
+
+==============================================================================*/
+int IOTCLIENT_DecodeHeaders( const void *buf,
+                             size_t len,
+                             char *headers,
+                             size_t size,
+                             size_t *pHeaderLength,
+                             size_t *pEncodedLength )
+{
+    int result = EINVAL;
+    const uint8_t *p = buf;
+    uint64_t blockLength;
+    uint64_t key;
+    uint64_t length;
+    const char *name = NULL;
+    size_t nameLength = 0;
+    size_t offset = 0;
+    size_t end = 0;
+    size_t total = 0;
+    size_t n;
+    bool overflow = ( headers == NULL );
+
+    if ( buf == NULL )
+    {
+        return EINVAL;
+    }
+
+    result = headers_IsBinary( buf, len ) ? EOK : EBADMSG;
+    if ( result == EOK )
+    {
+        n = headers_GetVarint( &p[HEADERS_PREFIX_LENGTH],
+                               len - HEADERS_PREFIX_LENGTH,
+                               &blockLength );
+        offset = HEADERS_PREFIX_LENGTH + n;
+        if ( ( n == 0 ) || ( blockLength > len - offset ) )
+        {
+            result = EBADMSG;
+        }
+
+        end = offset + blockLength;
+    }
+
+    while ( ( result == EOK ) && ( offset < end ) )
+    {
+        /* property name */
+        n = headers_GetVarint( &p[offset], end - offset, &key );
+        offset += n;
+        if ( n == 0 )
+        {
+            result = EBADMSG;
+        }
+        else if ( key == 0 )
+        {
+            n = headers_GetVarint( &p[offset], end - offset, &length );
+            offset += n;
+            if ( ( n == 0 ) || ( length > end - offset ) )
+            {
+                result = EBADMSG;
+            }
+            else
+            {
+                name = (const char *)&p[offset];
+                nameLength = length;
+                offset += length;
+            }
+        }
+        else if ( key < IOTCLIENT_PROP_COUNT )
+        {
+            name = headerNames[key];
+            nameLength = strlen( name );
+        }
+        else
+        {
+            result = EBADMSG;
+        }
+
+        /* property value */
+        if ( result == EOK )
+        {
+            n = headers_GetVarint( &p[offset], end - offset, &length );
+            offset += n;
+            if ( ( n == 0 ) || ( length > end - offset ) )
+            {
+                result = EBADMSG;
+            }
+        }
+
+        if ( result == EOK )
+        {
+            /* newline separator, name, colon and value */
+            n = ( ( total > 0 ) ? 1 : 0 ) + nameLength + 1 + length;
+            if ( total + n >= size )
+            {
+                /* keep counting to report the size required */
+                overflow = true;
+            }
+
+            if ( overflow == false )
+            {
+                if ( total > 0 )
+                {
+                    headers[total++] = '\n';
+                }
+
+                memcpy( &headers[total], name, nameLength );
+                total += nameLength;
+                headers[total++] = ':';
+                memcpy( &headers[total], &p[offset], length );
+                total += length;
+            }
+            else
+            {
+                total += n;
+            }
+
+            offset += length;
+        }
+    }
+
+    if ( result == EOK )
+    {
+        if ( headers != NULL )
+        {
+            if ( overflow == false )
+            {
+                headers[total] = '\0';
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+
+        if ( pHeaderLength != NULL )
+        {
+            *pHeaderLength = total;
+        }
+
+        if ( pEncodedLength != NULL )
+        {
+            *pEncodedLength = end;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetPropertyId                                                   */
+/*!
+    Look up the id of a well-known property name
+
+    The IOTCLIENT_GetPropertyId function maps a property name to its
+    well-known property id using a perfect hash, so the lookup costs
+    one hash of the name and at most one string comparison.
+
+    @param[in]
+        name
+            pointer to the property name
+
+    @param[in]
+        len
+            length of the property name
+
+    @retval id of the well-known property name
+    @retval IOTCLIENT_PROP_UNKNOWN if the property name is not well-known
+
+==============================================================================*/
+IOTCLIENT_PROPERTY_ID IOTCLIENT_GetPropertyId( const char *name, size_t len )
+{
+    IOTCLIENT_PROPERTY_ID id = IOTCLIENT_PROP_UNKNOWN;
+    uint8_t candidate;
+
+    if ( name != NULL )
+    {
+        candidate = propertyHashTable[headers_Hash( name, len )];
+        if ( ( candidate != 0 ) &&
+             ( strncmp( headerNames[candidate], name, len ) == 0 ) &&
+             ( headerNames[candidate][len] == '\0' ) )
+        {
+            id = (IOTCLIENT_PROPERTY_ID)candidate;
+        }
+    }
+
+    return id;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetPropertyName                                                 */
+/*!
+    Get the name of a well-known property
+
+    @param[in]
+        id
+            well-known property id
+
+    @retval pointer to the NUL terminated property name
+    @retval NULL if the id is not a well-known property id
+
+==============================================================================*/
+const char *IOTCLIENT_GetPropertyName( IOTCLIENT_PROPERTY_ID id )
+{
+    return ( ( id > IOTCLIENT_PROP_UNKNOWN ) && ( id < IOTCLIENT_PROP_COUNT ) )
+            ? headerNames[id]
+            : NULL;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_AppendProperty                                                  */
+/*!
+    Append a well-known property to text message headers
+
+    The IOTCLIENT_AppendProperty function appends a "name:value\n" line
+    for a well-known property to a NUL terminated text header buffer,
+    so callers building headers do not need to spell out the names.
+
+    @param[in,out]
+        buf
+            pointer to the header buffer
+
+    @param[in]
+        size
+            size of the header buffer
+
+    @param[in,out]
+        pLength
+            pointer to the current length of the headers in the buffer,
+            which is updated with the new length
+
+    @param[in]
+        id
+            well-known property id
+
+    @param[in]
+        value
+            pointer to the NUL terminated property value
+
+    @retval EOK the property was appended
+    @retval EINVAL invalid arguments or an unknown property id
+    @retval EMSGSIZE the property does not fit in the buffer
+
+==============================================================================*/
+int IOTCLIENT_AppendProperty( char *buf,
+                              size_t size,
+                              size_t *pLength,
+                              IOTCLIENT_PROPERTY_ID id,
+                              const char *value )
+{
+    int result = EINVAL;
+    const char *name = IOTCLIENT_GetPropertyName( id );
+    size_t nameLength;
+    size_t valueLength;
+    size_t offset;
+
+    if ( ( buf != NULL ) &&
+         ( pLength != NULL ) &&
+         ( name != NULL ) &&
+         ( value != NULL ) )
+    {
+        offset = *pLength;
+        nameLength = strlen( name );
+        valueLength = strlen( value );
+
+        /* name, colon, value, newline and NUL terminator */
+        if ( ( offset < size ) &&
+             ( nameLength + valueLength + 3 <= size - offset ) )
+        {
+            memcpy( &buf[offset], name, nameLength );
+            offset += nameLength;
+            buf[offset++] = ':';
+            memcpy( &buf[offset], value, valueLength );
+            offset += valueLength;
+            buf[offset++] = '\n';
+            buf[offset] = '\0';
+
+            *pLength = offset;
+            result = EOK;
+        }
+        else
+        {
+            result = EMSGSIZE;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_IndexHeaders                                                    */
+/*!
+    Build an index of text message headers
+
+    The IOTCLIENT_IndexHeaders function scans text message headers once,
+    recording the location of each property name and value, and the
+    entry of the first occurrence of each well-known property so it can
+    be retrieved in constant time with IOTCLIENT_GetPropertyById.
+    Scanning stops at the first empty line, a NUL character or after
+    len characters.  All len characters must be readable.
+
+    The newline, colon and NUL delimiters are located with SSE2 or AVX2
+    vector compares where the CPU supports them, 16 or 32 characters at
+    a time, so long header sections are not examined character by
+    character.
+
+    The index refers to the header text, which must remain unchanged
+    while the index is in use.
+
+    @param[in]
+        headers
+            pointer to the text message headers
+
+    @param[in]
+        len
+            maximum number of characters to scan
+
+    @param[out]
+        pIndex
+            pointer to the header index to populate
+
+    @retval EOK the headers were indexed
+    @retval EINVAL invalid arguments
+    @retval E2BIG there are more than IOTCLIENT_MAX_INDEXED_HEADERS headers.
+            The first IOTCLIENT_MAX_INDEXED_HEADERS are indexed
+
+==============================================================================*/
+int IOTCLIENT_IndexHeaders( const char *headers,
+                            size_t len,
+                            IOTCLIENT_HEADER_INDEX *pIndex )
+{
+    int result = EINVAL;
+    HeaderScan scan;
+
+    if ( ( headers != NULL ) &&
+         ( pIndex != NULL ) )
+    {
+        memset( pIndex, 0, sizeof( IOTCLIENT_HEADER_INDEX ) );
+        memset( &scan, 0, sizeof( scan ) );
+        scan.headers = headers;
+        scan.pIndex = pIndex;
+        scan.result = EOK;
+
+        headerScanner( &scan, 0, len );
+
+        if ( ( scan.done == false ) &&
+             ( scan.sepFound == true ) )
+        {
+            /* the last header is terminated by the end of the buffer */
+            headers_AddEntry( &scan, len );
+        }
+
+        result = scan.result;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetPropertyById                                                 */
+/*!
+    Get the value of a well-known property from a header index
+
+    @param[in]
+        pIndex
+            pointer to the header index built by IOTCLIENT_IndexHeaders
+
+    @param[in]
+        id
+            well-known property id
+
+    @param[out]
+        ppValue
+            pointer to the location to store a pointer to the value.
+            The value is not NUL terminated
+
+    @param[out]
+        pLength
+            pointer to the location to store the value length
+
+    @retval EOK the property value was retrieved
+    @retval EINVAL invalid arguments
+    @retval ENOENT the property is not in the headers
+
+==============================================================================*/
+int IOTCLIENT_GetPropertyById( const IOTCLIENT_HEADER_INDEX *pIndex,
+                               IOTCLIENT_PROPERTY_ID id,
+                               const char **ppValue,
+                               size_t *pLength )
+{
+    int result = EINVAL;
+    const IOTCLIENT_HEADER_ENTRY *pEntry;
+
+    if ( ( pIndex != NULL ) &&
+         ( id > IOTCLIENT_PROP_UNKNOWN ) &&
+         ( id < IOTCLIENT_PROP_COUNT ) &&
+         ( ppValue != NULL ) &&
+         ( pLength != NULL ) )
+    {
+        if ( pIndex->byId[id] != 0 )
+        {
+            pEntry = &pIndex->entries[pIndex->byId[id] - 1];
+            *ppValue = pEntry->value;
+            *pLength = pEntry->valueLength;
+            result = EOK;
+        }
+        else
+        {
+            result = ENOENT;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  headers_OnDelimiter                                                       */
+/*!
+    Process a header delimiter
+
+    The headers_OnDelimiter function advances the header index scan
+    state for a newline, colon or NUL character found by a scanner.
+    The first colon in a line separates the name from the value, and a
+    newline or NUL ends the line.  An empty line or a NUL ends the scan.
+
+    @param[in]
+        pScan
+            pointer to the scan state
+
+    @param[in]
+        pos
+            offset of the delimiter in the headers
+
+    @retval true continue scanning
+    @retval false the scan is complete
+
+==============================================================================*/
+static bool headers_OnDelimiter( HeaderScan *pScan, size_t pos )
+{
+    char c = pScan->headers[pos];
+
+    if ( c == ':' )
+    {
+        if ( pScan->sepFound == false )
+        {
+            pScan->sep = pos;
+            pScan->sepFound = true;
+        }
+    }
+    else if ( pos == pScan->lineStart )
+    {
+        /* an empty line ends the headers */
+        pScan->done = true;
+    }
+    else
+    {
+        if ( pScan->sepFound == true )
+        {
+            headers_AddEntry( pScan, pos );
+        }
+
+        pScan->lineStart = pos + 1;
+        pScan->sepFound = false;
+
+        if ( c == '\0' )
+        {
+            pScan->done = true;
+        }
+    }
+
+    return ( pScan->done == false );
+}
+
+/*============================================================================*/
+/*  headers_AddEntry                                                          */
+/*!
+    Add the current line to the header index
+
+    @param[in]
+        pScan
+            pointer to the scan state
+
+    @param[in]
+        end
+            offset of the end of the current line
+
+==============================================================================*/
+static void headers_AddEntry( HeaderScan *pScan, size_t end )
+{
+    IOTCLIENT_HEADER_INDEX *pIndex = pScan->pIndex;
+    IOTCLIENT_HEADER_ENTRY *pEntry;
+
+    if ( pIndex->count == IOTCLIENT_MAX_INDEXED_HEADERS )
+    {
+        pScan->result = E2BIG;
+        pScan->done = true;
+    }
+    else
+    {
+        pEntry = &pIndex->entries[pIndex->count++];
+        pEntry->name = &pScan->headers[pScan->lineStart];
+        pEntry->nameLength = pScan->sep - pScan->lineStart;
+        pEntry->value = &pScan->headers[pScan->sep + 1];
+        pEntry->valueLength = end - pScan->sep - 1;
+        pEntry->id = IOTCLIENT_GetPropertyId( pEntry->name,
+                                              pEntry->nameLength );
+
+        if ( ( pEntry->id != IOTCLIENT_PROP_UNKNOWN ) &&
+             ( pIndex->byId[pEntry->id] == 0 ) )
+        {
+            pIndex->byId[pEntry->id] = pIndex->count;
+        }
+    }
+}
+
+/*============================================================================*/
+/*  headers_ScanScalar                                                        */
+/*!
+    Scan the header delimiters one character at a time
+
+    @param[in]
+        pScan
+            pointer to the scan state
+
+    @param[in]
+        start
+            offset to start scanning from
+
+    @param[in]
+        len
+            offset to stop scanning at
+
+==============================================================================*/
+static void headers_ScanScalar( HeaderScan *pScan,
+                                size_t start,
+                                size_t len )
+{
+    const char *p = pScan->headers;
+    size_t i;
+
+    for ( i = start; i < len; i++ )
+    {
+        if ( ( ( p[i] == '\n' ) || ( p[i] == ':' ) || ( p[i] == '\0' ) ) &&
+             ( headers_OnDelimiter( pScan, i ) == false ) )
+        {
+            break;
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+/*============================================================================*/
+/*  headers_ScanSSE2                                                          */
+/*!
+    Scan the header delimiters 16 characters at a time using SSE2
+
+    Each block of 16 characters is compared against the three delimiters,
+    and the resulting bit mask is walked to visit the delimiters in
+    order.  The remaining characters are scanned one at a time.
+
+    @param[in]
+        pScan
+            pointer to the scan state
+
+    @param[in]
+        start
+            offset to start scanning from
+
+    @param[in]
+        len
+            offset to stop scanning at
+
+==============================================================================*/
+__attribute__ ((target("sse2")))
+static void headers_ScanSSE2( HeaderScan *pScan,
+                              size_t start,
+                              size_t len )
+{
+    const char *p = pScan->headers;
+    const __m128i newline = _mm_set1_epi8( '\n' );
+    const __m128i colon = _mm_set1_epi8( ':' );
+    const __m128i nul = _mm_setzero_si128();
+    __m128i v;
+    uint32_t mask;
+    size_t i;
+
+    for ( i = start; i + 16 <= len; i += 16 )
+    {
+        v = _mm_loadu_si128( (const __m128i *)&p[i] );
+        mask = (uint32_t)_mm_movemask_epi8(
+                    _mm_or_si128( _mm_or_si128( _mm_cmpeq_epi8( v, newline ),
+                                                _mm_cmpeq_epi8( v, colon ) ),
+                                  _mm_cmpeq_epi8( v, nul ) ) );
+        while ( mask != 0 )
+        {
+            if ( headers_OnDelimiter( pScan,
+                                      i + __builtin_ctz( mask ) ) == false )
+            {
+                return;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+
+    /* scan the remaining characters one at a time */
+    headers_ScanScalar( pScan, i, len );
+}
+
+/*============================================================================*/
+/*  headers_ScanAVX2                                                          */
+/*!
+    Scan the header delimiters 32 characters at a time using AVX2
+
+    As per headers_ScanSSE2, using 32 character blocks.
+
+    @param[in]
+        pScan
+            pointer to the scan state
+
+    @param[in]
+        start
+            offset to start scanning from
+
+    @param[in]
+        len
+            offset to stop scanning at
+
+==============================================================================*/
+__attribute__ ((target("avx2")))
+static void headers_ScanAVX2( HeaderScan *pScan,
+                              size_t start,
+                              size_t len )
+{
+    const char *p = pScan->headers;
+    const __m256i newline = _mm256_set1_epi8( '\n' );
+    const __m256i colon = _mm256_set1_epi8( ':' );
+    const __m256i nul = _mm256_setzero_si256();
+    __m256i v;
+    uint32_t mask;
+    size_t i;
+
+    for ( i = start; i + 32 <= len; i += 32 )
+    {
+        v = _mm256_loadu_si256( (const __m256i *)&p[i] );
+        mask = (uint32_t)_mm256_movemask_epi8(
+                    _mm256_or_si256(
+                        _mm256_or_si256( _mm256_cmpeq_epi8( v, newline ),
+                                         _mm256_cmpeq_epi8( v, colon ) ),
+                        _mm256_cmpeq_epi8( v, nul ) ) );
+        while ( mask != 0 )
+        {
+            if ( headers_OnDelimiter( pScan,
+                                      i + __builtin_ctz( mask ) ) == false )
+            {
+                return;
+            }
+
+            mask &= mask - 1;
+        }
+    }
+
+    /* the SSE2 scanner handles the remaining characters */
+    headers_ScanSSE2( pScan, i, len );
+}
+
+#endif
+
+/*============================================================================*/
+/*  headers_IsBinary                                                          */
+/*!
+    Check if a buffer starts with a binary header block
+
+    @param[in]
+        buf
+            pointer to the buffer
+
+    @param[in]
+        len
+            number of octets in the buffer
+
+    @retval true the buffer starts with a binary header block prefix
+    @retval false the buffer does not start with a binary header block
+
+==============================================================================*/
+bool headers_IsBinary( const void *buf, size_t len )
+{
+    const uint8_t *p = buf;
+
+    return ( p != NULL ) &&
+           ( len > HEADERS_PREFIX_LENGTH ) &&
+           ( p[0] == HEADERS_BINARY_MARKER ) &&
+           ( p[1] == HEADERS_BINARY_VERSION );
+}
+
+/*============================================================================*/
+/*  headers_GetFramedLength                                                   */
+/*!
+    Get the header length of a length-framed message
+
+    The headers_GetFramedLength function reads the explicit header
+    length from the prefix of a length-framed message, and checks
+    that the header text fits within the received octets.  Only the
+    prefix is examined, so the body is never scanned.
+
+    @param[in]
+        buf
+            pointer to the received message
+
+    @param[in]
+        len
+            number of octets received
+
+    @param[out]
+        pHeaderLength
+            pointer to the location to store the header text length
+
+    @retval EOK the message is length-framed
+    @retval EBADMSG the message is not length-framed or is truncated
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int headers_GetFramedLength( const void *buf,
+                             size_t len,
+                             size_t *pHeaderLength )
+{
+    int result = EINVAL;
+    const uint8_t *p = buf;
+    size_t headerLength;
+
+    if ( ( p != NULL ) && ( pHeaderLength != NULL ) )
+    {
+        result = EBADMSG;
+
+        if ( ( len >= HEADERS_FRAMED_PREFIX_LENGTH ) &&
+             ( p[0] == HEADERS_BINARY_MARKER ) &&
+             ( p[1] == HEADERS_FRAMED_VERSION ) )
+        {
+            headerLength = ( (size_t)p[2] << 24 ) |
+                           ( (size_t)p[3] << 16 ) |
+                           ( (size_t)p[4] << 8 ) |
+                           (size_t)p[5];
+
+            if ( headerLength <= len - HEADERS_FRAMED_PREFIX_LENGTH )
+            {
+                *pHeaderLength = headerLength;
+                result = EOK;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  headers_PutEntry                                                          */
+/*!
+    Append a header entry to a binary header block
+
+    @param[in]
+        buf
+            pointer to the binary header block buffer
+
+    @param[in]
+        size
+            size of the buffer
+
+    @param[in,out]
+        pOffset
+            pointer to the offset at which to write the entry, which is
+            advanced past the entry
+
+    @param[in]
+        name
+            pointer to the property name
+
+    @param[in]
+        nameLength
+            length of the property name
+
+    @param[in]
+        value
+            pointer to the property value
+
+    @param[in]
+        valueLength
+            length of the property value
+
+    @retval EOK the entry was appended
+    @retval EMSGSIZE the entry does not fit in the buffer
+
+==============================================================================*/
+static int headers_PutEntry( uint8_t *buf,
+                             size_t size,
+                             size_t *pOffset,
+                             const char *name,
+                             size_t nameLength,
+                             const char *value,
+                             size_t valueLength )
+{
+    int result = EMSGSIZE;
+    size_t offset = *pOffset;
+    uint64_t key;
+
+    size_t n;
+
+    key = IOTCLIENT_GetPropertyId( name, nameLength );
+
+    n = headers_VarintLength( key ) +
+        headers_VarintLength( valueLength ) +
+        valueLength;
+    if ( key == 0 )
+    {
+        n += headers_VarintLength( nameLength ) + nameLength;
+    }
+
+    if ( n <= size - offset )
+    {
+        offset += headers_PutVarint( &buf[offset], key );
+        if ( key == 0 )
+        {
+            offset += headers_PutVarint( &buf[offset], nameLength );
+            memcpy( &buf[offset], name, nameLength );
+            offset += nameLength;
+        }
+
+        offset += headers_PutVarint( &buf[offset], valueLength );
+        memcpy( &buf[offset], value, valueLength );
+        offset += valueLength;
+
+        *pOffset = offset;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  headers_Hash                                                              */
+/*!
+    Hash a property name
+
+    The headers_Hash function calculates the property name hash table
+    index of a property name using the FNV-1a hash.  The top bits of
+    the hash are used since they depend on every octet of the name.
+
+    @param[in]
+        name
+            pointer to the property name
+
+    @param[in]
+        len
+            length of the property name
+
+    @retval property name hash table index
+
+==============================================================================*/
+static uint32_t headers_Hash( const char *name, size_t len )
+{
+    uint32_t hash = PROPERTY_HASH_SEED;
+    size_t i;
+
+    for ( i = 0; i < len; i++ )
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= PROPERTY_HASH_PRIME;
+    }
+
+    return hash >> ( 32 - PROPERTY_HASH_BITS );
+}
+
+/*============================================================================*/
+/*  headers_PutVarint                                                         */
+/*!
+    Encode a varint
+
+    @param[out]
+        buf
+            pointer to the buffer, which must have room for
+            MAX_VARINT_LENGTH octets
+
+    @param[in]
+        value
+            value to encode
+
+    @retval number of octets written
+
+==============================================================================*/
+static size_t headers_PutVarint( uint8_t *buf, uint64_t value )
+{
+    size_t n = 0;
+
+    while ( value >= 0x80 )
+    {
+        buf[n++] = (uint8_t)( value | 0x80 );
+        value >>= 7;
+    }
+
+    buf[n++] = (uint8_t)value;
+
+    return n;
+}
+
+/*============================================================================*/
+/*  headers_VarintLength                                                      */
+/*!
+    Get the encoded length of a varint
+
+    @param[in]
+        value
+            value to encode
+
+    @retval number of octets needed to encode the value
+
+==============================================================================*/
+static size_t headers_VarintLength( uint64_t value )
+{
+    size_t n = 1;
+
+    while ( value >= 0x80 )
+    {
+        value >>= 7;
+        n++;
+    }
+
+    return n;
+}
+
+/*============================================================================*/
+/*  headers_GetVarint                                                         */
+/*!
+    Decode a varint
+
+    @param[in]
+        buf
+            pointer to the encoded varint
+
+    @param[in]
+        len
+            number of octets available
+
+    @param[out]
+        pValue
+            pointer to the location to store the decoded value
+
+    @retval number of octets consumed
+    @retval 0 if the varint is truncated or too long
+
+==============================================================================*/
+static size_t headers_GetVarint( const uint8_t *buf,
+                                 size_t len,
+                                 uint64_t *pValue )
+{
+    uint64_t value = 0;
+    size_t n = 0;
+
+    while ( ( n < len ) && ( n < MAX_VARINT_LENGTH ) )
+    {
+        value |= (uint64_t)( buf[n] & 0x7F ) << ( 7 * n );
+        if ( ( buf[n++] & 0x80 ) == 0 )
+        {
+            *pValue = value;
+            return n;
+        }
+    }
+
+    return 0;
+}
+
+/*! @}
+ * end of the headers group */
@@ -0,0 +1,66 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef HEADERS_H
+#define HEADERS_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdbool.h>
+
+/*==============================================================================
+        Public Definitions
+==============================================================================*/
+
+/*! first octet of a binary header block.  Text headers never start
+    with a NUL character, so the encodings can be told apart */
+#define HEADERS_BINARY_MARKER 0x00
+
+/*! binary header encoding version */
+#define HEADERS_BINARY_VERSION 0x01
+
+/*! second octet of a length-framed text header block.  The marker and
+    version are followed by a 32-bit big-endian header length, the
+    header text, and then the body */
+#define HEADERS_FRAMED_VERSION 0x02
+
+/*! number of octets preceding the header text in a framed message */
+#define HEADERS_FRAMED_PREFIX_LENGTH 6
+
+/*==============================================================================
+        Public Function Declarations
+==============================================================================*/
+
+/*! check if a buffer starts with a binary header block */
+bool headers_IsBinary( const void *buf, size_t len );
+
+/*! get the header length of a length-framed message */
+int headers_GetFramedLength( const void *buf,
+                             size_t len,
+                             size_t *pHeaderLength );
+
+#endif
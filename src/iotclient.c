@@ -57,13 +57,32 @@ SOFTWARE.
 #include <sys/mman.h>
 #include <sys/syslog.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <time.h>
 #include <fcntl.h>
 #include <mqueue.h>
 #include <errno.h>
 #include <semaphore.h>
 #include <string.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include <iotclient/iotclient.h>
+#include "iouring.h"
+#include "headers.h"
+#include "filter.h"
+#include "ratelimit.h"
+#include "checkpoint.h"
+#include "digest.h"
 
 /*==============================================================================
         Private definitions
@@ -72,13 +91,468 @@ SOFTWARE.
 /*! message queue name */
 #define MESSAGE_QUEUE_NAME "/iothub"
 
+/*! directory in which the message body FIFOs are created */
+#define FIFO_DIRECTORY "/tmp"
+
+/*! message preamble identifier for channel 0 clients */
+#define PREAMBLE_ID "IOTC"
+
+/*! extended message preamble identifier used by all other channels */
+#define PREAMBLE_ID_EXTENDED "IOTX"
+
+/*! sequenced message preamble identifier used by clients which
+    have an in-flight window */
+#define PREAMBLE_ID_SEQUENCED "IOTS"
+
+/*! trailer message preamble identifier, used for the message which
+    follows a streamed message body with its trailers */
+#define PREAMBLE_ID_TRAILER "IOTT"
+
+/*! known length message preamble identifier, used instead of the other
+    preambles by IOTCLIENT_OPT_BODY_LENGTH clients when the length of
+    the message body is known before it is sent */
+#define PREAMBLE_ID_LENGTH "IOTL"
+
+/*! known length preamble flag: the message carries a sequence number */
+#define PREAMBLE_FLAG_SEQUENCED ( 1U << 0 )
+
+/*! acknowledgement message identifier */
+#define ACK_ID "IOTA"
+
+/*! maximum number of acknowledgements queued by the IOT Hub service */
+#define ACK_QUEUE_DEPTH 10
+
+/*! largest in-flight window which can be rounded up to a power of two */
+#define WINDOW_MAX ( 1U << 31 )
+
 /*! maximum IOTHUB message size */
 #define MAX_MESSAGE_SIZE ( 256 * 1024 * 1024 )
 
+/*! maximum number of unused transfer buffers retained for re-use */
+#define MAX_POOLED_BUFFERS 8
+
+/*! system-wide maximum pipe size setting */
+#define PIPE_MAX_SIZE_PATH "/proc/sys/fs/pipe-max-size"
+
+/*! default pipe capacity used if the system limit cannot be read */
+#define DEFAULT_PIPE_SIZE ( 64 * 1024 )
+
+/*! number of log2 body size histogram buckets */
+#define BODY_SIZE_BUCKETS 32
+
+/*! body size histogram sample count at which older samples are aged */
+#define BODY_SIZE_HISTORY 1024
+
+/*! percentile of observed body sizes the automatic pipe size covers */
+#define PIPE_SIZE_PERCENTILE 90
+
+/*! number of submission queue entries in the io_uring engine */
+#define IOURING_ENTRIES 16
+
+/*! size of the buffer used to stream asynchronous message bodies */
+#define ASYNC_STREAM_BUFSIZE ( 64 * 1024 )
+
+/*! initial delay before retrying an asynchronous FIFO open (ns) */
+#define FIFO_RETRY_MIN_NS ( 1000000L )
+
+/*! maximum delay before retrying an asynchronous FIFO open (ns) */
+#define FIFO_RETRY_MAX_NS ( 64000000L )
+
+/*! default number of messages each receive worker queue can hold */
+#define RECEIVE_QUEUE_DEPTH 32
+
+/*! FNV-1a offset basis used to hash correlation ids */
+#define CORRELATION_HASH_BASIS 2166136261U
+
+/*! FNV-1a prime used to hash correlation ids */
+#define CORRELATION_HASH_PRIME 16777619U
+
+/*! default number of channels used by IOTCLIENT_StreamMany */
+#define STREAM_CONCURRENCY 4
+
+/*! default segment size of a resumable upload */
+#define RESUME_SEGMENT_SIZE ( 4 * 1024 * 1024 )
+
+/*! size of the blocks a spliced message body is paced in */
+#define SPLICE_PACE_SIZE ( 64 * 1024 )
+
+/*! header carrying the identifier of a resumable upload */
+#define RESUME_ID_HEADER "upload-id"
+
+/*! header carrying the file offset of a resumable upload segment */
+#define RESUME_OFFSET_HEADER "upload-offset"
+
+/*! header carrying the total size of a resumable upload */
+#define RESUME_SIZE_HEADER "upload-size"
+
+/*! smallest chunk the stream copy loop reads its input in */
+#define STREAM_CHUNK_MIN ( 4 * 1024 )
+
+/*! chunk the stream copy loop starts with for a new type of input */
+#define STREAM_CHUNK_INITIAL ( 64 * 1024 )
+
+/*! largest chunk the stream copy loop reads its input in */
+#define STREAM_CHUNK_MAX ( 1024 * 1024 )
+
+/*! number of consecutive short reads after which the stream copy
+    loop halves its chunk size */
+#define STREAM_CHUNK_SHRINK_READS 4
+
+/*! header listing the trailers which follow a message body */
+#define TRAILER_HEADER "trailer"
+
+/*! trailer carrying the length of a message body */
+#define TRAILER_LENGTH "content-length"
+
+/*! trailer carrying the digest of a message body */
+#define TRAILER_DIGEST "content-digest"
+
+/*! maximum length of the trailers of a message */
+#define MAX_TRAILER_LENGTH 1024
+
 /*==============================================================================
         Private type definitions
 ==============================================================================*/
 
+/*! extended message preamble.  The preamble is sent at the start
+    of every header message on the IOTHub message queue */
+typedef struct _iotclient_preamble
+{
+    /*! preamble identifier PREAMBLE_ID_EXTENDED */
+    char id[4];
+
+    /*! process identifier of the client */
+    uint32_t pid;
+
+    /*! channel identifier of the client within its process */
+    uint32_t channel;
+} IoTClientPreamble;
+
+/*! sequenced message preamble, sent instead of the other preambles
+    by clients which have an in-flight window */
+typedef struct _iotclient_sequenced_preamble
+{
+    /*! preamble identifier PREAMBLE_ID_SEQUENCED */
+    char id[4];
+
+    /*! process identifier of the client */
+    uint32_t pid;
+
+    /*! channel identifier of the client within its process */
+    uint32_t channel;
+
+    /*! message sequence number.  A retransmitted message carries
+        the same sequence number as the original */
+    uint32_t seq;
+} IoTClientSequencedPreamble;
+
+/*! known length message preamble.  The sequence number is at the same
+    offset as in the sequenced preamble */
+typedef struct _iotclient_length_preamble
+{
+    /*! preamble identifier PREAMBLE_ID_LENGTH */
+    char id[4];
+
+    /*! process identifier of the client */
+    uint32_t pid;
+
+    /*! channel identifier of the client within its process */
+    uint32_t channel;
+
+    /*! message sequence number if PREAMBLE_FLAG_SEQUENCED is set */
+    uint32_t seq;
+
+    /*! PREAMBLE_FLAG_xxx flags */
+    uint32_t flags;
+
+    /*! reserved, always 0 */
+    uint32_t reserved;
+
+    /*! length of the message body which follows on the FIFO */
+    uint64_t length;
+} IoTClientLengthPreamble;
+
+/*! acknowledgement sent by the IOT Hub service on the client's
+    acknowledgement queue for each sequenced message */
+typedef struct _iotclient_ack
+{
+    /*! acknowledgement identifier ACK_ID */
+    char id[4];
+
+    /*! sequence number of the acknowledged message */
+    uint32_t seq;
+
+    /*! EOK if the message was forwarded, otherwise an errno value */
+    int32_t status;
+} IoTClientAck;
+
+/*! unacknowledged message in the in-flight window */
+typedef struct _iotclient_in_flight
+{
+    /*! indicates the window slot holds an unacknowledged message */
+    bool inUse;
+
+    /*! message sequence number */
+    uint32_t seq;
+
+    /*! copy of the preamble and headers, or NULL if not retained */
+    char *headers;
+
+    /*! length of the preamble and headers */
+    size_t headerLength;
+
+    /*! copy of the message body, or NULL if not retained */
+    unsigned char *body;
+
+    /*! message body length */
+    size_t bodyLength;
+
+    /*! indicates the message body is a copy owned by the IOT Client,
+        rather than the caller's asynchronous message body */
+    bool bodyOwned;
+
+    /*! acknowledgement callback, or NULL */
+    IOTCLIENT_SEND_CALLBACK cb;
+
+    /*! acknowledgement callback context */
+    void *ctx;
+} IoTClientInFlight;
+
+/*! asynchronous message transfer state */
+typedef enum _iotclient_async_state
+{
+    /*! waiting to send the message headers */
+    ASYNC_STATE_HEADERS,
+
+    /*! waiting for the IOT Hub service to open the body FIFO */
+    ASYNC_STATE_OPEN,
+
+    /*! transferring the message body */
+    ASYNC_STATE_BODY,
+
+    /*! message body transferred */
+    ASYNC_STATE_DONE
+
+} IoTClientAsyncState;
+
+/*! asynchronous message waiting to be transferred */
+typedef struct _iotclient_async_message
+{
+    /*! message transfer state */
+    IoTClientAsyncState state;
+
+    /*! preamble and headers to send on the IOTHub message queue */
+    char *headers;
+
+    /*! length of the preamble and headers */
+    size_t headerLength;
+
+    /*! message body, or NULL if the body is streamed */
+    const unsigned char *body;
+
+    /*! message body length, or number of bytes buffered for a stream */
+    size_t bodyLength;
+
+    /*! number of body bytes written to the FIFO */
+    size_t offset;
+
+    /*! number of body bytes taken from the byte rate limits which
+        have not been written yet */
+    size_t credit;
+
+    /*! total number of bytes streamed so far */
+    size_t total;
+
+    /*! maximum number of bytes to stream */
+    size_t limit;
+
+    /*! indicates the body length is known, so the input must supply
+        exactly limit bytes */
+    bool known;
+
+    /*! file descriptor to stream the message body from, or -1 */
+    int fd;
+
+    /*! indicates the streamed input has been exhausted */
+    bool eof;
+
+    /*! indicates the message has been taken from the message rate
+        limit, so retrying the header send does not take it again */
+    bool admitted;
+
+    /*! indicates the message has been added to the in-flight window */
+    bool sequenced;
+
+    /*! message sequence number, if sequenced */
+    uint32_t seq;
+
+    /*! completion callback */
+    IOTCLIENT_SEND_CALLBACK cb;
+
+    /*! completion callback context */
+    void *ctx;
+
+    /*! pointer to the next message in the send queue */
+    struct _iotclient_async_message *pNext;
+} IoTClientAsyncMessage;
+
+/*! transfer buffer header, stored in the page preceding the buffer */
+typedef struct _iotclient_buffer
+{
+    /*! total size of the mapping, including the header page */
+    size_t mapSize;
+
+    /*! pointer to the next buffer in the buffer pool or gifted list */
+    struct _iotclient_buffer *pNext;
+} IoTClientBuffer;
+
+/*! received message buffer */
+typedef struct _iotclient_rx_buffer
+{
+    /*! received message, with room for a NUL terminator */
+    char *buf;
+
+    /*! buffer for the text form of received binary headers */
+    char *headerBuf;
+
+    /*! size of the received binary headers buffer */
+    size_t headerBufSize;
+} IoTClientRxBuffer;
+
+/*! received message handed from the receiver thread to a worker */
+typedef struct _iotclient_rx_item
+{
+    /*! buffer holding the received message */
+    IoTClientRxBuffer rx;
+
+    /*! received message descriptor */
+    IOTCLIENT_MESSAGE message;
+
+    /*! pointer to the next unused item */
+    struct _iotclient_rx_item *pNext;
+} IoTClientRxItem;
+
+/*! bounded queue of received messages waiting for a worker */
+typedef struct _iotclient_rx_queue
+{
+    /*! lock protecting the queue */
+    pthread_mutex_t lock;
+
+    /*! signalled when a message is added to the queue */
+    pthread_cond_t notEmpty;
+
+    /*! signalled when a message is removed from the queue */
+    pthread_cond_t notFull;
+
+    /*! circular buffer of queued messages */
+    IoTClientRxItem **ppItems;
+
+    /*! capacity of the queue */
+    size_t size;
+
+    /*! position of the oldest queued message */
+    size_t head;
+
+    /*! number of queued messages */
+    size_t count;
+
+    /*! indicates the workers should exit once the queue is empty */
+    bool stop;
+
+    /*! receiver which owns the queue */
+    struct _iotclient_receiver *pReceiver;
+} IoTClientRxQueue;
+
+/*! library managed receiver thread and worker pool */
+typedef struct _iotclient_receiver
+{
+    /*! IOT Client which owns the receive message queue */
+    struct IotClient *hIoTClient;
+
+    /*! message handler */
+    IOTCLIENT_RECEIVE_CALLBACK cb;
+
+    /*! message handler context */
+    void *ctx;
+
+    /*! receiver flags */
+    uint32_t flags;
+
+    /*! event used to stop the receiver thread */
+    int stopFd;
+
+    /*! receiver thread */
+    pthread_t thread;
+
+    /*! indicates the receiver thread was started */
+    bool running;
+
+    /*! worker threads */
+    pthread_t *pWorkers;
+
+    /*! number of worker threads started */
+    size_t nWorkers;
+
+    /*! worker queues: one per worker if ordered, otherwise one shared */
+    IoTClientRxQueue *pQueues;
+
+    /*! number of worker queues */
+    size_t nQueues;
+
+    /*! next queue for messages without a correlation-id */
+    size_t nextQueue;
+
+    /*! lock protecting the unused item list */
+    pthread_mutex_t freeLock;
+
+    /*! list of unused received message items */
+    IoTClientRxItem *pFree;
+} IoTClientReceiver;
+
+/*! IOTCLIENT_StreamMany transfer shared by its channels */
+typedef struct _iotclient_stream_job
+{
+    /*! IOT Client which started the transfer */
+    struct IotClient *hIoTClient;
+
+    /*! messages to stream */
+    IOTCLIENT_STREAM_ITEM *pItems;
+
+    /*! number of messages to stream */
+    size_t count;
+
+    /*! index of the next message to stream */
+    size_t next;
+
+    /*! lock protecting the next index, filters, statistics and callback */
+    pthread_mutex_t lock;
+
+    /*! progress callback, or NULL */
+    IOTCLIENT_STREAM_CALLBACK cb;
+
+    /*! progress callback context */
+    void *ctx;
+
+    /*! aggregate progress */
+    IOTCLIENT_STREAM_STATS stats;
+
+    /*! time the transfer started */
+    struct timespec start;
+} IoTClientStreamJob;
+
+/*! IOTCLIENT_StreamMany transfer channel */
+typedef struct _iotclient_stream_channel
+{
+    /*! transfer the channel belongs to */
+    IoTClientStreamJob *pJob;
+
+    /*! IOT Client on its own channel, used by the channel's thread */
+    struct IotClient *hIoTClient;
+
+    /*! channel thread */
+    pthread_t thread;
+} IoTClientStreamChannel;
+
 /*! IOT Client connection state object */
 struct IotClient
 {
@@ -101,16 +575,140 @@ struct IotClient
     char *txBuf;
 
     /*! receive buffer */
-    char *rxBuf;
+    IoTClientRxBuffer rx;
 
     /*! receive buffer size */
     size_t rxBufSize;
 
+    /*! chain of pre-send filters, or NULL */
+    Filter *pFilters;
+
+    /*! send rate limiter */
+    RateLimiter limiter;
+
+    /*! rate limiter applied to sends, which is shared with the parent
+        client for the channels of IOTCLIENT_StreamMany */
+    RateLimiter *pLimiter;
+
+    /*! message priority level */
+    unsigned int priority;
+
+    /*! digest computed over streamed message bodies */
+    IOTCLIENT_DIGEST_TYPE digestType;
+
+    /*! streamed message body digest callback */
+    IOTCLIENT_DIGEST_CALLBACK digestCb;
+
+    /*! streamed message body digest callback context */
+    void *digestCtx;
+
+    /*! library managed receiver, or NULL if it is not running */
+    IoTClientReceiver *pReceiver;
+
+    /*! pool of receive buffers used by IOTCLIENT_ReceiveMany */
+    IoTClientRxBuffer *pRxPool;
+
+    /*! number of buffers in the receive buffer pool */
+    size_t rxPoolSize;
+
     /*! process PID used to create the data FIFO */
     pid_t pid;
 
+    /*! channel identifier which distinguishes the client's FIFO and
+        messages from those of other clients in the same process */
+    uint32_t channel;
+
     /*! name of the FIFO used to transfer the IOT message body */
     char *fifoName;
+
+    /*! pool of unused page-aligned transfer buffers */
+    IoTClientBuffer *pBufferPool;
+
+    /*! number of buffers in the transfer buffer pool */
+    size_t nPooledBuffers;
+
+    /*! sent transfer buffers whose pages may still be in the pipe */
+    IoTClientBuffer *pGiftedBuffers;
+
+    /*! number of sent transfer buffers awaiting re-use */
+    size_t nGiftedBuffers;
+
+    /*! requested body FIFO pipe capacity, 0 for automatic sizing */
+    size_t pipeSize;
+
+    /*! effective body FIFO pipe capacity of the last message sent */
+    size_t effectivePipeSize;
+
+    /*! log2 histogram of the observed message body sizes */
+    uint32_t bodySizeHistogram[BODY_SIZE_BUCKETS];
+
+    /*! number of samples in the body size histogram */
+    uint32_t bodySizeSamples;
+
+    /*! options the IOT Client was created with */
+    IOTCLIENT_OPTIONS options;
+
+    /*! io_uring engine, NULL if the FIFO transport is in use */
+    IoURing *pRing;
+
+    /*! epoll descriptor used to integrate with external event loops */
+    int epollFd;
+
+    /*! timer used to schedule event processing */
+    int timerFd;
+
+    /*! descriptor the asynchronous send queue is waiting on, or -1 */
+    int waitFd;
+
+    /*! message body FIFO opened for the current asynchronous message */
+    int asyncFifoFd;
+
+    /*! delay before retrying the asynchronous FIFO open (ns) */
+    long retryDelay;
+
+    /*! buffer used to stream asynchronous message bodies */
+    unsigned char *asyncBuf;
+
+    /*! page-aligned buffer the stream copy loop reads into */
+    unsigned char *streamBuf;
+
+    /*! size of the stream copy buffer */
+    size_t streamBufSize;
+
+    /*! chunk size the last copy from each type of input finished with */
+    size_t chunkSize[IOTCLIENT_INPUT_TYPES];
+
+    /*! chunk sizing of the last message body copied */
+    IOTCLIENT_CHUNK_STATS chunkStats;
+
+    /*! queue of asynchronous messages waiting to be transferred */
+    IoTClientAsyncMessage *pSendQueue;
+
+    /*! last message in the asynchronous send queue */
+    IoTClientAsyncMessage *pSendQueueTail;
+
+    /*! receive callback */
+    IOTCLIENT_RECEIVE_CALLBACK receiveCb;
+
+    /*! receive callback context */
+    void *receiveCtx;
+
+    /*! queue on which the IOT Hub service acknowledges sequenced
+        messages, or -1 if the client has no in-flight window */
+    mqd_t ackMsgQ;
+
+    /*! name of the acknowledgement queue */
+    char *ackQueueName;
+
+    /*! in-flight window of unacknowledged messages, indexed by
+        sequence number modulo the window size */
+    IoTClientInFlight *pWindow;
+
+    /*! sequence number of the next message to send */
+    uint32_t nextSeq;
+
+    /*! number of unacknowledged messages in the in-flight window */
+    size_t inFlight;
 };
 
 /*==============================================================================
@@ -119,23 +717,172 @@ struct IotClient
 
 static int iotclient_CreateFIFO( IOTCLIENT_HANDLE hIoTClient );
 static int iotclient_SendHeaders( IOTCLIENT_HANDLE hIoTClient,
-                                  const char *headers);
+                                  const char *headers,
+                                  size_t length,
+                                  bool paced );
+static int iotclient_BuildHeaders( IOTCLIENT_HANDLE hIoTClient,
+                                   const char *headers,
+                                   size_t length,
+                                   char *buf,
+                                   size_t size,
+                                   size_t *pLength );
+static char *iotclient_AnnounceTrailers( const char *headers,
+                                         const IOTCLIENT_TRAILERS *pTrailers );
+static int iotclient_BuildTrailers( const IOTCLIENT_TRAILERS *pTrailers,
+                                    Digest *pDigest,
+                                    uint64_t length,
+                                    char *buf,
+                                    size_t size );
+static int iotclient_SendTrailers( IOTCLIENT_HANDLE hIoTClient,
+                                   const char *trailers );
+static int iotclient_DecodeBinaryHeaders( IoTClientRxBuffer *pRx,
+                                          ssize_t n,
+                                          IOTCLIENT_MESSAGE *pMessage );
+static void iotclient_ParseMessage( IoTClientRxBuffer *pRx,
+                                    ssize_t n,
+                                    uint32_t flags,
+                                    IOTCLIENT_MESSAGE *pMessage );
+static IoTClientRxBuffer *iotclient_GetRxBuffer( IOTCLIENT_HANDLE hIoTClient,
+                                                 size_t index );
+static void iotclient_DestroyRxPool( IOTCLIENT_HANDLE hIoTClient );
+static int iotclient_InitReceiver( IoTClientReceiver *pReceiver,
+                                  size_t queueDepth );
+static void iotclient_DestroyReceiver( IoTClientReceiver *pReceiver );
+static void iotclient_SetAffinity( IOTCLIENT_HANDLE hIoTClient,
+                                   pthread_t thread );
+static void *iotclient_ReceiverThread( void *arg );
+static void *iotclient_WorkerThread( void *arg );
+static void iotclient_DispatchMessage( IoTClientReceiver *pReceiver,
+                                       IoTClientRxItem *pItem );
+static IoTClientRxItem *iotclient_GetRxItem( IoTClientReceiver *pReceiver );
+static void iotclient_PutRxItem( IoTClientReceiver *pReceiver,
+                                 IoTClientRxItem *pItem );
 static int iotclient_SendBody( IOTCLIENT_HANDLE hIoTClient,
                                const unsigned char *body,
                                size_t len );
-static int iotclient_StreamBody( IOTCLIENT_HANDLE hIoTClient, int fd );
+static int iotclient_StreamBody( IOTCLIENT_HANDLE hIoTClient,
+                                 int fd,
+                                 size_t length,
+                                 Digest *pDigest,
+                                 size_t *pTotal );
+static int iotclient_SpliceBody( IOTCLIENT_HANDLE hIoTClient,
+                                 int fd,
+                                 loff_t *pOffset,
+                                 int fd_out,
+                                 size_t *pBytesLeft,
+                                 size_t *pTotal );
+static size_t iotclient_KnownLength( IOTCLIENT_HANDLE hIoTClient, int fd );
+static int iotclient_CopyBody( IOTCLIENT_HANDLE hIoTClient,
+                               int fd,
+                               loff_t *pOffset,
+                               int fd_out,
+                               Digest *pDigest,
+                               size_t *pBytesLeft,
+                               size_t *pTotal );
+static IOTCLIENT_INPUT_TYPE iotclient_InputType( int fd, size_t *pLimit );
+static unsigned char *iotclient_StreamBuffer( IOTCLIENT_HANDLE hIoTClient,
+                                              size_t size );
+static void *iotclient_StreamThread( void *arg );
+static void iotclient_StreamWorker( IoTClientStreamJob *pJob,
+                                    IOTCLIENT_HANDLE hIoTClient );
+static int iotclient_StreamItem( IOTCLIENT_HANDLE hIoTClient,
+                                 IOTCLIENT_STREAM_ITEM *pItem,
+                                 bool *pSent );
+static int iotclient_SendSegment( IOTCLIENT_HANDLE hIoTClient,
+                                  const char *headers,
+                                  int fd,
+                                  const Checkpoint *pCheckpoint,
+                                  size_t len );
+static void iotclient_SegmentAck( void *ctx, int result );
+static int iotclient_StreamRange( IOTCLIENT_HANDLE hIoTClient,
+                                  int fd,
+                                  off_t offset,
+                                  size_t len );
+static int iotclient_GiftBody( IOTCLIENT_HANDLE hIoTClient,
+                               unsigned char *body,
+                               size_t len,
+                               bool *pDrained );
+static IoTClientBuffer *iotclient_GetBufferHeader( void *buf );
+static void iotclient_RecycleGiftedBuffers( IOTCLIENT_HANDLE hIoTClient );
+static void iotclient_DestroyBufferPool( IOTCLIENT_HANDLE hIoTClient );
 
 static void iotclient_DestroyFIFO( IOTCLIENT_HANDLE hIoTClient );
+static uint32_t iotclient_AllocChannel( void );
+static void iotclient_FreeChannel( uint32_t channel );
+static void iotclient_ResetChannels( void );
+static size_t iotclient_BuildPreamble( IOTCLIENT_HANDLE hIoTClient,
+                                       size_t length,
+                                       char *buf,
+                                       size_t len );
+static int iotclient_OpenFIFO( IOTCLIENT_HANDLE hIoTClient,
+                               size_t len,
+                               int flags );
+static void iotclient_ReadPipeMaxSize( void );
+static void iotclient_RecordBodySize( IOTCLIENT_HANDLE hIoTClient,
+                                      size_t len );
+static size_t iotclient_GetAutoPipeSize( IOTCLIENT_HANDLE hIoTClient );
 static int iotclient_CreateTxMessageQueue( IOTCLIENT_HANDLE hIoTClient );
 static void iotclient_DestroyTxMessageQueue( IOTCLIENT_HANDLE hIoTClient );
 static void iotclient_DestroyRxMessageQueue( IOTCLIENT_HANDLE hIoTClient );
 
+static int iotclient_SetOptions( IOTCLIENT_HANDLE hIoTClient,
+                                 const IOTCLIENT_OPTIONS *pOptions );
+static void iotclient_FreeOptions( IOTCLIENT_HANDLE hIoTClient );
+
+static int iotclient_InitEvents( IOTCLIENT_HANDLE hIoTClient );
+static void iotclient_DestroyEvents( IOTCLIENT_HANDLE hIoTClient );
+static int iotclient_QueueAsync( IOTCLIENT_HANDLE hIoTClient,
+                                 const char *headers,
+                                 const unsigned char *body,
+                                 size_t bodylen,
+                                 int fd,
+                                 IOTCLIENT_SEND_CALLBACK cb,
+                                 void *ctx );
+static void iotclient_ProcessSendQueue( IOTCLIENT_HANDLE hIoTClient );
+static int iotclient_AdvanceAsync( IOTCLIENT_HANDLE hIoTClient,
+                                   IoTClientAsyncMessage *pMsg );
+static int iotclient_WaitFd( IOTCLIENT_HANDLE hIoTClient,
+                             int fd,
+                             uint32_t events );
+static void iotclient_ScheduleEvents( IOTCLIENT_HANDLE hIoTClient,
+                                      long delay );
+static void iotclient_ProcessReceiveQueue( IOTCLIENT_HANDLE hIoTClient );
+static int iotclient_CreateAckQueue( IOTCLIENT_HANDLE hIoTClient );
+static void iotclient_DestroyAckQueue( IOTCLIENT_HANDLE hIoTClient );
+static int iotclient_ReserveSlot( IOTCLIENT_HANDLE hIoTClient );
+static int iotclient_AcquireRate( IOTCLIENT_HANDLE hIoTClient, size_t length );
+static bool iotclient_WindowFull( IOTCLIENT_HANDLE hIoTClient );
+static void iotclient_TrackMessage( IOTCLIENT_HANDLE hIoTClient,
+                                    const char *headers,
+                                    size_t headerLength );
+static void iotclient_RetainBody( IOTCLIENT_HANDLE hIoTClient,
+                                  const unsigned char *body,
+                                  size_t bodylen );
+static int iotclient_ProcessAcks( IOTCLIENT_HANDLE hIoTClient, bool wait );
+static void iotclient_Acknowledge( IOTCLIENT_HANDLE hIoTClient,
+                                   uint32_t seq,
+                                   int status );
+static IoTClientInFlight *iotclient_FindInFlight( IOTCLIENT_HANDLE hIoTClient,
+                                                  uint32_t seq );
+static void iotclient_ReleaseInFlight( IOTCLIENT_HANDLE hIoTClient,
+                                       IoTClientInFlight *pEntry,
+                                       int status );
+
 static void iotclient_log( IOTCLIENT_HANDLE hIoTClient, char *msg );
 
 /*==============================================================================
         File scoped variables
 ==============================================================================*/
 
+/*! maximum pipe size which can be set by an unprivileged process */
+static size_t pipeMaxSize = DEFAULT_PIPE_SIZE;
+
+/*! indicates channel 0 is in use by a client in this process */
+static atomic_flag channelZeroInUse = ATOMIC_FLAG_INIT;
+
+/*! next channel identifier to allocate once channel 0 is in use */
+static atomic_uint nextChannel = 1;
+
 /*==============================================================================
         Function definitions
 ==============================================================================*/
@@ -144,6 +891,8 @@ void __attribute__ ((constructor)) initLibrary(void) {
  //
  // Function that is called when the library is loaded
  //
+    iotclient_ReadPipeMaxSize();
+    pthread_atfork( NULL, NULL, iotclient_ResetChannels );
 }
 void __attribute__ ((destructor)) cleanUpLibrary(void) {
  //
@@ -160,11 +909,70 @@ void __attribute__ ((destructor)) cleanUpLibrary(void) {
     to create a connection to the IOT Hub service to send and receive
     IOT messages via the IOT service.
 
+    The IOT Client is created with the default options.
+
     @retval a handle to the IOT server
     @retval NULL if the variable server could not be opened
 
 ==============================================================================*/
 IOTCLIENT_HANDLE IOTCLIENT_Create( void )
+{
+    return IOTCLIENT_CreateEx( NULL );
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_InitOptions                                                     */
+/*!
+    Initialize an IOT Client options object
+
+    The IOTCLIENT_InitOptions function populates an IOT Client options
+    object with the default values and the current options version.
+    Callers should initialize the options object with this function
+    before changing the options they are interested in, so that options
+    added in later versions of the library take their default values.
+
+    @param[in,out]
+        pOptions
+            pointer to the options object to initialize
+
+    @retval EOK the options object was initialized
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_InitOptions( IOTCLIENT_OPTIONS *pOptions )
+{
+    int result = EINVAL;
+
+    if ( pOptions != NULL )
+    {
+        memset( pOptions, 0, sizeof( IOTCLIENT_OPTIONS ) );
+        pOptions->version = IOTCLIENT_OPTIONS_VERSION;
+        pOptions->transport = IOTCLIENT_TRANSPORT_FIFO;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_CreateEx                                                        */
+/*!
+    Create a connection to the IOT Hub service with the specified options
+
+    The IOTCLIENT_CreateEx function is used by IOT client applications
+    to create a connection to the IOT Hub service, selecting the
+    transport, buffering and threading behavior of the connection via
+    an options object initialized with IOTCLIENT_InitOptions.
+
+    @param[in]
+        pOptions
+            pointer to the IOT Client options, or NULL for the defaults
+
+    @retval a handle to the IOT server
+    @retval NULL if the variable server could not be opened (errno is set)
+
+==============================================================================*/
+IOTCLIENT_HANDLE IOTCLIENT_CreateEx( const IOTCLIENT_OPTIONS *pOptions )
 {
     IOTCLIENT_HANDLE hIoTClient = NULL;
     int rc = EINVAL;
@@ -173,8 +981,31 @@ IOTCLIENT_HANDLE IOTCLIENT_Create( void )
     hIoTClient = calloc( 1, sizeof( struct IotClient ) );
     if ( hIoTClient != NULL )
     {
-        /* create the message queue */
-        rc = iotclient_CreateTxMessageQueue( hIoTClient );
+        /* initialize descriptors */
+        hIoTClient->txMsgQ = -1;
+        hIoTClient->rxMsgQ = -1;
+        hIoTClient->epollFd = -1;
+        hIoTClient->timerFd = -1;
+        hIoTClient->waitFd = -1;
+        hIoTClient->asyncFifoFd = -1;
+        hIoTClient->ackMsgQ = -1;
+        hIoTClient->pLimiter = &hIoTClient->limiter;
+
+        /* apply the IOT Client options */
+        rc = iotclient_SetOptions( hIoTClient, pOptions );
+        if ( rc == EOK )
+        {
+            /* create the message queue */
+            rc = iotclient_CreateTxMessageQueue( hIoTClient );
+        }
+
+        if ( ( rc == EOK ) &&
+             ( hIoTClient->options.transport == IOTCLIENT_TRANSPORT_IOURING ) )
+        {
+            /* fall back to the FIFO transport if io_uring is unavailable */
+            hIoTClient->pRing = iouring_Create( IOURING_ENTRIES );
+        }
+
         if ( rc == EOK )
         {
             /* create the message body FIFO */
@@ -186,11 +1017,26 @@ IOTCLIENT_HANDLE IOTCLIENT_Create( void )
             }
         }
 
+        if ( ( rc == EOK ) &&
+             ( hIoTClient->options.window > 0 ) )
+        {
+            /* create the acknowledgement queue and in-flight window */
+            rc = iotclient_CreateAckQueue( hIoTClient );
+            if ( rc != EOK )
+            {
+                iotclient_DestroyFIFO( hIoTClient );
+                iotclient_DestroyTxMessageQueue( hIoTClient );
+            }
+        }
+
         if ( rc != EOK )
         {
             /* clean up IOT Client object */
+            iouring_Destroy( hIoTClient->pRing );
+            iotclient_FreeOptions( hIoTClient );
             free( hIoTClient );
             hIoTClient = NULL;
+            errno = rc;
         }
     }
 
@@ -241,6 +1087,7 @@ IOTCLIENT_HANDLE IOTCLIENT_Create( void )
     @retval EOK message delivered to IOTHub ingress queue
     @retval EINVAL invalid arguments
     @retval EMSGSIZE the message body or message headers are too big
+    @retval ECANCELED the message was dropped by a pre-send filter
     @retval EBADF invalid message queue descriptor
 
 ==============================================================================*/
@@ -255,10 +1102,36 @@ int IOTCLIENT_Send( IOTCLIENT_HANDLE hIoTClient,
          ( headers != NULL ) &&
          ( body != NULL ) )
     {
-        /* send the message header to the IOT Hub service */
-        result = iotclient_SendHeaders( hIoTClient, headers );
+        if ( bodylen >= MAX_IOT_MSG_SIZE )
+        {
+            /* reject the message before the hub expects a body */
+            result = EMSGSIZE;
+        }
+        else if ( !filter_Accept( hIoTClient->pFilters,
+                                  headers,
+                                  body,
+                                  bodylen ) )
+        {
+            /* the message was dropped by a pre-send filter */
+            result = ECANCELED;
+        }
+        else
+        {
+            /* send the message header to the IOT Hub service */
+            result = iotclient_SendHeaders( hIoTClient,
+                                            headers,
+                                            bodylen,
+                                            false );
+        }
+
         if ( result == EOK )
         {
+            /* the message is sent, so update the pre-send filters */
+            filter_Commit( hIoTClient->pFilters, headers, body, bodylen );
+
+            /* keep a copy of the body in case it must be retransmitted */
+            iotclient_RetainBody( hIoTClient, body, bodylen );
+
             /* send the message body to the IOT Hub service */
             result = iotclient_SendBody( hIoTClient,
                                          body,
@@ -290,7 +1163,13 @@ int IOTCLIENT_Send( IOTCLIENT_HANDLE hIoTClient,
     my-header-2:value-2\n\n
 
     The message body is read as an octet stream from an open file
-    descriptor.
+    descriptor.  If a stream digest has been set up with
+    IOTCLIENT_SetStreamDigest, it is computed over the body as it is
+    sent, and reported once the body has been sent.
+
+    The input is streamed until it ends.  Clients created with
+    IOTCLIENT_OPT_BODY_LENGTH send the rest of a regular file as a
+    message of known length, as per IOTCLIENT_StreamWithLength.
 
     @param[in]
         hIotClient
@@ -304,13 +1183,10 @@ int IOTCLIENT_Send( IOTCLIENT_HANDLE hIoTClient,
         fd
             file descriptor to stream data from
 
-    @param[in]
-        bodylen
-            number of octets in the message body
-
     @retval EOK message delivered to IOTHub ingress queue
     @retval EINVAL invalid arguments
     @retval EMSGSIZE the message body or message headers are too big
+    @retval ECANCELED the message was dropped by a pre-send filter
     @retval EBADF invalid message queue descriptor
 
 ==============================================================================*/
@@ -318,18 +1194,106 @@ int IOTCLIENT_Stream( IOTCLIENT_HANDLE hIoTClient,
                       const char *headers,
                       int fd )
 {
-    int result = EINVAL;
+    size_t length = iotclient_KnownLength( hIoTClient, fd );
 
-    if ( ( hIoTClient != NULL ) &&
-         ( headers != NULL ) &&
-         ( fd != -1 ) )
+    return IOTCLIENT_StreamWithLength( hIoTClient, headers, fd, length );
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_StreamWithLength                                                */
+/*!
+    Stream an IOT message with a body of known length
+
+    The IOTCLIENT_StreamWithLength function streams an IOT message as
+    per IOTCLIENT_Stream, where the caller knows the length of the
+    message body in advance, eg. from a Content-Length, even though
+    the input is a pipe or a socket.
+
+    Clients created with IOTCLIENT_OPT_BODY_LENGTH announce the length
+    in the header message so the IOT Hub service can preallocate for
+    the body.  Exactly that many octets are spliced from the input to
+    the FIFO where the input supports it, otherwise they are copied.
+
+    @param[in]
+        hIotClient
+            handle to the IOT Client
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        fd
+            file descriptor to stream data from
+
+    @param[in]
+        length
+            number of octets in the message body, or
+            IOTCLIENT_LENGTH_UNKNOWN to stream the input until it ends
+
+    @retval EOK message delivered to IOTHub ingress queue
+    @retval EINVAL invalid arguments
+    @retval EMSGSIZE the message body or message headers are too big
+    @retval ECANCELED the message was dropped by a pre-send filter
+    @retval EBADF invalid message queue descriptor
+    @retval EIO the input ended before the length was reached
+
+==============================================================================*/
+int IOTCLIENT_StreamWithLength( IOTCLIENT_HANDLE hIoTClient,
+                                const char *headers,
+                                int fd,
+                                size_t length )
+{
+    int result = EINVAL;
+    Digest digest;
+    unsigned char value[IOTCLIENT_DIGEST_MAX_LENGTH];
+    size_t len;
+
+    if ( ( length != IOTCLIENT_LENGTH_UNKNOWN ) &&
+         ( length >= MAX_IOT_MSG_SIZE ) )
     {
-        /* send the message header to the IOT Hub service */
-        result = iotclient_SendHeaders( hIoTClient, headers );
+        result = EMSGSIZE;
+    }
+    else if ( ( hIoTClient != NULL ) &&
+              ( headers != NULL ) &&
+              ( fd != -1 ) )
+    {
+        if ( !filter_Accept( hIoTClient->pFilters, headers, NULL, 0 ) )
+        {
+            /* the message was dropped by a pre-send filter */
+            result = ECANCELED;
+        }
+        else
+        {
+            /* send the message header to the IOT Hub service */
+            result = iotclient_SendHeaders( hIoTClient, headers, length, true );
+        }
+
         if ( result == EOK )
         {
+            /* the message is sent, so update the pre-send filters */
+            filter_Commit( hIoTClient->pFilters, headers, NULL, 0 );
+
             /* send the message body to the IOT Hub service */
-            result = iotclient_StreamBody( hIoTClient, fd );
+            digest_Init( &digest, hIoTClient->digestType );
+            result = iotclient_StreamBody( hIoTClient,
+                                           fd,
+                                           length,
+                                           ( hIoTClient->digestCb != NULL )
+                                             ? &digest
+                                             : NULL,
+                                           NULL );
+        }
+
+        if ( ( result == EOK ) && ( hIoTClient->digestCb != NULL ) )
+        {
+            /* report the digest of the streamed body */
+            len = digest_Final( &digest, value );
+            hIoTClient->digestCb( hIoTClient->digestCtx,
+                                  digest.type,
+                                  value,
+                                  len,
+                                  digest.length );
         }
     }
 
@@ -337,199 +1301,366 @@ int IOTCLIENT_Stream( IOTCLIENT_HANDLE hIoTClient,
 }
 
 /*============================================================================*/
-/*  IOTCLIENT_CreateReceiver                                                  */
+/*  IOTCLIENT_StreamWithTrailers                                              */
 /*!
-    Create and IOTCLIENT message receiver
-
-    The IOTCLIENT_CreateReceiver function creates an IOTCLIENT message
-    receiver which can received cloud-to-device messages from the IOTHUB
-    service.
+    Stream a message followed by late-bound trailer properties
+
+    The IOTCLIENT_StreamWithTrailers function streams a message as per
+    IOTCLIENT_Stream, and then sends trailers: properties which are
+    only known once the body has been sent, such as its length, its
+    digest, or values supplied by the trailer callback.  This avoids
+    scanning the input in advance to compute them.
+
+    The message headers announce the trailers with a "trailer" property
+    listing their names.  Once the body has been sent, the trailers are
+    sent as a separate message on the IOTHub message queue with the
+    "IOTT" preamble followed by the process id and channel id, and the
+    trailer properties in the same encoding as the headers.  The IOT Hub
+    service merges them into the message's properties.  The trailers
+    are sent even if the body could not be sent in full, so the IOT Hub
+    service is never left waiting for them.
+
+    Trailers are only sent by clients created with the
+    IOTCLIENT_OPT_TRAILERS option, since the IOT Hub service must expect
+    the trailer message.  When the trailer definition requests no
+    trailers, the message is streamed as per IOTCLIENT_Stream without a
+    trailer announcement.
 
     @param[in]
         hIoTClient
-            handle to the IOT Client which owns the message queue
+            handle to the IOT Client
 
     @param[in]
-        name
-            name of the receiver.
+        headers
+            pointer to a NUL terminated string containing the message headers
 
     @param[in]
-        maxMessages
-            maximum number of messages that can be queued
+        fd
+            file descriptor to stream data from
 
     @param[in]
-        size
-            max size of allowed command-to-device messages
+        pTrailers
+            pointer to the trailer definition
 
-    @retval EOK the message queue and message buffer were created
-    @retval ENOMEM the message buffer could not be allocated
-    @retval errno other message as reported by mq_open
+    @retval EOK message and trailers delivered to IOTHub ingress queue
+    @retval EINVAL invalid arguments
+    @retval ENOTSUP the client was not created with IOTCLIENT_OPT_TRAILERS
+    @retval ENOMEM the headers could not be allocated
+    @retval EMSGSIZE the message headers or trailers are too big
+    @retval ECANCELED the message was dropped by a pre-send filter
+    @retval other error as returned by the send functions or the
+            trailer callback
 
 ==============================================================================*/
-int IOTCLIENT_CreateReceiver( IOTCLIENT_HANDLE hIoTClient,
-                              char *name,
-                              int maxMessages,
-                              size_t size )
+int IOTCLIENT_StreamWithTrailers( IOTCLIENT_HANDLE hIoTClient,
+                                  const char *headers,
+                                  int fd,
+                                  const IOTCLIENT_TRAILERS *pTrailers )
 {
     int result = EINVAL;
-    struct mq_attr attr;
-    char *receiver = NULL;
-
-    attr.mq_maxmsg = maxMessages;
-    attr.mq_msgsize = size;
+    int rc;
+    int sent;
+    char *trailedHeaders = NULL;
+    char trailers[MAX_TRAILER_LENGTH];
+    Digest digest;
+    size_t total = 0;
+    size_t length;
 
-    if ( hIoTClient != NULL )
+    if ( ( hIoTClient != NULL ) &&
+         ( headers != NULL ) &&
+         ( fd != -1 ) &&
+         ( pTrailers != NULL ) &&
+         ( ( pTrailers->digest == IOTCLIENT_DIGEST_NONE ) ||
+           ( pTrailers->digest == IOTCLIENT_DIGEST_CRC32C ) ||
+           ( pTrailers->digest == IOTCLIENT_DIGEST_SHA256 ) ) )
     {
-        /* initialize descriptors */
-        hIoTClient->rxMsgQ = -1;
+        if ( !( hIoTClient->options.flags & IOTCLIENT_OPT_TRAILERS ) )
+        {
+            /* the IOT Hub service does not expect trailer messages */
+            result = ENOTSUP;
+        }
+        else if ( ( ( pTrailers->names == NULL ) ||
+                    ( *pTrailers->names == '\0' ) ) &&
+                  ( !( pTrailers->flags & IOTCLIENT_TRAILER_LENGTH ) ) &&
+                  ( pTrailers->digest == IOTCLIENT_DIGEST_NONE ) &&
+                  ( pTrailers->cb == NULL ) )
+        {
+            /* there are no trailers to send */
+            result = IOTCLIENT_Stream( hIoTClient, headers, fd );
+        }
+        else if ( !filter_Accept( hIoTClient->pFilters, headers, NULL, 0 ) )
+        {
+            /* the message was dropped by a pre-send filter */
+            result = ECANCELED;
+        }
+        else
+        {
+            /* announce the trailers in the message headers */
+            length = iotclient_KnownLength( hIoTClient, fd );
+            trailedHeaders = iotclient_AnnounceTrailers( headers, pTrailers );
+            result = ( trailedHeaders != NULL )
+                     ? iotclient_SendHeaders( hIoTClient,
+                                              trailedHeaders,
+                                              length,
+                                              true )
+                     : ENOMEM;
+        }
 
-        /* build the message queue name */
-        if ( asprintf( &receiver, "/%s", name ) > 0 )
+        if ( ( result == EOK ) && ( trailedHeaders != NULL ) )
         {
-            /* allocate memory for the received messages */
-            hIoTClient->rxBufSize = size;
-            hIoTClient->rxBuf = calloc( 1, size );
-            if ( hIoTClient->rxBuf != NULL )
-            {
-                /* create the receive message queue */
-                hIoTClient->rxMsgQ = mq_open( receiver,
-                                            O_RDONLY | O_CREAT,
-                                            0666,
-                                            &attr );
-                result = ( hIoTClient->rxMsgQ != -1 ) ? EOK : errno;
-            }
-            else
+            /* the message is sent, so update the pre-send filters */
+            filter_Commit( hIoTClient->pFilters, headers, NULL, 0 );
+
+            /* send the message body to the IOT Hub service */
+            digest_Init( &digest, pTrailers->digest );
+            result = iotclient_StreamBody( hIoTClient,
+                                           fd,
+                                           length,
+                                           ( pTrailers->digest !=
+                                             IOTCLIENT_DIGEST_NONE )
+                                             ? &digest
+                                             : NULL,
+                                           &total );
+
+            /* the trailers are sent once the headers have been sent */
+            rc = iotclient_BuildTrailers( pTrailers,
+                                          &digest,
+                                          total,
+                                          trailers,
+                                          sizeof( trailers ) );
+            if ( rc != EOK )
             {
-                result = ENOMEM;
+                /* send an empty set of trailers */
+                strcpy( trailers, "\n" );
             }
 
-            free( receiver );
-            receiver = NULL;
+            sent = iotclient_SendTrailers( hIoTClient, trailers );
+            rc = ( rc == EOK ) ? sent : rc;
+            result = ( result == EOK ) ? rc : result;
         }
+
+        free( trailedHeaders );
     }
 
     return result;
 }
 
 /*============================================================================*/
-/*  IOTCLIENT_Receive                                                         */
+/*  IOTCLIENT_SetStreamDigest                                                 */
 /*!
-    Receive a message from the IOTHUB Service
+    Compute a digest of streamed message bodies as they are sent
 
-    The IOTCLIENT_Receiver function waits for a received message from the
-    IOTHUB service.  When the message is retrieved it is split into
-    a set of message headers, and a message body component.
+    The IOTCLIENT_SetStreamDigest function sets up a CRC32C or SHA-256
+    digest which IOTCLIENT_Stream computes over each message body as it
+    forwards it, so an integrity check does not need a separate pass
+    over the input.  The callback receives the digest and body length
+    once the body has been sent.  The hardware CRC32 instruction and
+    SHA extensions are used when the processor supports them.
+
+    Digested bodies are copied through a buffer rather than spliced by
+    the io_uring engine, since the octets must pass through the library.
 
     @param[in]
         hIoTClient
-            handle to the IOT Client which owns the message queue
+            handle to the IOT Client
 
     @param[in]
-        name
-            name of the receiver.
+        type
+            digest algorithm, or IOTCLIENT_DIGEST_NONE to stop computing
+            digests
 
     @param[in]
-        maxMessages
-            maximum number of messages that can be queued
+        cb
+            digest callback
 
     @param[in]
-        size
-            max size of allowed command-to-device messages
+        ctx
+            digest callback context
 
-    @retval EOK the message queue and message buffer were created
-    @retval ENOMEM the message buffer could not be allocated
-    @retval errno other message as reported by mq_open
+    @retval EOK the stream digest was set up
+    @retval EINVAL invalid arguments
 
 ==============================================================================*/
-int IOTCLIENT_Receive( IOTCLIENT_HANDLE hIoTClient,
-                       char **ppHeader,
-                       char **ppBody,
-                       size_t *pHeaderLength,
-                       size_t *pBodyLength )
+int IOTCLIENT_SetStreamDigest( IOTCLIENT_HANDLE hIoTClient,
+                               IOTCLIENT_DIGEST_TYPE type,
+                               IOTCLIENT_DIGEST_CALLBACK cb,
+                               void *ctx )
 {
     int result = EINVAL;
-    ssize_t n;
-    unsigned int prio;
-    char *p;
-    size_t len;
 
-    if( ( hIoTClient != NULL ) &&
-        ( hIoTClient->rxMsgQ != -1 ) &&
-        ( hIoTClient->rxBuf != NULL ) &&
-        ( hIoTClient->rxBufSize > 0 ) &&
-        ( ppHeader != NULL ) &&
-        ( ppBody != NULL ) &&
-        ( pHeaderLength != NULL ) &&
-        ( pBodyLength != NULL ) )
+    if ( ( hIoTClient != NULL ) &&
+         ( ( type == IOTCLIENT_DIGEST_NONE ) ||
+           ( ( ( type == IOTCLIENT_DIGEST_CRC32C ) ||
+               ( type == IOTCLIENT_DIGEST_SHA256 ) ) &&
+             ( cb != NULL ) ) ) )
     {
-        printf("Waiting for data...\n");
-        /* wait for a message on the receive queue */
-        n = mq_receive( hIoTClient->rxMsgQ,
-                        hIoTClient->rxBuf,
-                        hIoTClient->rxBufSize,
-                        &prio );
+        hIoTClient->digestType = type;
+        hIoTClient->digestCb = ( type != IOTCLIENT_DIGEST_NONE ) ? cb : NULL;
+        hIoTClient->digestCtx = ctx;
+        result = EOK;
+    }
 
-        printf("size: %ld\n", hIoTClient->rxBufSize);
-        printf("rxBuf = %p\n", hIoTClient->rxBuf);
-        printf("mq = %d\n", hIoTClient->rxMsgQ);
-        printf("prio = %d\n", prio);
-        printf("n = %ld\n", n);
-        if ( n > 0 )
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_StreamMany                                                      */
+/*!
+    Stream many messages concurrently over multiple channels
+
+    The IOTCLIENT_StreamMany function streams a list of messages, such
+    as rotated log files or image captures, with up to the specified
+    number of transfers in progress at once.  The calling thread streams
+    messages using the IOT Client, and each additional transfer runs on
+    its own thread using a temporary IOT Client on a separate channel,
+    with the same options, so its message body has a FIFO of its own.
+    The temporary IOT Clients share the rate limits and priority level
+    of the IOT Client, and its pre-send filters are applied to every
+    message.
+
+    Each message body is read from a file which is opened by path, or
+    from a caller supplied file descriptor.  The result and body length
+    of each message are stored in its item, and the progress callback
+    is invoked as each message completes, with the aggregate progress
+    of the transfer.
+
+    The IOT Client must not be used by other threads until the function
+    returns.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in,out]
+        pItems
+            array of messages to stream
+
+    @param[in]
+        count
+            number of messages to stream
+
+    @param[in]
+        concurrency
+            maximum number of messages to stream at once, or 0 for the
+            default
+
+    @param[in]
+        cb
+            progress callback, or NULL
+
+    @param[in]
+        ctx
+            progress callback context
+
+    @param[out]
+        pStats
+            optional pointer to the location to store the aggregate
+            progress of the transfer
+
+    @retval EOK all of the messages were streamed
+    @retval EINVAL invalid arguments
+    @retval other result of the first message which failed
+
+==============================================================================*/
+int IOTCLIENT_StreamMany( IOTCLIENT_HANDLE hIoTClient,
+                          IOTCLIENT_STREAM_ITEM *pItems,
+                          size_t count,
+                          unsigned int concurrency,
+                          IOTCLIENT_STREAM_CALLBACK cb,
+                          void *ctx,
+                          IOTCLIENT_STREAM_STATS *pStats )
+{
+    int result = EINVAL;
+    IoTClientStreamJob job;
+    IoTClientStreamChannel *pChannels = NULL;
+    IoTClientStreamChannel *pChannel;
+    size_t nChannels = 0;
+    size_t i;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( pItems != NULL ) &&
+         ( count > 0 ) )
+    {
+        memset( &job, 0, sizeof( job ) );
+        job.hIoTClient = hIoTClient;
+        job.pItems = pItems;
+        job.count = count;
+        job.cb = cb;
+        job.ctx = ctx;
+        pthread_mutex_init( &job.lock, NULL );
+        clock_gettime( CLOCK_MONOTONIC, &job.start );
+
+        if ( concurrency == 0 )
+        {
+            concurrency = STREAM_CONCURRENCY;
+        }
+
+        if ( concurrency > count )
+        {
+            concurrency = count;
+        }
+
+        /* the calling thread is the first channel */
+        if ( concurrency > 1 )
+        {
+            pChannels = calloc( concurrency - 1,
+                                sizeof( IoTClientStreamChannel ) );
+        }
+
+        while ( ( pChannels != NULL ) && ( nChannels < concurrency - 1 ) )
         {
-            /* search for the start of the message body */
-            p = strstr( hIoTClient->rxBuf, "\n\n");
-            if( p == NULL )
+            pChannel = &pChannels[nChannels];
+            pChannel->pJob = &job;
+            pChannel->hIoTClient = IOTCLIENT_CreateEx( &hIoTClient->options );
+            if ( pChannel->hIoTClient == NULL )
             {
-                /* no header data is included in the received message */
-                printf("No header data\n");
-                *ppHeader = NULL;
-                *pHeaderLength = 0;
-                *ppBody = hIoTClient->rxBuf;
-                *pBodyLength = n;
+                /* continue with the channels which were opened */
+                break;
             }
-            else
-            {
-                /* NUL terminate the headers */
-                *p = '\0';
-                printf("buffer length = %ld\n", strlen( hIoTClient->rxBuf));
-                printf("headers:\n");
-                printf("%s\n", hIoTClient->rxBuf);
-                /* calculate the header length */
-                len = (void *)p - (void *)(hIoTClient->rxBuf);
-                printf("p=%p\n", p);
-                printf("header length=%ld\n",len);
 
-                *ppHeader = hIoTClient->rxBuf;
-                printf("*ppHeader = %s\n", *ppHeader);
-                *pHeaderLength = len;
+            pChannel->hIoTClient->pLimiter = hIoTClient->pLimiter;
+            pChannel->hIoTClient->priority = hIoTClient->priority;
+
+            if ( pthread_create( &pChannel->thread,
+                                 NULL,
+                                 iotclient_StreamThread,
+                                 pChannel ) != 0 )
+            {
+                IOTCLIENT_Close( pChannel->hIoTClient );
+                break;
+            }
 
-                /* skip over the header/body delimeter */
-                p += 2;
+            nChannels++;
+        }
 
-                if( len < hIoTClient->rxBufSize )
-                {
-                    *ppBody = p;
+        iotclient_StreamWorker( &job, hIoTClient );
 
-                    /* calculate the body length */
-                    len = n - len;
+        for ( i = 0; i < nChannels; i++ )
+        {
+            pChannel = &pChannels[i];
+            pthread_join( pChannel->thread, NULL );
 
-                    printf("body length = %ld\n", len);
-                    *pBodyLength = len;
-                }
-                else
-                {
-                    printf("No body data\n");
-                    /* no body data is included in the message */
-                    *ppBody = NULL;
-                    *pBodyLength = 0;
-                }
+            if ( pChannel->hIoTClient->pWindow != NULL )
+            {
+                /* wait for the channel's messages to be acknowledged */
+                IOTCLIENT_Flush( pChannel->hIoTClient );
             }
 
-            result = EOK;
+            IOTCLIENT_Close( pChannel->hIoTClient );
         }
-        else
+
+        free( pChannels );
+        pthread_mutex_destroy( &job.lock );
+
+        result = EOK;
+        for ( i = 0; ( i < count ) && ( result == EOK ); i++ )
         {
-            result = errno;
+            result = pItems[i].result;
+        }
+
+        if ( pStats != NULL )
+        {
+            *pStats = job.stats;
         }
     }
 
@@ -537,92 +1668,294 @@ int IOTCLIENT_Receive( IOTCLIENT_HANDLE hIoTClient,
 }
 
 /*============================================================================*/
-/*  IOTCLIENT_GetProperty                                                     */
+/*  IOTCLIENT_StreamResumable                                                 */
 /*!
-    Get a property from the message headers
-
-    The IOTCLIENT_GetProperty function searches for a property in the
-    message headers given its name. If the property is found, its value
-    is copied into the supplied buffer.
+    Stream a file as a resumable, checkpointed upload
+
+    The IOTCLIENT_StreamResumable function uploads a regular file as a
+    sequence of segment messages, each carrying the message headers
+    along with the upload identifier, the segment's offset in the file
+    and the file size, so the IOT Hub service can reassemble the file.
+
+    After each segment has been delivered, the upload offset is saved
+    in the specified state file.  If the IOT Client has an in-flight
+    window, a segment is only considered delivered once it has been
+    acknowledged.  If the upload fails, calling the function again with
+    the same file and state file resumes the upload from the saved
+    offset, reading the file with splice() or pread() at the offset.
+    A state file which belongs to a different or modified file is
+    ignored and the upload is restarted with a new upload identifier.
+    The offset the upload started from is reported to the caller, so
+    a restarted upload can be told apart from a resumed one.  The state
+    file is removed once the upload is complete.
 
-    If the property value is not found, or the size of its value exceeds
-    the length of the supplied buffer, this function will return an
-    error and the contents of the supplied buffer should be considered
-    invalid and should not be used.
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
 
     @param[in]
         headers
-            pointer to the message headers (NUL terminated string
-            containing concatendated message properties in the following
-            form: "name:value\n"
+            pointer to a NUL terminated string containing the message headers
 
     @param[in]
-        property
-            name of the property to retrieve.
+        fd
+            descriptor of the regular file to upload
 
     @param[in]
-        buf
-            pointer to a buffer to receive the property value
+        stateFile
+            path of the state file used to record the upload progress
 
     @param[in]
-        len
-            length of the buffer to hold the received value
+        segmentSize
+            maximum size of each segment, or 0 for the default
 
-    @retval EOK the property was found and its value retrieved
-    @retval ENOENT the property was not found
-    @retval ENOMEM the property length exceeded the supplied buffer length
+    @param[out]
+        pResumeOffset
+            optional pointer to receive the file offset the upload
+            started from: 0 for a new upload, or the saved offset of a
+            resumed one.  It is set once the state file has been read,
+            even if the upload is then interrupted.
+
+    @retval EOK the file was uploaded
+    @retval EINVAL invalid arguments
+    @retval ESPIPE the file is not a regular file
+    @retval EMSGSIZE the segment size is too big
+    @retval ECANCELED the upload was dropped by a pre-send filter
+    @retval EIO the file was truncated during the upload
+    @retval other error which interrupted the upload.  The upload can
+            be resumed from the state file.
 
 ==============================================================================*/
-int IOTCLIENT_GetProperty( const char *headers,
-                           char *property,
-                           char *buf,
-                           size_t len )
+int IOTCLIENT_StreamResumable( IOTCLIENT_HANDLE hIoTClient,
+                               const char *headers,
+                               int fd,
+                               const char *stateFile,
+                               size_t segmentSize,
+                               uint64_t *pResumeOffset )
 {
     int result = EINVAL;
-    char *p;
-    size_t plen;
-    size_t i = 0;
+    struct stat st;
+    Checkpoint checkpoint;
+    uint64_t len;
 
-    if ( ( headers != NULL ) &&
-         ( property != NULL ) &&
-         ( buf != NULL ) &&
-         ( len > 0 ) )
+    if ( ( hIoTClient != NULL ) &&
+         ( headers != NULL ) &&
+         ( fd != -1 ) &&
+         ( stateFile != NULL ) )
     {
-        /* get the length of the property we are searching for */
-        plen = strlen(property);
+        if ( segmentSize == 0 )
+        {
+            segmentSize = RESUME_SEGMENT_SIZE;
+        }
 
-        /* search for the property name in the headers */
-        p = strstr( headers, property );
+        if ( fstat( fd, &st ) != 0 )
+        {
+            result = errno;
+        }
+        else if ( !S_ISREG( st.st_mode ) )
+        {
+            /* resuming requires a file which can be read at an offset */
+            result = ESPIPE;
+        }
+        else if ( segmentSize >= MAX_IOT_MSG_SIZE )
+        {
+            result = EMSGSIZE;
+        }
+        else if ( !filter_Accept( hIoTClient->pFilters, headers, NULL, 0 ) )
+        {
+            /* the upload was dropped by a pre-send filter */
+            result = ECANCELED;
+        }
+        else
+        {
+            /* a checkpoint which was not loaded starts at offset 0 */
+            (void)checkpoint_Load( stateFile, &st, &checkpoint );
+            if ( pResumeOffset != NULL )
+            {
+                *pResumeOffset = checkpoint.offset;
+            }
 
-        /* if we fail from this point onwards it is because the property
-           value length exceeds the available buffer length provided by
-           the caller */
-        result = ENOMEM;
+            result = EOK;
+        }
 
-        /* confirm what we found is a property name */
-        if ( ( p != NULL ) && ( p[plen] == ':' ) )
+        if ( ( result == EOK ) && ( checkpoint.size == 0 ) )
         {
-            /* point to the start of the proerty value */
-            p = &p[plen+1];
-            while( i < len )
+            /* an empty file is uploaded as a single empty segment */
+            result = iotclient_SendSegment( hIoTClient,
+                                            headers,
+                                            fd,
+                                            &checkpoint,
+                                            0 );
+        }
+
+        while ( ( result == EOK ) &&
+                ( checkpoint.offset < checkpoint.size ) )
+        {
+            len = checkpoint.size - checkpoint.offset;
+            if ( len > segmentSize )
             {
-                if ( ( p[i] == '\n' ) || ( p[i] == '\0' ) )
+                len = segmentSize;
+            }
+
+            result = iotclient_SendSegment( hIoTClient,
+                                            headers,
+                                            fd,
+                                            &checkpoint,
+                                            (size_t)len );
+            if ( result == EOK )
+            {
+                /* record the delivered offset */
+                checkpoint.offset += len;
+                result = checkpoint_Save( stateFile, &checkpoint );
+            }
+        }
+
+        if ( result == EOK )
+        {
+            /* the upload is complete, so update the pre-send filters.
+               An interrupted upload is evaluated afresh on resumption */
+            filter_Commit( hIoTClient->pFilters, headers, NULL, 0 );
+
+            result = checkpoint_Remove( stateFile );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SendFile                                                        */
+/*!
+    Send the content of a file as an IOT message via the IOT Hub service.
+
+    The IOTCLIENT_SendFile function is used to send the content of a
+    regular file (eg. an image or a recorded data set) to the cloud via
+    the IOT Hub service.
+
+    Unlike IOTCLIENT_Stream, the file is not read through an intermediate
+    buffer.  Instead it is mapped into memory and the message body is
+    written directly from the mapping into the message body FIFO.
+    The kernel is advised that the mapping will be accessed sequentially
+    so it can read ahead aggressively while the body is being written.
+
+    The message headers are formatted as per IOTCLIENT_Send.
+
+    @param[in]
+        hIotClient
+            handle to the IOT Client
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        path
+            path to the regular file to send as the message body
+
+    @retval EOK message delivered to IOTHub ingress queue
+    @retval EINVAL invalid arguments, or the path is not a regular file
+    @retval EMSGSIZE the message body or message headers are too big
+    @retval ECANCELED the message was dropped by a pre-send filter
+    @retval EBADF invalid message queue descriptor
+    @retval other error as returned by open(), fstat() or mmap()
+
+==============================================================================*/
+int IOTCLIENT_SendFile( IOTCLIENT_HANDLE hIoTClient,
+                        const char *headers,
+                        const char *path )
+{
+    int result = EINVAL;
+    int fd;
+    struct stat sb;
+    void *p = NULL;
+    size_t len = 0;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( headers != NULL ) &&
+         ( path != NULL ) )
+    {
+        fd = open( path, O_RDONLY );
+        if ( fd != -1 )
+        {
+            if ( fstat( fd, &sb ) == 0 )
+            {
+                if ( !S_ISREG( sb.st_mode ) )
                 {
-                    /* NUL terminate the returned property value */
-                    buf[i] = 0;
-                    result = EOK;
+                    /* only regular files can be mapped */
+                    result = EINVAL;
+                }
+                else if ( sb.st_size >= MAX_IOT_MSG_SIZE )
+                {
+                    /* message body is too large */
+                    result = EMSGSIZE;
                 }
                 else
                 {
-                    buf[i] = p[i];
+                    len = (size_t)sb.st_size;
+                    result = EOK;
                 }
+            }
+            else
+            {
+                result = errno;
+            }
 
-                i++;
+            if ( ( result == EOK ) && ( len > 0 ) )
+            {
+                /* map the file content for reading */
+                p = mmap( NULL, len, PROT_READ, MAP_PRIVATE, fd, 0 );
+                if ( p != MAP_FAILED )
+                {
+                    /* we will read through the file once, front to back */
+                    (void)madvise( p, len, MADV_SEQUENTIAL );
+                }
+                else
+                {
+                    p = NULL;
+                    result = errno;
+                }
             }
+
+            /* the mapping remains valid after the file is closed */
+            close( fd );
         }
         else
         {
-            result = ENOENT;
+            result = errno;
+        }
+
+        if ( ( result == EOK ) &&
+             ( !filter_Accept( hIoTClient->pFilters,
+                               headers,
+                               ( p != NULL ) ? p : (void *)"",
+                               len ) ) )
+        {
+            /* the message was dropped by a pre-send filter */
+            result = ECANCELED;
+        }
+
+        if ( result == EOK )
+        {
+            /* send the message header to the IOT Hub service */
+            result = iotclient_SendHeaders( hIoTClient, headers, len, false );
+            if ( result == EOK )
+            {
+                /* the message is sent, so update the pre-send filters */
+                filter_Commit( hIoTClient->pFilters,
+                               headers,
+                               ( p != NULL ) ? p : (void *)"",
+                               len );
+
+                /* send the message body directly from the mapping */
+                result = iotclient_SendBody( hIoTClient,
+                                             ( p != NULL ) ? p : (void *)"",
+                                             len );
+            }
+        }
+
+        if ( p != NULL )
+        {
+            munmap( p, len );
         }
     }
 
@@ -630,75 +1963,123 @@ int IOTCLIENT_GetProperty( const char *headers,
 }
 
 /*============================================================================*/
-/*  IOTCLIENT_Close                                                           */
+/*  IOTCLIENT_AllocBuffer                                                     */
 /*!
-    Close the connection to the IOTHub service
+    Allocate a page-aligned message body transfer buffer
 
-    The IOTCLIENT_Close function closes the connection to the IOTHub
-    service and frees up any resources used by the IOT Client connection.
+    The IOTCLIENT_AllocBuffer function allocates a page-aligned buffer
+    which can be filled with message body data and then handed over to
+    the IOT Client using IOTCLIENT_SendBuffer.  Buffers are taken from
+    a small per-client pool of unused buffers where possible.
 
     @param[in]
         hIoTClient
             handle to the IOT Client
 
-    @retval EOK - the connection was successfully closed
-    @retval EINVAL - an invalid IOT Client handle was specified
+    @param[in]
+        size
+            minimum size of the buffer to allocate
+
+    @retval pointer to the page-aligned buffer
+    @retval NULL if the buffer could not be allocated
 
 ==============================================================================*/
-int IOTCLIENT_Close( IOTCLIENT_HANDLE hIoTClient )
+void *IOTCLIENT_AllocBuffer( IOTCLIENT_HANDLE hIoTClient, size_t size )
 {
-    int result = EINVAL;
+    IoTClientBuffer *pBuffer = NULL;
+    IoTClientBuffer **ppBuffer;
+    size_t pageSize = (size_t)sysconf( _SC_PAGESIZE );
+    size_t mapSize;
+    void *p;
 
-    if ( hIoTClient != NULL )
+    if ( ( hIoTClient != NULL ) &&
+         ( size > 0 ) &&
+         ( size < MAX_IOT_MSG_SIZE ) )
     {
-        iotclient_log( hIoTClient, "iotclient: closing");
-
-        /* destroy the IOT FIFO */
-        iotclient_DestroyFIFO( hIoTClient );
+        /* one header page plus the buffer rounded up to a page boundary */
+        mapSize = pageSize + ( ( size + pageSize - 1 ) & ~( pageSize - 1 ) );
 
-        /* destroy the IOT transmit message queue */
-        iotclient_DestroyTxMessageQueue( hIoTClient );
+        /* look for an unused buffer in the pool which is big enough */
+        ppBuffer = &hIoTClient->pBufferPool;
+        while ( *ppBuffer != NULL )
+        {
+            if ( (*ppBuffer)->mapSize >= mapSize )
+            {
+                pBuffer = *ppBuffer;
+                *ppBuffer = pBuffer->pNext;
+                pBuffer->pNext = NULL;
+                hIoTClient->nPooledBuffers--;
+                break;
+            }
 
-        /* destroy the IOT receive message queue */
-        iotclient_DestroyRxMessageQueue( hIoTClient );
+            ppBuffer = &(*ppBuffer)->pNext;
+        }
 
-        /* free the IoTClient object */
-        free( hIoTClient );
-        result = EOK;
+        if ( pBuffer == NULL )
+        {
+            /* create a new anonymous mapping */
+            p = mmap( NULL,
+                      mapSize,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS,
+                      -1,
+                      0 );
+            if ( p != MAP_FAILED )
+            {
+                pBuffer = (IoTClientBuffer *)p;
+                pBuffer->mapSize = mapSize;
+                pBuffer->pNext = NULL;
+            }
+        }
     }
 
-    return result;
+    return ( pBuffer != NULL ) ? (char *)pBuffer + pageSize : NULL;
 }
 
 /*============================================================================*/
-/*  IOTCLIENT_SetVerbose                                                      */
+/*  IOTCLIENT_FreeBuffer                                                      */
 /*!
-    Set the IOT Client library verbosity level
+    Release an unsent message body transfer buffer
 
-    The IOTCLIENT_SetVerbose function enables or disables the IOT client
-    verbose debug output.
+    The IOTCLIENT_FreeBuffer function returns a buffer allocated with
+    IOTCLIENT_AllocBuffer which will not be sent, back to the IOT Client.
+    It is retained in the buffer pool for re-use if there is space,
+    otherwise it is unmapped.
+
+    Buffers which have been passed to IOTCLIENT_SendBuffer must not be
+    released with this function.
 
     @param[in]
         hIoTClient
             handle to the IOT Client
 
     @param[in]
-        verbose
-            boolean to enable/disable verbose output
+        buf
+            pointer to the buffer returned by IOTCLIENT_AllocBuffer
 
-    @retval EOK - the verbose level was set
-    @retval EINVAL - an invalid IOT Client handle was specified
+    @retval EOK the buffer was released
+    @retval EINVAL invalid arguments
 
 ==============================================================================*/
-int IOTCLIENT_SetVerbose( IOTCLIENT_HANDLE hIoTClient, bool verbose )
+int IOTCLIENT_FreeBuffer( IOTCLIENT_HANDLE hIoTClient, void *buf )
 {
     int result = EINVAL;
+    IoTClientBuffer *pBuffer;
 
-    if ( hIoTClient != NULL )
+    if ( ( hIoTClient != NULL ) &&
+         ( buf != NULL ) )
     {
-        hIoTClient->verbose = verbose;
-
-        iotclient_log( hIoTClient, "iotclient: verbose mode enabled");
+        pBuffer = iotclient_GetBufferHeader( buf );
+        if ( hIoTClient->nPooledBuffers < MAX_POOLED_BUFFERS )
+        {
+            pBuffer->pNext = hIoTClient->pBufferPool;
+            hIoTClient->pBufferPool = pBuffer;
+            hIoTClient->nPooledBuffers++;
+        }
+        else
+        {
+            munmap( pBuffer, pBuffer->mapSize );
+        }
 
         result = EOK;
     }
@@ -707,22 +2088,25 @@ int IOTCLIENT_SetVerbose( IOTCLIENT_HANDLE hIoTClient, bool verbose )
 }
 
 /*============================================================================*/
-/*  iotclient_SendHeaders                                                     */
+/*  IOTCLIENT_SendBuffer                                                      */
 /*!
-    Send IOT message headers via the IOT Hub service.
-
-    The message headers are a collection of key:value pairs, one per line
-    separated by a newline.  The last header has an additional newline
-    character to indicate that it is the last one.  The message headers
-    are a text string and must be terminated with a NUL character.
+    Send an IOT message from a transfer buffer without copying the body
 
-    eg.
+    The IOTCLIENT_SendBuffer function is used to send an IOT message
+    whose body has been prepared in a buffer allocated with
+    IOTCLIENT_AllocBuffer.
 
-    my-header-1:value-1\n
-    my-header-2:value-2\n\n
+    Ownership of the buffer passes to the IOT Client, whether or not the
+    message was successfully sent.  The body pages are gifted to the
+    message body FIFO using vmsplice() so they are moved into the pipe
+    rather than being copied.  Since the pages are referenced by the pipe
+    until the IOT Hub service has read them, the caller must not access
+    the buffer once this function has been called.  The IOT Client holds
+    on to the buffer until the pipe has been drained, and then returns
+    it to the buffer pool, so a steady stream of sends re-uses the same
+    few mappings rather than mapping and faulting in new pages each time.
 
-    The message body is an octet array.  It may contain binary or ASCII
-    data.  It cannot exceed 256KB in length.
+    The message headers are formatted as per IOTCLIENT_Send.
 
     @param[in]
         hIotClient
@@ -732,64 +2116,92 @@ int IOTCLIENT_SetVerbose( IOTCLIENT_HANDLE hIoTClient, bool verbose )
         headers
             pointer to a NUL terminated string containing the message headers
 
+    @param[in]
+        buf
+            pointer to the body buffer returned by IOTCLIENT_AllocBuffer
+
+    @param[in]
+        bodylen
+            number of octets in the message body
+
     @retval EOK message delivered to IOTHub ingress queue
     @retval EINVAL invalid arguments
-    @retval EMSGSIZE the message body or message headers are too big
+    @retval EMSGSIZE the message body exceeds the buffer size
+    @retval ECANCELED the message was dropped by a pre-send filter
     @retval EBADF invalid message queue descriptor
 
 ==============================================================================*/
-static int iotclient_SendHeaders( IOTCLIENT_HANDLE hIoTClient,
-                                  const char *headers )
+int IOTCLIENT_SendBuffer( IOTCLIENT_HANDLE hIoTClient,
+                          const char *headers,
+                          void *buf,
+                          size_t bodylen )
 {
     int result = EINVAL;
-    size_t len;
-    size_t totalLength;
-    mqd_t q;
-    const char preamble[] = "IOTC";
-    char *txbuf;
+    IoTClientBuffer *pBuffer;
+    size_t pageSize = (size_t)sysconf( _SC_PAGESIZE );
+    bool drained;
 
     if ( ( hIoTClient != NULL ) &&
-         ( hIoTClient->txBuf != NULL ) &&
-         ( headers != NULL ) )
+         ( buf != NULL ) )
     {
+        pBuffer = iotclient_GetBufferHeader( buf );
 
-        /* check the header size against the maximum message size
-           allowing room for the preamble and PID of the client */
-        len = strlen( headers );
-        totalLength = len + 8;
-
-        if( totalLength < hIoTClient->maxMessageSize )
+        if ( headers == NULL )
         {
-            /* construct the transmit buffer */
-            /* preamble + pid + headers */
-            txbuf = hIoTClient->txBuf;
-            memcpy(txbuf, preamble, 4);
-            memcpy(&txbuf[4], &(hIoTClient->pid), 4);
-            memcpy(&txbuf[8], headers, len);
-
-            /* get the message queue */
-            q = hIoTClient->txMsgQ;
-            if( q != (mqd_t)-1)
+            result = EINVAL;
+        }
+        else if ( bodylen > pBuffer->mapSize - pageSize )
+        {
+            result = EMSGSIZE;
+        }
+        else if ( !filter_Accept( hIoTClient->pFilters,
+                                  headers,
+                                  buf,
+                                  bodylen ) )
+        {
+            /* the message was dropped by a pre-send filter */
+            result = ECANCELED;
+        }
+        else
+        {
+            /* send the message header to the IOT Hub service */
+            result = iotclient_SendHeaders( hIoTClient,
+                                            headers,
+                                            bodylen,
+                                            false );
+            if ( result == EOK )
             {
-                /* send the message */
-                iotclient_log( hIoTClient, "iotclient: sending headers");
-                if ( mq_send(q, txbuf, totalLength, 0) == 0 )
+                /* the message is sent, so update the pre-send filters */
+                filter_Commit( hIoTClient->pFilters, headers, buf, bodylen );
+
+                /* gift the message body to the IOT Hub service */
+                result = iotclient_GiftBody( hIoTClient,
+                                             buf,
+                                             bodylen,
+                                             &drained );
+                if ( ( drained == false ) &&
+                     ( hIoTClient->nGiftedBuffers < MAX_POOLED_BUFFERS ) )
                 {
-                    result = EOK;
+                    /* the pipe still references the gifted pages, so
+                       hold the buffer until they have been read */
+                    pBuffer->pNext = hIoTClient->pGiftedBuffers;
+                    hIoTClient->pGiftedBuffers = pBuffer;
+                    hIoTClient->nGiftedBuffers++;
+                    pBuffer = NULL;
                 }
-                else
+                else if ( drained == false )
                 {
-                    result = errno;
+                    /* the pipe holds its own references to the pages */
+                    munmap( pBuffer, pBuffer->mapSize );
+                    pBuffer = NULL;
                 }
             }
-            else
-            {
-                result = EBADF;
-            }
         }
-        else
+
+        if ( pBuffer != NULL )
         {
-            result = EMSGSIZE;
+            /* the pipe does not reference the buffer, so re-use it */
+            IOTCLIENT_FreeBuffer( hIoTClient, buf );
         }
     }
 
@@ -797,249 +2209,6014 @@ static int iotclient_SendHeaders( IOTCLIENT_HANDLE hIoTClient,
 }
 
 /*============================================================================*/
-/*  iotclient_log                                                             */
+/*  IOTCLIENT_CreateReceiver                                                  */
 /*!
-    Generate a debug output log
+    Create and IOTCLIENT message receiver
+
+    The IOTCLIENT_CreateReceiver function creates an IOTCLIENT message
+    receiver which can received cloud-to-device messages from the IOTHUB
+    service.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the message queue
+
+    @param[in]
+        name
+            name of the receiver.
+
+    @param[in]
+        maxMessages
+            maximum number of messages that can be queued
+
+    @param[in]
+        size
+            max size of allowed command-to-device messages
+
+    @retval EOK the message queue and message buffer were created
+    @retval ENOMEM the message buffer could not be allocated
+    @retval errno other message as reported by mq_open
+
+==============================================================================*/
+int IOTCLIENT_CreateReceiver( IOTCLIENT_HANDLE hIoTClient,
+                              char *name,
+                              int maxMessages,
+                              size_t size )
+{
+    int result = EINVAL;
+    struct mq_attr attr;
+    char *receiver = NULL;
+
+    attr.mq_maxmsg = maxMessages;
+    attr.mq_msgsize = size;
+
+    if ( hIoTClient != NULL )
+    {
+        /* initialize descriptors */
+        hIoTClient->rxMsgQ = -1;
+
+        /* build the message queue name */
+        if ( asprintf( &receiver, "/%s", name ) > 0 )
+        {
+            /* allocate memory for the received messages, with room
+               for a NUL terminator after the longest message */
+            hIoTClient->rxBufSize = size;
+            hIoTClient->rx.buf = calloc( 1, size + 1 );
+            if ( hIoTClient->rx.buf != NULL )
+            {
+                /* create the receive message queue */
+                hIoTClient->rxMsgQ = mq_open( receiver,
+                                            O_RDONLY | O_CREAT,
+                                            0666,
+                                            &attr );
+                result = ( hIoTClient->rxMsgQ != -1 ) ? EOK : errno;
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+
+            free( receiver );
+            receiver = NULL;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Receive                                                         */
+/*!
+    Receive a message from the IOTHUB Service
+
+    The IOTCLIENT_Receiver function waits for a received message from the
+    IOTHUB service.  When the message is retrieved it is split into
+    a set of message headers, and a message body component.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the message queue
+
+    @param[in]
+        name
+            name of the receiver.
+
+    @param[in]
+        maxMessages
+            maximum number of messages that can be queued
+
+    @param[in]
+        size
+            max size of allowed command-to-device messages
+
+    @retval EOK the message queue and message buffer were created
+    @retval ENOMEM the message buffer could not be allocated
+    @retval errno other message as reported by mq_open
+
+==============================================================================*/
+int IOTCLIENT_Receive( IOTCLIENT_HANDLE hIoTClient,
+                       char **ppHeader,
+                       char **ppBody,
+                       size_t *pHeaderLength,
+                       size_t *pBodyLength )
+{
+    int result = EINVAL;
+    ssize_t n;
+    unsigned int prio;
+    IOTCLIENT_MESSAGE message;
+
+    if( ( hIoTClient != NULL ) &&
+        ( hIoTClient->rxMsgQ != -1 ) &&
+        ( hIoTClient->rx.buf != NULL ) &&
+        ( hIoTClient->rxBufSize > 0 ) &&
+        ( ppHeader != NULL ) &&
+        ( ppBody != NULL ) &&
+        ( pHeaderLength != NULL ) &&
+        ( pBodyLength != NULL ) &&
+        ( hIoTClient->pReceiver == NULL ) )
+    {
+        /* wait for a message on the receive queue */
+        n = mq_receive( hIoTClient->rxMsgQ,
+                        hIoTClient->rx.buf,
+                        hIoTClient->rxBufSize,
+                        &prio );
+        if ( n > 0 )
+        {
+            /* split the message into its headers and body */
+            iotclient_ParseMessage( &hIoTClient->rx,
+                                    n,
+                                    hIoTClient->options.flags,
+                                    &message );
+
+            *ppHeader = message.headers;
+            *pHeaderLength = message.headerLength;
+            *ppBody = message.body;
+            *pBodyLength = message.bodyLength;
+            result = EOK;
+        }
+        else
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_ReceiveMany                                                     */
+/*!
+    Receive a batch of messages from the IOTHUB Service
+
+    The IOTCLIENT_ReceiveMany function waits for a received message from
+    the IOTHUB service, and then drains up to maxMessages - 1 further
+    messages which are already queued, without waiting.  This allows a
+    burst of messages to be handled with a single wakeup.
+
+    Each message is received into its own buffer from a receive buffer
+    pool owned by the IOT Client, and is split into its headers and
+    body.  The message descriptors remain valid until the next call to
+    IOTCLIENT_ReceiveMany or IOTCLIENT_Close.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the receive message queue
+
+    @param[out]
+        pMessages
+            pointer to an array of message descriptors to populate
+
+    @param[in]
+        maxMessages
+            maximum number of messages to receive
+
+    @param[out]
+        pCount
+            pointer to the location to store the number of messages received
+
+    @retval EOK one or more messages were received
+    @retval EINVAL invalid arguments
+    @retval ENOMEM the receive buffer pool could not be allocated
+    @retval errno other error as reported by mq_receive
+
+==============================================================================*/
+int IOTCLIENT_ReceiveMany( IOTCLIENT_HANDLE hIoTClient,
+                           IOTCLIENT_MESSAGE *pMessages,
+                           size_t maxMessages,
+                           size_t *pCount )
+{
+    int result = EINVAL;
+    struct timespec ts = { 0, 0 };
+    IoTClientRxBuffer *pRx;
+    unsigned int prio;
+    size_t count = 0;
+    ssize_t n;
+
+    if( ( hIoTClient != NULL ) &&
+        ( hIoTClient->rxMsgQ != -1 ) &&
+        ( hIoTClient->rxBufSize > 0 ) &&
+        ( pMessages != NULL ) &&
+        ( maxMessages > 0 ) &&
+        ( pCount != NULL ) &&
+        ( hIoTClient->pReceiver == NULL ) )
+    {
+        result = EOK;
+
+        while ( count < maxMessages )
+        {
+            pRx = iotclient_GetRxBuffer( hIoTClient, count );
+            if ( pRx == NULL )
+            {
+                /* return the messages already received, if any */
+                result = ( count == 0 ) ? ENOMEM : EOK;
+                break;
+            }
+
+            if ( count == 0 )
+            {
+                /* wait for the first message */
+                n = mq_receive( hIoTClient->rxMsgQ,
+                                pRx->buf,
+                                hIoTClient->rxBufSize,
+                                &prio );
+            }
+            else
+            {
+                /* poll for further queued messages */
+                n = mq_timedreceive( hIoTClient->rxMsgQ,
+                                     pRx->buf,
+                                     hIoTClient->rxBufSize,
+                                     &prio,
+                                     &ts );
+            }
+
+            if ( n > 0 )
+            {
+                iotclient_ParseMessage( pRx,
+                                        n,
+                                        hIoTClient->options.flags,
+                                        &pMessages[count] );
+                count++;
+            }
+            else if ( ( n == -1 ) && ( errno == EINTR ) )
+            {
+                continue;
+            }
+            else
+            {
+                /* the queue is drained, or the first receive failed */
+                result = ( count == 0 ) ? errno : EOK;
+                break;
+            }
+        }
+
+        *pCount = count;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetProperty                                                     */
+/*!
+    Get a property from the message headers
+
+    The IOTCLIENT_GetProperty function searches for a property in the
+    message headers given its name. If the property is found, its value
+    is copied into the supplied buffer.
+
+    If the property value is not found, or the size of its value exceeds
+    the length of the supplied buffer, this function will return an
+    error and the contents of the supplied buffer should be considered
+    invalid and should not be used.
+
+    @param[in]
+        headers
+            pointer to the message headers (NUL terminated string
+            containing concatendated message properties in the following
+            form: "name:value\n"
+
+    @param[in]
+        property
+            name of the property to retrieve.
+
+    @param[in]
+        buf
+            pointer to a buffer to receive the property value
+
+    @param[in]
+        len
+            length of the buffer to hold the received value
+
+    @retval EOK the property was found and its value retrieved
+    @retval ENOENT the property was not found
+    @retval ENOMEM the property length exceeded the supplied buffer length
+
+==============================================================================*/
+int IOTCLIENT_GetProperty( const char *headers,
+                           char *property,
+                           char *buf,
+                           size_t len )
+{
+    int result = EINVAL;
+    char *p;
+    size_t plen;
+    size_t i = 0;
+
+    if ( ( headers != NULL ) &&
+         ( property != NULL ) &&
+         ( buf != NULL ) &&
+         ( len > 0 ) )
+    {
+        /* get the length of the property we are searching for */
+        plen = strlen(property);
+
+        /* search for the property name in the headers */
+        p = strstr( headers, property );
+
+        /* if we fail from this point onwards it is because the property
+           value length exceeds the available buffer length provided by
+           the caller */
+        result = ENOMEM;
+
+        /* confirm what we found is a property name */
+        if ( ( p != NULL ) && ( p[plen] == ':' ) )
+        {
+            /* point to the start of the proerty value */
+            p = &p[plen+1];
+            while( i < len )
+            {
+                if ( ( p[i] == '\n' ) || ( p[i] == '\0' ) )
+                {
+                    /* NUL terminate the returned property value */
+                    buf[i] = 0;
+                    result = EOK;
+                }
+                else
+                {
+                    buf[i] = p[i];
+                }
+
+                i++;
+            }
+        }
+        else
+        {
+            result = ENOENT;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Close                                                           */
+/*!
+    Close the connection to the IOTHub service
+
+    The IOTCLIENT_Close function closes the connection to the IOTHub
+    service and frees up any resources used by the IOT Client connection.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @retval EOK - the connection was successfully closed
+    @retval EINVAL - an invalid IOT Client handle was specified
+
+==============================================================================*/
+int IOTCLIENT_Close( IOTCLIENT_HANDLE hIoTClient )
+{
+    int result = EINVAL;
+
+    if ( hIoTClient != NULL )
+    {
+        iotclient_log( hIoTClient, "iotclient: closing");
+
+        /* stop the library managed receiver */
+        IOTCLIENT_StopReceiver( hIoTClient );
+
+        /* cancel outstanding asynchronous messages */
+        iotclient_DestroyEvents( hIoTClient );
+
+        /* discard unacknowledged messages */
+        iotclient_DestroyAckQueue( hIoTClient );
+
+        /* destroy the IOT FIFO */
+        iotclient_DestroyFIFO( hIoTClient );
+
+        /* destroy the IOT transmit message queue */
+        iotclient_DestroyTxMessageQueue( hIoTClient );
+
+        /* destroy the IOT receive message queue */
+        iotclient_DestroyRxMessageQueue( hIoTClient );
+
+        /* release any pooled transfer buffers */
+        iotclient_DestroyBufferPool( hIoTClient );
+
+        /* release the pre-send filters */
+        filter_Destroy( hIoTClient->pFilters );
+        hIoTClient->pFilters = NULL;
+
+        /* release the io_uring engine */
+        iouring_Destroy( hIoTClient->pRing );
+        hIoTClient->pRing = NULL;
+
+        /* release the stream copy buffer */
+        free( hIoTClient->streamBuf );
+        hIoTClient->streamBuf = NULL;
+
+        /* release the IOT Client options */
+        iotclient_FreeOptions( hIoTClient );
+
+        /* free the IoTClient object */
+        free( hIoTClient );
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SetVerbose                                                      */
+/*!
+    Set the IOT Client library verbosity level
+
+    The IOTCLIENT_SetVerbose function enables or disables the IOT client
+    verbose debug output.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        verbose
+            boolean to enable/disable verbose output
+
+    @retval EOK - the verbose level was set
+    @retval EINVAL - an invalid IOT Client handle was specified
+
+==============================================================================*/
+int IOTCLIENT_SetVerbose( IOTCLIENT_HANDLE hIoTClient, bool verbose )
+{
+    int result = EINVAL;
+
+    if ( hIoTClient != NULL )
+    {
+        hIoTClient->verbose = verbose;
+
+        iotclient_log( hIoTClient, "iotclient: verbose mode enabled");
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SetPipeSize                                                     */
+/*!
+    Set the capacity of the message body FIFO
+
+    The IOTCLIENT_SetPipeSize function requests the pipe capacity to
+    be used for the message body FIFO.  Message bodies which fit in the
+    pipe can be written in one operation without waiting for the IOT Hub
+    service to drain the pipe.
+
+    The requested size is rounded up by the kernel to a power of two
+    number of pages, and is capped at the system limit given by
+    /proc/sys/fs/pipe-max-size.
+
+    If a size of zero is requested, the pipe capacity is sized
+    automatically to accommodate most of the message bodies which have
+    been sent so far.
+
+    Message bodies sent with IOTCLIENT_Send by the io_uring transport
+    are written through a FIFO opened by the kernel on the client's
+    behalf, and use the default pipe capacity.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        size
+            requested pipe capacity in bytes, or 0 for automatic sizing
+
+    @retval EOK - the pipe capacity was set
+    @retval EINVAL - an invalid IOT Client handle was specified
+
+==============================================================================*/
+int IOTCLIENT_SetPipeSize( IOTCLIENT_HANDLE hIoTClient, size_t size )
+{
+    int result = EINVAL;
+
+    if ( hIoTClient != NULL )
+    {
+        hIoTClient->pipeSize = ( size < pipeMaxSize ) ? size : pipeMaxSize;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetPipeSize                                                     */
+/*!
+    Get the effective capacity of the message body FIFO
+
+    The IOTCLIENT_GetPipeSize function gets the pipe capacity which
+    was in effect for the last message body sent to the IOT Hub service.
+    It is zero if no message body has been sent yet.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[out]
+        pSize
+            pointer to the location to store the effective pipe capacity
+
+    @retval EOK - the pipe capacity was retrieved
+    @retval EINVAL - invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_GetPipeSize( IOTCLIENT_HANDLE hIoTClient, size_t *pSize )
+{
+    int result = EINVAL;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( pSize != NULL ) )
+    {
+        *pSize = hIoTClient->effectivePipeSize;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetChunkStats                                                   */
+/*!
+    Get the chunk sizing of the last message body copied
+
+    The IOTCLIENT_GetChunkStats function gets the type of input, the
+    chunk sizes and the throughput of the last message body the IOT
+    Client streamed through its copy buffer.  Bodies which are spliced
+    do not pass through the buffer and are not reported.  The input
+    type is IOTCLIENT_INPUT_NONE if no body has been copied yet.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[out]
+        pStats
+            pointer to the location to store the chunk stats
+
+    @retval EOK - the chunk stats were retrieved
+    @retval EINVAL - invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_GetChunkStats( IOTCLIENT_HANDLE hIoTClient,
+                             IOTCLIENT_CHUNK_STATS *pStats )
+{
+    int result = EINVAL;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( pStats != NULL ) )
+    {
+        *pStats = hIoTClient->chunkStats;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetTransport                                                    */
+/*!
+    Get the transport engine in use by an IOT Client
+
+    The IOTCLIENT_GetTransport function gets the transport engine which
+    is in use by the IOT Client.  This may differ from the transport
+    requested when the client was created if the requested transport
+    is not supported by the system.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[out]
+        pTransport
+            pointer to the location to store the transport engine
+
+    @retval EOK - the transport engine was retrieved
+    @retval EINVAL - invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_GetTransport( IOTCLIENT_HANDLE hIoTClient,
+                            IOTCLIENT_TRANSPORT *pTransport )
+{
+    int result = EINVAL;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( pTransport != NULL ) )
+    {
+        *pTransport = ( hIoTClient->pRing != NULL )
+                        ? IOTCLIENT_TRANSPORT_IOURING
+                        : IOTCLIENT_TRANSPORT_FIFO;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetEventFd                                                      */
+/*!
+    Get a file descriptor to integrate the IOT Client into an event loop
+
+    The IOTCLIENT_GetEventFd function gets a file descriptor which can be
+    watched for readability by an external event loop (eg. epoll, poll
+    or select).  When it becomes readable, the event loop should call
+    IOTCLIENT_ProcessEvents to advance the asynchronous sends and
+    deliver received messages.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[out]
+        pFd
+            pointer to the location to store the file descriptor
+
+    @retval EOK - the file descriptor was retrieved
+    @retval EINVAL - invalid arguments
+    @retval other error as returned by epoll_create1() or timerfd_create()
+
+==============================================================================*/
+int IOTCLIENT_GetEventFd( IOTCLIENT_HANDLE hIoTClient, int *pFd )
+{
+    int result = EINVAL;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( pFd != NULL ) )
+    {
+        result = iotclient_InitEvents( hIoTClient );
+        if ( result == EOK )
+        {
+            *pFd = hIoTClient->epollFd;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_ProcessEvents                                                   */
+/*!
+    Process the IOT Client events without blocking
+
+    The IOTCLIENT_ProcessEvents function delivers any acknowledgements
+    received from the IOT Hub service, advances the asynchronous sends
+    as far as possible without blocking, invoking the send completion
+    callback of each message which completes, and delivers any received
+    messages to the receive callback.
+
+    Callbacks are only ever invoked from this function.  They may queue
+    further asynchronous messages, but must not close the IOT Client.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @retval EOK - the events were processed
+    @retval EINVAL - an invalid IOT Client handle was specified
+
+==============================================================================*/
+int IOTCLIENT_ProcessEvents( IOTCLIENT_HANDLE hIoTClient )
+{
+    int result = EINVAL;
+    uint64_t expirations;
+
+    if ( hIoTClient != NULL )
+    {
+        if ( hIoTClient->timerFd != -1 )
+        {
+            /* acknowledge the timer */
+            (void)read( hIoTClient->timerFd,
+                        &expirations,
+                        sizeof( expirations ) );
+        }
+
+        if ( hIoTClient->pWindow != NULL )
+        {
+            /* acknowledgements may free window slots for queued messages */
+            (void)iotclient_ProcessAcks( hIoTClient, false );
+        }
+
+        iotclient_ProcessSendQueue( hIoTClient );
+        iotclient_ProcessReceiveQueue( hIoTClient );
+
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SendAsync                                                       */
+/*!
+    Send an IOT message via the IOT Hub service without blocking
+
+    The IOTCLIENT_SendAsync function queues an IOT message to be sent
+    to the cloud via the IOT Hub service.  The message is transferred
+    by IOTCLIENT_ProcessEvents, and the completion callback is invoked
+    with the result once the message body has been delivered to the
+    IOT Hub service or the transfer fails.
+
+    The message headers are copied, but the message body is not.  It
+    must remain valid until the completion callback is invoked.
+
+    Asynchronous messages are sent in the order they are queued.
+    Synchronous sends fail with EBUSY while asynchronous messages
+    are outstanding.
+
+    On clients with an in-flight window, the completion callback is
+    invoked when the IOT Hub service acknowledges the message, with the
+    acknowledgement status, and the message body must remain valid until
+    then.  Messages wait in the queue while the window is full.
+
+    @param[in]
+        hIotClient
+            handle to the IOT Client
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        body
+            pointer to the message body
+
+    @param[in]
+        bodylen
+            number of octets in the message body
+
+    @param[in]
+        cb
+            completion callback, or NULL if no notification is required
+
+    @param[in]
+        ctx
+            context passed to the completion callback
+
+    @retval EOK message queued for transmission
+    @retval EINVAL invalid arguments
+    @retval EMSGSIZE the message body or message headers are too big
+    @retval ECANCELED the message was dropped by a pre-send filter
+    @retval ENOMEM memory could not be allocated for the message
+
+==============================================================================*/
+int IOTCLIENT_SendAsync( IOTCLIENT_HANDLE hIoTClient,
+                         const char *headers,
+                         const unsigned char *body,
+                         size_t bodylen,
+                         IOTCLIENT_SEND_CALLBACK cb,
+                         void *ctx )
+{
+    int result = EINVAL;
+
+    if ( body != NULL )
+    {
+        result = iotclient_QueueAsync( hIoTClient,
+                                       headers,
+                                       body,
+                                       bodylen,
+                                       -1,
+                                       cb,
+                                       ctx );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_StreamAsync                                                     */
+/*!
+    Stream an IOT message via the IOT Hub service without blocking
+
+    The IOTCLIENT_StreamAsync function queues an IOT message whose body
+    is read from a file descriptor until end of file.  The message is
+    transferred by IOTCLIENT_ProcessEvents, and the completion callback
+    is invoked with the result once the message body has been delivered
+    to the IOT Hub service or the transfer fails.
+
+    The file descriptor must remain open until the completion callback
+    is invoked.  It should be in non-blocking mode if reading from it
+    could block.  When IOTCLIENT_OPT_BODY_LENGTH clients announce the
+    length of a regular file, the completion callback reports EIO if
+    the file ends before that length, as per IOTCLIENT_Stream.
+
+    @param[in]
+        hIotClient
+            handle to the IOT Client
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        fd
+            file descriptor to stream data from
+
+    @param[in]
+        cb
+            completion callback, or NULL if no notification is required
+
+    @param[in]
+        ctx
+            context passed to the completion callback
+
+    @retval EOK message queued for transmission
+    @retval EINVAL invalid arguments
+    @retval EMSGSIZE the message headers are too big
+    @retval ECANCELED the message was dropped by a pre-send filter
+    @retval ENOMEM memory could not be allocated for the message
+
+==============================================================================*/
+int IOTCLIENT_StreamAsync( IOTCLIENT_HANDLE hIoTClient,
+                           const char *headers,
+                           int fd,
+                           IOTCLIENT_SEND_CALLBACK cb,
+                           void *ctx )
+{
+    int result = EINVAL;
+
+    if ( fd != -1 )
+    {
+        result = iotclient_QueueAsync( hIoTClient,
+                                       headers,
+                                       NULL,
+                                       0,
+                                       fd,
+                                       cb,
+                                       ctx );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_AddFilter                                                       */
+/*!
+    Attach a pre-send filter to the IOT Client
+
+    The IOTCLIENT_AddFilter function appends a filter to the IOT Client's
+    chain of pre-send filters.  Every message sent by the IOT Client is
+    evaluated by the filters in the order they were added, before the
+    message is copied or any of it is sent.  The send functions return
+    ECANCELED for a message which is dropped by a filter, and no
+    completion or acknowledgement callback is invoked for it.
+
+    The filter state (rate limit tokens, every nth counts, deadband
+    values and duplicate hashes) is only updated once a message has
+    been sent, so a message which fails to send, eg. with EAGAIN, is
+    not dropped by the filters when it is retried.
+
+    Streamed message bodies are not available to the filters, so the
+    deadband filter only applies to them if it uses a value property,
+    and the duplicate filter does not apply to them.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        pFilter
+            pointer to the filter definition.  Its strings are copied.
+
+    @retval EOK the filter was added
+    @retval EINVAL invalid arguments or filter definition
+    @retval ENOMEM the filter could not be allocated
+
+==============================================================================*/
+int IOTCLIENT_AddFilter( IOTCLIENT_HANDLE hIoTClient,
+                         const IOTCLIENT_FILTER *pFilter )
+{
+    int result = EINVAL;
+
+    if ( hIoTClient != NULL )
+    {
+        result = filter_Add( &hIoTClient->pFilters, pFilter );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_ClearFilters                                                    */
+/*!
+    Remove all pre-send filters from the IOT Client
+
+    The IOTCLIENT_ClearFilters function removes and destroys all of the
+    IOT Client's pre-send filters, along with their per-stream state.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @retval EOK the filters were removed
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_ClearFilters( IOTCLIENT_HANDLE hIoTClient )
+{
+    int result = EINVAL;
+
+    if ( hIoTClient != NULL )
+    {
+        filter_Destroy( hIoTClient->pFilters );
+        hIoTClient->pFilters = NULL;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SetRateLimit                                                    */
+/*!
+    Set the send rate limits of the IOT Client
+
+    The IOTCLIENT_SetRateLimit function limits the rate at which the
+    IOT Client sends messages and message body bytes, using a token
+    bucket for each.  Sends which exceed a limit block until it allows
+    them, or fail with EAGAIN if the IOT Client is non-blocking.
+    Asynchronous sends are paced by the IOT Client's event loop instead
+    of blocking.  The limits apply in addition to those of the IOT
+    Client's priority level.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        pLimit
+            pointer to the rate limits, or NULL to remove them
+
+    @retval EOK the rate limits were set
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_SetRateLimit( IOTCLIENT_HANDLE hIoTClient,
+                            const IOTCLIENT_RATE_LIMIT *pLimit )
+{
+    int result = EINVAL;
+
+    if ( hIoTClient != NULL )
+    {
+        result = ratelimit_Configure( &hIoTClient->limiter, pLimit );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SetPriorityRateLimit                                            */
+/*!
+    Set the process wide send rate limits of a priority level
+
+    The IOTCLIENT_SetPriorityRateLimit function limits the combined rate
+    at which all of the process's IOT Clients at the specified priority
+    level send messages and message body bytes.  This allows bulk
+    transfers to be paced on a low priority level without limiting
+    latency sensitive traffic on other levels.
+
+    @param[in]
+        priority
+            priority level, less than IOTCLIENT_PRIORITY_LEVELS
+
+    @param[in]
+        pLimit
+            pointer to the rate limits, or NULL to remove them
+
+    @retval EOK the rate limits were set
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_SetPriorityRateLimit( unsigned int priority,
+                                    const IOTCLIENT_RATE_LIMIT *pLimit )
+{
+    return ratelimit_ConfigurePriority( priority, pLimit );
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SetPriority                                                     */
+/*!
+    Set the message priority level of the IOT Client
+
+    The IOTCLIENT_SetPriority function sets the priority level which
+    the IOT Client's message headers are queued to the IOTHub with,
+    and selects the priority level rate limits which apply to it.
+    The default priority level is 0.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        priority
+            priority level, less than IOTCLIENT_PRIORITY_LEVELS
+
+    @retval EOK the priority level was set
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_SetPriority( IOTCLIENT_HANDLE hIoTClient,
+                           unsigned int priority )
+{
+    int result = EINVAL;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( priority < IOTCLIENT_PRIORITY_LEVELS ) )
+    {
+        hIoTClient->priority = priority;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetNextSendTime                                                 */
+/*!
+    Get the time until a message may be sent
+
+    The IOTCLIENT_GetNextSendTime function calculates how long it will
+    be until a message with the specified body length may be sent
+    without exceeding the rate limits of the IOT Client and its priority
+    level.  It does not block or consume any of the limits, so it can
+    be used to pace bulk transfers from an external event loop.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        length
+            length of the message body
+
+    @param[out]
+        pDelay
+            pointer to the location to store the delay (ms), rounded up.
+            0 if the message may be sent now.
+
+    @retval EOK the delay was calculated
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_GetNextSendTime( IOTCLIENT_HANDLE hIoTClient,
+                               size_t length,
+                               unsigned int *pDelay )
+{
+    int result = EINVAL;
+    uint64_t delay;
+
+    if ( ( hIoTClient != NULL ) && ( pDelay != NULL ) )
+    {
+        delay = ratelimit_Delay( hIoTClient->pLimiter,
+                                 hIoTClient->priority,
+                                 1,
+                                 length );
+
+        *pDelay = (unsigned int)( ( delay + 999999 ) / 1000000 );
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SetReceiveHandler                                               */
+/*!
+    Set the callback for cloud-to-device messages
+
+    The IOTCLIENT_SetReceiveHandler function registers a callback which
+    is invoked by IOTCLIENT_ProcessEvents for each cloud-to-device message
+    received by the IOT Client's receiver, so messages can be received
+    from an external event loop instead of blocking in IOTCLIENT_Receive.
+
+    The header and body pointers passed to the callback refer to the
+    receive buffer, and are only valid until the callback returns.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client, which must have a receiver
+
+    @param[in]
+        cb
+            receive callback, or NULL to stop receiving messages
+
+    @param[in]
+        ctx
+            context passed to the receive callback
+
+    @retval EOK - the receive callback was set
+    @retval EINVAL - an invalid IOT Client handle was specified
+    @retval EBADF - the IOT Client does not have a receiver
+    @retval other error as returned by epoll_ctl()
+
+==============================================================================*/
+int IOTCLIENT_SetReceiveHandler( IOTCLIENT_HANDLE hIoTClient,
+                                 IOTCLIENT_RECEIVE_CALLBACK cb,
+                                 void *ctx )
+{
+    int result = EINVAL;
+    struct epoll_event ev;
+    int op;
+
+    if ( hIoTClient != NULL )
+    {
+        if ( hIoTClient->rxMsgQ == -1 )
+        {
+            result = EBADF;
+        }
+        else if ( hIoTClient->pReceiver != NULL )
+        {
+            result = EBUSY;
+        }
+        else
+        {
+            result = iotclient_InitEvents( hIoTClient );
+        }
+
+        if ( result == EOK )
+        {
+            op = ( cb != NULL ) ? EPOLL_CTL_ADD : EPOLL_CTL_DEL;
+            if ( ( cb != NULL ) && ( hIoTClient->receiveCb != NULL ) )
+            {
+                /* already watching the receive queue */
+                op = 0;
+            }
+            else if ( ( cb == NULL ) && ( hIoTClient->receiveCb == NULL ) )
+            {
+                /* not watching the receive queue */
+                op = 0;
+            }
+
+            ev.events = EPOLLIN;
+            ev.data.fd = hIoTClient->rxMsgQ;
+            if ( ( op != 0 ) &&
+                 ( epoll_ctl( hIoTClient->epollFd,
+                              op,
+                              hIoTClient->rxMsgQ,
+                              &ev ) == -1 ) )
+            {
+                result = errno;
+            }
+            else
+            {
+                hIoTClient->receiveCb = cb;
+                hIoTClient->receiveCtx = ctx;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_StartReceiver                                                   */
+/*!
+    Start a library managed receiver thread and worker pool
+
+    The IOTCLIENT_StartReceiver function starts a receiver thread which
+    waits for cloud-to-device messages on the IOT Client's receive
+    message queue, and invokes the message handler for each one.
+
+    If the IOT Client options specify a number of workers, a pool of
+    worker threads is started, and the receiver thread hands each
+    message to the workers via a bounded queue.  The receiver thread
+    stops receiving while the queue is full.  Otherwise the message
+    handler is invoked on the receiver thread.  All of the threads are
+    bound to the CPU affinity mask specified in the IOT Client options.
+
+    With the IOTCLIENT_RECEIVE_ORDERED flag, each worker has its own
+    queue, and messages are assigned to a worker by the hash of their
+    correlation-id, so messages with the same correlation-id are handled
+    in the order they were received.  Messages without a correlation-id
+    are shared among the workers.
+
+    The headers and body passed to the message handler are only valid
+    for the duration of the call.  While the receiver is running, the
+    receive message queue cannot be read by any other means.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the receive message queue
+
+    @param[in]
+        cb
+            message handler
+
+    @param[in]
+        ctx
+            message handler context
+
+    @param[in]
+        queueDepth
+            number of messages each worker queue can hold, 0 for the default
+
+    @param[in]
+        flags
+            receiver flags
+
+    @retval EOK the receiver was started
+    @retval EINVAL invalid arguments
+    @retval EBADF the IOT Client does not have a receive message queue
+    @retval EBUSY the receive message queue is already being read
+    @retval ENOMEM the receiver could not be allocated
+    @retval other error as reported by pthread_create or eventfd
+
+==============================================================================*/
+int IOTCLIENT_StartReceiver( IOTCLIENT_HANDLE hIoTClient,
+                             IOTCLIENT_RECEIVE_CALLBACK cb,
+                             void *ctx,
+                             size_t queueDepth,
+                             uint32_t flags )
+{
+    int result = EINVAL;
+    IoTClientReceiver *pReceiver;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( cb != NULL ) )
+    {
+        if ( hIoTClient->rxMsgQ == -1 )
+        {
+            result = EBADF;
+        }
+        else if ( ( hIoTClient->pReceiver != NULL ) ||
+                  ( hIoTClient->receiveCb != NULL ) )
+        {
+            result = EBUSY;
+        }
+        else
+        {
+            pReceiver = calloc( 1, sizeof( IoTClientReceiver ) );
+            if ( pReceiver != NULL )
+            {
+                pReceiver->hIoTClient = hIoTClient;
+                pReceiver->cb = cb;
+                pReceiver->ctx = ctx;
+                pReceiver->flags = flags;
+
+                result = iotclient_InitReceiver( pReceiver,
+                                                 ( queueDepth > 0 )
+                                                    ? queueDepth
+                                                    : RECEIVE_QUEUE_DEPTH );
+                if ( result == EOK )
+                {
+                    result = pthread_create( &pReceiver->thread,
+                                             NULL,
+                                             iotclient_ReceiverThread,
+                                             pReceiver );
+                }
+
+                if ( result == EOK )
+                {
+                    pReceiver->running = true;
+                    iotclient_SetAffinity( hIoTClient, pReceiver->thread );
+                    hIoTClient->pReceiver = pReceiver;
+                }
+                else
+                {
+                    iotclient_DestroyReceiver( pReceiver );
+                }
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_StopReceiver                                                    */
+/*!
+    Stop the library managed receiver thread and worker pool
+
+    The IOTCLIENT_StopReceiver function stops the receiver thread.
+    Messages which have already been handed to the workers are handled
+    before the worker threads exit.  Messages remaining on the receive
+    message queue are left there.
+
+    This function must not be called from the message handler.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the receiver
+
+    @retval EOK the receiver was stopped
+    @retval EINVAL invalid arguments
+    @retval ENOENT the receiver is not running
+
+==============================================================================*/
+int IOTCLIENT_StopReceiver( IOTCLIENT_HANDLE hIoTClient )
+{
+    int result = EINVAL;
+
+    if ( hIoTClient != NULL )
+    {
+        if ( hIoTClient->pReceiver != NULL )
+        {
+            iotclient_DestroyReceiver( hIoTClient->pReceiver );
+            hIoTClient->pReceiver = NULL;
+            result = EOK;
+        }
+        else
+        {
+            result = ENOENT;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SendWithAck                                                     */
+/*!
+    Send an IOT message and request notification of its acknowledgement
+
+    The IOTCLIENT_SendWithAck function sends an IOT message as per
+    IOTCLIENT_Send, and registers a callback which is invoked when the
+    IOT Hub service acknowledges the message.  It returns as soon as the
+    message body has been written to the message body FIFO, so up to
+    the in-flight window size messages can be outstanding at once.
+    It only blocks when the in-flight window is full.
+
+    The acknowledgement callback is invoked with the status reported by
+    the IOT Hub service, or ECANCELED if the message is discarded
+    without being acknowledged.  It is invoked from within subsequent
+    IOT Client calls which process acknowledgements: the send functions,
+    IOTCLIENT_Flush, IOTCLIENT_GetInFlight, IOTCLIENT_Retransmit,
+    IOTCLIENT_ProcessEvents and IOTCLIENT_Close.
+
+    @param[in]
+        hIotClient
+            handle to the IOT Client, which must have an in-flight window
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        body
+            pointer to the message body
+
+    @param[in]
+        bodylen
+            number of octets in the message body
+
+    @param[in]
+        cb
+            acknowledgement callback
+
+    @param[in]
+        ctx
+            context passed to the acknowledgement callback
+
+    @retval EOK message delivered to IOTHub ingress queue
+    @retval EINVAL invalid arguments
+    @retval ENOTSUP the IOT Client does not have an in-flight window
+    @retval EMSGSIZE the message body or message headers are too big
+    @retval ETIMEDOUT the in-flight window is full and no acknowledgement
+            arrived within the ack timeout
+    @retval EAGAIN the in-flight window is full and the client is
+            non-blocking
+
+==============================================================================*/
+int IOTCLIENT_SendWithAck( IOTCLIENT_HANDLE hIoTClient,
+                           const char *headers,
+                           const unsigned char *body,
+                           size_t bodylen,
+                           IOTCLIENT_SEND_CALLBACK cb,
+                           void *ctx )
+{
+    int result = EINVAL;
+    IoTClientInFlight *pEntry;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( cb != NULL ) )
+    {
+        if ( hIoTClient->pWindow != NULL )
+        {
+            result = IOTCLIENT_Send( hIoTClient, headers, body, bodylen );
+        }
+        else
+        {
+            result = ENOTSUP;
+        }
+
+        if ( result == EOK )
+        {
+            pEntry = iotclient_FindInFlight( hIoTClient,
+                                             hIoTClient->nextSeq - 1 );
+            if ( pEntry != NULL )
+            {
+                pEntry->cb = cb;
+                pEntry->ctx = ctx;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Flush                                                           */
+/*!
+    Wait for all in-flight messages to be acknowledged
+
+    The IOTCLIENT_Flush function waits until the IOT Hub service has
+    acknowledged every message in the in-flight window, invoking the
+    acknowledgement callbacks as the acknowledgements arrive.
+    Each wait is bounded by the ack timeout specified in the options.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @retval EOK all messages have been acknowledged
+    @retval EINVAL an invalid IOT Client handle was specified
+    @retval ETIMEDOUT no acknowledgement arrived within the ack timeout
+    @retval other error as returned by mq_receive()
+
+==============================================================================*/
+int IOTCLIENT_Flush( IOTCLIENT_HANDLE hIoTClient )
+{
+    int result = EINVAL;
+
+    if ( hIoTClient != NULL )
+    {
+        result = EOK;
+        while ( ( result == EOK ) && ( hIoTClient->inFlight > 0 ) )
+        {
+            result = iotclient_ProcessAcks( hIoTClient, true );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Retransmit                                                      */
+/*!
+    Retransmit the unacknowledged messages
+
+    The IOTCLIENT_Retransmit function re-sends every message in the
+    in-flight window which has not been acknowledged by the IOT Hub
+    service, eg. after the IOT Hub service has been restarted or an
+    acknowledgement wait has timed out.  The IOTHub message queue is
+    re-opened first in case the IOT Hub service has re-created it.
+
+    Retransmitted messages carry their original sequence numbers so the
+    IOT Hub service can discard messages it has already forwarded, and
+    only acknowledge them.
+
+    Only messages sent with IOTCLIENT_Send, IOTCLIENT_SendWithAck or
+    IOTCLIENT_SendAsync retain their body.  Unacknowledged messages which
+    were streamed or sent from a file or transfer buffer cannot be
+    retransmitted, and are discarded from the in-flight window, invoking
+    their acknowledgement callbacks with ECANCELED.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[out]
+        pLost
+            pointer to the location to store the number of messages which
+            could not be retransmitted, or NULL if not required
+
+    @retval EOK the unacknowledged messages were retransmitted
+    @retval EINVAL the IOT Client does not have an in-flight window
+    @retval EBUSY asynchronous messages are queued
+    @retval other error as returned by mq_open() or the message transfer
+
+==============================================================================*/
+int IOTCLIENT_Retransmit( IOTCLIENT_HANDLE hIoTClient, size_t *pLost )
+{
+    int result = EINVAL;
+    IoTClientInFlight *pEntry;
+    size_t window;
+    size_t lost = 0;
+    size_t i;
+    uint32_t seq;
+    mqd_t q;
+    int flags;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( hIoTClient->pWindow != NULL ) )
+    {
+        result = ( hIoTClient->pSendQueue == NULL ) ? EOK : EBUSY;
+    }
+
+    if ( result == EOK )
+    {
+        /* the IOT Hub service may have re-created its message queue */
+        flags = O_WRONLY;
+        if ( hIoTClient->options.flags & IOTCLIENT_OPT_NONBLOCK )
+        {
+            flags |= O_NONBLOCK;
+        }
+
+        q = mq_open( hIoTClient->options.queueName, flags );
+        if ( q != (mqd_t)-1 )
+        {
+            mq_close( hIoTClient->txMsgQ );
+            hIoTClient->txMsgQ = q;
+        }
+        else
+        {
+            result = errno;
+        }
+    }
+
+    if ( result == EOK )
+    {
+        /* discard messages which have been acknowledged meanwhile */
+        (void)iotclient_ProcessAcks( hIoTClient, false );
+
+        /* re-send in sequence order, starting with the oldest */
+        window = hIoTClient->options.window;
+        for ( i = window; ( i > 0 ) && ( result == EOK ); i-- )
+        {
+            seq = hIoTClient->nextSeq - (uint32_t)i;
+            pEntry = &hIoTClient->pWindow[seq % window];
+            if ( ( pEntry->inUse == false ) || ( pEntry->seq != seq ) )
+            {
+                continue;
+            }
+
+            if ( ( pEntry->headers == NULL ) || ( pEntry->body == NULL ) )
+            {
+                /* the message cannot be reconstructed */
+                iotclient_ReleaseInFlight( hIoTClient, pEntry, ECANCELED );
+                lost++;
+                continue;
+            }
+
+            if ( mq_send( hIoTClient->txMsgQ,
+                          pEntry->headers,
+                          pEntry->headerLength,
+                          hIoTClient->priority ) == 0 )
+            {
+                result = iotclient_SendBody( hIoTClient,
+                                             pEntry->body,
+                                             pEntry->bodyLength );
+            }
+            else
+            {
+                result = errno;
+            }
+        }
+
+        if ( pLost != NULL )
+        {
+            *pLost = lost;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_GetInFlight                                                     */
+/*!
+    Get the number of unacknowledged messages
+
+    The IOTCLIENT_GetInFlight function processes any acknowledgements
+    which have been received from the IOT Hub service, and gets the
+    number of messages in the in-flight window which remain unacknowledged.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[out]
+        pCount
+            pointer to the location to store the number of messages
+
+    @retval EOK the number of messages was retrieved
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_GetInFlight( IOTCLIENT_HANDLE hIoTClient, size_t *pCount )
+{
+    int result = EINVAL;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( pCount != NULL ) )
+    {
+        if ( hIoTClient->pWindow != NULL )
+        {
+            (void)iotclient_ProcessAcks( hIoTClient, false );
+        }
+
+        *pCount = hIoTClient->inFlight;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_SendHeaders                                                     */
+/*!
+    Send IOT message headers via the IOT Hub service.
+
+    The message headers are a collection of key:value pairs, one per line
+    separated by a newline.  The last header has an additional newline
+    character to indicate that it is the last one.  The message headers
+    are a text string and must be terminated with a NUL character.
+
+    eg.
+
+    my-header-1:value-1\n
+    my-header-2:value-2\n\n
+
+    The headers are preceded by a preamble which identifies the client
+    so the IOT Hub service can locate its message body FIFO.  Channel 0
+    clients send "IOTC" followed by the 32-bit process id, and use the
+    FIFO iothub_<pid>.  Clients on other channels send "IOTX" followed
+    by the 32-bit process id and 32-bit channel id, and use the FIFO
+    iothub_<pid>_<channel>.  Clients with an in-flight window send "IOTS"
+    followed by the process id, channel id and 32-bit message sequence
+    number.
+
+    @param[in]
+        hIotClient
+            handle to the IOT Client
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        length
+            length of the message body, or IOTCLIENT_LENGTH_UNKNOWN.
+            A known length is announced in the preamble of
+            IOTCLIENT_OPT_BODY_LENGTH clients
+
+    @param[in]
+        paced
+            true if the body is paced to the byte rate limits as it is
+            sent, false to take its length from the byte rate limits
+            with the message
+
+    @retval EOK message delivered to IOTHub ingress queue
+    @retval EINVAL invalid arguments
+    @retval EMSGSIZE the message body or message headers are too big
+    @retval EBADF invalid message queue descriptor
+    @retval EAGAIN the rate limits do not allow a non-blocking message
+
+==============================================================================*/
+static int iotclient_SendHeaders( IOTCLIENT_HANDLE hIoTClient,
+                                  const char *headers,
+                                  size_t length,
+                                  bool paced )
+{
+    int result = EINVAL;
+    size_t totalLength;
+    mqd_t q;
+    char *txbuf;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( hIoTClient->txBuf != NULL ) &&
+         ( headers != NULL ) )
+    {
+        txbuf = hIoTClient->txBuf;
+        result = EOK;
+
+        if ( hIoTClient->pSendQueue != NULL )
+        {
+            /* asynchronous messages must be sent first */
+            result = EBUSY;
+        }
+        else
+        {
+            /* wait for the rate limits to allow the message */
+            result = iotclient_AcquireRate( hIoTClient,
+                                            ( ( paced == true ) ||
+                                              ( length ==
+                                                IOTCLIENT_LENGTH_UNKNOWN ) )
+                                              ? 0
+                                              : length );
+        }
+
+        if ( ( result == EOK ) && ( hIoTClient->pWindow != NULL ) )
+        {
+            /* wait for space in the in-flight window.  This is done
+               first since acknowledgement callbacks may send messages */
+            result = iotclient_ReserveSlot( hIoTClient );
+        }
+
+        if ( result == EOK )
+        {
+            /* construct the transmit buffer */
+            result = iotclient_BuildHeaders( hIoTClient,
+                                             headers,
+                                             length,
+                                             txbuf,
+                                             hIoTClient->maxMessageSize,
+                                             &totalLength );
+        }
+
+        if ( result == EOK )
+        {
+            /* get the message queue */
+            q = hIoTClient->txMsgQ;
+            if( q != (mqd_t)-1)
+            {
+                /* send the message */
+                iotclient_log( hIoTClient, "iotclient: sending headers");
+                if ( mq_send( q,
+                              txbuf,
+                              totalLength,
+                              hIoTClient->priority ) == 0 )
+                {
+                    /* track the message until it is acknowledged */
+                    iotclient_TrackMessage( hIoTClient, txbuf, totalLength );
+                    result = EOK;
+                }
+                else
+                {
+                    result = errno;
+                }
+            }
+            else
+            {
+                result = EBADF;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_BuildHeaders                                                    */
+/*!
+    Build the message sent on the IOTHub message queue
+
+    The iotclient_BuildHeaders function constructs the message which is
+    sent to the IOT Hub service on the IOTHub message queue, consisting
+    of the message preamble followed by the message headers.  Clients
+    created with IOTCLIENT_OPT_BINARY_HEADERS send the headers as a
+    binary header block.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        length
+            length of the message body, or IOTCLIENT_LENGTH_UNKNOWN
+
+    @param[in]
+        buf
+            pointer to the buffer to construct the message in
+
+    @param[in]
+        size
+            size of the buffer
+
+    @param[out]
+        pLength
+            pointer to the location to store the message length
+
+    @retval EOK the message was constructed
+    @retval EMSGSIZE the message does not fit in the buffer
+    @retval EINVAL the headers cannot be binary encoded
+
+==============================================================================*/
+static int iotclient_BuildHeaders( IOTCLIENT_HANDLE hIoTClient,
+                                   const char *headers,
+                                   size_t length,
+                                   char *buf,
+                                   size_t size,
+                                   size_t *pLength )
+{
+    int result = EMSGSIZE;
+    size_t len;
+    size_t preambleLength;
+
+    /* preamble + headers */
+    preambleLength = iotclient_BuildPreamble( hIoTClient, length, buf, size );
+
+    if ( ( preambleLength > 0 ) &&
+         ( hIoTClient->options.flags & IOTCLIENT_OPT_BINARY_HEADERS ) )
+    {
+        /* encode the headers after the preamble */
+        result = IOTCLIENT_EncodeHeaders( headers,
+                                          &buf[preambleLength],
+                                          size - preambleLength,
+                                          &len );
+        if ( result == EOK )
+        {
+            *pLength = len + preambleLength;
+        }
+    }
+    else
+    {
+        /* check the header size against the maximum message size
+           allowing room for the preamble */
+        len = strlen( headers );
+        if( ( preambleLength > 0 ) &&
+            ( len + preambleLength < size ) )
+        {
+            memcpy( &buf[preambleLength], headers, len );
+            *pLength = len + preambleLength;
+            result = EOK;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_AnnounceTrailers                                                */
+/*!
+    Add the trailer announcement to the message headers
+
+    The iotclient_AnnounceTrailers function appends a "trailer" property
+    listing the names of the trailers which will follow the message
+    body to the message headers.
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        pTrailers
+            pointer to the trailer definition
+
+    @retval pointer to the allocated headers
+    @retval NULL if the headers could not be allocated
+
+==============================================================================*/
+static char *iotclient_AnnounceTrailers( const char *headers,
+                                         const IOTCLIENT_TRAILERS *pTrailers )
+{
+    char *trailedHeaders = NULL;
+    size_t n = strlen( headers );
+    bool names = ( pTrailers->names != NULL ) &&
+                 ( *pTrailers->names != '\0' );
+    bool length = ( pTrailers->flags & IOTCLIENT_TRAILER_LENGTH ) != 0;
+    bool digest = ( pTrailers->digest != IOTCLIENT_DIGEST_NONE );
+
+    /* the announcement follows the caller's headers */
+    while ( ( n > 0 ) && ( headers[n - 1] == '\n' ) )
+    {
+        n--;
+    }
+
+    if ( asprintf( &trailedHeaders,
+                   "%.*s%s" TRAILER_HEADER ":%s%s%s%s%s\n\n",
+                   (int)n,
+                   headers,
+                   ( n > 0 ) ? "\n" : "",
+                   names ? pTrailers->names : "",
+                   ( names && length ) ? "," : "",
+                   length ? TRAILER_LENGTH : "",
+                   ( ( names || length ) && digest ) ? "," : "",
+                   digest ? TRAILER_DIGEST : "" ) < 0 )
+    {
+        trailedHeaders = NULL;
+    }
+
+    return trailedHeaders;
+}
+
+/*============================================================================*/
+/*  iotclient_BuildTrailers                                                   */
+/*!
+    Build the trailers of a streamed message
+
+    The iotclient_BuildTrailers function collects the trailers written
+    by the trailer callback, followed by the body length and digest
+    trailers if they were requested.  The digest is written as the
+    algorithm name and the hexadecimal digest, eg.
+    content-digest:sha-256=<hex>
+
+    @param[in]
+        pTrailers
+            pointer to the trailer definition
+
+    @param[in]
+        pDigest
+            pointer to the body digest
+
+    @param[in]
+        length
+            length of the message body
+
+    @param[out]
+        buf
+            pointer to the buffer to write the NUL terminated trailers to
+
+    @param[in]
+        size
+            size of the buffer
+
+    @retval EOK the trailers were built
+    @retval EMSGSIZE the trailers do not fit in the buffer
+    @retval other error as returned by the trailer callback
+
+==============================================================================*/
+static int iotclient_BuildTrailers( const IOTCLIENT_TRAILERS *pTrailers,
+                                    Digest *pDigest,
+                                    uint64_t length,
+                                    char *buf,
+                                    size_t size )
+{
+    int result = EOK;
+    unsigned char value[IOTCLIENT_DIGEST_MAX_LENGTH];
+    size_t len = 0;
+    size_t n;
+    size_t i;
+
+    buf[0] = '\0';
+
+    if ( pTrailers->cb != NULL )
+    {
+        /* leave room for a newline and the final newline */
+        result = pTrailers->cb( pTrailers->ctx, length, buf, size - 2 );
+        len = strnlen( buf, size - 2 );
+        if ( len == size - 2 )
+        {
+            result = EMSGSIZE;
+        }
+        else if ( ( len > 0 ) && ( buf[len - 1] != '\n' ) )
+        {
+            buf[len++] = '\n';
+        }
+    }
+
+    if ( ( result == EOK ) &&
+         ( pTrailers->flags & IOTCLIENT_TRAILER_LENGTH ) )
+    {
+        len += snprintf( &buf[len],
+                         size - len,
+                         TRAILER_LENGTH ":%" PRIu64 "\n",
+                         length );
+    }
+
+    if ( ( result == EOK ) &&
+         ( len < size ) &&
+         ( pTrailers->digest != IOTCLIENT_DIGEST_NONE ) )
+    {
+        n = digest_Final( pDigest, value );
+        len += snprintf( &buf[len],
+                         size - len,
+                         TRAILER_DIGEST ":%s=",
+                         ( pTrailers->digest == IOTCLIENT_DIGEST_SHA256 )
+                            ? "sha-256"
+                            : "crc32c" );
+
+        for ( i = 0; ( i < n ) && ( len < size ); i++ )
+        {
+            len += snprintf( &buf[len], size - len, "%02x", value[i] );
+        }
+
+        if ( len < size )
+        {
+            len += snprintf( &buf[len], size - len, "\n" );
+        }
+    }
+
+    if ( ( result == EOK ) && ( len < size - 1 ) )
+    {
+        /* the last trailer has an additional newline */
+        buf[len++] = '\n';
+        buf[len] = '\0';
+    }
+    else if ( result == EOK )
+    {
+        result = EMSGSIZE;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_SendTrailers                                                    */
+/*!
+    Send the trailers of a streamed message via the IOT Hub service
+
+    The iotclient_SendTrailers function sends the trailers which follow
+    a streamed message body on the IOTHub message queue, preceded by
+    the trailer preamble identifying the client.  Clients created with
+    IOTCLIENT_OPT_BINARY_HEADERS send the trailers using the binary
+    header encoding.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        trailers
+            pointer to a NUL terminated string containing the trailers
+
+    @retval EOK the trailers were delivered to the IOTHub ingress queue
+    @retval EMSGSIZE the trailers are too big
+    @retval EBADF invalid message queue descriptor
+    @retval other error as returned by mq_send()
+
+==============================================================================*/
+static int iotclient_SendTrailers( IOTCLIENT_HANDLE hIoTClient,
+                                   const char *trailers )
+{
+    int result = EMSGSIZE;
+    IoTClientPreamble preamble;
+    char *buf = hIoTClient->txBuf;
+    size_t size = hIoTClient->maxMessageSize - sizeof( IoTClientPreamble );
+    size_t len;
+
+    memcpy( preamble.id, PREAMBLE_ID_TRAILER, 4 );
+    preamble.pid = (uint32_t)hIoTClient->pid;
+    preamble.channel = hIoTClient->channel;
+    memcpy( buf, &preamble, sizeof( IoTClientPreamble ) );
+
+    if ( hIoTClient->options.flags & IOTCLIENT_OPT_BINARY_HEADERS )
+    {
+        result = IOTCLIENT_EncodeHeaders( trailers,
+                                          &buf[sizeof( IoTClientPreamble )],
+                                          size,
+                                          &len );
+    }
+    else
+    {
+        len = strlen( trailers );
+        if ( len < size )
+        {
+            memcpy( &buf[sizeof( IoTClientPreamble )], trailers, len );
+            result = EOK;
+        }
+    }
+
+    if ( result == EOK )
+    {
+        if ( hIoTClient->txMsgQ == (mqd_t)-1 )
+        {
+            result = EBADF;
+        }
+        else if ( mq_send( hIoTClient->txMsgQ,
+                           buf,
+                           sizeof( IoTClientPreamble ) + len,
+                           hIoTClient->priority ) != 0 )
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_ParseMessage                                                    */
+/*!
+    Split a received message into its headers and body
+
+    The iotclient_ParseMessage function splits a message received into
+    a receive buffer into its headers and body components.
+    Only the n received octets are examined, so stale data from an
+    earlier, larger message is never parsed.
+
+    Clients created with IOTCLIENT_OPT_BINARY_HEADERS decode binary
+    header blocks into the receive buffer's header buffer, and the body
+    follows the block.  Clients created with IOTCLIENT_OPT_FRAMED_HEADERS
+    accept length-framed messages, which carry an explicit header
+    length, so the body is located without scanning and may contain any
+    octets.  Neither encoding is looked for unless its option is set,
+    so a headerless body is never mistaken for one.  Otherwise the
+    header/body delimiter is searched for within the received octets.
+    Text headers are NUL terminated, and the received message is NUL
+    terminated after its last octet.
+
+    @param[in]
+        pRx
+            pointer to the receive buffer holding the message
+
+    @param[in]
+        n
+            number of bytes received
+
+    @param[in]
+        flags
+            IOTCLIENT_OPT_xxx option flags of the receiving IOT Client
+
+    @param[out]
+        pMessage
+            pointer to the message descriptor to populate
+
+==============================================================================*/
+static void iotclient_ParseMessage( IoTClientRxBuffer *pRx,
+                                    ssize_t n,
+                                    uint32_t flags,
+                                    IOTCLIENT_MESSAGE *pMessage )
+{
+    char *buf = pRx->buf;
+    char *p;
+    size_t len;
+
+    /* the receive buffer has room for a terminator after the message */
+    buf[n] = '\0';
+
+    if ( ( flags & IOTCLIENT_OPT_BINARY_HEADERS ) &&
+         ( iotclient_DecodeBinaryHeaders( pRx, n, pMessage ) == EOK ) )
+    {
+        /* the message has a binary header block */
+    }
+    else if ( ( flags & IOTCLIENT_OPT_FRAMED_HEADERS ) &&
+              ( headers_GetFramedLength( buf, n, &len ) == EOK ) )
+    {
+        /* shift the header text down over the last prefix octet so it
+           can be NUL terminated without overwriting the body */
+        p = &buf[HEADERS_FRAMED_PREFIX_LENGTH - 1];
+        memmove( p, &buf[HEADERS_FRAMED_PREFIX_LENGTH], len );
+        p[len] = '\0';
+
+        pMessage->headers = p;
+        pMessage->headerLength = len;
+        pMessage->body = &buf[HEADERS_FRAMED_PREFIX_LENGTH + len];
+        pMessage->bodyLength = n - HEADERS_FRAMED_PREFIX_LENGTH - len;
+    }
+    else if ( ( p = memmem( buf, n, "\n\n", 2 ) ) != NULL )
+    {
+        /* NUL terminate the headers */
+        *p = '\0';
+
+        /* calculate the header length */
+        len = p - buf;
+
+        pMessage->headers = buf;
+        pMessage->headerLength = len;
+
+        /* skip over the header/body delimiter */
+        pMessage->body = p + 2;
+        pMessage->bodyLength = n - len - 2;
+    }
+    else
+    {
+        /* no header data is included in the received message */
+        pMessage->headers = NULL;
+        pMessage->headerLength = 0;
+        pMessage->body = buf;
+        pMessage->bodyLength = n;
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_DecodeBinaryHeaders                                             */
+/*!
+    Decode the binary header block of a received message
+
+    The iotclient_DecodeBinaryHeaders function decodes the binary header
+    block at the start of a message in a receive buffer into the
+    receive buffer's header buffer, which is grown as required.  The
+    header block carries its own length, so the body is located without
+    scanning.
+
+    @param[in]
+        pRx
+            pointer to the receive buffer holding the message
+
+    @param[in]
+        n
+            number of bytes received
+
+    @param[out]
+        pMessage
+            pointer to the message descriptor to populate
+
+    @retval EOK the binary headers were decoded
+    @retval EBADMSG the message does not have a valid binary header block
+    @retval ENOMEM the received headers buffer could not be allocated
+
+==============================================================================*/
+static int iotclient_DecodeBinaryHeaders( IoTClientRxBuffer *pRx,
+                                          ssize_t n,
+                                          IOTCLIENT_MESSAGE *pMessage )
+{
+    int result = EBADMSG;
+    size_t headerLength = 0;
+    size_t encodedLength = 0;
+    char *p;
+
+    if ( headers_IsBinary( pRx->buf, n ) )
+    {
+        /* find the text length */
+        result = IOTCLIENT_DecodeHeaders( pRx->buf,
+                                          n,
+                                          NULL,
+                                          0,
+                                          &headerLength,
+                                          &encodedLength );
+    }
+
+    if ( ( result == EOK ) &&
+         ( headerLength >= pRx->headerBufSize ) )
+    {
+        p = realloc( pRx->headerBuf, headerLength + 1 );
+        if ( p != NULL )
+        {
+            pRx->headerBuf = p;
+            pRx->headerBufSize = headerLength + 1;
+        }
+        else
+        {
+            result = ENOMEM;
+        }
+    }
+
+    if ( result == EOK )
+    {
+        result = IOTCLIENT_DecodeHeaders( pRx->buf,
+                                          n,
+                                          pRx->headerBuf,
+                                          pRx->headerBufSize,
+                                          &headerLength,
+                                          &encodedLength );
+    }
+
+    if ( result == EOK )
+    {
+        pMessage->headers = pRx->headerBuf;
+        pMessage->headerLength = headerLength;
+        pMessage->body = &pRx->buf[encodedLength];
+        pMessage->bodyLength = n - encodedLength;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_GetRxBuffer                                                     */
+/*!
+    Get a buffer from the receive buffer pool
+
+    The iotclient_GetRxBuffer function gets the receive buffer at the
+    specified position in the IOT Client's receive buffer pool.  The
+    pool is grown as required, and its buffers are retained for re-use
+    until the IOT Client is closed.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the receive buffer pool
+
+    @param[in]
+        index
+            position of the receive buffer in the pool
+
+    @retval pointer to the receive buffer
+    @retval NULL if the receive buffer could not be allocated
+
+==============================================================================*/
+static IoTClientRxBuffer *iotclient_GetRxBuffer( IOTCLIENT_HANDLE hIoTClient,
+                                                 size_t index )
+{
+    IoTClientRxBuffer *pPool;
+    IoTClientRxBuffer *pRx = NULL;
+
+    if ( index >= hIoTClient->rxPoolSize )
+    {
+        /* grow the pool to hold the requested buffer */
+        pPool = realloc( hIoTClient->pRxPool,
+                         ( index + 1 ) * sizeof( IoTClientRxBuffer ) );
+        if ( pPool != NULL )
+        {
+            memset( &pPool[hIoTClient->rxPoolSize],
+                    0,
+                    ( index + 1 - hIoTClient->rxPoolSize ) *
+                        sizeof( IoTClientRxBuffer ) );
+
+            hIoTClient->pRxPool = pPool;
+            hIoTClient->rxPoolSize = index + 1;
+        }
+    }
+
+    if ( index < hIoTClient->rxPoolSize )
+    {
+        pRx = &hIoTClient->pRxPool[index];
+        if ( pRx->buf == NULL )
+        {
+            /* allow room for a NUL terminator after the message */
+            pRx->buf = malloc( hIoTClient->rxBufSize + 1 );
+            if ( pRx->buf == NULL )
+            {
+                pRx = NULL;
+            }
+        }
+    }
+
+    return pRx;
+}
+
+/*============================================================================*/
+/*  iotclient_DestroyRxPool                                                   */
+/*!
+    Destroy the receive buffer pool
+
+    The iotclient_DestroyRxPool function frees all of the buffers in
+    the IOT Client's receive buffer pool.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the receive buffer pool
+
+==============================================================================*/
+static void iotclient_DestroyRxPool( IOTCLIENT_HANDLE hIoTClient )
+{
+    size_t i;
+
+    if ( hIoTClient->pRxPool != NULL )
+    {
+        for ( i = 0; i < hIoTClient->rxPoolSize; i++ )
+        {
+            free( hIoTClient->pRxPool[i].buf );
+            free( hIoTClient->pRxPool[i].headerBuf );
+        }
+
+        free( hIoTClient->pRxPool );
+        hIoTClient->pRxPool = NULL;
+        hIoTClient->rxPoolSize = 0;
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_InitEvents                                                      */
+/*!
+    Initialize the event loop integration
+
+    The iotclient_InitEvents function creates the epoll descriptor which
+    an external event loop watches, and the timer used to schedule event
+    processing, if they have not already been created.  The acknowledgement
+    queue, if any, is added to the epoll set.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @retval EOK the event loop integration is initialized
+    @retval other error as returned by epoll_create1() or timerfd_create()
+
+==============================================================================*/
+static int iotclient_InitEvents( IOTCLIENT_HANDLE hIoTClient )
+{
+    int result = EOK;
+    struct epoll_event ev;
+
+    if ( hIoTClient->epollFd == -1 )
+    {
+        hIoTClient->epollFd = epoll_create1( EPOLL_CLOEXEC );
+        hIoTClient->timerFd = timerfd_create( CLOCK_MONOTONIC,
+                                              TFD_NONBLOCK | TFD_CLOEXEC );
+
+        ev.events = EPOLLIN;
+        ev.data.fd = hIoTClient->timerFd;
+
+        if ( ( hIoTClient->epollFd == -1 ) ||
+             ( hIoTClient->timerFd == -1 ) ||
+             ( epoll_ctl( hIoTClient->epollFd,
+                          EPOLL_CTL_ADD,
+                          hIoTClient->timerFd,
+                          &ev ) == -1 ) )
+        {
+            result = errno;
+        }
+
+        if ( ( result == EOK ) &&
+             ( hIoTClient->ackMsgQ != (mqd_t)-1 ) )
+        {
+            /* acknowledgements are delivered from the event loop */
+            ev.events = EPOLLIN;
+            ev.data.fd = hIoTClient->ackMsgQ;
+            if ( epoll_ctl( hIoTClient->epollFd,
+                            EPOLL_CTL_ADD,
+                            hIoTClient->ackMsgQ,
+                            &ev ) == -1 )
+            {
+                result = errno;
+            }
+        }
+
+        if ( result != EOK )
+        {
+            iotclient_DestroyEvents( hIoTClient );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_DestroyEvents                                                   */
+/*!
+    Clean up the event loop integration
+
+    The iotclient_DestroyEvents function cancels all outstanding
+    asynchronous messages, invoking their completion callbacks with
+    ECANCELED, and closes the epoll and timer descriptors.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+==============================================================================*/
+static void iotclient_DestroyEvents( IOTCLIENT_HANDLE hIoTClient )
+{
+    IoTClientAsyncMessage *pMsg;
+
+    if ( hIoTClient->asyncFifoFd != -1 )
+    {
+        close( hIoTClient->asyncFifoFd );
+        hIoTClient->asyncFifoFd = -1;
+    }
+
+    while ( hIoTClient->pSendQueue != NULL )
+    {
+        pMsg = hIoTClient->pSendQueue;
+        hIoTClient->pSendQueue = pMsg->pNext;
+
+        if ( pMsg->cb != NULL )
+        {
+            pMsg->cb( pMsg->ctx, ECANCELED );
+        }
+
+        free( pMsg->headers );
+        free( pMsg );
+    }
+
+    hIoTClient->pSendQueueTail = NULL;
+
+    if ( hIoTClient->timerFd != -1 )
+    {
+        close( hIoTClient->timerFd );
+        hIoTClient->timerFd = -1;
+    }
+
+    if ( hIoTClient->epollFd != -1 )
+    {
+        close( hIoTClient->epollFd );
+        hIoTClient->epollFd = -1;
+    }
+
+    hIoTClient->waitFd = -1;
+    hIoTClient->receiveCb = NULL;
+
+    free( hIoTClient->asyncBuf );
+    hIoTClient->asyncBuf = NULL;
+}
+
+/*============================================================================*/
+/*  iotclient_QueueAsync                                                      */
+/*!
+    Queue an asynchronous message
+
+    The iotclient_QueueAsync function builds the header message for
+    an asynchronous message and appends it to the send queue.  Event
+    processing is scheduled if it is the only message in the queue.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        body
+            pointer to the message body, or NULL if it is streamed
+
+    @param[in]
+        bodylen
+            number of octets in the message body
+
+    @param[in]
+        fd
+            file descriptor to stream the message body from, or -1
+
+    @param[in]
+        cb
+            completion callback
+
+    @param[in]
+        ctx
+            context passed to the completion callback
+
+    @retval EOK message queued for transmission
+    @retval EINVAL invalid arguments
+    @retval EMSGSIZE the message body or message headers are too big
+    @retval ENOMEM memory could not be allocated for the message
+
+==============================================================================*/
+static int iotclient_QueueAsync( IOTCLIENT_HANDLE hIoTClient,
+                                 const char *headers,
+                                 const unsigned char *body,
+                                 size_t bodylen,
+                                 int fd,
+                                 IOTCLIENT_SEND_CALLBACK cb,
+                                 void *ctx )
+{
+    int result = EINVAL;
+    IoTClientAsyncMessage *pMsg;
+    size_t size;
+    size_t length;
+
+    if ( ( hIoTClient == NULL ) ||
+         ( headers == NULL ) ||
+         ( hIoTClient->txMsgQ == (mqd_t)-1 ) ||
+         ( hIoTClient->fifoName == NULL ) )
+    {
+        return EINVAL;
+    }
+
+    if ( bodylen >= MAX_IOT_MSG_SIZE )
+    {
+        return EMSGSIZE;
+    }
+
+    if ( !filter_Accept( hIoTClient->pFilters, headers, body, bodylen ) )
+    {
+        /* the message was dropped by a pre-send filter */
+        return ECANCELED;
+    }
+
+    result = iotclient_InitEvents( hIoTClient );
+    if ( ( result == EOK ) &&
+         ( fd != -1 ) &&
+         ( hIoTClient->asyncBuf == NULL ) )
+    {
+        hIoTClient->asyncBuf = malloc( ASYNC_STREAM_BUFSIZE );
+        result = ( hIoTClient->asyncBuf != NULL ) ? EOK : ENOMEM;
+    }
+
+    if ( result == EOK )
+    {
+        result = ENOMEM;
+
+        /* the length of a streamed body is known for regular files
+           when the client announces body lengths */
+        length = ( fd == -1 )
+                 ? bodylen
+                 : iotclient_KnownLength( hIoTClient, fd );
+
+        size = sizeof( IoTClientLengthPreamble ) + strlen( headers ) + 1;
+        if ( ( size > hIoTClient->maxMessageSize ) ||
+             ( hIoTClient->options.flags & IOTCLIENT_OPT_BINARY_HEADERS ) )
+        {
+            /* the binary encoding may be slightly longer than the text */
+            size = hIoTClient->maxMessageSize;
+        }
+
+        pMsg = calloc( 1, sizeof( IoTClientAsyncMessage ) );
+        if ( pMsg != NULL )
+        {
+            pMsg->headers = malloc( size );
+            if ( pMsg->headers != NULL )
+            {
+                result = iotclient_BuildHeaders( hIoTClient,
+                                                 headers,
+                                                 length,
+                                                 pMsg->headers,
+                                                 size,
+                                                 &pMsg->headerLength );
+            }
+
+            if ( result == EOK )
+            {
+                pMsg->state = ASYNC_STATE_HEADERS;
+                pMsg->body = body;
+                pMsg->bodyLength = bodylen;
+                pMsg->fd = fd;
+                pMsg->limit = ( length != IOTCLIENT_LENGTH_UNKNOWN )
+                              ? length
+                              : MAX_IOT_MSG_SIZE;
+                pMsg->known = ( length != IOTCLIENT_LENGTH_UNKNOWN );
+                pMsg->cb = cb;
+                pMsg->ctx = ctx;
+
+                if ( hIoTClient->pSendQueueTail != NULL )
+                {
+                    hIoTClient->pSendQueueTail->pNext = pMsg;
+                }
+                else
+                {
+                    hIoTClient->pSendQueue = pMsg;
+
+                    /* make the event descriptor readable */
+                    iotclient_ScheduleEvents( hIoTClient, 1 );
+                }
+
+                hIoTClient->pSendQueueTail = pMsg;
+
+                /* the queue owns the message now, so update the
+                   pre-send filters */
+                filter_Commit( hIoTClient->pFilters, headers, body, bodylen );
+            }
+            else
+            {
+                free( pMsg->headers );
+                free( pMsg );
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_ProcessSendQueue                                                */
+/*!
+    Advance the asynchronous send queue
+
+    The iotclient_ProcessSendQueue function advances the messages at the
+    head of the send queue until one cannot make progress without
+    blocking.  Each message which completes is removed from the queue
+    before its completion callback is invoked.  On clients with an
+    in-flight window, the completion callback of a message which was
+    transferred successfully is deferred until it is acknowledged.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+==============================================================================*/
+static void iotclient_ProcessSendQueue( IOTCLIENT_HANDLE hIoTClient )
+{
+    IoTClientAsyncMessage *pMsg;
+    IoTClientInFlight *pEntry;
+    int rc;
+
+    while ( ( pMsg = hIoTClient->pSendQueue ) != NULL )
+    {
+        rc = iotclient_AdvanceAsync( hIoTClient, pMsg );
+        if ( rc == EINPROGRESS )
+        {
+            break;
+        }
+
+        /* the message is complete */
+        iotclient_WaitFd( hIoTClient, -1, 0 );
+        if ( hIoTClient->asyncFifoFd != -1 )
+        {
+            close( hIoTClient->asyncFifoFd );
+            hIoTClient->asyncFifoFd = -1;
+        }
+
+        if ( ( pMsg->fd != -1 ) && ( rc == EOK ) )
+        {
+            iotclient_RecordBodySize( hIoTClient, pMsg->total );
+        }
+
+        hIoTClient->pSendQueue = pMsg->pNext;
+        if ( hIoTClient->pSendQueue == NULL )
+        {
+            hIoTClient->pSendQueueTail = NULL;
+        }
+
+        pEntry = ( ( rc == EOK ) && ( pMsg->sequenced == true ) )
+                    ? iotclient_FindInFlight( hIoTClient, pMsg->seq )
+                    : NULL;
+        if ( pEntry != NULL )
+        {
+            /* complete the message when it is acknowledged.  The caller
+               keeps the body valid until then, so it can be re-sent */
+            pEntry->cb = pMsg->cb;
+            pEntry->ctx = pMsg->ctx;
+            if ( pMsg->fd == -1 )
+            {
+                pEntry->body = (unsigned char *)pMsg->body;
+                pEntry->bodyLength = pMsg->bodyLength;
+            }
+        }
+        else if ( pMsg->cb != NULL )
+        {
+            pMsg->cb( pMsg->ctx, rc );
+        }
+
+        free( pMsg->headers );
+        free( pMsg );
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_AdvanceAsync                                                    */
+/*!
+    Advance an asynchronous message transfer
+
+    The iotclient_AdvanceAsync function moves an asynchronous message
+    through its transfer states without blocking.  Headers are sent with
+    a timed send which has already expired, the FIFO is opened in
+    non-blocking mode and retried on a timer until the IOT Hub service
+    has opened it for reading, and the body is written in non-blocking
+    mode.  Whenever the transfer would block, the descriptor it is
+    waiting on is added to the epoll set.  When the rate limits do not
+    allow the message or the next block of its body, the timer is armed
+    to resume the transfer once they do.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        pMsg
+            pointer to the message to advance
+
+    @retval EOK the message transfer is complete
+    @retval EINPROGRESS the message transfer would block
+    @retval other error which terminated the message transfer
+
+==============================================================================*/
+static int iotclient_AdvanceAsync( IOTCLIENT_HANDLE hIoTClient,
+                                   IoTClientAsyncMessage *pMsg )
+{
+    int result = EOK;
+    struct timespec ts = { 0, 0 };
+    ssize_t n;
+    size_t len;
+    uint64_t delay;
+    int fd;
+
+    while ( ( result == EOK ) && ( pMsg->state != ASYNC_STATE_DONE ) )
+    {
+        switch ( pMsg->state )
+        {
+            case ASYNC_STATE_HEADERS:
+                if ( ( hIoTClient->pWindow != NULL ) &&
+                     ( iotclient_WindowFull( hIoTClient ) == true ) )
+                {
+                    /* the acknowledgement queue is in the epoll set,
+                       so an acknowledgement will resume the transfer */
+                    iotclient_WaitFd( hIoTClient, -1, 0 );
+                    result = EINPROGRESS;
+                    break;
+                }
+
+                if ( pMsg->admitted == false )
+                {
+                    delay = ratelimit_Acquire( hIoTClient->pLimiter,
+                                               hIoTClient->priority,
+                                               1,
+                                               0 );
+                    if ( delay > 0 )
+                    {
+                        /* resume the transfer when the rate limits
+                           allow it */
+                        iotclient_WaitFd( hIoTClient, -1, 0 );
+                        iotclient_ScheduleEvents( hIoTClient, (long)delay );
+                        result = EINPROGRESS;
+                        break;
+                    }
+
+                    pMsg->admitted = true;
+                }
+
+                if ( hIoTClient->pWindow != NULL )
+                {
+                    /* stamp the sequence number now the message is sent */
+                    memcpy( &pMsg->headers[offsetof( IoTClientSequencedPreamble,
+                                                     seq )],
+                            &hIoTClient->nextSeq,
+                            sizeof( uint32_t ) );
+                }
+
+                if ( mq_timedsend( hIoTClient->txMsgQ,
+                                   pMsg->headers,
+                                   pMsg->headerLength,
+                                   hIoTClient->priority,
+                                   &ts ) == 0 )
+                {
+                    if ( hIoTClient->pWindow != NULL )
+                    {
+                        pMsg->seq = hIoTClient->nextSeq;
+                        pMsg->sequenced = true;
+                        iotclient_TrackMessage( hIoTClient,
+                                                pMsg->headers,
+                                                pMsg->headerLength );
+                    }
+
+                    pMsg->state = ASYNC_STATE_OPEN;
+                }
+                else if ( ( errno == ETIMEDOUT ) || ( errno == EAGAIN ) )
+                {
+                    /* wait for space in the message queue */
+                    result = iotclient_WaitFd( hIoTClient,
+                                               hIoTClient->txMsgQ,
+                                               EPOLLOUT );
+                }
+                else if ( errno != EINTR )
+                {
+                    result = errno;
+                }
+                break;
+
+            case ASYNC_STATE_OPEN:
+                fd = iotclient_OpenFIFO( hIoTClient,
+                                         pMsg->bodyLength,
+                                         O_NONBLOCK );
+                if ( fd != -1 )
+                {
+                    hIoTClient->asyncFifoFd = fd;
+                    hIoTClient->retryDelay = 0;
+                    pMsg->state = ASYNC_STATE_BODY;
+                }
+                else if ( errno == ENXIO )
+                {
+                    /* the hub has not opened the FIFO yet, so there is
+                       nothing to wait on.  Retry with an increasing delay */
+                    hIoTClient->retryDelay =
+                        ( hIoTClient->retryDelay == 0 )
+                            ? FIFO_RETRY_MIN_NS
+                            : 2 * hIoTClient->retryDelay;
+                    if ( hIoTClient->retryDelay > FIFO_RETRY_MAX_NS )
+                    {
+                        hIoTClient->retryDelay = FIFO_RETRY_MAX_NS;
+                    }
+
+                    iotclient_WaitFd( hIoTClient, -1, 0 );
+                    iotclient_ScheduleEvents( hIoTClient,
+                                              hIoTClient->retryDelay );
+                    result = EINPROGRESS;
+                }
+                else if ( errno != EINTR )
+                {
+                    result = errno;
+                }
+                break;
+
+            case ASYNC_STATE_BODY:
+                len = pMsg->bodyLength - pMsg->offset;
+                if ( ( len > 0 ) &&
+                     ( pMsg->credit == 0 ) &&
+                     ( ratelimit_BytesLimited( hIoTClient->pLimiter,
+                                               hIoTClient->priority ) ) )
+                {
+                    /* pace the body to the byte rate limits */
+                    if ( len > ASYNC_STREAM_BUFSIZE )
+                    {
+                        len = ASYNC_STREAM_BUFSIZE;
+                    }
+
+                    delay = ratelimit_Acquire( hIoTClient->pLimiter,
+                                               hIoTClient->priority,
+                                               0,
+                                               len );
+                    if ( delay > 0 )
+                    {
+                        iotclient_WaitFd( hIoTClient, -1, 0 );
+                        iotclient_ScheduleEvents( hIoTClient, (long)delay );
+                        result = EINPROGRESS;
+                        break;
+                    }
+
+                    pMsg->credit = len;
+                }
+
+                if ( ( pMsg->credit > 0 ) && ( len > pMsg->credit ) )
+                {
+                    len = pMsg->credit;
+                }
+
+                if ( len > 0 )
+                {
+                    n = write( hIoTClient->asyncFifoFd,
+                               &pMsg->body[pMsg->offset],
+                               len );
+                    if ( n > 0 )
+                    {
+                        pMsg->offset += n;
+                        pMsg->credit -= ( pMsg->credit > (size_t)n )
+                                        ? (size_t)n
+                                        : pMsg->credit;
+                    }
+                    else if ( ( n == -1 ) && ( errno == EAGAIN ) )
+                    {
+                        /* wait for the hub to drain the pipe */
+                        result = iotclient_WaitFd( hIoTClient,
+                                                   hIoTClient->asyncFifoFd,
+                                                   EPOLLOUT );
+                    }
+                    else if ( ( n == -1 ) && ( errno != EINTR ) )
+                    {
+                        result = errno;
+                    }
+                }
+                else if ( ( pMsg->fd == -1 ) || ( pMsg->eof == true ) )
+                {
+                    pMsg->state = ASYNC_STATE_DONE;
+                }
+                else
+                {
+                    /* refill the stream buffer */
+                    len = pMsg->limit - pMsg->total;
+                    if ( len > ASYNC_STREAM_BUFSIZE )
+                    {
+                        len = ASYNC_STREAM_BUFSIZE;
+                    }
+
+                    n = ( len > 0 ) ? read( pMsg->fd, hIoTClient->asyncBuf, len )
+                                    : 0;
+                    if ( n > 0 )
+                    {
+                        pMsg->body = hIoTClient->asyncBuf;
+                        pMsg->bodyLength = n;
+                        pMsg->offset = 0;
+                        pMsg->total += n;
+                    }
+                    else if ( ( n == 0 ) &&
+                              ( pMsg->known == true ) &&
+                              ( pMsg->total < pMsg->limit ) )
+                    {
+                        /* the input ended before the known length */
+                        result = EIO;
+                    }
+                    else if ( n == 0 )
+                    {
+                        pMsg->eof = true;
+                    }
+                    else if ( errno == EAGAIN )
+                    {
+                        /* wait for more input */
+                        result = iotclient_WaitFd( hIoTClient,
+                                                   pMsg->fd,
+                                                   EPOLLIN );
+                    }
+                    else if ( errno != EINTR )
+                    {
+                        result = errno;
+                    }
+                }
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_WaitFd                                                          */
+/*!
+    Select the descriptor the send queue is waiting on
+
+    The iotclient_WaitFd function replaces the descriptor in the epoll
+    set which the asynchronous send queue is waiting on.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        fd
+            descriptor to wait on, or -1 to stop waiting
+
+    @param[in]
+        events
+            epoll events to wait for
+
+    @retval EINPROGRESS the send queue is waiting on the descriptor
+    @retval other error as returned by epoll_ctl()
+
+==============================================================================*/
+static int iotclient_WaitFd( IOTCLIENT_HANDLE hIoTClient,
+                             int fd,
+                             uint32_t events )
+{
+    int result = EINPROGRESS;
+    struct epoll_event ev;
+
+    if ( hIoTClient->waitFd != fd )
+    {
+        if ( hIoTClient->waitFd != -1 )
+        {
+            (void)epoll_ctl( hIoTClient->epollFd,
+                             EPOLL_CTL_DEL,
+                             hIoTClient->waitFd,
+                             NULL );
+            hIoTClient->waitFd = -1;
+        }
+
+        if ( fd != -1 )
+        {
+            ev.events = events;
+            ev.data.fd = fd;
+            if ( epoll_ctl( hIoTClient->epollFd,
+                            EPOLL_CTL_ADD,
+                            fd,
+                            &ev ) == 0 )
+            {
+                hIoTClient->waitFd = fd;
+            }
+            else
+            {
+                result = errno;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_ScheduleEvents                                                  */
+/*!
+    Schedule event processing
+
+    The iotclient_ScheduleEvents function arms the timer in the epoll
+    set so the event descriptor becomes readable after the specified
+    delay.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        delay
+            delay in nanoseconds (must be greater than zero)
+
+==============================================================================*/
+static void iotclient_ScheduleEvents( IOTCLIENT_HANDLE hIoTClient,
+                                      long delay )
+{
+    struct itimerspec its;
+
+    memset( &its, 0, sizeof( its ) );
+    its.it_value.tv_sec = delay / 1000000000L;
+    its.it_value.tv_nsec = delay % 1000000000L;
+
+    (void)timerfd_settime( hIoTClient->timerFd, 0, &its, NULL );
+}
+
+/*============================================================================*/
+/*  iotclient_ProcessReceiveQueue                                             */
+/*!
+    Deliver the received messages to the receive callback
+
+    The iotclient_ProcessReceiveQueue function drains the receive
+    message queue without blocking, invoking the receive callback for
+    each message.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+==============================================================================*/
+static void iotclient_ProcessReceiveQueue( IOTCLIENT_HANDLE hIoTClient )
+{
+    struct timespec ts = { 0, 0 };
+    unsigned int prio;
+    ssize_t n;
+    IOTCLIENT_MESSAGE message;
+
+    while ( ( hIoTClient->receiveCb != NULL ) &&
+            ( hIoTClient->rxMsgQ != -1 ) &&
+            ( hIoTClient->rx.buf != NULL ) )
+    {
+        n = mq_timedreceive( hIoTClient->rxMsgQ,
+                             hIoTClient->rx.buf,
+                             hIoTClient->rxBufSize,
+                             &prio,
+                             &ts );
+        if ( n > 0 )
+        {
+            iotclient_ParseMessage( &hIoTClient->rx,
+                                    n,
+                                    hIoTClient->options.flags,
+                                    &message );
+
+            hIoTClient->receiveCb( hIoTClient->receiveCtx,
+                                   message.headers,
+                                   message.headerLength,
+                                   message.body,
+                                   message.bodyLength );
+        }
+        else if ( ( n == -1 ) && ( errno == EINTR ) )
+        {
+            continue;
+        }
+        else
+        {
+            break;
+        }
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_InitReceiver                                                    */
+/*!
+    Initialize a receiver's worker pool
+
+    The iotclient_InitReceiver function creates the receiver's stop
+    event, and the worker queues and worker threads requested in the
+    IOT Client options.  On failure, iotclient_DestroyReceiver releases
+    whatever was created.
+
+    @param[in]
+        pReceiver
+            pointer to the receiver to initialize
+
+    @param[in]
+        queueDepth
+            number of messages each worker queue can hold
+
+    @retval EOK the receiver was initialized
+    @retval ENOMEM memory could not be allocated
+    @retval other error as reported by eventfd or pthread_create
+
+==============================================================================*/
+static int iotclient_InitReceiver( IoTClientReceiver *pReceiver,
+                                   size_t queueDepth )
+{
+    int result = EOK;
+    size_t workers = pReceiver->hIoTClient->options.workers;
+    size_t nQueues;
+    IoTClientRxQueue *pQueue;
+    size_t i;
+
+    pthread_mutex_init( &pReceiver->freeLock, NULL );
+
+    pReceiver->stopFd = eventfd( 0, EFD_CLOEXEC );
+    if ( pReceiver->stopFd == -1 )
+    {
+        result = errno;
+    }
+
+    if ( ( result == EOK ) && ( workers > 0 ) )
+    {
+        nQueues = ( pReceiver->flags & IOTCLIENT_RECEIVE_ORDERED )
+                    ? workers
+                    : 1;
+
+        pReceiver->pQueues = calloc( nQueues, sizeof( IoTClientRxQueue ) );
+        pReceiver->pWorkers = calloc( workers, sizeof( pthread_t ) );
+        if ( ( pReceiver->pQueues == NULL ) ||
+             ( pReceiver->pWorkers == NULL ) )
+        {
+            result = ENOMEM;
+        }
+
+        for ( i = 0; ( result == EOK ) && ( i < nQueues ); i++ )
+        {
+            pQueue = &pReceiver->pQueues[i];
+            pQueue->ppItems = calloc( queueDepth, sizeof( IoTClientRxItem * ) );
+            if ( pQueue->ppItems != NULL )
+            {
+                pthread_mutex_init( &pQueue->lock, NULL );
+                pthread_cond_init( &pQueue->notEmpty, NULL );
+                pthread_cond_init( &pQueue->notFull, NULL );
+                pQueue->size = queueDepth;
+                pQueue->pReceiver = pReceiver;
+                pReceiver->nQueues++;
+            }
+            else
+            {
+                result = ENOMEM;
+            }
+        }
+
+        for ( i = 0; ( result == EOK ) && ( i < workers ); i++ )
+        {
+            /* workers share a single queue unless ordering is required */
+            pQueue = &pReceiver->pQueues[i % nQueues];
+            result = pthread_create( &pReceiver->pWorkers[i],
+                                     NULL,
+                                     iotclient_WorkerThread,
+                                     pQueue );
+            if ( result == EOK )
+            {
+                iotclient_SetAffinity( pReceiver->hIoTClient,
+                                       pReceiver->pWorkers[i] );
+                pReceiver->nWorkers++;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_DestroyReceiver                                                 */
+/*!
+    Stop and destroy a receiver
+
+    The iotclient_DestroyReceiver function stops the receiver thread,
+    waits for the workers to handle the queued messages and exit, and
+    frees the receiver and its resources.
+
+    @param[in]
+        pReceiver
+            pointer to the receiver to destroy
+
+==============================================================================*/
+static void iotclient_DestroyReceiver( IoTClientReceiver *pReceiver )
+{
+    uint64_t stop = 1;
+    IoTClientRxQueue *pQueue;
+    IoTClientRxItem *pItem;
+    size_t i;
+
+    if ( pReceiver->running )
+    {
+        /* stop the receiver thread */
+        if ( write( pReceiver->stopFd, &stop, sizeof( stop ) ) != sizeof( stop ) )
+        {
+            iotclient_log( pReceiver->hIoTClient,
+                           "iotclient: cannot signal the receiver" );
+        }
+
+        pthread_join( pReceiver->thread, NULL );
+    }
+
+    /* let the workers exit once their queues are empty */
+    for ( i = 0; i < pReceiver->nQueues; i++ )
+    {
+        pQueue = &pReceiver->pQueues[i];
+        pthread_mutex_lock( &pQueue->lock );
+        pQueue->stop = true;
+        pthread_cond_broadcast( &pQueue->notEmpty );
+        pthread_mutex_unlock( &pQueue->lock );
+    }
+
+    for ( i = 0; i < pReceiver->nWorkers; i++ )
+    {
+        pthread_join( pReceiver->pWorkers[i], NULL );
+    }
+
+    for ( i = 0; i < pReceiver->nQueues; i++ )
+    {
+        pQueue = &pReceiver->pQueues[i];
+        pthread_cond_destroy( &pQueue->notFull );
+        pthread_cond_destroy( &pQueue->notEmpty );
+        pthread_mutex_destroy( &pQueue->lock );
+        free( pQueue->ppItems );
+    }
+
+    /* free the received message items */
+    while ( pReceiver->pFree != NULL )
+    {
+        pItem = pReceiver->pFree;
+        pReceiver->pFree = pItem->pNext;
+        free( pItem->rx.buf );
+        free( pItem->rx.headerBuf );
+        free( pItem );
+    }
+
+    if ( pReceiver->stopFd != -1 )
+    {
+        close( pReceiver->stopFd );
+    }
+
+    pthread_mutex_destroy( &pReceiver->freeLock );
+    free( pReceiver->pQueues );
+    free( pReceiver->pWorkers );
+    free( pReceiver );
+}
+
+/*============================================================================*/
+/*  iotclient_SetAffinity                                                     */
+/*!
+    Bind a library managed thread to the configured CPUs
+
+    The iotclient_SetAffinity function binds a thread to the CPUs in
+    the CPU affinity mask specified in the IOT Client options.  The
+    thread may run on any CPU if no mask was specified, or the mask
+    could not be applied.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the thread
+
+    @param[in]
+        thread
+            thread to bind
+
+==============================================================================*/
+static void iotclient_SetAffinity( IOTCLIENT_HANDLE hIoTClient,
+                                   pthread_t thread )
+{
+    uint64_t mask = hIoTClient->options.cpuAffinity;
+    cpu_set_t cpus;
+    int cpu;
+
+    if ( mask != 0 )
+    {
+        CPU_ZERO( &cpus );
+        for ( cpu = 0; cpu < 64; cpu++ )
+        {
+            if ( mask & ( (uint64_t)1 << cpu ) )
+            {
+                CPU_SET( cpu, &cpus );
+            }
+        }
+
+        if ( pthread_setaffinity_np( thread, sizeof( cpus ), &cpus ) != 0 )
+        {
+            iotclient_log( hIoTClient, "iotclient: cannot set CPU affinity" );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_ReceiverThread                                                  */
+/*!
+    Receive messages on a library managed thread
+
+    The iotclient_ReceiverThread function waits for the receive message
+    queue to become readable, then drains it, dispatching each message
+    to the message handler or the workers.  It exits when the receiver's
+    stop event is signalled.
+
+    @param[in]
+        arg
+            pointer to the receiver
+
+    @retval NULL always
+
+==============================================================================*/
+static void *iotclient_ReceiverThread( void *arg )
+{
+    IoTClientReceiver *pReceiver = arg;
+    IOTCLIENT_HANDLE hIoTClient = pReceiver->hIoTClient;
+    struct timespec ts = { 0, 0 };
+    struct pollfd fds[2];
+    IoTClientRxItem *pItem = NULL;
+    unsigned int prio;
+    bool running = true;
+    ssize_t n;
+
+    fds[0].fd = hIoTClient->rxMsgQ;
+    fds[0].events = POLLIN;
+    fds[1].fd = pReceiver->stopFd;
+    fds[1].events = POLLIN;
+
+    while ( running )
+    {
+        if ( poll( fds, 2, -1 ) == -1 )
+        {
+            running = ( errno == EINTR );
+        }
+        else if ( ( fds[1].revents & POLLIN ) ||
+                  ( fds[0].revents & ( POLLERR | POLLNVAL ) ) )
+        {
+            running = false;
+        }
+        else
+        {
+            /* drain the receive message queue */
+            do
+            {
+                if ( pItem == NULL )
+                {
+                    pItem = iotclient_GetRxItem( pReceiver );
+                    if ( pItem == NULL )
+                    {
+                        iotclient_log( hIoTClient,
+                                       "iotclient: receiver out of memory" );
+                        running = false;
+                        break;
+                    }
+                }
+
+                n = mq_timedreceive( hIoTClient->rxMsgQ,
+                                     pItem->rx.buf,
+                                     hIoTClient->rxBufSize,
+                                     &prio,
+                                     &ts );
+                if ( n > 0 )
+                {
+                    iotclient_ParseMessage( &pItem->rx,
+                                            n,
+                                            hIoTClient->options.flags,
+                                            &pItem->message );
+                    iotclient_DispatchMessage( pReceiver, pItem );
+                    pItem = NULL;
+                }
+
+            } while ( ( n > 0 ) || ( ( n == -1 ) && ( errno == EINTR ) ) );
+        }
+    }
+
+    if ( pItem != NULL )
+    {
+        iotclient_PutRxItem( pReceiver, pItem );
+    }
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  iotclient_WorkerThread                                                    */
+/*!
+    Handle received messages on a library managed worker thread
+
+    The iotclient_WorkerThread function takes messages from a worker
+    queue in order and invokes the message handler for each one.  It
+    exits when the queue is stopped and empty.
+
+    @param[in]
+        arg
+            pointer to the worker queue
+
+    @retval NULL always
+
+==============================================================================*/
+static void *iotclient_WorkerThread( void *arg )
+{
+    IoTClientRxQueue *pQueue = arg;
+    IoTClientReceiver *pReceiver = pQueue->pReceiver;
+    IoTClientRxItem *pItem;
+
+    while ( true )
+    {
+        pthread_mutex_lock( &pQueue->lock );
+        while ( ( pQueue->count == 0 ) && ( pQueue->stop == false ) )
+        {
+            pthread_cond_wait( &pQueue->notEmpty, &pQueue->lock );
+        }
+
+        if ( pQueue->count == 0 )
+        {
+            /* the queue has been stopped */
+            pthread_mutex_unlock( &pQueue->lock );
+            break;
+        }
+
+        pItem = pQueue->ppItems[pQueue->head];
+        pQueue->head = ( pQueue->head + 1 ) % pQueue->size;
+        pQueue->count--;
+        pthread_cond_signal( &pQueue->notFull );
+        pthread_mutex_unlock( &pQueue->lock );
+
+        pReceiver->cb( pReceiver->ctx,
+                       pItem->message.headers,
+                       pItem->message.headerLength,
+                       pItem->message.body,
+                       pItem->message.bodyLength );
+
+        iotclient_PutRxItem( pReceiver, pItem );
+    }
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  iotclient_DispatchMessage                                                 */
+/*!
+    Hand a received message to the message handler or a worker
+
+    The iotclient_DispatchMessage function invokes the message handler
+    directly if there is no worker pool.  Otherwise it selects a worker
+    queue and adds the message to it, waiting while the queue is full.
+
+    For ordered receivers the queue is selected by the FNV-1a hash of
+    the message's correlation-id, so messages with the same
+    correlation-id are always handled by the same worker.
+
+    @param[in]
+        pReceiver
+            pointer to the receiver
+
+    @param[in]
+        pItem
+            pointer to the received message
+
+==============================================================================*/
+static void iotclient_DispatchMessage( IoTClientReceiver *pReceiver,
+                                       IoTClientRxItem *pItem )
+{
+    IOTCLIENT_HEADER_INDEX index;
+    IoTClientRxQueue *pQueue;
+    const char *value;
+    size_t length;
+    uint32_t hash;
+    size_t q;
+    size_t i;
+
+    if ( pReceiver->nQueues == 0 )
+    {
+        /* handle the message on the receiver thread */
+        pReceiver->cb( pReceiver->ctx,
+                       pItem->message.headers,
+                       pItem->message.headerLength,
+                       pItem->message.body,
+                       pItem->message.bodyLength );
+
+        iotclient_PutRxItem( pReceiver, pItem );
+    }
+    else
+    {
+        if ( ( pReceiver->nQueues > 1 ) &&
+             ( IOTCLIENT_IndexHeaders( pItem->message.headers,
+                                       pItem->message.headerLength,
+                                       &index ) != EINVAL ) &&
+             ( IOTCLIENT_GetPropertyById( &index,
+                                          IOTCLIENT_PROP_CORRELATION_ID,
+                                          &value,
+                                          &length ) == EOK ) )
+        {
+            hash = CORRELATION_HASH_BASIS;
+            for ( i = 0; i < length; i++ )
+            {
+                hash ^= (uint8_t)value[i];
+                hash *= CORRELATION_HASH_PRIME;
+            }
+
+            q = hash % pReceiver->nQueues;
+        }
+        else
+        {
+            /* unrelated messages are shared among the workers */
+            q = pReceiver->nextQueue++ % pReceiver->nQueues;
+        }
+
+        pQueue = &pReceiver->pQueues[q];
+
+        pthread_mutex_lock( &pQueue->lock );
+        while ( pQueue->count == pQueue->size )
+        {
+            pthread_cond_wait( &pQueue->notFull, &pQueue->lock );
+        }
+
+        pQueue->ppItems[( pQueue->head + pQueue->count ) % pQueue->size] = pItem;
+        pQueue->count++;
+        pthread_cond_signal( &pQueue->notEmpty );
+        pthread_mutex_unlock( &pQueue->lock );
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_GetRxItem                                                       */
+/*!
+    Get an unused received message item
+
+    The iotclient_GetRxItem function takes an item from the receiver's
+    list of unused items, or allocates a new one if the list is empty.
+    The number of items is bounded by the worker queue capacity.
+
+    @param[in]
+        pReceiver
+            pointer to the receiver
+
+    @retval pointer to the received message item
+    @retval NULL if the item could not be allocated
+
+==============================================================================*/
+static IoTClientRxItem *iotclient_GetRxItem( IoTClientReceiver *pReceiver )
+{
+    IoTClientRxItem *pItem;
+
+    pthread_mutex_lock( &pReceiver->freeLock );
+    pItem = pReceiver->pFree;
+    if ( pItem != NULL )
+    {
+        pReceiver->pFree = pItem->pNext;
+    }
+    pthread_mutex_unlock( &pReceiver->freeLock );
+
+    if ( pItem == NULL )
+    {
+        pItem = calloc( 1, sizeof( IoTClientRxItem ) );
+        if ( pItem != NULL )
+        {
+            /* allow room for a NUL terminator after the message */
+            pItem->rx.buf = malloc( pReceiver->hIoTClient->rxBufSize + 1 );
+            if ( pItem->rx.buf == NULL )
+            {
+                free( pItem );
+                pItem = NULL;
+            }
+        }
+    }
+
+    return pItem;
+}
+
+/*============================================================================*/
+/*  iotclient_PutRxItem                                                       */
+/*!
+    Return a received message item to the unused item list
+
+    @param[in]
+        pReceiver
+            pointer to the receiver
+
+    @param[in]
+        pItem
+            pointer to the received message item
+
+==============================================================================*/
+static void iotclient_PutRxItem( IoTClientReceiver *pReceiver,
+                                 IoTClientRxItem *pItem )
+{
+    pthread_mutex_lock( &pReceiver->freeLock );
+    pItem->pNext = pReceiver->pFree;
+    pReceiver->pFree = pItem;
+    pthread_mutex_unlock( &pReceiver->freeLock );
+}
+
+/*============================================================================*/
+/*  iotclient_CreateAckQueue                                                  */
+/*!
+    Create the acknowledgement queue and in-flight window
+
+    The iotclient_CreateAckQueue function creates the message queue on
+    which the IOT Hub service acknowledges sequenced messages, and the
+    in-flight window which tracks the unacknowledged messages.
+
+    The acknowledgement queue name follows the message body FIFO name:
+    /iothub_ack_<pid> for channel 0 clients, and
+    /iothub_ack_<pid>_<channel> for all other channels.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @retval EOK the acknowledgement queue was created
+    @retval ENOMEM memory could not be allocated
+    @retval other error as returned by mq_open()
+
+==============================================================================*/
+static int iotclient_CreateAckQueue( IOTCLIENT_HANDLE hIoTClient )
+{
+    int result = ENOMEM;
+    struct mq_attr attr;
+    int n;
+
+    if ( hIoTClient->channel == 0 )
+    {
+        n = asprintf( &hIoTClient->ackQueueName,
+                      "/iothub_ack_%d",
+                      hIoTClient->pid );
+    }
+    else
+    {
+        n = asprintf( &hIoTClient->ackQueueName,
+                      "/iothub_ack_%d_%u",
+                      hIoTClient->pid,
+                      hIoTClient->channel );
+    }
+
+    if ( n <= 0 )
+    {
+        hIoTClient->ackQueueName = NULL;
+    }
+
+    hIoTClient->pWindow = calloc( hIoTClient->options.window,
+                                  sizeof( IoTClientInFlight ) );
+
+    if ( ( hIoTClient->ackQueueName != NULL ) &&
+         ( hIoTClient->pWindow != NULL ) )
+    {
+        /* remove any queue left behind by a previous process */
+        mq_unlink( hIoTClient->ackQueueName );
+
+        memset( &attr, 0, sizeof( attr ) );
+        attr.mq_maxmsg = ACK_QUEUE_DEPTH;
+        attr.mq_msgsize = sizeof( IoTClientAck );
+
+        hIoTClient->ackMsgQ = mq_open( hIoTClient->ackQueueName,
+                                       O_RDONLY | O_CREAT,
+                                       0666,
+                                       &attr );
+        result = ( hIoTClient->ackMsgQ != (mqd_t)-1 ) ? EOK : errno;
+    }
+
+    if ( result != EOK )
+    {
+        iotclient_DestroyAckQueue( hIoTClient );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_DestroyAckQueue                                                 */
+/*!
+    Clean up the acknowledgement queue and in-flight window
+
+    The iotclient_DestroyAckQueue function discards the unacknowledged
+    messages, and closes and removes the acknowledgement queue.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+==============================================================================*/
+static void iotclient_DestroyAckQueue( IOTCLIENT_HANDLE hIoTClient )
+{
+    size_t i;
+
+    if ( hIoTClient->pWindow != NULL )
+    {
+        for ( i = 0; i < hIoTClient->options.window; i++ )
+        {
+            iotclient_ReleaseInFlight( hIoTClient,
+                                       &hIoTClient->pWindow[i],
+                                       ECANCELED );
+        }
+
+        free( hIoTClient->pWindow );
+        hIoTClient->pWindow = NULL;
+    }
+
+    if ( hIoTClient->ackMsgQ != (mqd_t)-1 )
+    {
+        mq_close( hIoTClient->ackMsgQ );
+        hIoTClient->ackMsgQ = -1;
+    }
+
+    if ( hIoTClient->ackQueueName != NULL )
+    {
+        mq_unlink( hIoTClient->ackQueueName );
+        free( hIoTClient->ackQueueName );
+        hIoTClient->ackQueueName = NULL;
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_AcquireRate                                                     */
+/*!
+    Take a message from the IOT Client's rate limits
+
+    The iotclient_AcquireRate function takes a message and its body
+    length from the rate limits of the IOT Client and its priority level,
+    waiting until they allow it unless the IOT Client is non-blocking.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        length
+            length of the message body
+
+    @retval EOK the message may be sent
+    @retval EAGAIN the rate limits do not allow a non-blocking message
+
+==============================================================================*/
+static int iotclient_AcquireRate( IOTCLIENT_HANDLE hIoTClient, size_t length )
+{
+    int result = EOK;
+
+    if ( hIoTClient->options.flags & IOTCLIENT_OPT_NONBLOCK )
+    {
+        if ( ratelimit_Acquire( hIoTClient->pLimiter,
+                                hIoTClient->priority,
+                                1,
+                                length ) > 0 )
+        {
+            result = EAGAIN;
+        }
+    }
+    else
+    {
+        ratelimit_Wait( hIoTClient->pLimiter,
+                        hIoTClient->priority,
+                        1,
+                        length );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_ReserveSlot                                                     */
+/*!
+    Wait for space in the in-flight window
+
+    The iotclient_ReserveSlot function processes the acknowledgements
+    received from the IOT Hub service, and if the window slot for the
+    next sequence number is still occupied, waits for further
+    acknowledgements until it is released.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @retval EOK the window slot is free
+    @retval EAGAIN the window is full and the client is non-blocking
+    @retval ETIMEDOUT no acknowledgement arrived within the ack timeout
+    @retval other error as returned by mq_receive()
+
+==============================================================================*/
+static int iotclient_ReserveSlot( IOTCLIENT_HANDLE hIoTClient )
+{
+    int result;
+
+    result = iotclient_ProcessAcks( hIoTClient, false );
+    if ( ( result == EOK ) &&
+         ( iotclient_WindowFull( hIoTClient ) == true ) &&
+         ( hIoTClient->options.flags & IOTCLIENT_OPT_NONBLOCK ) )
+    {
+        /* non-blocking clients do not wait for acknowledgements */
+        result = EAGAIN;
+    }
+
+    /* the slot is re-checked after each wait, since acknowledgement
+       callbacks may have sent further messages */
+    while ( ( result == EOK ) && ( iotclient_WindowFull( hIoTClient ) == true ) )
+    {
+        result = iotclient_ProcessAcks( hIoTClient, true );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_TrackMessage                                                    */
+/*!
+    Add a sent message to the in-flight window
+
+    The iotclient_TrackMessage function records the message which has
+    just been sent with the next sequence number in the in-flight window,
+    retaining a copy of its preamble and headers for retransmission.
+    If the copy cannot be allocated the message is still tracked,
+    but cannot be retransmitted.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        headers
+            pointer to the preamble and headers which were sent
+
+    @param[in]
+        headerLength
+            length of the preamble and headers
+
+==============================================================================*/
+static void iotclient_TrackMessage( IOTCLIENT_HANDLE hIoTClient,
+                                    const char *headers,
+                                    size_t headerLength )
+{
+    IoTClientInFlight *pEntry;
+
+    if ( hIoTClient->pWindow != NULL )
+    {
+        pEntry = &hIoTClient->pWindow[hIoTClient->nextSeq %
+                                      hIoTClient->options.window];
+
+        pEntry->inUse = true;
+        pEntry->seq = hIoTClient->nextSeq++;
+        pEntry->headers = malloc( headerLength );
+        if ( pEntry->headers != NULL )
+        {
+            memcpy( pEntry->headers, headers, headerLength );
+            pEntry->headerLength = headerLength;
+        }
+
+        hIoTClient->inFlight++;
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_RetainBody                                                      */
+/*!
+    Retain a copy of a message body for retransmission
+
+    The iotclient_RetainBody function stores a copy of the body of the
+    message most recently added to the in-flight window.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        body
+            pointer to the message body
+
+    @param[in]
+        bodylen
+            length of the message body
+
+==============================================================================*/
+static void iotclient_RetainBody( IOTCLIENT_HANDLE hIoTClient,
+                                  const unsigned char *body,
+                                  size_t bodylen )
+{
+    IoTClientInFlight *pEntry = NULL;
+
+    if ( hIoTClient->pWindow != NULL )
+    {
+        pEntry = iotclient_FindInFlight( hIoTClient, hIoTClient->nextSeq - 1 );
+    }
+
+    if ( ( pEntry != NULL ) &&
+         ( pEntry->body == NULL ) )
+    {
+        /* allocate at least one byte so an empty body is retained */
+        pEntry->body = malloc( ( bodylen > 0 ) ? bodylen : 1 );
+        if ( pEntry->body != NULL )
+        {
+            memcpy( pEntry->body, body, bodylen );
+            pEntry->bodyLength = bodylen;
+            pEntry->bodyOwned = true;
+        }
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_ProcessAcks                                                     */
+/*!
+    Process the acknowledgements from the IOT Hub service
+
+    The iotclient_ProcessAcks function drains the acknowledgement queue,
+    releasing each acknowledged message from the in-flight window.
+    If requested, it first waits for an acknowledgement to arrive, for
+    at most the acknowledgement timeout specified in the options.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        wait
+            true to wait for at least one acknowledgement
+
+    @retval EOK the acknowledgements were processed
+    @retval ETIMEDOUT no acknowledgement arrived within the ack timeout
+    @retval other error as returned by mq_receive()
+
+==============================================================================*/
+static int iotclient_ProcessAcks( IOTCLIENT_HANDLE hIoTClient, bool wait )
+{
+    int result = EOK;
+    struct timespec ts = { 0, 0 };
+    unsigned int timeout = hIoTClient->options.ackTimeout;
+    IoTClientAck ack;
+    ssize_t n;
+
+    if ( ( wait == true ) && ( timeout != 0 ) )
+    {
+        clock_gettime( CLOCK_REALTIME, &ts );
+        ts.tv_sec += timeout / 1000;
+        ts.tv_nsec += ( timeout % 1000 ) * 1000000L;
+        if ( ts.tv_nsec >= 1000000000L )
+        {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+    }
+
+    for ( ;; )
+    {
+        if ( ( wait == true ) && ( timeout == 0 ) )
+        {
+            n = mq_receive( hIoTClient->ackMsgQ,
+                            (char *)&ack,
+                            sizeof( ack ),
+                            NULL );
+        }
+        else
+        {
+            /* an expired timeout polls the queue without blocking */
+            n = mq_timedreceive( hIoTClient->ackMsgQ,
+                                 (char *)&ack,
+                                 sizeof( ack ),
+                                 NULL,
+                                 &ts );
+        }
+
+        if ( n == -1 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            if ( wait == true )
+            {
+                result = errno;
+            }
+
+            break;
+        }
+
+        if ( ( n == sizeof( ack ) ) &&
+             ( memcmp( ack.id, ACK_ID, 4 ) == 0 ) )
+        {
+            iotclient_Acknowledge( hIoTClient, ack.seq, ack.status );
+        }
+
+        /* drain the remaining acknowledgements without waiting */
+        wait = false;
+        ts.tv_sec = 0;
+        ts.tv_nsec = 0;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_Acknowledge                                                     */
+/*!
+    Release an acknowledged message from the in-flight window
+
+    The iotclient_Acknowledge function releases the message with the
+    specified sequence number from the in-flight window, and invokes its
+    acknowledgement callback.  Duplicate acknowledgements, eg. for
+    retransmitted messages, are ignored.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        seq
+            sequence number of the acknowledged message
+
+    @param[in]
+        status
+            acknowledgement status from the IOT Hub service
+
+==============================================================================*/
+static void iotclient_Acknowledge( IOTCLIENT_HANDLE hIoTClient,
+                                   uint32_t seq,
+                                   int status )
+{
+    IoTClientInFlight *pEntry;
+
+    pEntry = iotclient_FindInFlight( hIoTClient, seq );
+    if ( pEntry != NULL )
+    {
+        iotclient_ReleaseInFlight( hIoTClient, pEntry, status );
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_FindInFlight                                                    */
+/*!
+    Find an unacknowledged message in the in-flight window
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        seq
+            sequence number of the message
+
+    @retval pointer to the in-flight window slot holding the message
+    @retval NULL if the message is not in the in-flight window
+
+==============================================================================*/
+static IoTClientInFlight *iotclient_FindInFlight( IOTCLIENT_HANDLE hIoTClient,
+                                                  uint32_t seq )
+{
+    IoTClientInFlight *pEntry;
+
+    pEntry = &hIoTClient->pWindow[seq % hIoTClient->options.window];
+
+    return ( ( pEntry->inUse == true ) && ( pEntry->seq == seq ) )
+            ? pEntry
+            : NULL;
+}
+
+/*============================================================================*/
+/*  iotclient_WindowFull                                                      */
+/*!
+    Check if the in-flight window slot for the next message is occupied
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @retval true the next message cannot be sent until a message
+            is acknowledged
+    @retval false the next message can be sent
+
+==============================================================================*/
+static bool iotclient_WindowFull( IOTCLIENT_HANDLE hIoTClient )
+{
+    return hIoTClient->pWindow[hIoTClient->nextSeq %
+                               hIoTClient->options.window].inUse;
+}
+
+/*============================================================================*/
+/*  iotclient_ReleaseInFlight                                                 */
+/*!
+    Release an in-flight window slot
+
+    The iotclient_ReleaseInFlight function frees the retained copy of
+    the message in an in-flight window slot and marks the slot free,
+    then invokes the message's acknowledgement callback.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        pEntry
+            pointer to the in-flight window slot
+
+    @param[in]
+        status
+            status passed to the acknowledgement callback
+
+==============================================================================*/
+static void iotclient_ReleaseInFlight( IOTCLIENT_HANDLE hIoTClient,
+                                       IoTClientInFlight *pEntry,
+                                       int status )
+{
+    IOTCLIENT_SEND_CALLBACK cb;
+    void *ctx;
+
+    if ( pEntry->inUse == true )
+    {
+        cb = pEntry->cb;
+        ctx = pEntry->ctx;
+
+        free( pEntry->headers );
+        if ( pEntry->bodyOwned == true )
+        {
+            free( pEntry->body );
+        }
+
+        memset( pEntry, 0, sizeof( IoTClientInFlight ) );
+        hIoTClient->inFlight--;
+
+        /* the slot is free before the callback, so it can send again */
+        if ( cb != NULL )
+        {
+            cb( ctx, status );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_log                                                             */
+/*!
+    Generate a debug output log
+
+    The iotclient_log function generates the specified debug output log
+    if the debug logging is enabled via the verbose flag.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        msg
+            pointer to the NUL terminated character string to output
+
+==============================================================================*/
+static void iotclient_log( IOTCLIENT_HANDLE hIoTClient, char *msg )
+{
+    if ( hIoTClient != NULL )
+    {
+        if ( hIoTClient->verbose == true )
+        {
+            fprintf(stdout, "%s\n", msg );
+        }
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_CreateFIFO                                                      */
+/*!
+    Create a FIFO for sending IOT message bodies
+
+    The iotclient_CreateFIFO function creates a FIFO which is used to
+    stream IOT message body data to the IOTHUB for transmission.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which will contain the FIFO reference
+
+==============================================================================*/
+static int iotclient_CreateFIFO( IOTCLIENT_HANDLE hIoTClient )
+{
+    int result = EINVAL;
+    int n;
+
+    if ( hIoTClient != NULL )
+    {
+        /* allocate a channel for the client */
+        hIoTClient->pid = getpid();
+        hIoTClient->channel = iotclient_AllocChannel();
+
+        /* generate the FIFO name */
+        if ( hIoTClient->channel == 0 )
+        {
+            n = asprintf( &hIoTClient->fifoName,
+                          "%s/iothub_%d",
+                          hIoTClient->options.fifoDir,
+                          hIoTClient->pid );
+        }
+        else
+        {
+            n = asprintf( &hIoTClient->fifoName,
+                          "%s/iothub_%d_%u",
+                          hIoTClient->options.fifoDir,
+                          hIoTClient->pid,
+                          hIoTClient->channel );
+        }
+
+        if ( ( n > 0 ) &&
+             ( hIoTClient->fifoName != NULL ) )
+        {
+            /* create the FIFO */
+            if( mkfifo( hIoTClient->fifoName, 0666) == 0 )
+            {
+                result = EOK;
+            }
+            else
+            {
+                result = errno;
+                free( hIoTClient->fifoName );
+                hIoTClient->fifoName = NULL;
+            }
+        }
+        else
+        {
+            hIoTClient->fifoName = NULL;
+            result = ENOMEM;
+        }
+
+        if ( result != EOK )
+        {
+            iotclient_FreeChannel( hIoTClient->channel );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_SendBody                                                        */
+/*!
+    Send an IOT message body to the IOT Hub Service
+
+    The iotclient_SendBody function sends an IOT message body to the
+    IOT Hub service via the IOT client write FIFO.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client containing the FIFO
+
+    @param[in]
+        body
+            pointer to the message body data
+
+    @param[in]
+        len
+            length of the message body to send
+
+    If the io_uring transport is in use, the FIFO open, body write and
+    FIFO close are submitted together in one system call.  If the kernel
+    cannot do this, the IOT Client falls back to the FIFO transport.
+
+    @retval EOK the IOT message body was sent to the FIFO successfully
+    @retval ENOENT the output FIFO name does not exist
+    @retval EIO not all bytes were written
+    @retval EMSGSIZE the message body exceeds the allowable size
+    @retval other error as returned by write() or open()
+
+==============================================================================*/
+static int iotclient_SendBody( IOTCLIENT_HANDLE hIoTClient,
+                               const unsigned char *body,
+                               size_t len )
+{
+    int result = EINVAL;
+    int fd;
+    ssize_t n;
+
+    if( ( hIoTClient != NULL ) &&
+        ( body != NULL ) )
+    {
+        if( hIoTClient->fifoName == NULL )
+        {
+            /* FIFO Name is not defined */
+            result = ENOENT;
+        }
+        else if( len >= MAX_IOT_MSG_SIZE )
+        {
+            /* message body is too large */
+            result = EMSGSIZE;
+        }
+        else
+        {
+            result = ENOTSUP;
+
+            if ( hIoTClient->pRing != NULL )
+            {
+                result = iouring_SendBody( hIoTClient->pRing,
+                                           hIoTClient->fifoName,
+                                           body,
+                                           len );
+                if ( result == ENOTSUP )
+                {
+                    iotclient_log( hIoTClient,
+                                   "iotclient: io_uring unsupported" );
+                    iouring_Destroy( hIoTClient->pRing );
+                    hIoTClient->pRing = NULL;
+                }
+                else
+                {
+                    /* the ring opened the FIFO, so record the body here */
+                    iotclient_RecordBodySize( hIoTClient, len );
+                }
+            }
+
+            if ( result == ENOTSUP )
+            {
+                /* open the output FIFO */
+                fd = iotclient_OpenFIFO( hIoTClient, len, 0 );
+                if( fd != -1 )
+                {
+                    /* send the body to the FIFO */
+                    n = write( fd, body, len );
+                    if( n == (ssize_t)len )
+                    {
+                        result = EOK;
+                    }
+                    else if ( n == -1 )
+                    {
+                        result = errno;
+                    }
+                    else
+                    {
+                        /* did not write all expected data */
+                        result = EIO;
+                    }
+
+                    /* close the output FIFO */
+                    close( fd );
+                }
+                else
+                {
+                    /* unable to open the output FIFO */
+                    result = errno;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_StreamBody                                                      */
+/*!
+    Stream an IOT message body to the IOT Hub Service
+
+    The iotclient_StreamBody function streams an IOT message body to the
+    IOT Hub service via the IOT client write FIFO.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client containing the FIFO
+
+    @param[in]
+        fd
+            file descriptor to stream from
+
+    @param[in]
+        length
+            length of the message body, or IOTCLIENT_LENGTH_UNKNOWN to
+            stream the input until it ends
+
+    @param[in,out]
+        pDigest
+            optional pointer to a digest to compute over the body
+
+    @param[out]
+        pTotal
+            optional pointer to the location to store the number of
+            body bytes streamed
+
+    If the io_uring transport is in use, the body is spliced from the
+    input to the FIFO in batches of linked splice operations.  Otherwise
+    a body of known length is spliced directly to the FIFO.  Inputs
+    which cannot be spliced are copied through the client's stream
+    buffer instead, as are digested bodies, and bodies which are paced
+    to a byte rate limit on the io_uring transport.
+
+    @retval EOK the IOT message body was sent to the FIFO successfully
+    @retval ENOENT the output FIFO name does not exist
+    @retval EBADF invalid output stream
+    @retval EIO the input ended before the known length was reached
+    @retval ENOMEM the stream buffer could not be allocated
+    @retval other error as returned by read(), write(), splice() or open()
+
+==============================================================================*/
+static int iotclient_StreamBody( IOTCLIENT_HANDLE hIoTClient,
+                                 int fd,
+                                 size_t length,
+                                 Digest *pDigest,
+                                 size_t *pTotal )
+{
+    int result = EINVAL;
+    int fd_out;
+    size_t total = 0;
+    size_t bytesLeft = MAX_IOT_MSG_SIZE;
+    bool known = ( length != IOTCLIENT_LENGTH_UNKNOWN );
+
+    if( ( hIoTClient != NULL ) &&
+        ( fd != -1 ) )
+    {
+        if( hIoTClient->fifoName != NULL )
+        {
+            /* assume everything is ok, until it isn't */
+            result = EOK;
+
+            if ( known == true )
+            {
+                /* send exactly the announced length */
+                bytesLeft = length;
+            }
+
+            /* open the output FIFO */
+            fd_out = iotclient_OpenFIFO( hIoTClient,
+                                         ( known == true ) ? length : 0,
+                                         0 );
+            if( fd_out != -1 )
+            {
+                if ( ( hIoTClient->pRing != NULL ) &&
+                     ( pDigest == NULL ) &&
+                     ( !ratelimit_BytesLimited( hIoTClient->pLimiter,
+                                                hIoTClient->priority ) ) )
+                {
+                    /* splice the body using the io_uring engine */
+                    result = iouring_StreamBody( hIoTClient->pRing,
+                                                 fd,
+                                                 fd_out,
+                                                 bytesLeft,
+                                                 &total );
+                    bytesLeft -= total;
+
+                    /* fall through to the copy loop if splice failed */
+                    result = ( result == ENOTSUP ) ? EOK : result;
+                    if ( result != EOK )
+                    {
+                        bytesLeft = 0;
+                    }
+                }
+                else if ( ( known == true ) && ( pDigest == NULL ) )
+                {
+                    /* splice the body directly to the FIFO */
+                    result = iotclient_SpliceBody( hIoTClient,
+                                                   fd,
+                                                   NULL,
+                                                   fd_out,
+                                                   &bytesLeft,
+                                                   &total );
+
+                    /* fall through to the copy loop if splice failed */
+                    result = ( result == ENOTSUP ) ? EOK : result;
+                    if ( result != EOK )
+                    {
+                        bytesLeft = 0;
+                    }
+                }
+
+                if ( ( result == EOK ) && ( bytesLeft > 0 ) )
+                {
+                    /* copy the rest of the body through the buffer */
+                    result = iotclient_CopyBody( hIoTClient,
+                                                 fd,
+                                                 NULL,
+                                                 fd_out,
+                                                 pDigest,
+                                                 &bytesLeft,
+                                                 &total );
+                }
+
+                if ( ( result == EOK ) &&
+                     ( known == true ) &&
+                     ( bytesLeft > 0 ) )
+                {
+                    /* the input ended before the announced length */
+                    result = EIO;
+                }
+
+                /* close the output FIFO */
+                close( fd_out );
+
+                if ( known == false )
+                {
+                    /* remember the stream length for automatic pipe
+                       sizing.  A known length was recorded on open */
+                    iotclient_RecordBodySize( hIoTClient, total );
+                }
+
+                if ( pTotal != NULL )
+                {
+                    *pTotal = total;
+                }
+            }
+            else
+            {
+                /* message body is too large */
+                result = EBADF;
+            }
+        }
+        else
+        {
+            /* FIFO Name is not defined */
+            result = ENOENT;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_SpliceBody                                                      */
+/*!
+    Splice a message body of known length to the IOT Hub Service
+
+    The iotclient_SpliceBody function moves a message body from the
+    input to the IOT client write FIFO using splice(), so the body is
+    not copied through user space.  The body is paced in blocks while
+    a byte rate limit applies, and the limiter is charged for the bytes
+    each splice actually moved.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client containing the FIFO
+
+    @param[in]
+        fd
+            file descriptor to splice from
+
+    @param[in,out]
+        pOffset
+            optional pointer to the file offset to splice from, which is
+            advanced past the data spliced, or NULL to splice from the
+            current file offset
+
+    @param[in]
+        fd_out
+            file descriptor of the open FIFO
+
+    @param[in,out]
+        pBytesLeft
+            pointer to the number of body bytes left to send
+
+    @param[in,out]
+        pTotal
+            pointer to the number of body bytes sent
+
+    @retval EOK the body was spliced, or the input ended
+    @retval ENOTSUP the input cannot be spliced, and nothing was sent
+    @retval other error as returned by splice()
+
+==============================================================================*/
+static int iotclient_SpliceBody( IOTCLIENT_HANDLE hIoTClient,
+                                 int fd,
+                                 loff_t *pOffset,
+                                 int fd_out,
+                                 size_t *pBytesLeft,
+                                 size_t *pTotal )
+{
+    int result = EOK;
+    ssize_t n;
+    size_t chunk;
+    bool paced;
+
+    paced = ratelimit_BytesLimited( hIoTClient->pLimiter,
+                                    hIoTClient->priority );
+
+    while ( ( result == EOK ) && ( *pBytesLeft > 0 ) )
+    {
+        chunk = *pBytesLeft;
+        if ( ( paced == true ) && ( chunk > SPLICE_PACE_SIZE ) )
+        {
+            chunk = SPLICE_PACE_SIZE;
+        }
+
+        n = splice( fd, pOffset, fd_out, NULL, chunk, SPLICE_F_MOVE );
+        if ( n > 0 )
+        {
+            /* pace the body to the byte rate limits */
+            ratelimit_Wait( hIoTClient->pLimiter,
+                            hIoTClient->priority,
+                            0,
+                            n );
+
+            *pBytesLeft -= n;
+            *pTotal += n;
+        }
+        else if ( n == 0 )
+        {
+            /* end of input */
+            break;
+        }
+        else if ( ( errno == EINVAL ) && ( *pTotal == 0 ) )
+        {
+            /* the input does not support splicing */
+            result = ENOTSUP;
+        }
+        else if ( errno != EINTR )
+        {
+            result = errno;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_KnownLength                                                     */
+/*!
+    Get the length of a message body read from a file descriptor
+
+    The iotclient_KnownLength function determines the length of the
+    message body which will be streamed from a file descriptor.  It is
+    only known for regular files, where it is the rest of the file from
+    the current file offset, and is only used by clients created with
+    IOTCLIENT_OPT_BODY_LENGTH.  Other clients stream the input until it
+    ends, so a file which grows or shrinks during the upload is sent as
+    it is read.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which will stream the body
+
+    @param[in]
+        fd
+            file descriptor the body will be streamed from
+
+    @retval the length of the message body
+    @retval IOTCLIENT_LENGTH_UNKNOWN the length cannot be determined,
+            is too big to be sent as a single message, or the client
+            does not announce body lengths
+
+==============================================================================*/
+static size_t iotclient_KnownLength( IOTCLIENT_HANDLE hIoTClient, int fd )
+{
+    size_t length = IOTCLIENT_LENGTH_UNKNOWN;
+    struct stat sb;
+    off_t offset;
+
+    if ( ( hIoTClient != NULL ) &&
+         ( hIoTClient->options.flags & IOTCLIENT_OPT_BODY_LENGTH ) &&
+         ( fd != -1 ) &&
+         ( fstat( fd, &sb ) == 0 ) &&
+         ( S_ISREG( sb.st_mode ) ) )
+    {
+        offset = lseek( fd, 0, SEEK_CUR );
+        if ( ( offset != -1 ) &&
+             ( offset <= sb.st_size ) &&
+             ( sb.st_size - offset < MAX_IOT_MSG_SIZE ) )
+        {
+            length = (size_t)( sb.st_size - offset );
+        }
+    }
+
+    return length;
+}
+
+/*============================================================================*/
+/*  iotclient_CopyBody                                                        */
+/*!
+    Copy a message body to the IOT Hub Service through a buffer
+
+    The iotclient_CopyBody function reads a message body from the input
+    in chunks into the client's page-aligned stream buffer, and writes
+    each chunk to the IOT client write FIFO.
+
+    The chunk size adapts to the input.  It is bounded by the type of
+    the input: the pipe capacity of a pipe, the receive buffer of a
+    socket, or STREAM_CHUNK_MAX for a file.  It doubles while the input
+    fills every chunk, and halves after STREAM_CHUNK_SHRINK_READS
+    consecutive reads which fill less than half of it.  The next copy
+    from the same type of input starts from the chunk size this one
+    finished with.  The choice is recorded in the client's chunk stats.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client containing the FIFO
+
+    @param[in]
+        fd
+            file descriptor to read from
+
+    @param[in,out]
+        pOffset
+            optional pointer to the file offset to read from with
+            pread(), which is advanced past the data read, or NULL to
+            read from the current file offset
+
+    @param[in]
+        fd_out
+            file descriptor of the open FIFO
+
+    @param[in,out]
+        pDigest
+            optional pointer to a digest to compute over the body
+
+    @param[in,out]
+        pBytesLeft
+            pointer to the number of body bytes left to send
+
+    @param[in,out]
+        pTotal
+            pointer to the number of body bytes sent
+
+    @retval EOK the body was copied, or the input ended
+    @retval EIO the body could not be written to the FIFO
+    @retval ENOMEM the stream buffer could not be allocated
+    @retval other error as returned by read() or pread()
+
+==============================================================================*/
+static int iotclient_CopyBody( IOTCLIENT_HANDLE hIoTClient,
+                               int fd,
+                               loff_t *pOffset,
+                               int fd_out,
+                               Digest *pDigest,
+                               size_t *pBytesLeft,
+                               size_t *pTotal )
+{
+    int result = EOK;
+    IOTCLIENT_CHUNK_STATS *pStats = &hIoTClient->chunkStats;
+    IOTCLIENT_INPUT_TYPE type;
+    unsigned char *buf;
+    size_t limit;
+    size_t chunk;
+    size_t len;
+    int shortReads = 0;
+    ssize_t n;
+    struct timespec start;
+    struct timespec end;
+    uint64_t elapsed;
+
+    type = iotclient_InputType( fd, &limit );
+    if ( ( ratelimit_BytesLimited( hIoTClient->pLimiter,
+                                   hIoTClient->priority ) ) &&
+         ( limit > SPLICE_PACE_SIZE ) )
+    {
+        /* keep the paced blocks small */
+        limit = SPLICE_PACE_SIZE;
+    }
+
+    /* start from where the last copy from this type of input finished */
+    chunk = ( hIoTClient->chunkSize[type] != 0 )
+            ? hIoTClient->chunkSize[type]
+            : STREAM_CHUNK_INITIAL;
+    if ( chunk > limit )
+    {
+        chunk = limit;
+    }
+
+    memset( pStats, 0, sizeof( IOTCLIENT_CHUNK_STATS ) );
+    pStats->inputType = type;
+    pStats->initialChunk = chunk;
+    pStats->chunkLimit = limit;
+
+    clock_gettime( CLOCK_MONOTONIC, &start );
+
+    while ( *pBytesLeft > 0 )
+    {
+        buf = iotclient_StreamBuffer( hIoTClient, chunk );
+        if ( buf == NULL )
+        {
+            result = ENOMEM;
+            break;
+        }
+
+        /* read a chunk of data from the input, without consuming
+           input beyond the end of the body */
+        len = ( *pBytesLeft < chunk ) ? *pBytesLeft : chunk;
+        n = ( pOffset != NULL ) ? pread( fd, buf, len, *pOffset )
+                                : read( fd, buf, len );
+        if ( n == 0 )
+        {
+            /* end of input */
+            break;
+        }
+        else if ( n < 0 )
+        {
+            if ( errno == EINTR )
+            {
+                continue;
+            }
+
+            result = errno;
+            break;
+        }
+
+        pStats->reads++;
+
+        /* pace the body to the byte rate limits */
+        ratelimit_Wait( hIoTClient->pLimiter,
+                        hIoTClient->priority,
+                        0,
+                        n );
+
+        /* write the output buffer */
+        if ( write( fd_out, buf, n ) != n )
+        {
+            result = EIO;
+            break;
+        }
+
+        if ( pDigest != NULL )
+        {
+            /* digest the octets as they are forwarded */
+            digest_Update( pDigest, buf, n );
+        }
+
+        pStats->bytes += n;
+        *pTotal += n;
+        *pBytesLeft -= n;
+
+        if ( pOffset != NULL )
+        {
+            *pOffset += n;
+        }
+
+        if ( (size_t)n == chunk )
+        {
+            /* the input keeps up, so read more per call */
+            shortReads = 0;
+            chunk = ( chunk * 2 < limit ) ? chunk * 2 : limit;
+        }
+        else if ( (size_t)n < len / 2 )
+        {
+            /* the input is slower than the chunk size */
+            if ( ++shortReads >= STREAM_CHUNK_SHRINK_READS )
+            {
+                shortReads = 0;
+                chunk = ( chunk / 2 > STREAM_CHUNK_MIN )
+                        ? chunk / 2
+                        : STREAM_CHUNK_MIN;
+            }
+        }
+        else
+        {
+            shortReads = 0;
+        }
+    }
+
+    clock_gettime( CLOCK_MONOTONIC, &end );
+    elapsed = (uint64_t)( end.tv_sec - start.tv_sec ) * 1000000000ULL
+              + end.tv_nsec - start.tv_nsec;
+
+    pStats->finalChunk = chunk;
+    pStats->bufferSize = hIoTClient->streamBufSize;
+    pStats->throughput = ( elapsed > 0 )
+                         ? pStats->bytes * 1e9 / elapsed
+                         : 0.0;
+
+    if ( pStats->reads > 0 )
+    {
+        /* remember the chunk size for the next copy from this input */
+        hIoTClient->chunkSize[type] = chunk;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_InputType                                                       */
+/*!
+    Classify a stream input for chunk sizing
+
+    The iotclient_InputType function determines the type of a stream
+    input, and the largest chunk size worth reading from it.  A pipe
+    never returns more than its capacity in one read, and a socket
+    rarely returns more than its receive buffer.  Regular files and
+    block devices can be read in chunks of up to STREAM_CHUNK_MAX.
+
+    @param[in]
+        fd
+            file descriptor of the input
+
+    @param[out]
+        pLimit
+            pointer to the location to store the largest chunk size
+
+    @retval the type of the input
+
+==============================================================================*/
+static IOTCLIENT_INPUT_TYPE iotclient_InputType( int fd, size_t *pLimit )
+{
+    IOTCLIENT_INPUT_TYPE type = IOTCLIENT_INPUT_OTHER;
+    size_t limit = STREAM_CHUNK_INITIAL;
+    struct stat sb;
+    int size;
+    socklen_t optlen = sizeof( size );
+
+    if ( fstat( fd, &sb ) == 0 )
+    {
+        if ( S_ISREG( sb.st_mode ) || S_ISBLK( sb.st_mode ) )
+        {
+            type = IOTCLIENT_INPUT_FILE;
+            limit = STREAM_CHUNK_MAX;
+        }
+        else if ( S_ISFIFO( sb.st_mode ) )
+        {
+            type = IOTCLIENT_INPUT_PIPE;
+            size = fcntl( fd, F_GETPIPE_SZ );
+            if ( size > 0 )
+            {
+                limit = (size_t)size;
+            }
+        }
+        else if ( S_ISSOCK( sb.st_mode ) )
+        {
+            type = IOTCLIENT_INPUT_SOCKET;
+            if ( ( getsockopt( fd,
+                               SOL_SOCKET,
+                               SO_RCVBUF,
+                               &size,
+                               &optlen ) == 0 ) &&
+                 ( size > 0 ) )
+            {
+                /* the kernel reports double the usable buffer size */
+                limit = (size_t)size / 2;
+            }
+        }
+    }
+
+    if ( limit < STREAM_CHUNK_MIN )
+    {
+        limit = STREAM_CHUNK_MIN;
+    }
+    else if ( limit > STREAM_CHUNK_MAX )
+    {
+        limit = STREAM_CHUNK_MAX;
+    }
+
+    *pLimit = limit;
+
+    return type;
+}
+
+/*============================================================================*/
+/*  iotclient_StreamBuffer                                                    */
+/*!
+    Get the stream copy buffer of an IOT Client
+
+    The iotclient_StreamBuffer function gets the page-aligned buffer
+    the stream copy loop reads into, growing it if it is smaller than
+    the requested size.  The buffer is kept for the lifetime of the
+    IOT Client so it is not allocated for every message.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        size
+            minimum size of the buffer
+
+    @retval pointer to the stream buffer
+    @retval NULL if the buffer could not be allocated
+
+==============================================================================*/
+static unsigned char *iotclient_StreamBuffer( IOTCLIENT_HANDLE hIoTClient,
+                                              size_t size )
+{
+    size_t pageSize = (size_t)sysconf( _SC_PAGESIZE );
+    void *p;
+
+    if ( hIoTClient->streamBufSize < size )
+    {
+        /* round up to a whole number of pages */
+        size = ( size + pageSize - 1 ) & ~( pageSize - 1 );
+
+        if ( posix_memalign( &p, pageSize, size ) != 0 )
+        {
+            return NULL;
+        }
+
+        free( hIoTClient->streamBuf );
+        hIoTClient->streamBuf = p;
+        hIoTClient->streamBufSize = size;
+    }
+
+    return hIoTClient->streamBuf;
+}
+
+/*============================================================================*/
+/*  iotclient_StreamThread                                                    */
+/*!
+    IOTCLIENT_StreamMany channel thread
+
+    The iotclient_StreamThread function streams messages of an
+    IOTCLIENT_StreamMany transfer using the channel's IOT Client until
+    there are none left.
+
+    @param[in]
+        arg
+            pointer to the transfer channel
+
+    @retval NULL always
+
+==============================================================================*/
+static void *iotclient_StreamThread( void *arg )
+{
+    IoTClientStreamChannel *pChannel = arg;
+
+    iotclient_StreamWorker( pChannel->pJob, pChannel->hIoTClient );
+
+    return NULL;
+}
+
+/*============================================================================*/
+/*  iotclient_StreamWorker                                                    */
+/*!
+    Stream messages of an IOTCLIENT_StreamMany transfer
+
+    The iotclient_StreamWorker function takes the next message of the
+    transfer, applies the pre-send filters of the IOT Client which
+    started the transfer, and streams it, until there are no messages
+    left.  The filters are committed once the message headers have
+    been sent.  Channels do not hold the transfer lock while streaming,
+    so messages on the same filter stream which are in flight on
+    different channels at the same time are evaluated against the same
+    state.  The aggregate progress is updated and the progress callback
+    invoked as each message completes.
+
+    @param[in]
+        pJob
+            pointer to the transfer
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client to stream the messages with
+
+==============================================================================*/
+static void iotclient_StreamWorker( IoTClientStreamJob *pJob,
+                                    IOTCLIENT_HANDLE hIoTClient )
+{
+    IOTCLIENT_STREAM_ITEM *pItem;
+    IOTCLIENT_STREAM_STATS *pStats = &pJob->stats;
+    struct timespec now;
+    uint64_t elapsed;
+    size_t index;
+    bool accept;
+    bool sent;
+
+    pthread_mutex_lock( &pJob->lock );
+
+    while ( pJob->next < pJob->count )
+    {
+        index = pJob->next++;
+        pItem = &pJob->pItems[index];
+        accept = ( pItem->headers != NULL ) &&
+                 filter_Accept( pJob->hIoTClient->pFilters,
+                                pItem->headers,
+                                NULL,
+                                0 );
+
+        pthread_mutex_unlock( &pJob->lock );
+
+        pItem->length = 0;
+        sent = false;
+        if ( pItem->headers == NULL )
+        {
+            pItem->result = EINVAL;
+        }
+        else if ( accept == false )
+        {
+            /* the message was dropped by a pre-send filter */
+            pItem->result = ECANCELED;
+        }
+        else
+        {
+            pItem->result = iotclient_StreamItem( hIoTClient, pItem, &sent );
+        }
+
+        pthread_mutex_lock( &pJob->lock );
+
+        if ( sent == true )
+        {
+            /* the message was sent, so update the pre-send filters */
+            filter_Commit( pJob->hIoTClient->pFilters,
+                           pItem->headers,
+                           NULL,
+                           0 );
+        }
+
+        if ( pItem->result == EOK )
+        {
+            pStats->completed++;
+        }
+        else
+        {
+            pStats->failed++;
+        }
+
+        pStats->bytes += pItem->length;
+
+        clock_gettime( CLOCK_MONOTONIC, &now );
+        elapsed = (uint64_t)( now.tv_sec - pJob->start.tv_sec ) * 1000000000ULL
+                  + now.tv_nsec - pJob->start.tv_nsec;
+        pStats->elapsed = elapsed / 1000000ULL;
+        pStats->throughput = ( elapsed > 0 )
+                             ? pStats->bytes * 1e9 / elapsed
+                             : 0.0;
+
+        if ( pJob->cb != NULL )
+        {
+            pJob->cb( pJob->ctx, index, pItem, pStats );
+        }
+    }
+
+    pthread_mutex_unlock( &pJob->lock );
+}
+
+/*============================================================================*/
+/*  iotclient_StreamItem                                                      */
+/*!
+    Stream a message of an IOTCLIENT_StreamMany transfer
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client to stream the message with
+
+    @param[in,out]
+        pItem
+            pointer to the message to stream.  Its body length is updated.
+
+    @param[out]
+        pSent
+            pointer to the location to store whether the message
+            headers were sent
+
+    @retval EOK the message was streamed
+    @retval EINVAL invalid arguments
+    @retval other error as returned by open() or the send functions
+
+==============================================================================*/
+static int iotclient_StreamItem( IOTCLIENT_HANDLE hIoTClient,
+                                 IOTCLIENT_STREAM_ITEM *pItem,
+                                 bool *pSent )
+{
+    int result = EINVAL;
+    int fd = pItem->fd;
+    size_t length;
+
+    if ( pItem->path != NULL )
+    {
+        fd = open( pItem->path, O_RDONLY | O_CLOEXEC );
+        if ( fd == -1 )
+        {
+            result = errno;
+        }
+    }
+
+    if ( fd != -1 )
+    {
+        /* send the message header to the IOT Hub service */
+        length = iotclient_KnownLength( hIoTClient, fd );
+        result = iotclient_SendHeaders( hIoTClient,
+                                        pItem->headers,
+                                        length,
+                                        true );
+        *pSent = ( result == EOK );
+        if ( result == EOK )
+        {
+            /* send the message body to the IOT Hub service */
+            result = iotclient_StreamBody( hIoTClient,
+                                           fd,
+                                           length,
+                                           NULL,
+                                           &pItem->length );
+        }
+
+        if ( pItem->path != NULL )
+        {
+            close( fd );
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_SendSegment                                                     */
+/*!
+    Send a segment of a resumable upload
+
+    The iotclient_SendSegment function sends a segment of a resumable
+    upload, starting at the checkpoint's offset, with the upload
+    identifier, segment offset and file size appended to the message
+    headers.  If the IOT Client has an in-flight window, it waits for
+    the segment to be acknowledged.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        headers
+            pointer to a NUL terminated string containing the message headers
+
+    @param[in]
+        fd
+            descriptor of the regular file being uploaded
+
+    @param[in]
+        pCheckpoint
+            pointer to the upload checkpoint
+
+    @param[in]
+        len
+            length of the segment
+
+    @retval EOK the segment was delivered
+    @retval ENOMEM the segment headers could not be allocated
+    @retval other error as returned by the send functions, or the
+            acknowledgement status of the segment
+
+==============================================================================*/
+static int iotclient_SendSegment( IOTCLIENT_HANDLE hIoTClient,
+                                  const char *headers,
+                                  int fd,
+                                  const Checkpoint *pCheckpoint,
+                                  size_t len )
+{
+    int result = ENOMEM;
+    int status = EOK;
+    char *segmentHeaders;
+    IoTClientInFlight *pEntry = NULL;
+    size_t n = strlen( headers );
+
+    /* the segment properties follow the caller's headers */
+    while ( ( n > 0 ) && ( headers[n - 1] == '\n' ) )
+    {
+        n--;
+    }
+
+    if ( asprintf( &segmentHeaders,
+                   "%.*s%s"
+                   RESUME_ID_HEADER ":%s\n"
+                   RESUME_OFFSET_HEADER ":%" PRIu64 "\n"
+                   RESUME_SIZE_HEADER ":%" PRIu64 "\n\n",
+                   (int)n,
+                   headers,
+                   ( n > 0 ) ? "\n" : "",
+                   pCheckpoint->id,
+                   pCheckpoint->offset,
+                   pCheckpoint->size ) >= 0 )
+    {
+        /* send the message header to the IOT Hub service */
+        result = iotclient_SendHeaders( hIoTClient,
+                                        segmentHeaders,
+                                        len,
+                                        true );
+        if ( result == EOK )
+        {
+            /* send the segment directly from the file */
+            result = iotclient_StreamRange( hIoTClient,
+                                            fd,
+                                            (off_t)pCheckpoint->offset,
+                                            len );
+        }
+
+        if ( ( result == EOK ) && ( hIoTClient->pWindow != NULL ) )
+        {
+            /* wait for the segment to be acknowledged */
+            pEntry = iotclient_FindInFlight( hIoTClient,
+                                             hIoTClient->nextSeq - 1 );
+            if ( pEntry != NULL )
+            {
+                pEntry->cb = iotclient_SegmentAck;
+                pEntry->ctx = &status;
+                result = IOTCLIENT_Flush( hIoTClient );
+            }
+
+            if ( result != EOK )
+            {
+                /* the status cannot be reported once this returns */
+                pEntry = iotclient_FindInFlight( hIoTClient,
+                                                 hIoTClient->nextSeq - 1 );
+                if ( pEntry != NULL )
+                {
+                    pEntry->cb = NULL;
+                }
+            }
+            else
+            {
+                result = status;
+            }
+        }
+
+        free( segmentHeaders );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_SegmentAck                                                      */
+/*!
+    Record the acknowledgement status of a resumable upload segment
+
+    @param[in]
+        ctx
+            pointer to the segment status
+
+    @param[in]
+        result
+            acknowledgement status reported by the IOT Hub service
+
+==============================================================================*/
+static void iotclient_SegmentAck( void *ctx, int result )
+{
+    *(int *)ctx = result;
+}
+
+/*============================================================================*/
+/*  iotclient_StreamRange                                                     */
+/*!
+    Stream a range of a regular file as an IOT message body
+
+    The iotclient_StreamRange function sends a range of a regular file
+    to the IOT Hub service via the IOT client write FIFO.  The range is
+    spliced from the file to the FIFO without changing the file offset,
+    as per iotclient_SpliceBody.  If the file system does not support
+    splicing, the range is read with pread() through the client's
+    stream buffer, as per iotclient_CopyBody, which records the chunk
+    stats.  Either way the range is paced while a byte rate limit
+    applies, charging the limiter once for the bytes actually sent.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client containing the FIFO
+
+    @param[in]
+        fd
+            descriptor of the regular file
+
+    @param[in]
+        offset
+            offset of the range in the file
+
+    @param[in]
+        len
+            length of the range
+
+    @retval EOK the range was sent to the FIFO successfully
+    @retval ENOENT the output FIFO name does not exist
+    @retval EIO the file ended before the end of the range
+    @retval other error as returned by open(), splice(), pread() or write()
+
+==============================================================================*/
+static int iotclient_StreamRange( IOTCLIENT_HANDLE hIoTClient,
+                                  int fd,
+                                  off_t offset,
+                                  size_t len )
+{
+    int result = EOK;
+    int fd_out;
+    size_t total = 0;
+    size_t left = len;
+    loff_t off = offset;
+
+    if ( hIoTClient->fifoName == NULL )
+    {
+        /* FIFO Name is not defined */
+        result = ENOENT;
+    }
+    else if ( ( fd_out = iotclient_OpenFIFO( hIoTClient, len, 0 ) ) == -1 )
+    {
+        result = errno;
+    }
+    else
+    {
+        /* splice the range to the FIFO */
+        result = iotclient_SpliceBody( hIoTClient,
+                                       fd,
+                                       &off,
+                                       fd_out,
+                                       &left,
+                                       &total );
+
+        if ( result == ENOTSUP )
+        {
+            /* copy the range through the stream buffer */
+            result = iotclient_CopyBody( hIoTClient,
+                                         fd,
+                                         &off,
+                                         fd_out,
+                                         NULL,
+                                         &left,
+                                         &total );
+        }
+
+        if ( ( result == EOK ) && ( left > 0 ) )
+        {
+            /* the file was truncated */
+            result = EIO;
+        }
+
+        /* close the output FIFO */
+        close( fd_out );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_GiftBody                                                        */
+/*!
+    Gift an IOT message body to the IOT Hub Service
+
+    The iotclient_GiftBody function moves the pages of a page-aligned
+    IOT message body into the IOT client write FIFO using vmsplice()
+    with SPLICE_F_GIFT, so the body data is not copied.  If the kernel
+    does not support vmsplice() on the FIFO, the body is written instead.
+
+    Gifted pages stay referenced by the pipe until the IOT Hub service
+    has read them.  An empty pipe when the FIFO is opened means the
+    pages of earlier messages have all been read, so their buffers are
+    returned to the buffer pool.  The pipe is checked again before the
+    FIFO is closed, so the caller knows whether this body's pages can be
+    re-used straight away.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client containing the FIFO
+
+    @param[in]
+        body
+            pointer to the page-aligned message body data
+
+    @param[in]
+        len
+            length of the message body to send
+
+    @param[out]
+        pDrained
+            set to true if the pipe no longer references the body pages
+
+    @retval EOK the IOT message body was sent to the FIFO successfully
+    @retval ENOENT the output FIFO name does not exist
+    @retval EMSGSIZE the message body exceeds the allowable size
+    @retval other error as returned by vmsplice(), write() or open()
+
+==============================================================================*/
+static int iotclient_GiftBody( IOTCLIENT_HANDLE hIoTClient,
+                               unsigned char *body,
+                               size_t len,
+                               bool *pDrained )
+{
+    int result = EINVAL;
+    int fd;
+    int pending;
+    ssize_t n;
+    struct iovec iov;
+    bool gift = true;
+
+    /* nothing has been gifted yet */
+    *pDrained = true;
+
+    if( ( hIoTClient != NULL ) &&
+        ( body != NULL ) )
+    {
+        if( hIoTClient->fifoName == NULL )
+        {
+            /* FIFO Name is not defined */
+            result = ENOENT;
+        }
+        else if ( len >= MAX_IOT_MSG_SIZE )
+        {
+            /* message body is too large */
+            result = EMSGSIZE;
+        }
+        else
+        {
+            /* open the output FIFO */
+            fd = iotclient_OpenFIFO( hIoTClient, len, 0 );
+            if( fd != -1 )
+            {
+                if ( ( ioctl( fd, FIONREAD, &pending ) == 0 ) &&
+                     ( pending == 0 ) )
+                {
+                    /* earlier gifted pages have all been read */
+                    iotclient_RecycleGiftedBuffers( hIoTClient );
+                }
+
+                result = EOK;
+                iov.iov_base = body;
+                iov.iov_len = len;
+
+                while ( iov.iov_len > 0 )
+                {
+                    if ( gift == true )
+                    {
+                        n = vmsplice( fd, &iov, 1, SPLICE_F_GIFT );
+                        if ( ( n == -1 ) &&
+                             ( ( errno == EINVAL ) || ( errno == ENOSYS ) ) )
+                        {
+                            /* fall back to copying the body */
+                            gift = false;
+                            continue;
+                        }
+                    }
+                    else
+                    {
+                        n = write( fd, iov.iov_base, iov.iov_len );
+                    }
+
+                    if ( n > 0 )
+                    {
+                        iov.iov_base = (char *)iov.iov_base + n;
+                        iov.iov_len -= n;
+                    }
+                    else if ( ( n == -1 ) && ( errno == EINTR ) )
+                    {
+                        continue;
+                    }
+                    else
+                    {
+                        result = ( n == -1 ) ? errno : EIO;
+                        break;
+                    }
+                }
+
+                /* the hub may not have read all of the gifted pages */
+                *pDrained = ( ioctl( fd, FIONREAD, &pending ) == 0 ) &&
+                            ( pending == 0 );
+
+                /* close the output FIFO */
+                close( fd );
+            }
+            else
+            {
+                /* unable to open the output FIFO */
+                result = errno;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_GetBufferHeader                                                 */
+/*!
+    Get the header of a transfer buffer
+
+    The iotclient_GetBufferHeader function gets a pointer to the
+    transfer buffer header stored in the page preceding a buffer
+    returned by IOTCLIENT_AllocBuffer.
+
+    @param[in]
+        buf
+            pointer to the buffer returned by IOTCLIENT_AllocBuffer
+
+    @retval pointer to the transfer buffer header
+
+==============================================================================*/
+static IoTClientBuffer *iotclient_GetBufferHeader( void *buf )
+{
+    return (IoTClientBuffer *)( (char *)buf - sysconf( _SC_PAGESIZE ) );
+}
+
+/*============================================================================*/
+/*  iotclient_RecycleGiftedBuffers                                            */
+/*!
+    Return sent transfer buffers to the buffer pool
+
+    The iotclient_RecycleGiftedBuffers function moves the transfer
+    buffers whose pages were gifted to the body FIFO back into the
+    IOT Client's buffer pool.  It must only be called once the pipe is
+    known to be empty, so the pipe no longer references their pages.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the buffers
+
+==============================================================================*/
+static void iotclient_RecycleGiftedBuffers( IOTCLIENT_HANDLE hIoTClient )
+{
+    IoTClientBuffer *pBuffer;
+    size_t pageSize = (size_t)sysconf( _SC_PAGESIZE );
+
+    while ( hIoTClient->pGiftedBuffers != NULL )
+    {
+        pBuffer = hIoTClient->pGiftedBuffers;
+        hIoTClient->pGiftedBuffers = pBuffer->pNext;
+        IOTCLIENT_FreeBuffer( hIoTClient, (char *)pBuffer + pageSize );
+    }
+
+    hIoTClient->nGiftedBuffers = 0;
+}
+
+/*============================================================================*/
+/*  iotclient_DestroyBufferPool                                               */
+/*!
+    Release all of the unused transfer buffers
+
+    The iotclient_DestroyBufferPool function unmaps all of the unused
+    transfer buffers held in the IOT Client's buffer pool, and the sent
+    buffers awaiting re-use.  Pages still referenced by the pipe remain
+    valid there until they have been read.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client which owns the buffer pool
+
+==============================================================================*/
+static void iotclient_DestroyBufferPool( IOTCLIENT_HANDLE hIoTClient )
+{
+    IoTClientBuffer *pBuffer;
+
+    if ( hIoTClient != NULL )
+    {
+        while ( hIoTClient->pBufferPool != NULL )
+        {
+            pBuffer = hIoTClient->pBufferPool;
+            hIoTClient->pBufferPool = pBuffer->pNext;
+            munmap( pBuffer, pBuffer->mapSize );
+        }
+
+        while ( hIoTClient->pGiftedBuffers != NULL )
+        {
+            pBuffer = hIoTClient->pGiftedBuffers;
+            hIoTClient->pGiftedBuffers = pBuffer->pNext;
+            munmap( pBuffer, pBuffer->mapSize );
+        }
+
+        hIoTClient->nPooledBuffers = 0;
+        hIoTClient->nGiftedBuffers = 0;
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_AllocChannel                                                    */
+/*!
+    Allocate a channel identifier for an IOT Client
+
+    The iotclient_AllocChannel function allocates a channel identifier
+    which is unique within the process.  The first client gets channel 0,
+    which uses the original FIFO name and message preamble so it remains
+    compatible with IOT Hub services which do not support channels.
+    Subsequent clients get channels numbered from 1.
+
+    @retval the allocated channel identifier
+
+==============================================================================*/
+static uint32_t iotclient_AllocChannel( void )
+{
+    uint32_t channel = 0;
+
+    if ( atomic_flag_test_and_set( &channelZeroInUse ) )
+    {
+        channel = atomic_fetch_add( &nextChannel, 1 );
+    }
+
+    return channel;
+}
+
+/*============================================================================*/
+/*  iotclient_FreeChannel                                                     */
+/*!
+    Release a channel identifier
+
+    The iotclient_FreeChannel function releases a channel identifier
+    which is no longer in use.  Only channel 0 is re-used, other
+    channel identifiers are never handed out twice by a process.
+
+    @param[in]
+        channel
+            the channel identifier to release
+
+==============================================================================*/
+static void iotclient_FreeChannel( uint32_t channel )
+{
+    if ( channel == 0 )
+    {
+        atomic_flag_clear( &channelZeroInUse );
+    }
+}
+
+/*============================================================================*/
+/*  iotclient_ResetChannels                                                   */
+/*!
+    Reset channel allocation in a forked child
+
+    The iotclient_ResetChannels function is registered as a pthread_atfork
+    child handler.  A child process has its own process identifier, so
+    the IOT Hub sees it as a fresh process and expects its first client
+    to use channel 0.  Channel allocation state inherited from the parent
+    is discarded so the child starts numbering channels from scratch.
+
+==============================================================================*/
+static void iotclient_ResetChannels( void )
+{
+    atomic_flag_clear( &channelZeroInUse );
+    atomic_store( &nextChannel, 1 );
+}
+
+/*============================================================================*/
+/*  iotclient_BuildPreamble                                                   */
+/*!
+    Build the message preamble
+
+    The iotclient_BuildPreamble function writes the message preamble
+    which identifies the client to the IOT Hub service into the
+    specified buffer.  IOTCLIENT_OPT_BODY_LENGTH clients use the known
+    length preamble when the length of the message body is known, so
+    the IOT Hub service can preallocate for the body and read exactly
+    that many octets from the FIFO.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        length
+            length of the message body, or IOTCLIENT_LENGTH_UNKNOWN
+
+    @param[in]
+        buf
+            pointer to the buffer to write the preamble into
+
+    @param[in]
+        len
+            size of the buffer
+
+    @retval the length of the preamble
+    @retval 0 if the preamble does not fit in the buffer
+
+==============================================================================*/
+static size_t iotclient_BuildPreamble( IOTCLIENT_HANDLE hIoTClient,
+                                       size_t length,
+                                       char *buf,
+                                       size_t len )
+{
+    size_t n = 0;
+    uint32_t pid = (uint32_t)hIoTClient->pid;
+    IoTClientPreamble preamble;
+    IoTClientSequencedPreamble sequenced;
+    IoTClientLengthPreamble known;
+
+    if ( ( length != IOTCLIENT_LENGTH_UNKNOWN ) &&
+         ( hIoTClient->options.flags & IOTCLIENT_OPT_BODY_LENGTH ) )
+    {
+        if ( len >= sizeof( IoTClientLengthPreamble ) )
+        {
+            memset( &known, 0, sizeof( IoTClientLengthPreamble ) );
+            memcpy( known.id, PREAMBLE_ID_LENGTH, 4 );
+            known.pid = pid;
+            known.channel = hIoTClient->channel;
+            known.length = length;
+
+            if ( hIoTClient->pWindow != NULL )
+            {
+                known.seq = hIoTClient->nextSeq;
+                known.flags = PREAMBLE_FLAG_SEQUENCED;
+            }
+
+            memcpy( buf, &known, sizeof( IoTClientLengthPreamble ) );
+            n = sizeof( IoTClientLengthPreamble );
+        }
+    }
+    else if ( hIoTClient->pWindow != NULL )
+    {
+        if ( len >= sizeof( IoTClientSequencedPreamble ) )
+        {
+            memcpy( sequenced.id, PREAMBLE_ID_SEQUENCED, 4 );
+            sequenced.pid = pid;
+            sequenced.channel = hIoTClient->channel;
+            sequenced.seq = hIoTClient->nextSeq;
+
+            memcpy( buf, &sequenced, sizeof( IoTClientSequencedPreamble ) );
+            n = sizeof( IoTClientSequencedPreamble );
+        }
+    }
+    else if ( hIoTClient->channel == 0 )
+    {
+        if ( len >= 8 )
+        {
+            memcpy( buf, PREAMBLE_ID, 4 );
+            memcpy( &buf[4], &pid, 4 );
+            n = 8;
+        }
+    }
+    else if ( len >= sizeof( IoTClientPreamble ) )
+    {
+        memcpy( preamble.id, PREAMBLE_ID_EXTENDED, 4 );
+        preamble.pid = pid;
+        preamble.channel = hIoTClient->channel;
+
+        memcpy( buf, &preamble, sizeof( IoTClientPreamble ) );
+        n = sizeof( IoTClientPreamble );
+    }
+
+    return n;
+}
+
+/*============================================================================*/
+/*  iotclient_OpenFIFO                                                        */
+/*!
+    Open the message body FIFO for writing
+
+    The iotclient_OpenFIFO function opens the IOT client write FIFO
+    and sets its pipe capacity.  The pipe only exists while the FIFO
+    is open, so its capacity must be set every time it is opened.
 
-    The iotclient_log function generates the specified debug output log
-    if the debug logging is enabled via the verbose flag.
+    The pipe capacity is the size requested via IOTCLIENT_SetPipeSize,
+    or if automatic sizing is selected, a size large enough to hold
+    most of the message bodies observed so far.  Automatic sizing never
+    shrinks the pipe below its default capacity.
+
+    A known body length is recorded here for automatic sizing.  Callers
+    which open the FIFO without knowing the length record the number of
+    bytes sent once the body is complete, so each body is recorded once.
 
     @param[in]
         hIoTClient
-            handle to the IOT Client
+            handle to the IOT Client containing the FIFO
 
     @param[in]
-        msg
-            pointer to the NUL terminated character string to output
+        len
+            length of the message body to be sent, or 0 if it is not known
+
+    @param[in]
+        flags
+            additional open flags, eg. O_NONBLOCK
+
+    @retval file descriptor of the open FIFO
+    @retval -1 if the FIFO could not be opened (errno is set)
 
 ==============================================================================*/
-static void iotclient_log( IOTCLIENT_HANDLE hIoTClient, char *msg )
+static int iotclient_OpenFIFO( IOTCLIENT_HANDLE hIoTClient,
+                               size_t len,
+                               int flags )
 {
-    if ( hIoTClient != NULL )
+    int fd;
+    int current;
+    size_t size;
+
+    fd = open( hIoTClient->fifoName, O_WRONLY | flags );
+    if ( fd != -1 )
     {
-        if ( hIoTClient->verbose == true )
+        if ( len > 0 )
         {
-            fprintf(stdout, "%s\n", msg );
+            iotclient_RecordBodySize( hIoTClient, len );
+        }
+
+        size = ( hIoTClient->pipeSize != 0 )
+                ? hIoTClient->pipeSize
+                : iotclient_GetAutoPipeSize( hIoTClient );
+
+        current = fcntl( fd, F_GETPIPE_SZ );
+        if ( ( current != -1 ) &&
+             ( size != 0 ) &&
+             ( size != (size_t)current ) )
+        {
+            /* a failure here leaves the default pipe capacity in place */
+            if ( fcntl( fd, F_SETPIPE_SZ, (int)size ) != -1 )
+            {
+                current = fcntl( fd, F_GETPIPE_SZ );
+            }
         }
+
+        hIoTClient->effectivePipeSize = ( current != -1 ) ? current : 0;
     }
+
+    return fd;
 }
 
 /*============================================================================*/
-/*  iotclient_CreateFIFO                                                      */
+/*  iotclient_ReadPipeMaxSize                                                 */
 /*!
-    Create a FIFO for sending IOT message bodies
-
-    The iotclient_CreateFIFO function creates a FIFO which is used to
-    stream IOT message body data to the IOTHUB for transmission.
+    Read the system-wide maximum pipe capacity
 
-    @param[in]
-        hIoTClient
-            handle to the IOT Client which will contain the FIFO reference
+    The iotclient_ReadPipeMaxSize function reads the largest pipe
+    capacity which an unprivileged process may set, which bounds the
+    body FIFO pipe capacity of every IOT Client in the process.  If it
+    cannot be read, the default pipe capacity is assumed.
 
 ==============================================================================*/
-static int iotclient_CreateFIFO( IOTCLIENT_HANDLE hIoTClient )
+static void iotclient_ReadPipeMaxSize( void )
 {
-    int result = EINVAL;
-    int n;
+    FILE *fp;
+    unsigned long maxSize;
 
-    if ( hIoTClient != NULL )
+    fp = fopen( PIPE_MAX_SIZE_PATH, "r" );
+    if ( fp != NULL )
     {
-        /* generate the FIFO name */
-        hIoTClient->pid = getpid();
-        n = asprintf( &hIoTClient->fifoName,
-                      "/tmp/iothub_%d",
-                      hIoTClient->pid );
-        if ( ( n > 0 ) &&
-             ( hIoTClient->fifoName != NULL ) )
+        if ( fscanf( fp, "%lu", &maxSize ) == 1 )
         {
-            /* create the FIFO */
-            if( mkfifo( hIoTClient->fifoName, 0666) == 0 )
-            {
-                result = EOK;
-            }
-            else
-            {
-                iotclient_DestroyFIFO( hIoTClient );
-                result = errno;
-            }
+            pipeMaxSize = maxSize;
         }
-    }
 
-    return result;
+        fclose( fp );
+    }
 }
 
 /*============================================================================*/
-/*  iotclient_SendBody                                                        */
+/*  iotclient_RecordBodySize                                                  */
 /*!
-    Send an IOT message body to the IOT Hub Service
+    Record the size of a message body
 
-    The iotclient_SendBody function sends an IOT message body to the
-    IOT Hub service via the IOT client write FIFO.
+    The iotclient_RecordBodySize function adds a message body size to the
+    log2 histogram of observed message body sizes.  Older samples are
+    aged out by halving the histogram as it fills, so the automatic
+    pipe size tracks changes in the body size distribution.
 
     @param[in]
         hIoTClient
-            handle to the IOT Client containing the FIFO
-
-    @param[in]
-        body
-            pointer to the message body data
+            handle to the IOT Client
 
     @param[in]
         len
-            length of the message body to send
-
-    @retval EOK the IOT message body was sent to the FIFO successfully
-    @retval ENOENT the output FIFO name does not exist
-    @retval EIO not all bytes were written
-    @retval EMSGSIZE the message body exceeds the allowable size
-    @retval other error as returned by write() or open()
+            length of the message body
 
 ==============================================================================*/
-static int iotclient_SendBody( IOTCLIENT_HANDLE hIoTClient,
-                               const unsigned char *body,
-                               size_t len )
+static void iotclient_RecordBodySize( IOTCLIENT_HANDLE hIoTClient,
+                                      size_t len )
 {
-    int result = EINVAL;
-    int fd;
-    size_t n;
+    int bucket = 0;
+    int i;
 
-    if( ( hIoTClient != NULL ) &&
-        ( body != NULL ) )
+    while ( ( bucket < BODY_SIZE_BUCKETS - 1 ) &&
+            ( ( (size_t)1 << bucket ) < len ) )
     {
-        if( hIoTClient->fifoName != NULL )
-        {
-            /* open the output FIFO */
-            fd = open( hIoTClient->fifoName, O_WRONLY );
-            if( fd != -1 )
-            {
-                if( len < MAX_IOT_MSG_SIZE )
-                {
-                    /* send the body to the FIFO */
-                    n = write( fd, body, len );
-                    if( n == len )
-                    {
-                        result = EOK;
-                    }
-                    else if ( n == -1 )
-                    {
-                        result = errno;
-                    }
-                    else
-                    {
-                        /* did not write all expected data */
-                        result = EIO;
-                    }
+        bucket++;
+    }
 
-                    /* close the output FIFO */
-                    close( fd );
-                }
-                else
-                {
-                    /* message body is too large */
-                    result = EMSGSIZE;
-                }
-            }
-            else
-            {
-                /* unable to open the output FIFO */
-                result = errno;
-            }
-        }
-        else
+    if ( hIoTClient->bodySizeSamples >= BODY_SIZE_HISTORY )
+    {
+        hIoTClient->bodySizeSamples = 0;
+        for ( i = 0; i < BODY_SIZE_BUCKETS; i++ )
         {
-            /* FIFO Name is not defined */
-            result = ENOENT;
+            hIoTClient->bodySizeHistogram[i] /= 2;
+            hIoTClient->bodySizeSamples += hIoTClient->bodySizeHistogram[i];
         }
     }
 
-    return result;
+    hIoTClient->bodySizeHistogram[bucket]++;
+    hIoTClient->bodySizeSamples++;
 }
 
 /*============================================================================*/
-/*  iotclient_StreamBody                                                      */
+/*  iotclient_GetAutoPipeSize                                                 */
 /*!
-    Stream an IOT message body to the IOT Hub Service
+    Calculate the automatic pipe capacity
 
-    The iotclient_StreamBody function streams an IOT message body to the
-    IOT Hub service via the IOT client write FIFO.
+    The iotclient_GetAutoPipeSize function calculates the smallest power
+    of two pipe capacity which can hold PIPE_SIZE_PERCENTILE percent of
+    the observed message bodies, bounded below by the default pipe
+    capacity and above by the system maximum pipe size.
 
     @param[in]
         hIoTClient
-            handle to the IOT Client containing the FIFO
-
-    @param[in]
-        fd
-            file descriptor to stream from
+            handle to the IOT Client
 
-    @retval EOK the IOT message body was sent to the FIFO successfully
-    @retval ENOENT the output FIFO name does not exist
-    @retval EBADF invalid output stream
-    @retval other error as returned by write() or open()
+    @retval the automatic pipe capacity
 
 ==============================================================================*/
-static int iotclient_StreamBody( IOTCLIENT_HANDLE hIoTClient, int fd )
+static size_t iotclient_GetAutoPipeSize( IOTCLIENT_HANDLE hIoTClient )
 {
-    int result = EINVAL;
-    int fd_out;
-    size_t n;
-    unsigned char buf[BUFSIZ];
-    size_t total = 0;
-    size_t bytesLeft = MAX_IOT_MSG_SIZE;
+    uint32_t threshold;
+    uint32_t count = 0;
+    size_t size = DEFAULT_PIPE_SIZE;
+    int i;
 
-    if( ( hIoTClient != NULL ) &&
-        ( fd != -1 ) )
+    threshold = ( ( hIoTClient->bodySizeSamples * PIPE_SIZE_PERCENTILE )
+                  + 99 ) / 100;
+
+    for ( i = 0; i < BODY_SIZE_BUCKETS; i++ )
     {
-        if( hIoTClient->fifoName != NULL )
+        count += hIoTClient->bodySizeHistogram[i];
+        if ( count >= threshold )
         {
-            /* assume everything is ok, until it isn't */
-            result = EOK;
-
-            /* open the output FIFO */
-            fd_out = open( hIoTClient->fifoName, O_WRONLY );
-            if( fd_out != -1 )
-            {
-                while( total < MAX_IOT_MSG_SIZE )
-                {
-                    /* read a block of data from the input */
-                    n = read( fd, buf, BUFSIZ );
-                    if ( n > bytesLeft )
-                    {
-                        /* truncate */
-                        n = bytesLeft;
-                    }
-
-                    if ( n > 0 )
-                    {
-                        /* write the output buffer */
-                        write( fd_out, buf, n );
-                        printf("%.*s\n", (int)n, buf);
-                        total += n;
-                        bytesLeft -= n;
-                    }
-                    else
-                    {
-                        /* no more data */
-                        break;
-                    }
-                }
-
-                /* close the output FIFO */
-                close( fd_out );
-            }
-            else
+            if ( ( (size_t)1 << i ) > size )
             {
-                /* message body is too large */
-                result = EBADF;
+                size = (size_t)1 << i;
             }
-        }
-        else
-        {
-            /* FIFO Name is not defined */
-            result = ENOENT;
+
+            break;
         }
     }
 
-    return result;
+    return ( size < pipeMaxSize ) ? size : pipeMaxSize;
 }
 
 /*============================================================================*/
@@ -1065,6 +8242,9 @@ static void iotclient_DestroyFIFO( IOTCLIENT_HANDLE hIoTClient )
             unlink( hIoTClient->fifoName );
             free( hIoTClient->fifoName );
             hIoTClient->fifoName = NULL;
+
+            /* the channel can now be re-used */
+            iotclient_FreeChannel( hIoTClient->channel );
         }
     }
 }
@@ -1092,14 +8272,22 @@ static int iotclient_CreateTxMessageQueue( IOTCLIENT_HANDLE hIoTClient )
 {
     int result = EINVAL;
     struct mq_attr attr;
+    int flags;
 
     if ( hIoTClient != NULL )
     {
         /* initialize descriptors */
         hIoTClient->txMsgQ = -1;
 
+        /* non-blocking clients get EAGAIN when the queue is full */
+        flags = O_WRONLY;
+        if ( hIoTClient->options.flags & IOTCLIENT_OPT_NONBLOCK )
+        {
+            flags |= O_NONBLOCK;
+        }
+
         /* open a connection to the IOTHUB message queue */
-        hIoTClient->txMsgQ = mq_open( MESSAGE_QUEUE_NAME, O_WRONLY );
+        hIoTClient->txMsgQ = mq_open( hIoTClient->options.queueName, flags );
         if ( hIoTClient->txMsgQ != (mqd_t)-1 )
         {
             /* get the attributes */
@@ -1108,8 +8296,15 @@ static int iotclient_CreateTxMessageQueue( IOTCLIENT_HANDLE hIoTClient )
                 /* get the maximum message size */
                 hIoTClient->maxMessageSize = attr.mq_msgsize;
 
+                /* the transmit buffer may be smaller than the queue allows */
+                if ( ( hIoTClient->options.txBufSize != 0 ) &&
+                     ( hIoTClient->options.txBufSize < (size_t)attr.mq_msgsize ) )
+                {
+                    hIoTClient->maxMessageSize = hIoTClient->options.txBufSize;
+                }
+
                 /* allocate memory for a transmit buffer */
-                hIoTClient->txBuf = calloc( 1, attr.mq_msgsize );
+                hIoTClient->txBuf = calloc( 1, hIoTClient->maxMessageSize );
                 if( hIoTClient->txBuf != NULL )
                 {
                     result = EOK;
@@ -1171,6 +8366,142 @@ static void iotclient_DestroyTxMessageQueue( IOTCLIENT_HANDLE hIoTClient )
     }
 }
 
+/*============================================================================*/
+/*  iotclient_SetOptions                                                      */
+/*!
+    Apply the options to an IOT Client
+
+    The iotclient_SetOptions function validates the IOT Client options
+    and stores a private copy of them in the IOT Client, substituting
+    the defaults for any unspecified options.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+    @param[in]
+        pOptions
+            pointer to the IOT Client options, or NULL for the defaults
+
+    @retval EOK the options were applied
+    @retval ENOTSUP the options version is not supported
+    @retval EINVAL invalid options, or the in-flight window is too large
+    @retval ENOMEM memory could not be allocated for the options
+
+==============================================================================*/
+static int iotclient_SetOptions( IOTCLIENT_HANDLE hIoTClient,
+                                 const IOTCLIENT_OPTIONS *pOptions )
+{
+    int result = EINVAL;
+    IOTCLIENT_OPTIONS *pClientOptions;
+    unsigned int window;
+
+    if ( hIoTClient != NULL )
+    {
+        pClientOptions = &hIoTClient->options;
+
+        if ( pOptions == NULL )
+        {
+            result = IOTCLIENT_InitOptions( pClientOptions );
+        }
+        else if ( ( pOptions->version == 0 ) ||
+                  ( pOptions->version > IOTCLIENT_OPTIONS_VERSION ) )
+        {
+            result = ENOTSUP;
+        }
+        else if ( ( pOptions->transport != IOTCLIENT_TRANSPORT_FIFO ) &&
+                  ( pOptions->transport != IOTCLIENT_TRANSPORT_IOURING ) )
+        {
+            result = EINVAL;
+        }
+        else
+        {
+            /* options added after the caller's version take defaults */
+            IOTCLIENT_InitOptions( pClientOptions );
+            memcpy( pClientOptions,
+                    pOptions,
+                    ( pOptions->version == 1 )
+                        ? offsetof( IOTCLIENT_OPTIONS, window )
+                        : sizeof( IOTCLIENT_OPTIONS ) );
+            pClientOptions->version = IOTCLIENT_OPTIONS_VERSION;
+            result = EOK;
+        }
+
+        if ( result == EOK )
+        {
+            /* take private copies of the names */
+            pClientOptions->queueName =
+                strdup( ( pClientOptions->queueName != NULL )
+                        ? pClientOptions->queueName
+                        : MESSAGE_QUEUE_NAME );
+
+            pClientOptions->fifoDir =
+                strdup( ( pClientOptions->fifoDir != NULL )
+                        ? pClientOptions->fifoDir
+                        : FIFO_DIRECTORY );
+
+            if ( ( pClientOptions->queueName == NULL ) ||
+                 ( pClientOptions->fifoDir == NULL ) )
+            {
+                result = ENOMEM;
+            }
+            else if ( pClientOptions->window > WINDOW_MAX )
+            {
+                result = EINVAL;
+            }
+            else
+            {
+                hIoTClient->pipeSize = pClientOptions->pipeSize;
+                if ( hIoTClient->pipeSize > pipeMaxSize )
+                {
+                    hIoTClient->pipeSize = pipeMaxSize;
+                }
+
+                /* window slots are indexed by seq % window, so keep the
+                   window a power of two to stay consistent when the 32-bit
+                   sequence number wraps */
+                if ( pClientOptions->window > 0 )
+                {
+                    window = 1;
+                    while ( window < pClientOptions->window )
+                    {
+                        window <<= 1;
+                    }
+
+                    pClientOptions->window = window;
+                }
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iotclient_FreeOptions                                                     */
+/*!
+    Release the resources held by the IOT Client options
+
+    The iotclient_FreeOptions function frees the private copies of
+    the names held in the IOT Client options.
+
+    @param[in]
+        hIoTClient
+            handle to the IOT Client
+
+==============================================================================*/
+static void iotclient_FreeOptions( IOTCLIENT_HANDLE hIoTClient )
+{
+    if ( hIoTClient != NULL )
+    {
+        free( (char *)hIoTClient->options.queueName );
+        hIoTClient->options.queueName = NULL;
+
+        free( (char *)hIoTClient->options.fifoDir );
+        hIoTClient->options.fifoDir = NULL;
+    }
+}
+
 /*============================================================================*/
 /*  iotclient_DestroyRxMessageQueue                                           */
 /*!
@@ -1191,12 +8522,23 @@ static void iotclient_DestroyRxMessageQueue( IOTCLIENT_HANDLE hIoTClient )
     if ( hIoTClient != NULL )
     {
         /* free the receive buffer */
-        if( hIoTClient->rxBuf != NULL )
+        if( hIoTClient->rx.buf != NULL )
         {
-            free( hIoTClient->rxBuf );
-            hIoTClient->rxBuf = NULL;
+            free( hIoTClient->rx.buf );
+            hIoTClient->rx.buf = NULL;
         }
 
+        /* free the received binary headers buffer */
+        if( hIoTClient->rx.headerBuf != NULL )
+        {
+            free( hIoTClient->rx.headerBuf );
+            hIoTClient->rx.headerBuf = NULL;
+            hIoTClient->rx.headerBufSize = 0;
+        }
+
+        /* free the batch receive buffers */
+        iotclient_DestroyRxPool( hIoTClient );
+
         /* close the message queue */
         if ( hIoTClient->rxMsgQ != -1 )
         {
@@ -0,0 +1,831 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup iouring iouring
+ * @brief io_uring transport engine
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file iouring.c
+
+    io_uring transport engine
+
+    The io_uring transport engine submits the system calls needed to
+    transfer an IOT message body to the IOT Hub service as linked
+    submission queue entries, so that a complete body transfer costs a
+    single io_uring_enter() system call rather than one system call per
+    operation.
+
+    The engine uses the raw io_uring system calls so the library does
+    not depend on liburing.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#define _GNU_SOURCE
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "iouring.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/* define the success return code */
+#ifndef EOK
+#define EOK 0
+#endif
+
+/*! number of bytes transferred by each splice operation */
+#define SPLICE_CHUNK_SIZE ( 64 * 1024 )
+
+/*! maximum number of splice operations linked in one submission */
+#define MAX_LINKED_SPLICES 8
+
+/*! fixed file table slot used for the message body FIFO */
+#define FIFO_SLOT 0
+
+/*! user data of the cancel operations issued when a submission fails */
+#define CANCEL_USER_DATA ( ~(__u64)0 )
+
+/*==============================================================================
+        Private type definitions
+==============================================================================*/
+
+/*! io_uring instance */
+struct _iouring
+{
+    /*! io_uring file descriptor */
+    int fd;
+
+    /*! submission queue ring mapping */
+    void *sqRing;
+
+    /*! size of the submission queue ring mapping */
+    size_t sqRingSize;
+
+    /*! completion queue ring mapping */
+    void *cqRing;
+
+    /*! size of the completion queue ring mapping */
+    size_t cqRingSize;
+
+    /*! submission queue entries */
+    struct io_uring_sqe *sqes;
+
+    /*! size of the submission queue entries mapping */
+    size_t sqesSize;
+
+    /*! submission queue head index */
+    unsigned int *sqHead;
+
+    /*! submission queue tail index */
+    unsigned int *sqTail;
+
+    /*! submission queue index mask */
+    unsigned int sqMask;
+
+    /*! number of submission queue entries */
+    unsigned int sqEntries;
+
+    /*! submission queue index array */
+    unsigned int *sqArray;
+
+    /*! completion queue head index */
+    unsigned int *cqHead;
+
+    /*! completion queue tail index */
+    unsigned int *cqTail;
+
+    /*! completion queue index mask */
+    unsigned int cqMask;
+
+    /*! completion queue entries */
+    struct io_uring_cqe *cqes;
+
+    /*! local submission queue tail, not yet visible to the kernel */
+    unsigned int tail;
+
+    /*! number of prepared submission queue entries */
+    unsigned int pending;
+};
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static int iouring_RegisterFiles( IoURing *pRing );
+static struct io_uring_sqe *iouring_GetSQE( IoURing *pRing );
+static int iouring_Submit( IoURing *pRing,
+                           unsigned int count,
+                           int *pResults );
+static void iouring_Cancel( IoURing *pRing,
+                            unsigned int count,
+                            unsigned int inflight );
+
+/*==============================================================================
+        Function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  iouring_Create                                                            */
+/*!
+    Create an io_uring instance
+
+    The iouring_Create function sets up an io_uring instance with
+    the requested number of submission queue entries, maps its rings
+    into memory, and registers a fixed file table slot for the
+    message body FIFO.
+
+    @param[in]
+        entries
+            number of submission queue entries
+
+    @retval pointer to the io_uring instance
+    @retval NULL if io_uring is not available (errno is set)
+
+==============================================================================*/
+IoURing *iouring_Create( unsigned int entries )
+{
+    IoURing *pRing;
+    struct io_uring_params params;
+    void *p;
+    int rc = EOK;
+
+    pRing = calloc( 1, sizeof( IoURing ) );
+    if ( pRing == NULL )
+    {
+        return NULL;
+    }
+
+    memset( &params, 0, sizeof( params ) );
+    pRing->fd = syscall( __NR_io_uring_setup, entries, &params );
+    if ( pRing->fd == -1 )
+    {
+        rc = errno;
+    }
+    else if ( !( params.features & IORING_FEAT_SINGLE_MMAP ) ||
+              !( params.features & IORING_FEAT_NODROP ) )
+    {
+        /* kernels without these features are too old to be useful */
+        rc = ENOTSUP;
+    }
+
+    if ( rc == EOK )
+    {
+        /* the submission and completion rings share one mapping */
+        pRing->sqRingSize = params.sq_off.array +
+                            params.sq_entries * sizeof( unsigned int );
+        pRing->cqRingSize = params.cq_off.cqes +
+                            params.cq_entries * sizeof( struct io_uring_cqe );
+        if ( pRing->cqRingSize > pRing->sqRingSize )
+        {
+            pRing->sqRingSize = pRing->cqRingSize;
+        }
+
+        p = mmap( NULL,
+                  pRing->sqRingSize,
+                  PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE,
+                  pRing->fd,
+                  IORING_OFF_SQ_RING );
+        if ( p != MAP_FAILED )
+        {
+            pRing->sqRing = p;
+            pRing->cqRing = p;
+        }
+        else
+        {
+            rc = errno;
+        }
+    }
+
+    if ( rc == EOK )
+    {
+        pRing->sqesSize = params.sq_entries * sizeof( struct io_uring_sqe );
+        p = mmap( NULL,
+                  pRing->sqesSize,
+                  PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_POPULATE,
+                  pRing->fd,
+                  IORING_OFF_SQES );
+        if ( p != MAP_FAILED )
+        {
+            pRing->sqes = p;
+        }
+        else
+        {
+            rc = errno;
+        }
+    }
+
+    if ( rc == EOK )
+    {
+        p = pRing->sqRing;
+        pRing->sqHead = (unsigned int *)( (char *)p + params.sq_off.head );
+        pRing->sqTail = (unsigned int *)( (char *)p + params.sq_off.tail );
+        pRing->sqMask = *(unsigned int *)( (char *)p + params.sq_off.ring_mask );
+        pRing->sqEntries = params.sq_entries;
+        pRing->sqArray = (unsigned int *)( (char *)p + params.sq_off.array );
+        pRing->tail = *pRing->sqTail;
+
+        p = pRing->cqRing;
+        pRing->cqHead = (unsigned int *)( (char *)p + params.cq_off.head );
+        pRing->cqTail = (unsigned int *)( (char *)p + params.cq_off.tail );
+        pRing->cqMask = *(unsigned int *)( (char *)p + params.cq_off.ring_mask );
+        pRing->cqes = (struct io_uring_cqe *)( (char *)p + params.cq_off.cqes );
+
+        rc = iouring_RegisterFiles( pRing );
+    }
+
+    if ( rc != EOK )
+    {
+        iouring_Destroy( pRing );
+        pRing = NULL;
+        errno = rc;
+    }
+
+    return pRing;
+}
+
+/*============================================================================*/
+/*  iouring_Destroy                                                           */
+/*!
+    Destroy an io_uring instance
+
+    The iouring_Destroy function unmaps the io_uring rings and closes
+    the io_uring file descriptor, which also releases the fixed file
+    table.
+
+    @param[in]
+        pRing
+            pointer to the io_uring instance to destroy
+
+==============================================================================*/
+void iouring_Destroy( IoURing *pRing )
+{
+    if ( pRing != NULL )
+    {
+        if ( pRing->sqes != NULL )
+        {
+            munmap( pRing->sqes, pRing->sqesSize );
+        }
+
+        if ( pRing->sqRing != NULL )
+        {
+            munmap( pRing->sqRing, pRing->sqRingSize );
+        }
+
+        if ( pRing->fd != -1 )
+        {
+            close( pRing->fd );
+        }
+
+        free( pRing );
+    }
+}
+
+/*============================================================================*/
+/*  iouring_SendBody                                                          */
+/*!
+    Open a FIFO, write a message body to it and close it
+
+    The iouring_SendBody function submits a linked chain of three
+    operations in a single system call: an open of the message body FIFO
+    directly into the fixed file table, a write of the message body,
+    and a close of the fixed file.  The close is hard linked to the write
+    so the FIFO is always closed once it has been opened.
+
+    @param[in]
+        pRing
+            pointer to the io_uring instance
+
+    @param[in]
+        path
+            path of the message body FIFO
+
+    @param[in]
+        body
+            pointer to the message body
+
+    @param[in]
+        len
+            length of the message body
+
+    @retval EOK the message body was written to the FIFO
+    @retval ENOTSUP the kernel cannot open files into the fixed file table
+    @retval EIO not all bytes were written
+    @retval EINVAL invalid arguments
+    @retval other error as reported by the open or write operations
+
+==============================================================================*/
+int iouring_SendBody( IoURing *pRing,
+                      const char *path,
+                      const void *body,
+                      size_t len )
+{
+    int result = EINVAL;
+    struct io_uring_sqe *sqe;
+    int res[3];
+
+    if ( ( pRing != NULL ) &&
+         ( path != NULL ) &&
+         ( body != NULL ) &&
+         ( len <= UINT32_MAX ) &&
+         ( pRing->sqEntries >= 3 ) )
+    {
+        /* open the FIFO into the fixed file table */
+        sqe = iouring_GetSQE( pRing );
+        sqe->opcode = IORING_OP_OPENAT;
+        sqe->fd = AT_FDCWD;
+        sqe->addr = (unsigned long)path;
+        sqe->open_flags = O_WRONLY;
+        sqe->file_index = FIFO_SLOT + 1;
+        sqe->user_data = 0;
+
+        /* an inline open would fail with ENXIO until the hub opens the
+           FIFO for reading, so force the open to block in a worker */
+        sqe->flags = IOSQE_IO_LINK | IOSQE_ASYNC;
+
+        /* write the message body */
+        sqe = iouring_GetSQE( pRing );
+        sqe->opcode = IORING_OP_WRITE;
+        sqe->fd = FIFO_SLOT;
+        sqe->addr = (unsigned long)body;
+        sqe->len = (unsigned int)len;
+        sqe->off = (__u64)-1;
+        sqe->flags = IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK;
+        sqe->user_data = 1;
+
+        /* close the FIFO */
+        sqe = iouring_GetSQE( pRing );
+        sqe->opcode = IORING_OP_CLOSE;
+        sqe->file_index = FIFO_SLOT + 1;
+        sqe->user_data = 2;
+
+        result = iouring_Submit( pRing, 3, res );
+        if ( result == EOK )
+        {
+            if ( ( res[0] == -EINVAL ) || ( res[0] == -EBADF ) )
+            {
+                /* direct descriptors are not supported by this kernel */
+                result = ENOTSUP;
+            }
+            else if ( res[0] < 0 )
+            {
+                result = -res[0];
+            }
+            else if ( res[1] < 0 )
+            {
+                result = -res[1];
+            }
+            else if ( (size_t)res[1] != len )
+            {
+                /* did not write all expected data */
+                result = EIO;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iouring_StreamBody                                                        */
+/*!
+    Splice a message body from an input to an output descriptor
+
+    The iouring_StreamBody function transfers data from the input
+    descriptor to the output FIFO descriptor until the end of the input
+    is reached or the maximum length has been transferred.
+
+    Several splice operations are linked in each submission so that many
+    chunks of the body are transferred per system call.  A short splice
+    breaks the chain, and the remaining operations are re-submitted.
+
+    @param[in]
+        pRing
+            pointer to the io_uring instance
+
+    @param[in]
+        fd_in
+            input file descriptor
+
+    @param[in]
+        fd_out
+            output FIFO descriptor
+
+    @param[in]
+        maxLength
+            maximum number of bytes to transfer
+
+    @param[out]
+        pTotal
+            pointer to the location to store the number of bytes
+            transferred
+
+    @retval EOK the message body was transferred
+    @retval ENOTSUP the input cannot be spliced, nothing was transferred
+    @retval EINVAL invalid arguments
+    @retval other error as reported by the splice operation
+
+==============================================================================*/
+int iouring_StreamBody( IoURing *pRing,
+                        int fd_in,
+                        int fd_out,
+                        size_t maxLength,
+                        size_t *pTotal )
+{
+    int result = EINVAL;
+    struct io_uring_sqe *sqe;
+    int res[MAX_LINKED_SPLICES];
+    unsigned int count;
+    unsigned int i;
+    size_t total = 0;
+    size_t chunk;
+    size_t offset;
+    bool done = false;
+
+    if ( ( pRing != NULL ) &&
+         ( fd_in != -1 ) &&
+         ( fd_out != -1 ) &&
+         ( pTotal != NULL ) )
+    {
+        result = EOK;
+
+        while ( ( done == false ) && ( total < maxLength ) )
+        {
+            /* prepare a chain of splices covering the remaining length */
+            count = 0;
+            offset = total;
+            while ( ( count < MAX_LINKED_SPLICES ) &&
+                    ( count < pRing->sqEntries ) &&
+                    ( offset < maxLength ) )
+            {
+                chunk = maxLength - offset;
+                if ( chunk > SPLICE_CHUNK_SIZE )
+                {
+                    chunk = SPLICE_CHUNK_SIZE;
+                }
+
+                sqe = iouring_GetSQE( pRing );
+                sqe->opcode = IORING_OP_SPLICE;
+                sqe->splice_fd_in = fd_in;
+                sqe->splice_off_in = (__u64)-1;
+                sqe->fd = fd_out;
+                sqe->off = (__u64)-1;
+                sqe->len = (unsigned int)chunk;
+                sqe->splice_flags = SPLICE_F_MOVE;
+                sqe->user_data = count;
+                offset += chunk;
+                count++;
+            }
+
+            for ( i = 0; i + 1 < count; i++ )
+            {
+                /* link each splice to the next one */
+                pRing->sqes[ ( pRing->tail - count + i ) & pRing->sqMask ]
+                    .flags = IOSQE_IO_LINK;
+            }
+
+            result = iouring_Submit( pRing, count, res );
+            if ( result != EOK )
+            {
+                break;
+            }
+
+            for ( i = 0; i < count; i++ )
+            {
+                if ( res[i] > 0 )
+                {
+                    total += res[i];
+                }
+                else if ( res[i] == 0 )
+                {
+                    /* end of input */
+                    done = true;
+                    break;
+                }
+                else if ( res[i] == -ECANCELED )
+                {
+                    /* a short splice broke the chain */
+                    break;
+                }
+                else
+                {
+                    result = ( ( res[i] == -EINVAL ) && ( total == 0 ) )
+                             ? ENOTSUP
+                             : -res[i];
+                    done = true;
+                    break;
+                }
+            }
+        }
+
+        *pTotal = total;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iouring_RegisterFiles                                                     */
+/*!
+    Register the fixed file table
+
+    The iouring_RegisterFiles function registers a sparse fixed file
+    table with a single slot, into which the message body FIFO is opened.
+
+    @param[in]
+        pRing
+            pointer to the io_uring instance
+
+    @retval EOK the fixed file table was registered
+    @retval other error as reported by io_uring_register()
+
+==============================================================================*/
+static int iouring_RegisterFiles( IoURing *pRing )
+{
+    int result = EOK;
+    int fds[1] = { -1 };
+
+    if ( syscall( __NR_io_uring_register,
+                  pRing->fd,
+                  IORING_REGISTER_FILES,
+                  fds,
+                  1 ) == -1 )
+    {
+        result = errno;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iouring_GetSQE                                                            */
+/*!
+    Get a cleared submission queue entry
+
+    The iouring_GetSQE function gets the next free submission queue
+    entry.  The entry is not visible to the kernel until it is submitted.
+    Callers must not request more entries than the submission queue holds.
+
+    @param[in]
+        pRing
+            pointer to the io_uring instance
+
+    @retval pointer to the submission queue entry
+
+==============================================================================*/
+static struct io_uring_sqe *iouring_GetSQE( IoURing *pRing )
+{
+    unsigned int index = pRing->tail & pRing->sqMask;
+    struct io_uring_sqe *sqe = &pRing->sqes[index];
+
+    memset( sqe, 0, sizeof( struct io_uring_sqe ) );
+    pRing->sqArray[index] = index;
+    pRing->tail++;
+    pRing->pending++;
+
+    return sqe;
+}
+
+/*============================================================================*/
+/*  iouring_Submit                                                            */
+/*!
+    Submit the prepared entries and wait for their completion
+
+    The iouring_Submit function makes the prepared submission queue
+    entries visible to the kernel, submits them and waits for all of
+    them to complete with a single io_uring_enter() system call where
+    possible.  The completion results are returned in the order of
+    their user_data values, which must be 0 to count-1.
+
+    If io_uring_enter() fails, entries the kernel has not consumed are
+    withdrawn, and the entries still in flight are cancelled and reaped
+    before returning, so the kernel is no longer using the caller's
+    buffers and no stale completions are left for the next submission.
+
+    @param[in]
+        pRing
+            pointer to the io_uring instance
+
+    @param[in]
+        count
+            number of prepared entries
+
+    @param[out]
+        pResults
+            array of count results, one per submitted entry
+
+    @retval EOK all of the entries completed
+    @retval other error as reported by io_uring_enter()
+
+==============================================================================*/
+static int iouring_Submit( IoURing *pRing,
+                           unsigned int count,
+                           int *pResults )
+{
+    int result = EOK;
+    unsigned int completed = 0;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int toSubmit;
+    unsigned int unsubmitted;
+    struct io_uring_cqe *cqe;
+    int n;
+
+    /* publish the new submission queue tail to the kernel */
+    __atomic_store_n( pRing->sqTail, pRing->tail, __ATOMIC_RELEASE );
+    toSubmit = pRing->pending;
+    pRing->pending = 0;
+
+    while ( completed < count )
+    {
+        n = syscall( __NR_io_uring_enter,
+                     pRing->fd,
+                     toSubmit,
+                     count - completed,
+                     IORING_ENTER_GETEVENTS,
+                     NULL,
+                     0 );
+        if ( n >= 0 )
+        {
+            toSubmit -= ( (unsigned int)n < toSubmit ) ? (unsigned int)n
+                                                       : toSubmit;
+        }
+        else if ( errno != EINTR )
+        {
+            result = errno;
+
+            /* withdraw the entries which the kernel has not consumed */
+            unsubmitted = pRing->tail -
+                          __atomic_load_n( pRing->sqHead, __ATOMIC_ACQUIRE );
+            pRing->tail -= unsubmitted;
+            __atomic_store_n( pRing->sqTail, pRing->tail, __ATOMIC_RELEASE );
+
+            /* wait for the submitted entries before their buffers and
+               the caller's results go out of scope */
+            iouring_Cancel( pRing,
+                            count,
+                            count - unsubmitted - completed );
+            break;
+        }
+
+        /* reap the completions */
+        head = *pRing->cqHead;
+        tail = __atomic_load_n( pRing->cqTail, __ATOMIC_ACQUIRE );
+        while ( head != tail )
+        {
+            cqe = &pRing->cqes[head & pRing->cqMask];
+            if ( cqe->user_data < count )
+            {
+                pResults[cqe->user_data] = cqe->res;
+            }
+
+            completed++;
+            head++;
+        }
+
+        __atomic_store_n( pRing->cqHead, head, __ATOMIC_RELEASE );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  iouring_Cancel                                                            */
+/*!
+    Cancel and reap the entries of a failed submission
+
+    The iouring_Cancel function issues a cancel operation for each of
+    the user_data values 0 to count-1 of a failed submission, and then
+    reaps completions until all of the entries still in flight and the
+    cancel operations themselves have completed.  Entries which have
+    already completed simply fail to be found by their cancel operation.
+
+    @param[in]
+        pRing
+            pointer to the io_uring instance
+
+    @param[in]
+        count
+            number of entries in the failed submission
+
+    @param[in]
+        inflight
+            number of submitted entries which have not yet completed
+
+==============================================================================*/
+static void iouring_Cancel( IoURing *pRing,
+                            unsigned int count,
+                            unsigned int inflight )
+{
+    struct io_uring_sqe *sqe;
+    struct io_uring_cqe *cqe;
+    unsigned int cancels = 0;
+    unsigned int toSubmit = 0;
+    unsigned int head;
+    unsigned int tail;
+    unsigned int i;
+    int n;
+
+    if ( inflight > 0 )
+    {
+        for ( i = 0; ( i < count ) && ( i < pRing->sqEntries ); i++ )
+        {
+            sqe = iouring_GetSQE( pRing );
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = i;
+            sqe->user_data = CANCEL_USER_DATA;
+            cancels++;
+        }
+
+        __atomic_store_n( pRing->sqTail, pRing->tail, __ATOMIC_RELEASE );
+        toSubmit = pRing->pending;
+        pRing->pending = 0;
+    }
+
+    while ( ( inflight > 0 ) || ( cancels > 0 ) )
+    {
+        n = syscall( __NR_io_uring_enter,
+                     pRing->fd,
+                     toSubmit,
+                     1,
+                     IORING_ENTER_GETEVENTS,
+                     NULL,
+                     0 );
+        if ( n >= 0 )
+        {
+            toSubmit -= ( (unsigned int)n < toSubmit ) ? (unsigned int)n
+                                                       : toSubmit;
+        }
+        else if ( ( errno != EINTR ) &&
+                  ( errno != EAGAIN ) &&
+                  ( errno != EBUSY ) )
+        {
+            /* the ring cannot be waited on */
+            break;
+        }
+
+        /* reap the completions, making room for further ones */
+        head = *pRing->cqHead;
+        tail = __atomic_load_n( pRing->cqTail, __ATOMIC_ACQUIRE );
+        while ( head != tail )
+        {
+            cqe = &pRing->cqes[head & pRing->cqMask];
+            if ( cqe->user_data == CANCEL_USER_DATA )
+            {
+                cancels -= ( cancels > 0 ) ? 1 : 0;
+            }
+            else
+            {
+                inflight -= ( inflight > 0 ) ? 1 : 0;
+            }
+
+            head++;
+        }
+
+        __atomic_store_n( pRing->cqHead, head, __ATOMIC_RELEASE );
+    }
+}
+
+/*! @}
+ * end of the iouring group */
@@ -0,0 +1,64 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef IOURING_H
+#define IOURING_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+
+/*==============================================================================
+        Public Definitions
+==============================================================================*/
+
+/*! opaque pointer to an io_uring instance */
+typedef struct _iouring IoURing;
+
+/*==============================================================================
+        Public Function Declarations
+==============================================================================*/
+
+/*! create an io_uring instance */
+IoURing *iouring_Create( unsigned int entries );
+
+/*! destroy an io_uring instance */
+void iouring_Destroy( IoURing *pRing );
+
+/*! open a FIFO, write a message body to it and close it */
+int iouring_SendBody( IoURing *pRing,
+                      const char *path,
+                      const void *body,
+                      size_t len );
+
+/*! splice a message body from an input to an output descriptor */
+int iouring_StreamBody( IoURing *pRing,
+                        int fd_in,
+                        int fd_out,
+                        size_t maxLength,
+                        size_t *pTotal );
+
+#endif
@@ -0,0 +1,551 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup ratelimit ratelimit
+ * @brief token bucket rate limiting
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file ratelimit.c
+
+    Token bucket rate limiting
+
+    Message sends are limited by two pairs of token buckets: one pair
+    belonging to the IOT Client, and a process wide pair for the IOT
+    Client's priority level, so that bulk transfers on a low priority
+    level can be paced collectively without limiting latency sensitive
+    traffic on other levels.  Each pair has a bucket of messages and a
+    bucket of bytes.
+
+    A request is allowed once every bucket holds the requested amount,
+    or its full burst if the request is larger than the burst.  The full
+    amount is then taken, so an oversized request leaves the bucket in
+    debt and delays the requests which follow it.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <iotclient/iotclient.h>
+#include "ratelimit.h"
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! number of nanoseconds in a second */
+#define NS_PER_SEC 1000000000ULL
+
+/*==============================================================================
+        File scoped variables
+==============================================================================*/
+
+/*! process wide rate limiters for each priority level */
+static RateLimiter priorityLimiters[IOTCLIENT_PRIORITY_LEVELS];
+
+/*! lock protecting all rate limiters */
+static pthread_mutex_t rateLock = PTHREAD_MUTEX_INITIALIZER;
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static void ratelimit_InitBucket( TokenBucket *pBucket,
+                                  double rate,
+                                  double burst );
+static uint64_t ratelimit_BucketDelay( TokenBucket *pBucket,
+                                       double amount,
+                                       uint64_t now );
+static uint64_t ratelimit_LimiterDelay( RateLimiter *pLimiter,
+                                        size_t messages,
+                                        size_t bytes,
+                                        uint64_t now );
+static void ratelimit_Take( RateLimiter *pLimiter,
+                            size_t messages,
+                            size_t bytes );
+static uint64_t ratelimit_Now( void );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  ratelimit_Configure                                                       */
+/*!
+    Configure a rate limiter
+
+    The ratelimit_Configure function sets the message and byte rates
+    of a rate limiter.  Its buckets start full.
+
+    @param[in]
+        pLimiter
+            pointer to the rate limiter
+
+    @param[in]
+        pLimit
+            pointer to the rate limits, or NULL to remove the limits
+
+    @retval EOK the rate limiter was configured
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int ratelimit_Configure( RateLimiter *pLimiter,
+                         const IOTCLIENT_RATE_LIMIT *pLimit )
+{
+    int result = EINVAL;
+
+    if ( ( pLimiter != NULL ) &&
+         ( ( pLimit == NULL ) ||
+           ( ( pLimit->messageRate >= 0.0 ) &&
+             ( pLimit->messageBurst >= 0.0 ) &&
+             ( pLimit->byteRate >= 0.0 ) &&
+             ( pLimit->byteBurst >= 0.0 ) ) ) )
+    {
+        pthread_mutex_lock( &rateLock );
+
+        if ( pLimit != NULL )
+        {
+            /* by default allow one message, or one second of bytes */
+            ratelimit_InitBucket( &pLimiter->messages,
+                                  pLimit->messageRate,
+                                  ( pLimit->messageBurst > 0.0 )
+                                    ? pLimit->messageBurst
+                                    : 1.0 );
+            ratelimit_InitBucket( &pLimiter->bytes,
+                                  pLimit->byteRate,
+                                  ( pLimit->byteBurst > 0.0 )
+                                    ? pLimit->byteBurst
+                                    : pLimit->byteRate );
+        }
+        else
+        {
+            memset( pLimiter, 0, sizeof( RateLimiter ) );
+        }
+
+        pthread_mutex_unlock( &rateLock );
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ratelimit_ConfigurePriority                                               */
+/*!
+    Configure the process wide rate limiter of a priority level
+
+    @param[in]
+        priority
+            priority level, less than IOTCLIENT_PRIORITY_LEVELS
+
+    @param[in]
+        pLimit
+            pointer to the rate limits, or NULL to remove the limits
+
+    @retval EOK the rate limiter was configured
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int ratelimit_ConfigurePriority( unsigned int priority,
+                                 const IOTCLIENT_RATE_LIMIT *pLimit )
+{
+    int result = EINVAL;
+
+    if ( priority < IOTCLIENT_PRIORITY_LEVELS )
+    {
+        result = ratelimit_Configure( &priorityLimiters[priority], pLimit );
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  ratelimit_BytesLimited                                                    */
+/*!
+    Check if bytes are rate limited
+
+    @param[in]
+        pLimiter
+            pointer to the IOT Client's rate limiter
+
+    @param[in]
+        priority
+            priority level of the IOT Client
+
+    @retval true the byte rate of the IOT Client or its priority
+            level is limited
+    @retval false bytes may be sent at any rate
+
+==============================================================================*/
+bool ratelimit_BytesLimited( RateLimiter *pLimiter, unsigned int priority )
+{
+    bool limited;
+
+    pthread_mutex_lock( &rateLock );
+    limited = ( pLimiter->bytes.rate > 0.0 ) ||
+              ( priorityLimiters[priority].bytes.rate > 0.0 );
+    pthread_mutex_unlock( &rateLock );
+
+    return limited;
+}
+
+/*============================================================================*/
+/*  ratelimit_Delay                                                           */
+/*!
+    Get the delay until messages and bytes may be sent
+
+    The ratelimit_Delay function calculates how long it will be until
+    the IOT Client and its priority level allow the requested messages
+    and bytes to be sent, without taking them.
+
+    @param[in]
+        pLimiter
+            pointer to the IOT Client's rate limiter
+
+    @param[in]
+        priority
+            priority level of the IOT Client
+
+    @param[in]
+        messages
+            number of messages to send
+
+    @param[in]
+        bytes
+            number of bytes to send
+
+    @retval delay in nanoseconds, 0 if they may be sent now
+
+==============================================================================*/
+uint64_t ratelimit_Delay( RateLimiter *pLimiter,
+                          unsigned int priority,
+                          size_t messages,
+                          size_t bytes )
+{
+    uint64_t now = ratelimit_Now();
+    uint64_t delay;
+    uint64_t d;
+
+    pthread_mutex_lock( &rateLock );
+
+    delay = ratelimit_LimiterDelay( pLimiter, messages, bytes, now );
+    d = ratelimit_LimiterDelay( &priorityLimiters[priority],
+                                messages,
+                                bytes,
+                                now );
+
+    pthread_mutex_unlock( &rateLock );
+
+    return ( d > delay ) ? d : delay;
+}
+
+/*============================================================================*/
+/*  ratelimit_Acquire                                                         */
+/*!
+    Take messages and bytes from the rate limiters if allowed
+
+    The ratelimit_Acquire function takes the requested messages and
+    bytes from the IOT Client's and its priority level's buckets if
+    they allow them to be sent now.  Otherwise nothing is taken.
+
+    @param[in]
+        pLimiter
+            pointer to the IOT Client's rate limiter
+
+    @param[in]
+        priority
+            priority level of the IOT Client
+
+    @param[in]
+        messages
+            number of messages to send
+
+    @param[in]
+        bytes
+            number of bytes to send
+
+    @retval 0 the messages and bytes were taken
+    @retval delay in nanoseconds until they may be sent
+
+==============================================================================*/
+uint64_t ratelimit_Acquire( RateLimiter *pLimiter,
+                            unsigned int priority,
+                            size_t messages,
+                            size_t bytes )
+{
+    RateLimiter *pPriority = &priorityLimiters[priority];
+    uint64_t now = ratelimit_Now();
+    uint64_t delay;
+    uint64_t d;
+
+    pthread_mutex_lock( &rateLock );
+
+    delay = ratelimit_LimiterDelay( pLimiter, messages, bytes, now );
+    d = ratelimit_LimiterDelay( pPriority, messages, bytes, now );
+    delay = ( d > delay ) ? d : delay;
+
+    if ( delay == 0 )
+    {
+        ratelimit_Take( pLimiter, messages, bytes );
+        ratelimit_Take( pPriority, messages, bytes );
+    }
+
+    pthread_mutex_unlock( &rateLock );
+
+    return delay;
+}
+
+/*============================================================================*/
+/*  ratelimit_Wait                                                            */
+/*!
+    Wait until messages and bytes may be sent, and take them
+
+    @param[in]
+        pLimiter
+            pointer to the IOT Client's rate limiter
+
+    @param[in]
+        priority
+            priority level of the IOT Client
+
+    @param[in]
+        messages
+            number of messages to send
+
+    @param[in]
+        bytes
+            number of bytes to send
+
+==============================================================================*/
+void ratelimit_Wait( RateLimiter *pLimiter,
+                     unsigned int priority,
+                     size_t messages,
+                     size_t bytes )
+{
+    struct timespec ts;
+    uint64_t delay;
+
+    while ( ( delay = ratelimit_Acquire( pLimiter,
+                                         priority,
+                                         messages,
+                                         bytes ) ) > 0 )
+    {
+        ts.tv_sec = delay / NS_PER_SEC;
+        ts.tv_nsec = delay % NS_PER_SEC;
+        (void)nanosleep( &ts, NULL );
+    }
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  ratelimit_InitBucket                                                      */
+/*!
+    Initialize a full token bucket
+
+    @param[in]
+        pBucket
+            pointer to the token bucket
+
+    @param[in]
+        rate
+            tokens added per second, 0 for unlimited
+
+    @param[in]
+        burst
+            maximum number of tokens
+
+==============================================================================*/
+static void ratelimit_InitBucket( TokenBucket *pBucket,
+                                  double rate,
+                                  double burst )
+{
+    pBucket->rate = rate;
+    pBucket->burst = burst;
+    pBucket->tokens = burst;
+    pBucket->last = ratelimit_Now();
+}
+
+/*============================================================================*/
+/*  ratelimit_BucketDelay                                                     */
+/*!
+    Replenish a token bucket and get the delay until a request is allowed
+
+    The ratelimit_BucketDelay function adds the tokens accumulated since
+    the bucket was last replenished, and calculates how long it will be
+    until the bucket holds the requested amount, or its full burst if
+    the request is larger.
+
+    @param[in]
+        pBucket
+            pointer to the token bucket
+
+    @param[in]
+        amount
+            number of tokens requested
+
+    @param[in]
+        now
+            current monotonic time (ns)
+
+    @retval delay in nanoseconds, 0 if the request is allowed now
+
+==============================================================================*/
+static uint64_t ratelimit_BucketDelay( TokenBucket *pBucket,
+                                       double amount,
+                                       uint64_t now )
+{
+    uint64_t delay = 0;
+    double required;
+
+    if ( ( pBucket->rate > 0.0 ) && ( amount > 0.0 ) )
+    {
+        if ( now > pBucket->last )
+        {
+            pBucket->tokens += pBucket->rate *
+                               (double)( now - pBucket->last ) / NS_PER_SEC;
+            if ( pBucket->tokens > pBucket->burst )
+            {
+                pBucket->tokens = pBucket->burst;
+            }
+
+            pBucket->last = now;
+        }
+
+        required = ( amount < pBucket->burst ) ? amount : pBucket->burst;
+        if ( pBucket->tokens < required )
+        {
+            /* round up so the tokens are available when the delay ends */
+            delay = (uint64_t)( ( required - pBucket->tokens ) * NS_PER_SEC /
+                                pBucket->rate ) + 1;
+        }
+    }
+
+    return delay;
+}
+
+/*============================================================================*/
+/*  ratelimit_LimiterDelay                                                    */
+/*!
+    Get the delay until a rate limiter allows messages and bytes
+
+    @param[in]
+        pLimiter
+            pointer to the rate limiter
+
+    @param[in]
+        messages
+            number of messages to send
+
+    @param[in]
+        bytes
+            number of bytes to send
+
+    @param[in]
+        now
+            current monotonic time (ns)
+
+    @retval delay in nanoseconds, 0 if they may be sent now
+
+==============================================================================*/
+static uint64_t ratelimit_LimiterDelay( RateLimiter *pLimiter,
+                                        size_t messages,
+                                        size_t bytes,
+                                        uint64_t now )
+{
+    uint64_t delay;
+    uint64_t d;
+
+    delay = ratelimit_BucketDelay( &pLimiter->messages, messages, now );
+    d = ratelimit_BucketDelay( &pLimiter->bytes, bytes, now );
+
+    return ( d > delay ) ? d : delay;
+}
+
+/*============================================================================*/
+/*  ratelimit_Take                                                            */
+/*!
+    Take messages and bytes from a rate limiter's buckets
+
+    @param[in]
+        pLimiter
+            pointer to the rate limiter
+
+    @param[in]
+        messages
+            number of messages to take
+
+    @param[in]
+        bytes
+            number of bytes to take
+
+==============================================================================*/
+static void ratelimit_Take( RateLimiter *pLimiter,
+                            size_t messages,
+                            size_t bytes )
+{
+    if ( pLimiter->messages.rate > 0.0 )
+    {
+        pLimiter->messages.tokens -= messages;
+    }
+
+    if ( pLimiter->bytes.rate > 0.0 )
+    {
+        pLimiter->bytes.tokens -= bytes;
+    }
+}
+
+/*============================================================================*/
+/*  ratelimit_Now                                                             */
+/*!
+    Get the current monotonic time
+
+    @retval current monotonic time in nanoseconds
+
+==============================================================================*/
+static uint64_t ratelimit_Now( void )
+{
+    struct timespec ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts );
+
+    return ( (uint64_t)ts.tv_sec * NS_PER_SEC ) + ts.tv_nsec;
+}
+
+/*! @}
+ * end of the ratelimit group */
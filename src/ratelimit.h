@@ -0,0 +1,100 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+#ifndef RATELIMIT_H
+#define RATELIMIT_H
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <iotclient/iotclient.h>
+
+/*==============================================================================
+        Public Definitions
+==============================================================================*/
+
+/*! token bucket */
+typedef struct _token_bucket
+{
+    /*! tokens added per second, 0 for unlimited */
+    double rate;
+
+    /*! maximum number of tokens */
+    double burst;
+
+    /*! tokens available, negative while repaying an oversized request */
+    double tokens;
+
+    /*! time the tokens were last replenished (ns) */
+    uint64_t last;
+} TokenBucket;
+
+/*! message and byte rate limiter */
+typedef struct _rate_limiter
+{
+    /*! message rate bucket */
+    TokenBucket messages;
+
+    /*! byte rate bucket */
+    TokenBucket bytes;
+} RateLimiter;
+
+/*==============================================================================
+        Public Function Declarations
+==============================================================================*/
+
+/*! configure a rate limiter, or remove its limits */
+int ratelimit_Configure( RateLimiter *pLimiter,
+                         const IOTCLIENT_RATE_LIMIT *pLimit );
+
+/*! configure the process wide rate limiter of a priority level */
+int ratelimit_ConfigurePriority( unsigned int priority,
+                                 const IOTCLIENT_RATE_LIMIT *pLimit );
+
+/*! check if bytes are rate limited for a limiter or priority level */
+bool ratelimit_BytesLimited( RateLimiter *pLimiter, unsigned int priority );
+
+/*! get the delay until messages and bytes may be sent (ns) */
+uint64_t ratelimit_Delay( RateLimiter *pLimiter,
+                          unsigned int priority,
+                          size_t messages,
+                          size_t bytes );
+
+/*! take messages and bytes if allowed, otherwise get the delay (ns) */
+uint64_t ratelimit_Acquire( RateLimiter *pLimiter,
+                            unsigned int priority,
+                            size_t messages,
+                            size_t bytes );
+
+/*! wait until messages and bytes may be sent, and take them */
+void ratelimit_Wait( RateLimiter *pLimiter,
+                     unsigned int priority,
+                     size_t messages,
+                     size_t bytes );
+
+#endif
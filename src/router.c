@@ -0,0 +1,831 @@
+/*==============================================================================
+MIT License
+
+Copyright (c) 2023 Trevor Monk
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+==============================================================================*/
+
+/*!
+ * @defgroup router router
+ * @brief property based message routing
+ * @{
+ */
+
+/*============================================================================*/
+/*!
+@file router.c
+
+    Property based message routing
+
+    A message router dispatches received cloud-to-device messages to
+    handlers according to the values of their properties.  Each route
+    is a predicate on a single property value, which either matches the
+    value exactly or matches a prefix of it.
+
+    The routes for each property are compiled into a trie over the
+    property values.  Routing a message indexes its headers once, then
+    walks one trie per routed property, so the cost of routing depends
+    on the number of distinct routed properties and the length of their
+    values, not on the number of routes.  When several routes match,
+    the one which was added first is used.
+
+    Routes are added before the router is used.  Routing does not
+    modify the router, so a router may be used by several threads at
+    once, for example by the workers of a library managed receiver.
+
+*/
+/*============================================================================*/
+
+/*==============================================================================
+        Includes
+==============================================================================*/
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <iotclient/iotclient.h>
+
+/*==============================================================================
+        Private definitions
+==============================================================================*/
+
+/*! indicates the absence of a trie node or route */
+#define ROUTER_NONE 0
+
+/*==============================================================================
+        Private type definitions
+==============================================================================*/
+
+/*! property value trie node */
+typedef struct _router_node
+{
+    /*! value octet matched by this node */
+    char c;
+
+    /*! index of the first child node, or ROUTER_NONE */
+    uint32_t child;
+
+    /*! index of the next sibling node, or ROUTER_NONE */
+    uint32_t sibling;
+
+    /*! route number (index + 1) of the exact match route ending at
+        this node, or ROUTER_NONE */
+    uint32_t exactRoute;
+
+    /*! route number (index + 1) of the prefix match route ending at
+        this node, or ROUTER_NONE */
+    uint32_t prefixRoute;
+} RouterNode;
+
+/*! trie of the routes on one property */
+typedef struct _router_table
+{
+    /*! id of the property, or IOTCLIENT_PROP_UNKNOWN */
+    IOTCLIENT_PROPERTY_ID id;
+
+    /*! name of a property which is not well-known */
+    char *name;
+
+    /*! length of the property name */
+    size_t nameLength;
+
+    /*! index of the trie root node */
+    uint32_t root;
+} RouterTable;
+
+/*! message handler */
+typedef struct _router_route
+{
+    /*! message handler */
+    IOTCLIENT_RECEIVE_CALLBACK cb;
+
+    /*! message handler context */
+    void *ctx;
+} RouterRoute;
+
+/*! message router */
+struct _iotclient_router
+{
+    /*! one trie per routed property */
+    RouterTable *pTables;
+
+    /*! number of routed properties */
+    size_t nTables;
+
+    /*! trie nodes for all routed properties.  Node 0 is unused so
+        that ROUTER_NONE is never a valid node index */
+    RouterNode *pNodes;
+
+    /*! number of trie nodes in use */
+    size_t nNodes;
+
+    /*! number of trie nodes allocated */
+    size_t nodeCapacity;
+
+    /*! routes in the order they were added */
+    RouterRoute *pRoutes;
+
+    /*! number of routes */
+    size_t nRoutes;
+
+    /*! route for messages which do not match any other route */
+    RouterRoute defaultRoute;
+};
+
+/*==============================================================================
+        Private function declarations
+==============================================================================*/
+
+static RouterTable *router_GetTable( IOTCLIENT_ROUTER hRouter,
+                                     const char *property );
+static uint32_t router_AddNode( IOTCLIENT_ROUTER hRouter, char c );
+static uint32_t router_FindChild( IOTCLIENT_ROUTER hRouter,
+                                  uint32_t node,
+                                  char c );
+static int router_GetValue( const RouterTable *pTable,
+                            const IOTCLIENT_HEADER_INDEX *pIndex,
+                            const char **ppValue,
+                            size_t *pLength );
+static uint32_t router_Match( IOTCLIENT_ROUTER hRouter,
+                              const RouterTable *pTable,
+                              const char *value,
+                              size_t len );
+
+/*==============================================================================
+        Public function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  IOTCLIENT_CreateRouter                                                    */
+/*!
+    Create a message router
+
+    The IOTCLIENT_CreateRouter function creates an empty message router.
+    Routes are added to it using IOTCLIENT_AddRoute.
+
+    @retval handle to the message router
+    @retval NULL if the message router could not be allocated
+
+==============================================================================*/
+IOTCLIENT_ROUTER IOTCLIENT_CreateRouter( void )
+{
+    IOTCLIENT_ROUTER hRouter;
+
+    hRouter = calloc( 1, sizeof( struct _iotclient_router ) );
+    if ( hRouter != NULL )
+    {
+        /* reserve node 0 so it can represent the absence of a node */
+        (void)router_AddNode( hRouter, '\0' );
+        if ( hRouter->nNodes == 0 )
+        {
+            free( hRouter );
+            hRouter = NULL;
+        }
+    }
+
+    return hRouter;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_AddRoute                                                        */
+/*!
+    Add a route to a message router
+
+    The IOTCLIENT_AddRoute function adds a route which sends messages
+    to a handler if the specified property matches a value.  The
+    property value either matches the route value exactly, or starts
+    with it.  A prefix route with an empty value matches any message
+    which has the property.
+
+    When several routes match a message, the one which was added first
+    is used.
+
+    @param[in]
+        hRouter
+            handle to the message router
+
+    @param[in]
+        property
+            name of the property to match
+
+    @param[in]
+        match
+            IOTCLIENT_MATCH_EXACT or IOTCLIENT_MATCH_PREFIX
+
+    @param[in]
+        value
+            NUL terminated value to match
+
+    @param[in]
+        cb
+            message handler
+
+    @param[in]
+        ctx
+            message handler context
+
+    @retval EOK the route was added
+    @retval EINVAL invalid arguments
+    @retval EEXIST a route with the same predicate already exists
+    @retval ENOMEM the route could not be allocated
+
+==============================================================================*/
+int IOTCLIENT_AddRoute( IOTCLIENT_ROUTER hRouter,
+                        const char *property,
+                        IOTCLIENT_MATCH match,
+                        const char *value,
+                        IOTCLIENT_RECEIVE_CALLBACK cb,
+                        void *ctx )
+{
+    int result = EINVAL;
+    RouterTable *pTable;
+    RouterRoute *pRoutes;
+    uint32_t node;
+    uint32_t child;
+    uint32_t *pRoute;
+
+    if ( ( hRouter != NULL ) &&
+         ( property != NULL ) &&
+         ( *property != '\0' ) &&
+         ( ( match == IOTCLIENT_MATCH_EXACT ) ||
+           ( match == IOTCLIENT_MATCH_PREFIX ) ) &&
+         ( value != NULL ) &&
+         ( cb != NULL ) )
+    {
+        result = ENOMEM;
+
+        pTable = router_GetTable( hRouter, property );
+        node = ( pTable != NULL ) ? pTable->root : ROUTER_NONE;
+
+        /* walk the trie, adding nodes for the new part of the value */
+        while ( ( node != ROUTER_NONE ) && ( *value != '\0' ) )
+        {
+            child = router_FindChild( hRouter, node, *value );
+            if ( child == ROUTER_NONE )
+            {
+                child = router_AddNode( hRouter, *value );
+                if ( child != ROUTER_NONE )
+                {
+                    hRouter->pNodes[child].sibling =
+                        hRouter->pNodes[node].child;
+                    hRouter->pNodes[node].child = child;
+                }
+            }
+
+            node = child;
+            value++;
+        }
+
+        pRoutes = ( node != ROUTER_NONE )
+                    ? realloc( hRouter->pRoutes,
+                               ( hRouter->nRoutes + 1 ) *
+                                    sizeof( RouterRoute ) )
+                    : NULL;
+        if ( pRoutes != NULL )
+        {
+            hRouter->pRoutes = pRoutes;
+
+            pRoute = ( match == IOTCLIENT_MATCH_EXACT )
+                        ? &hRouter->pNodes[node].exactRoute
+                        : &hRouter->pNodes[node].prefixRoute;
+            if ( *pRoute == ROUTER_NONE )
+            {
+                pRoutes[hRouter->nRoutes].cb = cb;
+                pRoutes[hRouter->nRoutes].ctx = ctx;
+                hRouter->nRoutes++;
+                *pRoute = hRouter->nRoutes;
+                result = EOK;
+            }
+            else
+            {
+                result = EEXIST;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_SetDefaultRoute                                                 */
+/*!
+    Set the handler for messages which do not match any route
+
+    @param[in]
+        hRouter
+            handle to the message router
+
+    @param[in]
+        cb
+            message handler, or NULL to discard unmatched messages
+
+    @param[in]
+        ctx
+            message handler context
+
+    @retval EOK the default route was set
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_SetDefaultRoute( IOTCLIENT_ROUTER hRouter,
+                               IOTCLIENT_RECEIVE_CALLBACK cb,
+                               void *ctx )
+{
+    int result = EINVAL;
+
+    if ( hRouter != NULL )
+    {
+        hRouter->defaultRoute.cb = cb;
+        hRouter->defaultRoute.ctx = ctx;
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_Route                                                           */
+/*!
+    Dispatch a received message to its handler
+
+    The IOTCLIENT_Route function indexes the message headers, finds the
+    first added route which matches the message, and invokes its
+    handler.  Messages which do not match any route are passed to the
+    default route handler, if there is one.
+
+    @param[in]
+        hRouter
+            handle to the message router
+
+    @param[in]
+        headers
+            pointer to the message headers, or NULL if there are none
+
+    @param[in]
+        headerLength
+            length of the message headers
+
+    @param[in]
+        body
+            pointer to the message body
+
+    @param[in]
+        bodyLength
+            length of the message body
+
+    @retval EOK the message was passed to a handler
+    @retval ENOENT the message did not match any route
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_Route( IOTCLIENT_ROUTER hRouter,
+                     char *headers,
+                     size_t headerLength,
+                     char *body,
+                     size_t bodyLength )
+{
+    int result = EINVAL;
+    IOTCLIENT_HEADER_INDEX index;
+    const RouterRoute *pRoute;
+    const char *value;
+    size_t len;
+    uint32_t best = ROUTER_NONE;
+    uint32_t route;
+    size_t i;
+
+    if ( hRouter != NULL )
+    {
+        if ( ( headers != NULL ) &&
+             ( hRouter->nTables > 0 ) &&
+             ( IOTCLIENT_IndexHeaders( headers,
+                                       headerLength,
+                                       &index ) != EINVAL ) )
+        {
+            for ( i = 0; i < hRouter->nTables; i++ )
+            {
+                if ( router_GetValue( &hRouter->pTables[i],
+                                      &index,
+                                      &value,
+                                      &len ) == EOK )
+                {
+                    route = router_Match( hRouter,
+                                          &hRouter->pTables[i],
+                                          value,
+                                          len );
+                    if ( ( route != ROUTER_NONE ) &&
+                         ( ( best == ROUTER_NONE ) || ( route < best ) ) )
+                    {
+                        best = route;
+                    }
+                }
+            }
+        }
+
+        pRoute = ( best != ROUTER_NONE ) ? &hRouter->pRoutes[best - 1]
+                                         : &hRouter->defaultRoute;
+        if ( pRoute->cb != NULL )
+        {
+            pRoute->cb( pRoute->ctx, headers, headerLength, body, bodyLength );
+            result = EOK;
+        }
+        else
+        {
+            result = ENOENT;
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_RouteMessage                                                    */
+/*!
+    Message receive callback which dispatches via a message router
+
+    The IOTCLIENT_RouteMessage function can be registered as the message
+    handler with IOTCLIENT_SetReceiveHandler or IOTCLIENT_StartReceiver,
+    using the message router handle as the handler context.
+
+    @param[in]
+        ctx
+            handle to the message router
+
+    @param[in]
+        headers
+            pointer to the message headers, or NULL if there are none
+
+    @param[in]
+        headerLength
+            length of the message headers
+
+    @param[in]
+        body
+            pointer to the message body
+
+    @param[in]
+        bodyLength
+            length of the message body
+
+==============================================================================*/
+void IOTCLIENT_RouteMessage( void *ctx,
+                             char *headers,
+                             size_t headerLength,
+                             char *body,
+                             size_t bodyLength )
+{
+    (void)IOTCLIENT_Route( (IOTCLIENT_ROUTER)ctx,
+                           headers,
+                           headerLength,
+                           body,
+                           bodyLength );
+}
+
+/*============================================================================*/
+/*  IOTCLIENT_DestroyRouter                                                   */
+/*!
+    Destroy a message router
+
+    @param[in]
+        hRouter
+            handle to the message router
+
+    @retval EOK the message router was destroyed
+    @retval EINVAL invalid arguments
+
+==============================================================================*/
+int IOTCLIENT_DestroyRouter( IOTCLIENT_ROUTER hRouter )
+{
+    int result = EINVAL;
+    size_t i;
+
+    if ( hRouter != NULL )
+    {
+        for ( i = 0; i < hRouter->nTables; i++ )
+        {
+            free( hRouter->pTables[i].name );
+        }
+
+        free( hRouter->pTables );
+        free( hRouter->pNodes );
+        free( hRouter->pRoutes );
+        free( hRouter );
+        result = EOK;
+    }
+
+    return result;
+}
+
+/*==============================================================================
+        Private function definitions
+==============================================================================*/
+
+/*============================================================================*/
+/*  router_GetTable                                                           */
+/*!
+    Get the route trie for a property
+
+    The router_GetTable function finds the route trie for a property,
+    creating it if this is the first route on the property.  Well-known
+    properties are identified by their id so their values can be looked
+    up in a header index in constant time.
+
+    @param[in]
+        hRouter
+            handle to the message router
+
+    @param[in]
+        property
+            name of the property
+
+    @retval pointer to the route trie
+    @retval NULL if the route trie could not be allocated
+
+==============================================================================*/
+static RouterTable *router_GetTable( IOTCLIENT_ROUTER hRouter,
+                                     const char *property )
+{
+    RouterTable *pTable = NULL;
+    RouterTable *pTables;
+    size_t len = strlen( property );
+    IOTCLIENT_PROPERTY_ID id = IOTCLIENT_GetPropertyId( property, len );
+    size_t i;
+
+    for ( i = 0; ( pTable == NULL ) && ( i < hRouter->nTables ); i++ )
+    {
+        if ( ( hRouter->pTables[i].id == id ) &&
+             ( ( id != IOTCLIENT_PROP_UNKNOWN ) ||
+               ( ( hRouter->pTables[i].nameLength == len ) &&
+                 ( memcmp( hRouter->pTables[i].name, property, len ) == 0 ) ) ) )
+        {
+            pTable = &hRouter->pTables[i];
+        }
+    }
+
+    if ( pTable == NULL )
+    {
+        pTables = realloc( hRouter->pTables,
+                           ( hRouter->nTables + 1 ) * sizeof( RouterTable ) );
+        if ( pTables != NULL )
+        {
+            hRouter->pTables = pTables;
+            pTable = &pTables[hRouter->nTables];
+            pTable->id = id;
+            pTable->name = NULL;
+            pTable->nameLength = len;
+            pTable->root = router_AddNode( hRouter, '\0' );
+
+            if ( id == IOTCLIENT_PROP_UNKNOWN )
+            {
+                pTable->name = strdup( property );
+            }
+
+            if ( ( pTable->root != ROUTER_NONE ) &&
+                 ( ( id != IOTCLIENT_PROP_UNKNOWN ) ||
+                   ( pTable->name != NULL ) ) )
+            {
+                hRouter->nTables++;
+            }
+            else
+            {
+                free( pTable->name );
+                pTable = NULL;
+            }
+        }
+    }
+
+    return pTable;
+}
+
+/*============================================================================*/
+/*  router_AddNode                                                            */
+/*!
+    Add a node to the route tries
+
+    @param[in]
+        hRouter
+            handle to the message router
+
+    @param[in]
+        c
+            value octet matched by the node
+
+    @retval index of the new node
+    @retval ROUTER_NONE if the node could not be allocated, or if the
+            reserved node 0 was added
+
+==============================================================================*/
+static uint32_t router_AddNode( IOTCLIENT_ROUTER hRouter, char c )
+{
+    uint32_t node = ROUTER_NONE;
+    RouterNode *pNodes;
+    size_t capacity;
+
+    if ( hRouter->nNodes == hRouter->nodeCapacity )
+    {
+        capacity = ( hRouter->nodeCapacity > 0 )
+                        ? hRouter->nodeCapacity * 2
+                        : 64;
+        pNodes = realloc( hRouter->pNodes, capacity * sizeof( RouterNode ) );
+        if ( pNodes != NULL )
+        {
+            hRouter->pNodes = pNodes;
+            hRouter->nodeCapacity = capacity;
+        }
+    }
+
+    if ( hRouter->nNodes < hRouter->nodeCapacity )
+    {
+        node = hRouter->nNodes++;
+        memset( &hRouter->pNodes[node], 0, sizeof( RouterNode ) );
+        hRouter->pNodes[node].c = c;
+    }
+
+    return node;
+}
+
+/*============================================================================*/
+/*  router_FindChild                                                          */
+/*!
+    Find the child of a trie node which matches a value octet
+
+    @param[in]
+        hRouter
+            handle to the message router
+
+    @param[in]
+        node
+            index of the parent node
+
+    @param[in]
+        c
+            value octet to match
+
+    @retval index of the matching child node
+    @retval ROUTER_NONE if there is no matching child node
+
+==============================================================================*/
+static uint32_t router_FindChild( IOTCLIENT_ROUTER hRouter,
+                                  uint32_t node,
+                                  char c )
+{
+    uint32_t child = hRouter->pNodes[node].child;
+
+    while ( ( child != ROUTER_NONE ) &&
+            ( hRouter->pNodes[child].c != c ) )
+    {
+        child = hRouter->pNodes[child].sibling;
+    }
+
+    return child;
+}
+
+/*============================================================================*/
+/*  router_GetValue                                                           */
+/*!
+    Get the value of a routed property from a header index
+
+    @param[in]
+        pTable
+            pointer to the route trie of the property
+
+    @param[in]
+        pIndex
+            pointer to the header index of the message
+
+    @param[out]
+        ppValue
+            pointer to the location to store a pointer to the value
+
+    @param[out]
+        pLength
+            pointer to the location to store the value length
+
+    @retval EOK the property was found
+    @retval ENOENT the message does not have the property
+
+==============================================================================*/
+static int router_GetValue( const RouterTable *pTable,
+                            const IOTCLIENT_HEADER_INDEX *pIndex,
+                            const char **ppValue,
+                            size_t *pLength )
+{
+    int result = ENOENT;
+    const IOTCLIENT_HEADER_ENTRY *pEntry;
+    size_t i;
+
+    if ( pTable->id != IOTCLIENT_PROP_UNKNOWN )
+    {
+        result = IOTCLIENT_GetPropertyById( pIndex,
+                                            pTable->id,
+                                            ppValue,
+                                            pLength );
+    }
+    else
+    {
+        for ( i = 0; ( result == ENOENT ) && ( i < pIndex->count ); i++ )
+        {
+            pEntry = &pIndex->entries[i];
+            if ( ( pEntry->id == IOTCLIENT_PROP_UNKNOWN ) &&
+                 ( pEntry->nameLength == pTable->nameLength ) &&
+                 ( memcmp( pEntry->name,
+                           pTable->name,
+                           pTable->nameLength ) == 0 ) )
+            {
+                *ppValue = pEntry->value;
+                *pLength = pEntry->valueLength;
+                result = EOK;
+            }
+        }
+    }
+
+    return result;
+}
+
+/*============================================================================*/
+/*  router_Match                                                              */
+/*!
+    Find the first added route which matches a property value
+
+    The router_Match function walks the property's route trie along
+    the value, considering the prefix routes of every node it passes
+    through, and the exact route of the node at the end of the value.
+
+    @param[in]
+        hRouter
+            handle to the message router
+
+    @param[in]
+        pTable
+            pointer to the route trie of the property
+
+    @param[in]
+        value
+            pointer to the property value
+
+    @param[in]
+        len
+            length of the property value
+
+    @retval route number of the first added matching route
+    @retval ROUTER_NONE if no route matches
+
+==============================================================================*/
+static uint32_t router_Match( IOTCLIENT_ROUTER hRouter,
+                              const RouterTable *pTable,
+                              const char *value,
+                              size_t len )
+{
+    uint32_t best = ROUTER_NONE;
+    uint32_t node = pTable->root;
+    const RouterNode *pNode;
+    size_t i = 0;
+
+    while ( node != ROUTER_NONE )
+    {
+        pNode = &hRouter->pNodes[node];
+
+        if ( ( pNode->prefixRoute != ROUTER_NONE ) &&
+             ( ( best == ROUTER_NONE ) || ( pNode->prefixRoute < best ) ) )
+        {
+            best = pNode->prefixRoute;
+        }
+
+        if ( i == len )
+        {
+            if ( ( pNode->exactRoute != ROUTER_NONE ) &&
+                 ( ( best == ROUTER_NONE ) || ( pNode->exactRoute < best ) ) )
+            {
+                best = pNode->exactRoute;
+            }
+
+            node = ROUTER_NONE;
+        }
+        else
+        {
+            node = router_FindChild( hRouter, node, value[i++] );
+        }
+    }
+
+    return best;
+}
+
+/*! @}
+ * end of the router group */